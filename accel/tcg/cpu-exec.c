@@ -43,6 +43,7 @@
 #include "sysemu/tcg.h"
 #include "exec/helper-proto.h"
 #include "tb-hash.h"
+#include "tb-jmp-cache.h"
 #include "tb-context.h"
 #include "internal.h"
 
@@ -170,33 +171,74 @@ uint32_t curr_cflags(CPUState *cpu)
     return cflags;
 }
 
+static inline bool tb_jmp_cache_match(CPUState *cpu, TranslationBlock *tb,
+                                      target_ulong pc, target_ulong cs_base,
+                                      uint32_t flags, uint32_t cflags)
+{
+    return tb &&
+           tb->pc == pc &&
+           tb->cs_base == cs_base &&
+           tb->flags == flags &&
+           tb->trace_vcpu_dstate == *cpu->trace_dstate &&
+           tb_cflags(tb) == cflags;
+}
+
 /* Might cause an exception, so have a longjmp destination ready */
 static inline TranslationBlock *tb_lookup(CPUState *cpu, target_ulong pc,
                                           target_ulong cs_base,
                                           uint32_t flags, uint32_t cflags)
 {
+    CPUJumpCache *jc = cpu->tb_jmp_cache;
+    TranslationBlock **set;
     TranslationBlock *tb;
-    uint32_t hash;
+    int i;
 
     /* we should never be trying to look up an INVALID tb */
     tcg_debug_assert(!(cflags & CF_INVALID));
 
-    hash = tb_jmp_cache_hash_func(pc);
-    tb = qatomic_rcu_read(&cpu->tb_jmp_cache[hash]);
-
-    if (likely(tb &&
-               tb->pc == pc &&
-               tb->cs_base == cs_base &&
-               tb->flags == flags &&
-               tb->trace_vcpu_dstate == *cpu->trace_dstate &&
-               tb_cflags(tb) == cflags)) {
+    set = tb_jmp_cache_set(jc, pc);
+    tb = qatomic_rcu_read(&set[0]);
+    if (likely(tb_jmp_cache_match(cpu, tb, pc, cs_base, flags, cflags))) {
+        qatomic_set(&jc->hits, jc->hits + 1);
         return tb;
     }
+
+    for (i = 1; i < TB_JMP_CACHE_WAYS; i++) {
+        tb = qatomic_rcu_read(&set[i]);
+        if (tb_jmp_cache_match(cpu, tb, pc, cs_base, flags, cflags)) {
+            /* move to the head of the set */
+            for (; i > 0; i--) {
+                qatomic_set(&set[i], qatomic_read(&set[i - 1]));
+            }
+            qatomic_set(&set[0], tb);
+            qatomic_set(&jc->hits, jc->hits + 1);
+            return tb;
+        }
+    }
+
+    for (i = 0; i < TB_JMP_VICTIM_SIZE; i++) {
+        tb = qatomic_rcu_read(&jc->victim[i]);
+        if (tb_jmp_cache_match(cpu, tb, pc, cs_base, flags, cflags)) {
+            /* swap with the least recently used entry of the set */
+            TranslationBlock *old = qatomic_read(&set[TB_JMP_CACHE_WAYS - 1]);
+            int w;
+
+            for (w = TB_JMP_CACHE_WAYS - 1; w > 0; w--) {
+                qatomic_set(&set[w], qatomic_read(&set[w - 1]));
+            }
+            qatomic_set(&set[0], tb);
+            qatomic_set(&jc->victim[i], old);
+            qatomic_set(&jc->victim_hits, jc->victim_hits + 1);
+            return tb;
+        }
+    }
+
+    qatomic_set(&jc->misses, jc->misses + 1);
     tb = tb_htable_lookup(cpu, pc, cs_base, flags, cflags);
     if (tb == NULL) {
         return NULL;
     }
-    qatomic_set(&cpu->tb_jmp_cache[hash], tb);
+    tb_jmp_cache_insert(jc, tb);
     return tb;
 }
 
@@ -334,6 +376,22 @@ const void *HELPER(lookup_tb_ptr)(CPUArchState *env)
     return tb->tc.ptr;
 }
 
+/**
+ * helper_tb_hot: note that a TB reached the hot trace threshold
+ * @env: current cpu state
+ * @tb: the TB
+ *
+ * Stop at the start of the next TB, so that cpu_exec forms a trace
+ * starting at @tb before going on.
+ */
+void HELPER(tb_hot)(CPUArchState *env, void *tb)
+{
+    CPUState *cpu = env_cpu(env);
+
+    cpu->tb_hot = tb;
+    qatomic_set(&cpu_neg(cpu)->icount_decr.u16.high, -1);
+}
+
 /* Execute a TB, and fix up the CPU state afterwards if necessary */
 /*
  * Disable CFI checks.
@@ -475,6 +533,7 @@ void cpu_exec_step_atomic(CPUState *cpu)
         }
         assert_no_pages_locked();
         qemu_plugin_disable_mem_helpers(cpu);
+        tb_gen_release();
     }
 
     /*
@@ -942,6 +1001,7 @@ int cpu_exec(CPUState *cpu)
             qemu_mutex_unlock_iothread();
         }
         qemu_plugin_disable_mem_helpers(cpu);
+        tb_gen_release();
 
         assert_no_pages_locked();
     }
@@ -985,7 +1045,7 @@ int cpu_exec(CPUState *cpu)
                  * We add the TB in the virtual pc hash table
                  * for the fast lookup
                  */
-                qatomic_set(&cpu->tb_jmp_cache[tb_jmp_cache_hash_func(pc)], tb);
+                tb_jmp_cache_insert(cpu->tb_jmp_cache, tb);
             }
 
 #ifndef CONFIG_USER_ONLY
@@ -1006,6 +1066,10 @@ int cpu_exec(CPUState *cpu)
 
             cpu_loop_exec_tb(cpu, tb, &last_tb, &tb_exit);
 
+            if (unlikely(cpu->tb_hot)) {
+                tb_gen_trace(cpu);
+            }
+
             /* Try to align the host and virtual clocks
                if the guest is in advance */
             align_clocks(&sc, cpu);
@@ -1046,6 +1110,56 @@ void tcg_exec_unrealizefn(CPUState *cpu)
     tlb_destroy(cpu);
 }
 
+/* Call before the CPU is added to the CPU list */
+void tcg_exec_jmp_cache_init(CPUState *cpu)
+{
+    cpu->tb_jmp_cache = tb_jmp_cache_new(tb_jmp_cache_bits);
+}
+
+/*
+ * Call once the CPU has been removed from the CPU list; CPU_FOREACH
+ * walkers that still see it are within an RCU critical section.
+ */
+void tcg_exec_jmp_cache_free(CPUState *cpu)
+{
+    CPUJumpCache *jc = cpu->tb_jmp_cache;
+
+    qatomic_set(&cpu->tb_jmp_cache, NULL);
+    if (jc) {
+        g_free_rcu(jc, rcu);
+    }
+}
+
+unsigned int tb_jmp_cache_bits = TB_JMP_CACHE_BITS_DEFAULT;
+
+CPUJumpCache *tb_jmp_cache_new(unsigned int bits)
+{
+    CPUJumpCache *jc;
+
+    assert(bits >= TB_JMP_CACHE_BITS_MIN && bits <= TB_JMP_CACHE_BITS_LIMIT);
+    jc = g_malloc0(sizeof(CPUJumpCache) + (sizeof(jc->set[0]) << bits));
+    jc->bits = bits;
+    return jc;
+}
+
+void cpu_tb_jmp_cache_clear(CPUState *cpu)
+{
+    CPUJumpCache *jc = cpu->tb_jmp_cache;
+    unsigned int i, w;
+
+    if (!jc) {
+        return;
+    }
+    for (i = 0; i < (1u << jc->bits); i++) {
+        for (w = 0; w < TB_JMP_CACHE_WAYS; w++) {
+            qatomic_set(&jc->set[i][w], NULL);
+        }
+    }
+    for (i = 0; i < TB_JMP_VICTIM_SIZE; i++) {
+        qatomic_set(&jc->victim[i], NULL);
+    }
+}
+
 #ifndef CONFIG_USER_ONLY
 
 static void dump_drift_info(GString *buf)
@@ -19,6 +19,10 @@
 
 #include "qemu/osdep.h"
 #include "qemu/main-loop.h"
+#include "qapi/error.h"
+#include "qapi/qapi-commands-machine.h"
+#include "qapi/type-helpers.h"
+#include "sysemu/tcg.h"
 #include "hw/core/tcg-cpu-ops.h"
 #include "exec/exec-all.h"
 #include "exec/memory.h"
@@ -35,6 +39,7 @@
 #include "exec/translate-all.h"
 #include "trace/trace-root.h"
 #include "tb-hash.h"
+#include "tb-jmp-cache.h"
 #include "internal.h"
 #ifdef CONFIG_PLUGIN
 #include "qemu/plugin-memory.h"
@@ -100,10 +105,18 @@ static void tlb_window_reset(CPUTLBDesc *desc, int64_t ns,
 
 static void tb_jmp_cache_clear_page(CPUState *cpu, target_ulong page_addr)
 {
-    unsigned int i, i0 = tb_jmp_cache_hash_page(page_addr);
+    CPUJumpCache *jc = cpu->tb_jmp_cache;
+    unsigned int i, w, i0 = tb_jmp_cache_hash_page(jc->bits, page_addr);
+    unsigned int n = tb_jmp_cache_page_sets(jc->bits);
 
-    for (i = 0; i < TB_JMP_PAGE_SIZE; i++) {
-        qatomic_set(&cpu->tb_jmp_cache[i0 + i], NULL);
+    for (i = 0; i < n; i++) {
+        for (w = 0; w < TB_JMP_CACHE_WAYS; w++) {
+            qatomic_set(&jc->set[i0 + i][w], NULL);
+        }
+    }
+    /* the victims could come from any page, just drop them all */
+    for (i = 0; i < TB_JMP_VICTIM_SIZE; i++) {
+        qatomic_set(&jc->victim[i], NULL);
     }
 }
 
@@ -233,6 +246,7 @@ static void tlb_mmu_resize_locked(CPUTLBDesc *desc, CPUTLBDescFast *fast,
 static void tlb_mmu_flush_locked(CPUTLBDesc *desc, CPUTLBDescFast *fast)
 {
     desc->n_used_entries = 0;
+    desc->n_large_pages = 0;
     desc->large_page_addr = -1;
     desc->large_page_mask = -1;
     desc->vindex = 0;
@@ -248,6 +262,7 @@ static void tlb_flush_one_mmuidx_locked(CPUArchState *env, int mmu_idx,
 
     tlb_mmu_resize_locked(desc, fast, now);
     tlb_mmu_flush_locked(desc, fast);
+    qatomic_set(&desc->flush_count, desc->flush_count + 1);
 }
 
 static void tlb_mmu_init(CPUTLBDesc *desc, CPUTLBDescFast *fast, int64_t now)
@@ -339,6 +354,41 @@ void tlb_flush_counts(size_t *pfull, size_t *ppart, size_t *pelide)
     *pelide = elide;
 }
 
+HumanReadableText *qmp_x_query_tlb_stats(Error **errp)
+{
+    g_autoptr(GString) buf = g_string_new("");
+    CPUState *cpu;
+    int mmu_idx;
+
+    if (!tcg_enabled()) {
+        error_setg(errp, "TLB statistics are only available with accel=tcg");
+        return NULL;
+    }
+
+    CPU_FOREACH(cpu) {
+        CPUArchState *env = cpu->env_ptr;
+
+        g_string_append_printf(buf, "CPU#%d\n", cpu->cpu_index);
+        g_string_append_printf(buf, "  mmu_idx %12s %12s %12s %12s\n",
+                               "flushes", "page flushes", "large pages",
+                               "fills");
+        for (mmu_idx = 0; mmu_idx < NB_MMU_MODES; mmu_idx++) {
+            CPUTLBDesc *d = &env_tlb(env)->d[mmu_idx];
+            size_t flush = qatomic_read(&d->flush_count);
+            size_t page = qatomic_read(&d->page_flush_count);
+            size_t large = qatomic_read(&d->large_page_flush_count);
+            size_t fill = qatomic_read(&d->fill_count);
+
+            if (flush || page || large || fill) {
+                g_string_append_printf(buf, "  %7d %12zu %12zu %12zu %12zu\n",
+                                       mmu_idx, flush, page, large, fill);
+            }
+        }
+    }
+
+    return human_readable_text_from_str(buf);
+}
+
 static void tlb_flush_by_mmuidx_async_work(CPUState *cpu, run_on_cpu_data data)
 {
     CPUArchState *env = cpu->env_ptr;
@@ -493,11 +543,69 @@ static inline void tlb_flush_vtlb_page_locked(CPUArchState *env, int mmu_idx,
     tlb_flush_vtlb_page_mask_locked(env, mmu_idx, page, -1);
 }
 
+/* Evict all of the entries of the large page @lp from the tlb.  */
+static void tlb_flush_large_page_locked(CPUArchState *env, int midx,
+                                        const CPUTLBLargePage *lp)
+{
+    CPUTLBDesc *d = &env_tlb(env)->d[midx];
+    CPUTLBDescFast *f = &env_tlb(env)->f[midx];
+    size_t n_entries = tlb_n_entries(f);
+    target_ulong n_pages = (~lp->mask >> TARGET_PAGE_BITS) + 1;
+    target_ulong i;
+
+    tlb_debug("large page flush midx %d (" TARGET_FMT_lx "/" TARGET_FMT_lx
+              ")\n", midx, lp->addr, lp->mask);
+
+    /* Visit whichever is smaller, the pages or the tlb.  */
+    if (n_pages <= n_entries) {
+        for (i = 0; i < n_pages; i++) {
+            target_ulong page = lp->addr + (i << TARGET_PAGE_BITS);
+
+            if (tlb_flush_entry_mask_locked(tlb_entry(env, midx, page),
+                                            lp->addr, lp->mask)) {
+                tlb_n_used_entries_dec(env, midx);
+            }
+        }
+    } else {
+        for (i = 0; i < n_entries; i++) {
+            if (tlb_flush_entry_mask_locked(&f->table[i],
+                                            lp->addr, lp->mask)) {
+                tlb_n_used_entries_dec(env, midx);
+            }
+        }
+    }
+    tlb_flush_vtlb_page_mask_locked(env, midx, lp->addr, lp->mask);
+    qatomic_set(&d->large_page_flush_count, d->large_page_flush_count + 1);
+}
+
+/*
+ * Evict the tracked large pages that overlap [@addr, @last], and stop
+ * tracking them.
+ */
+static void tlb_flush_large_pages_locked(CPUArchState *env, int midx,
+                                         target_ulong addr, target_ulong last)
+{
+    CPUTLBDesc *d = &env_tlb(env)->d[midx];
+    size_t i = 0;
+
+    while (i < d->n_large_pages) {
+        CPUTLBLargePage lp = d->large_pages[i];
+
+        if (addr <= (lp.addr | ~lp.mask) && lp.addr <= last) {
+            d->large_pages[i] = d->large_pages[--d->n_large_pages];
+            tlb_flush_large_page_locked(env, midx, &lp);
+        } else {
+            i++;
+        }
+    }
+}
+
 static void tlb_flush_page_locked(CPUArchState *env, int midx,
                                   target_ulong page)
 {
-    target_ulong lp_addr = env_tlb(env)->d[midx].large_page_addr;
-    target_ulong lp_mask = env_tlb(env)->d[midx].large_page_mask;
+    CPUTLBDesc *d = &env_tlb(env)->d[midx];
+    target_ulong lp_addr = d->large_page_addr;
+    target_ulong lp_mask = d->large_page_mask;
 
     /* Check if we need to flush due to large pages.  */
     if ((page & lp_mask) == lp_addr) {
@@ -506,10 +614,13 @@ static void tlb_flush_page_locked(CPUArchState *env, int midx,
                   midx, lp_addr, lp_mask);
         tlb_flush_one_mmuidx_locked(env, midx, get_clock_realtime());
     } else {
+        tlb_flush_large_pages_locked(env, midx, page,
+                                     page + TARGET_PAGE_SIZE - 1);
         if (tlb_flush_entry_locked(tlb_entry(env, midx, page), page)) {
             tlb_n_used_entries_dec(env, midx);
         }
         tlb_flush_vtlb_page_locked(env, midx, page);
+        qatomic_set(&d->page_flush_count, d->page_flush_count + 1);
     }
 }
 
@@ -745,6 +856,9 @@ static void tlb_flush_range_locked(CPUArchState *env, int midx,
         tlb_flush_one_mmuidx_locked(env, midx, get_clock_realtime());
         return;
     }
+    tlb_flush_large_pages_locked(env, midx, addr, addr + len - 1);
+    qatomic_set(&d->page_flush_count,
+                d->page_flush_count + (len >> TARGET_PAGE_BITS));
 
     for (target_ulong i = 0; i < len; i += TARGET_PAGE_SIZE) {
         target_ulong page = addr + i;
@@ -787,7 +901,8 @@ static void tlb_flush_range_by_mmuidx_async_0(CPUState *cpu,
      * If the length is larger than the jump cache size, then it will take
      * longer to clear each entry individually than it will to clear it all.
      */
-    if (d.len >= (TARGET_PAGE_SIZE * TB_JMP_CACHE_SIZE)) {
+    if (d.len >= ((target_ulong)TARGET_PAGE_SIZE
+                  << cpu->tb_jmp_cache->bits)) {
         cpu_tb_jmp_cache_clear(cpu);
         return;
     }
@@ -1071,13 +1186,32 @@ void tlb_set_dirty(CPUState *cpu, target_ulong vaddr)
     qemu_spin_unlock(&env_tlb(env)->c.lock);
 }
 
-/* Our TLB does not support large pages, so remember the area covered by
-   large pages and trigger a full TLB flush if these are invalidated.  */
+/*
+ * Our TLB does not support large pages, so remember each of them and
+ * evict all of its entries if any part of it is invalidated.  Past
+ * CPU_TLB_LARGE_PAGES of them, remember the area covered by the others
+ * and trigger a full TLB flush if these are invalidated.
+ */
 static void tlb_add_large_page(CPUArchState *env, int mmu_idx,
                                target_ulong vaddr, target_ulong size)
 {
-    target_ulong lp_addr = env_tlb(env)->d[mmu_idx].large_page_addr;
+    CPUTLBDesc *d = &env_tlb(env)->d[mmu_idx];
+    target_ulong lp_addr = d->large_page_addr;
     target_ulong lp_mask = ~(size - 1);
+    size_t i;
+
+    for (i = 0; i < d->n_large_pages; i++) {
+        if (d->large_pages[i].addr == (vaddr & lp_mask) &&
+            d->large_pages[i].mask == lp_mask) {
+            return;
+        }
+    }
+    if (d->n_large_pages < CPU_TLB_LARGE_PAGES) {
+        d->large_pages[d->n_large_pages].addr = vaddr & lp_mask;
+        d->large_pages[d->n_large_pages].mask = lp_mask;
+        d->n_large_pages++;
+        return;
+    }
 
     if (lp_addr == (target_ulong)-1) {
         /* No previous large page.  */
@@ -1122,6 +1256,7 @@ void tlb_set_page_with_attrs(CPUState *cpu, target_ulong vaddr,
     bool is_ram, is_romd;
 
     assert_cpu_is_self(cpu);
+    qatomic_set(&desc->fill_count, desc->fill_count + 1);
 
     if (size <= TARGET_PAGE_SIZE) {
         sz = TARGET_PAGE_SIZE;
@@ -1557,10 +1692,7 @@ static void notdirty_write(CPUState *cpu, vaddr mem_vaddr, unsigned size,
     trace_memory_notdirty_write_access(mem_vaddr, ram_addr, size);
 
     if (!cpu_physical_memory_get_dirty_flag(ram_addr, DIRTY_MEMORY_CODE)) {
-        struct page_collection *pages
-            = page_collection_lock(ram_addr, ram_addr + size);
-        tb_invalidate_phys_page_fast(pages, ram_addr, size, retaddr);
-        page_collection_unlock(pages);
+        tb_invalidate_phys_page_fast(ram_addr, size, retaddr);
     }
 
     /*
@@ -17,5 +17,45 @@ TranslationBlock *tb_gen_code(CPUState *cpu, target_ulong pc,
 G_NORETURN void cpu_io_recompile(CPUState *cpu, uintptr_t retaddr);
 void page_init(void);
 void tb_htable_init(void);
+void tb_gen_release(void);
+
+/* Most TBs chained into one hot trace */
+#define TB_TRACE_MAX_BLOCKS 8
+
+/*
+ * A path of chained TBs to translate again as one TB: each block is
+ * translated like the TB at @pc was, and its exit @hot continues with
+ * the next block.
+ */
+typedef struct TranslatorTrace {
+    int nb_blocks;
+    struct {
+        target_ulong pc;
+        int icount;
+        int hot;
+    } blocks[TB_TRACE_MAX_BLOCKS];
+} TranslatorTrace;
+
+extern unsigned int tb_trace_threshold;
+void tb_gen_trace(CPUState *cpu);
+
+#ifdef CONFIG_SOFTMMU
+void tb_cache_init(const char *path);
+void tb_cache_load(void);
+TranslationBlock *tb_cache_lookup(CPUState *cpu, tb_page_addr_t phys_pc,
+                                  target_ulong pc, target_ulong cs_base,
+                                  uint32_t flags, uint32_t cflags);
+void tb_cache_exclude(TranslationBlock *tb);
+void tb_cache_reset(void);
+#else
+static inline TranslationBlock *
+tb_cache_lookup(CPUState *cpu, tb_page_addr_t phys_pc, target_ulong pc,
+                target_ulong cs_base, uint32_t flags, uint32_t cflags)
+{
+    return NULL;
+}
+static inline void tb_cache_exclude(TranslationBlock *tb) { }
+static inline void tb_cache_reset(void) { }
+#endif
 
 #endif /* ACCEL_TCG_INTERNAL_H */
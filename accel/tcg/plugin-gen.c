@@ -60,6 +60,7 @@
  * 0: enum plugin_gen_from
  * 1: enum plugin_gen_cb
  * 2: set to 1 for mem callback that is a write, 0 otherwise.
+ * 3: for mem callbacks, the temp holding the guest virtual address.
  */
 
 enum plugin_gen_from {
@@ -73,6 +74,7 @@ enum plugin_gen_from {
 enum plugin_gen_cb {
     PLUGIN_GEN_CB_UDATA,
     PLUGIN_GEN_CB_INLINE,
+    PLUGIN_GEN_CB_COND,
     PLUGIN_GEN_CB_MEM,
     PLUGIN_GEN_ENABLE_MEM_HELPER,
     PLUGIN_GEN_DISABLE_MEM_HELPER,
@@ -140,6 +142,15 @@ static void gen_empty_inline_cb(void)
     tcg_temp_free_i64(val);
 }
 
+/*
+ * Conditional callbacks, per-vCPU and address-filtered inline ops do not
+ * fit a fixed template; their ops are generated directly at injection
+ * time, so the placeholder is empty.
+ */
+static void gen_empty_cond_cb(void)
+{
+}
+
 static void gen_empty_mem_cb(TCGv addr, uint32_t info)
 {
     do_gen_mem_cb(addr, info);
@@ -160,15 +171,34 @@ static void gen_empty_mem_helper(void)
 }
 
 static void gen_plugin_cb_start(enum plugin_gen_from from,
-                                enum plugin_gen_cb type, unsigned wr)
+                                enum plugin_gen_cb type, unsigned wr,
+                                TCGArg vaddr)
+{
+    tcg_gen_plugin_cb_start(from, type, wr, vaddr);
+}
+
+static TCGArg plugin_vaddr_arg(TCGv addr)
 {
-    tcg_gen_plugin_cb_start(from, type, wr);
+#if TARGET_LONG_BITS == 32
+    return tcgv_i32_arg(addr);
+#else
+    return tcgv_i64_arg(addr);
+#endif
+}
+
+static TCGv plugin_vaddr(const TCGOp *begin_op)
+{
+#if TARGET_LONG_BITS == 32
+    return temp_tcgv_i32(arg_temp(begin_op->args[3]));
+#else
+    return temp_tcgv_i64(arg_temp(begin_op->args[3]));
+#endif
 }
 
 static void gen_wrapped(enum plugin_gen_from from,
                         enum plugin_gen_cb type, void (*func)(void))
 {
-    gen_plugin_cb_start(from, type, 0);
+    gen_plugin_cb_start(from, type, 0, 0);
     func();
     tcg_gen_plugin_cb_end();
 }
@@ -187,9 +217,12 @@ static void plugin_gen_empty_callback(enum plugin_gen_from from)
          */
         gen_wrapped(from, PLUGIN_GEN_ENABLE_MEM_HELPER,
                     gen_empty_mem_helper);
-        /* fall through */
+        gen_wrapped(from, PLUGIN_GEN_CB_UDATA, gen_empty_udata_cb);
+        gen_wrapped(from, PLUGIN_GEN_CB_INLINE, gen_empty_inline_cb);
+        break;
     case PLUGIN_GEN_FROM_TB:
         gen_wrapped(from, PLUGIN_GEN_CB_UDATA, gen_empty_udata_cb);
+        gen_wrapped(from, PLUGIN_GEN_CB_COND, gen_empty_cond_cb);
         gen_wrapped(from, PLUGIN_GEN_CB_INLINE, gen_empty_inline_cb);
         break;
     default:
@@ -208,7 +241,7 @@ static void gen_mem_wrapped(enum plugin_gen_cb type,
 {
     enum qemu_plugin_mem_rw rw = get_plugin_meminfo_rw(info);
 
-    gen_plugin_cb_start(PLUGIN_GEN_FROM_MEM, type, rw);
+    gen_plugin_cb_start(PLUGIN_GEN_FROM_MEM, type, rw, plugin_vaddr_arg(addr));
     if (is_mem) {
         f->mem_fn(addr, info);
     } else {
@@ -225,7 +258,7 @@ void plugin_gen_empty_mem_callback(TCGv addr, uint32_t info)
     gen_mem_wrapped(PLUGIN_GEN_CB_MEM, &fn, addr, info, true);
 
     fn.inline_fn = gen_empty_inline_cb;
-    gen_mem_wrapped(PLUGIN_GEN_CB_INLINE, &fn, 0, info, false);
+    gen_mem_wrapped(PLUGIN_GEN_CB_INLINE, &fn, addr, info, false);
 }
 
 static TCGOp *find_op(TCGOp *op, TCGOpcode opc)
@@ -411,6 +444,67 @@ static TCGOp *copy_call(TCGOp **begin_op, TCGOp *op, void *empty_func,
     return op;
 }
 
+/*
+ * Generate ops with the usual tcg_gen_* calls so that they land right
+ * after @op. Returns the op to pass to emit_after_end().
+ */
+static TCGOp *emit_after_begin(TCGOp *op)
+{
+    TCGOp *next = QTAILQ_NEXT(op, link);
+
+    tcg_debug_assert(next);
+    tcg_ctx->emit_before_op = next;
+    return next;
+}
+
+/* Stop emitting after @op; returns the last op emitted */
+static TCGOp *emit_after_end(TCGOp *next)
+{
+    tcg_ctx->emit_before_op = NULL;
+    return QTAILQ_PREV(next, link);
+}
+
+/* Address of the uint64_t that the current vCPU operates on */
+static TCGv_ptr gen_plugin_u64_ptr(void *ptr, size_t stride)
+{
+    TCGv_i32 cpu_index;
+    TCGv_ptr ret;
+
+    if (stride == 0) {
+        return tcg_constant_ptr(ptr);
+    }
+
+    cpu_index = tcg_temp_new_i32();
+    ret = tcg_temp_new_ptr();
+    tcg_gen_ld_i32(cpu_index, cpu_env,
+                   -offsetof(ArchCPU, env) + offsetof(CPUState, cpu_index));
+    tcg_gen_muli_i32(cpu_index, cpu_index, stride);
+    tcg_gen_ext_i32_ptr(ret, cpu_index);
+    tcg_gen_addi_ptr(ret, ret, (intptr_t)ptr);
+    tcg_temp_free_i32(cpu_index);
+    return ret;
+}
+
+static TCGCond plugin_cond_to_tcgcond(enum qemu_plugin_cond cond)
+{
+    switch (cond) {
+    case QEMU_PLUGIN_COND_EQ:
+        return TCG_COND_EQ;
+    case QEMU_PLUGIN_COND_NE:
+        return TCG_COND_NE;
+    case QEMU_PLUGIN_COND_LT:
+        return TCG_COND_LTU;
+    case QEMU_PLUGIN_COND_LE:
+        return TCG_COND_LEU;
+    case QEMU_PLUGIN_COND_GT:
+        return TCG_COND_GTU;
+    case QEMU_PLUGIN_COND_GE:
+        return TCG_COND_GEU;
+    default:
+        g_assert_not_reached();
+    }
+}
+
 /*
  * When we append/replace ops here we are sensitive to changing patterns of
  * TCGOps generated by the tcg_gen_FOO calls when we generated the
@@ -438,10 +532,52 @@ static TCGOp *append_udata_cb(const struct qemu_plugin_dyn_cb *cb,
     return op;
 }
 
+/*
+ * Per-vCPU and address-filtered inline ops. The address filter is
+ * branchless: the immediate is replaced by 0 when the access falls
+ * outside [lo, hi], which keeps any temps the translator has live
+ * across the memory access intact.
+ */
+static TCGOp *append_inline_cb_direct(const struct qemu_plugin_dyn_cb *cb,
+                                      TCGOp *begin_op, TCGOp *op)
+{
+    uint64_t lo = cb->inline_insn.lo;
+    uint64_t hi = cb->inline_insn.hi;
+    TCGOp *next = emit_after_begin(op);
+    TCGv_ptr ptr = gen_plugin_u64_ptr(cb->userp, cb->inline_insn.stride);
+    TCGv_i64 val = tcg_temp_new_i64();
+    TCGv_i64 imm = tcg_constant_i64(cb->inline_insn.imm);
+
+    if (lo != 0 || hi != UINT64_MAX) {
+        TCGv_i64 off = tcg_temp_new_i64();
+
+        tcg_debug_assert(begin_op->args[0] == PLUGIN_GEN_FROM_MEM);
+        tcg_gen_extu_tl_i64(off, plugin_vaddr(begin_op));
+        tcg_gen_subi_i64(off, off, lo);
+        tcg_gen_movcond_i64(TCG_COND_LEU, off, off, tcg_constant_i64(hi - lo),
+                            imm, tcg_constant_i64(0));
+        imm = off;
+    }
+
+    tcg_gen_ld_i64(val, ptr, 0);
+    tcg_gen_add_i64(val, val, imm);
+    tcg_gen_st_i64(val, ptr, 0);
+
+    tcg_temp_free_i64(imm);
+    tcg_temp_free_i64(val);
+    tcg_temp_free_ptr(ptr);
+    return emit_after_end(next);
+}
+
 static TCGOp *append_inline_cb(const struct qemu_plugin_dyn_cb *cb,
                                TCGOp *begin_op, TCGOp *op,
                                int *unused)
 {
+    if (cb->inline_insn.stride ||
+        cb->inline_insn.lo != 0 || cb->inline_insn.hi != UINT64_MAX) {
+        return append_inline_cb_direct(cb, begin_op, op);
+    }
+
     /* const_ptr */
     op = copy_const_ptr(&begin_op, op, cb->userp);
 
@@ -457,6 +593,53 @@ static TCGOp *append_inline_cb(const struct qemu_plugin_dyn_cb *cb,
     return op;
 }
 
+/*
+ * The value is compared inline and the callback is skipped with a
+ * branch. This is only done at the start of a TB, where the translator
+ * has no temps live that the branch could clobber.
+ */
+static TCGOp *append_cond_cb(const struct qemu_plugin_dyn_cb *cb,
+                             TCGOp *begin_op, TCGOp *op, int *unused)
+{
+    TCGOp *next = emit_after_begin(op);
+    TCGv_i32 cpu_index = tcg_temp_new_i32();
+    TCGLabel *skip = NULL;
+    int i;
+
+    if (cb->cond.cond != QEMU_PLUGIN_COND_ALWAYS) {
+        TCGv_ptr ptr = gen_plugin_u64_ptr(cb->cond.ptr, cb->cond.stride);
+        TCGv_i64 val = tcg_temp_new_i64();
+        TCGCond cond = plugin_cond_to_tcgcond(cb->cond.cond);
+
+        skip = gen_new_label();
+        tcg_gen_ld_i64(val, ptr, 0);
+        tcg_gen_brcondi_i64(tcg_invert_cond(cond), val, cb->cond.imm, skip);
+        tcg_temp_free_i64(val);
+        tcg_temp_free_ptr(ptr);
+    }
+
+    tcg_gen_ld_i32(cpu_index, cpu_env,
+                   -offsetof(ArchCPU, env) + offsetof(CPUState, cpu_index));
+    gen_helper_plugin_vcpu_udata_cb(cpu_index, tcg_constant_ptr(cb->userp));
+    tcg_temp_free_i32(cpu_index);
+
+    /* redirect the call, see copy_call() */
+    op = QTAILQ_PREV(next, link);
+    tcg_debug_assert(op->opc == INDEX_op_call);
+    for (i = 0; i < MAX_OPC_PARAM_ARGS; i++) {
+        if (op->args[i] == (uintptr_t)HELPER(plugin_vcpu_udata_cb)) {
+            op->args[i] = (uintptr_t)cb->f.vcpu_udata;
+            break;
+        }
+    }
+    tcg_debug_assert(i < MAX_OPC_PARAM_ARGS);
+
+    if (skip) {
+        gen_set_label(skip);
+    }
+    return emit_after_end(next);
+}
+
 static TCGOp *append_mem_cb(const struct qemu_plugin_dyn_cb *cb,
                             TCGOp *begin_op, TCGOp *op, int *cb_idx)
 {
@@ -548,6 +731,12 @@ inject_inline_cb(const GArray *cbs, TCGOp *begin_op, op_ok_fn ok)
     inject_cb_type(cbs, begin_op, append_inline_cb, ok);
 }
 
+static void
+inject_cond_cb(const GArray *cbs, TCGOp *begin_op)
+{
+    inject_cb_type(cbs, begin_op, append_cond_cb, op_ok);
+}
+
 static void
 inject_mem_cb(const GArray *cbs, TCGOp *begin_op)
 {
@@ -655,6 +844,12 @@ static void plugin_gen_tb_inline(const struct qemu_plugin_tb *ptb,
     inject_inline_cb(ptb->cbs[PLUGIN_CB_INLINE], begin_op, op_ok);
 }
 
+static void plugin_gen_tb_cond(const struct qemu_plugin_tb *ptb,
+                               TCGOp *begin_op)
+{
+    inject_cond_cb(ptb->cbs[PLUGIN_CB_COND], begin_op);
+}
+
 static void plugin_gen_insn_udata(const struct qemu_plugin_tb *ptb,
                                   TCGOp *begin_op, int insn_idx)
 {
@@ -737,6 +932,9 @@ static void pr_ops(void)
             case PLUGIN_GEN_CB_INLINE:
                 type = "inline";
                 break;
+            case PLUGIN_GEN_CB_COND:
+                type = "cond";
+                break;
             case PLUGIN_GEN_CB_MEM:
                 type = "mem";
                 break;
@@ -782,6 +980,9 @@ static void plugin_gen_inject(const struct qemu_plugin_tb *plugin_tb)
                 case PLUGIN_GEN_CB_UDATA:
                     plugin_gen_tb_udata(plugin_tb, op);
                     break;
+                case PLUGIN_GEN_CB_COND:
+                    plugin_gen_tb_cond(plugin_tb, op);
+                    break;
                 case PLUGIN_GEN_CB_INLINE:
                     plugin_gen_tb_inline(plugin_tb, op);
                     break;
@@ -0,0 +1,594 @@
+/*
+ * Persistent translation block cache
+ *
+ * The code generated by TCG is saved to a file when QEMU exits, and
+ * copied back at the same host address when the next run starts, so
+ * that the translation of the same guest code can be reused instead of
+ * being redone.  Since the generated code refers to the QEMU binary,
+ * to the TCG prologue and to the TranslationBlocks by absolute address,
+ * the file is only used when the binary and the layout of the code
+ * buffer are identical; this requires a QEMU built without PIE, or
+ * address space randomization to be disabled.
+ *
+ * Restored TBs are not linked into the lookup tables right away.  They
+ * are adopted by tb_gen_code() instead of a new translation, once the
+ * guest code they were translated from has been found unchanged.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "qemu-version.h"
+#include "qemu/cacheflush.h"
+#include "qemu/cutils.h"
+#include "qemu/error-report.h"
+#include "qemu/rcu.h"
+#include "qom/object.h"
+#include "exec/exec-all.h"
+#include "exec/memory.h"
+#include "exec/ram_addr.h"
+#include "hw/core/cpu.h"
+#include "sysemu/sysemu.h"
+#include "tcg/tcg.h"
+#include "tb-hash.h"
+#include "internal.h"
+#include "trace.h"
+
+#define TB_CACHE_MAGIC      "QEMUTBC1"
+#define TB_CACHE_ID_SIZE    32
+
+typedef struct TBCacheHeader {
+    char magic[8];
+    /* Identifies the QEMU binary and the code buffer layout */
+    uint8_t build_id[TB_CACHE_ID_SIZE];
+    /* Identifies the vCPU model the code was generated for */
+    uint8_t cpu_id[TB_CACHE_ID_SIZE];
+    uint64_t base;
+    uint64_t nb_segments;
+    uint64_t nb_entries;
+} TBCacheHeader;
+
+/* Followed by @size bytes of code, copied to the start of @region */
+typedef struct TBCacheSegment {
+    uint64_t region;
+    uint64_t size;
+} TBCacheSegment;
+
+/* Followed by the @size bytes of guest code that @tb was generated from */
+typedef struct TBCacheRecord {
+    uint64_t tb;
+    uint32_t size;
+    uint32_t reserved;
+} TBCacheRecord;
+
+typedef struct TBCacheEntry {
+    /* Lookup key, as in tb_lookup() */
+    tb_page_addr_t phys_pc;
+    target_ulong pc;
+    target_ulong cs_base;
+    uint32_t flags;
+    uint32_t cflags;
+    uint32_t trace_vcpu_dstate;
+
+    TranslationBlock *tb;
+    uint32_t size;
+    uint8_t code[];
+} TBCacheEntry;
+
+static struct {
+    QemuMutex lock;
+    char *path;
+    FILE *file;
+    TBCacheHeader header;
+    uint8_t build_id[TB_CACHE_ID_SIZE];
+    uint8_t cpu_id[TB_CACHE_ID_SIZE];
+    Notifier machine_done;
+    Notifier exit_notifier;
+
+    /* Fields below are protected by the lock */
+    /* Restored TBs waiting to be adopted */
+    GHashTable *entries;
+    unsigned int nb_entries;
+    /* TBs that must not be saved, see tcg_set_tb_nocache() */
+    GHashTable *nocache;
+    size_t adopted;
+    bool flushed;
+} tb_cache;
+
+static void tb_cache_save(Notifier *notifier, void *data);
+
+static guint tb_cache_entry_hash(gconstpointer p)
+{
+    const TBCacheEntry *e = p;
+
+    return tb_hash_func(e->phys_pc, e->pc, e->flags, e->cflags,
+                        e->trace_vcpu_dstate);
+}
+
+static gboolean tb_cache_entry_equal(gconstpointer ap, gconstpointer bp)
+{
+    const TBCacheEntry *a = ap;
+    const TBCacheEntry *b = bp;
+
+    return a->phys_pc == b->phys_pc &&
+           a->pc == b->pc &&
+           a->cs_base == b->cs_base &&
+           a->flags == b->flags &&
+           a->cflags == b->cflags &&
+           a->trace_vcpu_dstate == b->trace_vcpu_dstate;
+}
+
+static void tb_cache_build_id(uint8_t *digest)
+{
+    GChecksum *sum = g_checksum_new(G_CHECKSUM_SHA256);
+    gsize len = TB_CACHE_ID_SIZE;
+    uint64_t layout[] = {
+        /* Where the binary is loaded */
+        (uintptr_t)tb_gen_code,
+        (uintptr_t)&tb_cache,
+        /* Where the code buffer and the prologue are */
+        (uintptr_t)tcg_region_base(),
+        (uintptr_t)tcg_code_gen_epilogue,
+        tcg_code_capacity(),
+        tcg_nb_regions(),
+        sizeof(TranslationBlock),
+    };
+#ifdef CONFIG_LINUX
+    struct stat st;
+#endif
+
+    g_checksum_update(sum, (const guchar *)QEMU_FULL_VERSION, -1);
+    g_checksum_update(sum, (const guchar *)TARGET_NAME, -1);
+    g_checksum_update(sum, (const guchar *)layout, sizeof(layout));
+#ifdef CONFIG_LINUX
+    /* Tell apart two builds of the same version */
+    if (stat("/proc/self/exe", &st) == 0) {
+        g_checksum_update(sum, (const guchar *)&st.st_size,
+                          sizeof(st.st_size));
+        g_checksum_update(sum, (const guchar *)&st.st_mtime,
+                          sizeof(st.st_mtime));
+    }
+#endif
+    g_checksum_get_digest(sum, digest, &len);
+    g_checksum_free(sum);
+}
+
+/*
+ * The translation depends on the CPU model and features beyond what
+ * the TB flags hold, so identify them through the properties of @cpu.
+ */
+static void tb_cache_cpu_id(CPUState *cpu, uint8_t *digest)
+{
+    GChecksum *sum = g_checksum_new(G_CHECKSUM_SHA256);
+    gsize len = TB_CACHE_ID_SIZE;
+    ObjectPropertyIterator iter;
+    ObjectProperty *prop;
+    int page_bits = TARGET_PAGE_BITS;
+
+    g_checksum_update(sum, (const guchar *)object_get_typename(OBJECT(cpu)),
+                      -1);
+    g_checksum_update(sum, (const guchar *)&page_bits, sizeof(page_bits));
+
+    object_property_iter_init(&iter, OBJECT(cpu));
+    while ((prop = object_property_iter_next(&iter))) {
+        g_autofree char *value = NULL;
+
+        if (!prop->get || strstart(prop->type, "link<", NULL) ||
+            strstart(prop->type, "child<", NULL)) {
+            continue;
+        }
+        value = object_property_print(OBJECT(cpu), prop->name, false, NULL);
+        if (value) {
+            g_checksum_update(sum, (const guchar *)prop->name, -1);
+            g_checksum_update(sum, (const guchar *)value, -1);
+        }
+    }
+
+    g_checksum_get_digest(sum, digest, &len);
+    g_checksum_free(sum);
+}
+
+/* Drop the restored TBs if they were generated for another vCPU model */
+static void tb_cache_check_cpu(Notifier *notifier, void *data)
+{
+    if (!first_cpu) {
+        return;
+    }
+    tb_cache_cpu_id(first_cpu, tb_cache.cpu_id);
+
+    qemu_mutex_lock(&tb_cache.lock);
+    if (g_hash_table_size(tb_cache.entries) &&
+        memcmp(tb_cache.header.cpu_id, tb_cache.cpu_id, TB_CACHE_ID_SIZE)) {
+        trace_tb_cache_reject(tb_cache.path, "cpu");
+        g_hash_table_remove_all(tb_cache.entries);
+        qatomic_set(&tb_cache.nb_entries, 0);
+    }
+    qemu_mutex_unlock(&tb_cache.lock);
+}
+
+static bool tb_cache_read(FILE *f, void *buf, size_t size)
+{
+    return !size || fread(buf, size, 1, f) == 1;
+}
+
+static bool tb_cache_write(FILE *f, const void *buf, size_t size)
+{
+    return !size || fwrite(buf, size, 1, f) == 1;
+}
+
+/*
+ * Open the cache file at @path, and ask for the code buffer to be
+ * placed where it was in the run that wrote it.  Called before tcg_init().
+ */
+void tb_cache_init(const char *path)
+{
+    TBCacheHeader *hdr = &tb_cache.header;
+
+    qemu_mutex_init(&tb_cache.lock);
+    tb_cache.entries = g_hash_table_new_full(tb_cache_entry_hash,
+                                             tb_cache_entry_equal,
+                                             g_free, NULL);
+    tb_cache.nocache = g_hash_table_new(NULL, NULL);
+
+    tb_cache.file = fopen(path, "rb");
+    if (!tb_cache.file) {
+        if (errno != ENOENT) {
+            warn_report("tb-cache: cannot open %s: %s", path,
+                        strerror(errno));
+            return;
+        }
+        /* First run, the file is created on exit */
+        tb_cache.path = g_strdup(path);
+        return;
+    }
+
+    if (!tb_cache_read(tb_cache.file, hdr, sizeof(*hdr)) ||
+        memcmp(hdr->magic, TB_CACHE_MAGIC, sizeof(hdr->magic))) {
+        /* Do not overwrite a file that we did not write */
+        warn_report("tb-cache: %s is not a translation cache, ignoring it",
+                    path);
+        fclose(tb_cache.file);
+        tb_cache.file = NULL;
+        return;
+    }
+
+    tb_cache.path = g_strdup(path);
+    tcg_region_set_base((void *)(uintptr_t)hdr->base);
+}
+
+static bool tb_cache_load_entries(FILE *f, const TBCacheHeader *hdr)
+{
+    g_autofree TBCacheSegment *segs = g_new0(TBCacheSegment,
+                                             hdr->nb_segments);
+    g_autofree void **starts = g_new0(void *, hdr->nb_segments);
+    uint64_t i, j;
+
+    for (i = 0; i < hdr->nb_segments; i++) {
+        if (!tb_cache_read(f, &segs[i], sizeof(segs[i]))) {
+            return false;
+        }
+        starts[i] = tcg_region_reserve(segs[i].region, segs[i].size);
+        if (!starts[i] || !tb_cache_read(f, starts[i], segs[i].size)) {
+            return false;
+        }
+        flush_idcache_range((uintptr_t)tcg_splitwx_to_rx(starts[i]),
+                            (uintptr_t)starts[i], segs[i].size);
+    }
+
+    for (i = 0; i < hdr->nb_entries; i++) {
+        TBCacheRecord rec;
+        TBCacheEntry *e;
+        TranslationBlock *tb;
+
+        if (!tb_cache_read(f, &rec, sizeof(rec)) ||
+            rec.size > 2 * TARGET_PAGE_SIZE) {
+            return false;
+        }
+
+        /* Both the TB and its code must have been restored */
+        tb = (TranslationBlock *)(uintptr_t)rec.tb;
+        for (j = 0; j < hdr->nb_segments; j++) {
+            void *end = starts[j] + segs[j].size;
+
+            if ((void *)tb >= starts[j] && (void *)(tb + 1) <= end &&
+                tb->tc.ptr >= (void *)(tb + 1) &&
+                tb->tc.ptr + tb->tc.size <= end) {
+                break;
+            }
+        }
+        if (j == hdr->nb_segments || tb->size != rec.size ||
+            tb->page_addr[0] == -1) {
+            return false;
+        }
+
+        e = g_malloc(sizeof(*e) + rec.size);
+        e->phys_pc = tb->page_addr[0] | (tb->pc & ~TARGET_PAGE_MASK);
+        e->pc = tb->pc;
+        e->cs_base = tb->cs_base;
+        e->flags = tb->flags;
+        e->cflags = tb->cflags;
+        e->trace_vcpu_dstate = tb->trace_vcpu_dstate;
+        e->tb = tb;
+        e->size = rec.size;
+        if (!tb_cache_read(f, e->code, rec.size)) {
+            g_free(e);
+            return false;
+        }
+        g_hash_table_add(tb_cache.entries, e);
+    }
+    return true;
+}
+
+/*
+ * Restore the code of the cache file into the code buffer.
+ * Called once the prologue has been generated, before any vCPU starts.
+ */
+void tb_cache_load(void)
+{
+    TBCacheHeader *hdr = &tb_cache.header;
+
+    if (!tb_cache.path) {
+        return;
+    }
+    if (tcg_splitwx_diff) {
+        warn_report("tb-cache: not supported with split-wx, disabled");
+        g_free(tb_cache.path);
+        tb_cache.path = NULL;
+        goto out;
+    }
+
+    tb_cache_build_id(tb_cache.build_id);
+    tb_cache.machine_done.notify = tb_cache_check_cpu;
+    qemu_add_machine_init_done_notifier(&tb_cache.machine_done);
+    tb_cache.exit_notifier.notify = tb_cache_save;
+    qemu_add_exit_notifier(&tb_cache.exit_notifier);
+
+    if (!tb_cache.file) {
+        goto out;
+    }
+    if (memcmp(hdr->build_id, tb_cache.build_id, TB_CACHE_ID_SIZE)) {
+        /* Another binary, or the code buffer could not be placed */
+        trace_tb_cache_reject(tb_cache.path, "build");
+        goto out;
+    }
+    if (!tb_cache_load_entries(tb_cache.file, hdr)) {
+        warn_report("tb-cache: %s is truncated or corrupted, ignoring it",
+                    tb_cache.path);
+        g_hash_table_remove_all(tb_cache.entries);
+        goto out;
+    }
+    tb_cache.nb_entries = g_hash_table_size(tb_cache.entries);
+    trace_tb_cache_load(tb_cache.path, hdr->nb_segments, hdr->nb_entries);
+
+out:
+    if (tb_cache.file) {
+        fclose(tb_cache.file);
+        tb_cache.file = NULL;
+    }
+}
+
+/*
+ * Find a restored TB for the lookup key, and check that it was generated
+ * from the same guest code.  The caller links it in place of a new
+ * translation.
+ */
+TranslationBlock *tb_cache_lookup(CPUState *cpu, tb_page_addr_t phys_pc,
+                                  target_ulong pc, target_ulong cs_base,
+                                  uint32_t flags, uint32_t cflags)
+{
+    CPUArchState *env = cpu->env_ptr;
+    TBCacheEntry key, *e = NULL;
+    TranslationBlock *tb = NULL;
+    target_ulong virt_page2;
+    size_t len;
+    void *host;
+
+    if (!qatomic_read(&tb_cache.nb_entries)) {
+        return NULL;
+    }
+
+    key.phys_pc = phys_pc;
+    key.pc = pc;
+    key.cs_base = cs_base;
+    key.flags = flags;
+    key.cflags = cflags;
+    key.trace_vcpu_dstate = *cpu->trace_dstate;
+
+    qemu_mutex_lock(&tb_cache.lock);
+    /* Claim the entry, no other vCPU may adopt the same TB */
+    if (g_hash_table_steal_extended(tb_cache.entries, &key,
+                                    (gpointer *)&e, NULL)) {
+        tb = e->tb;
+    }
+    qatomic_set(&tb_cache.nb_entries, g_hash_table_size(tb_cache.entries));
+    qemu_mutex_unlock(&tb_cache.lock);
+
+    if (!tb) {
+        return NULL;
+    }
+
+    len = MIN(e->size, -(pc | TARGET_PAGE_MASK));
+    WITH_RCU_READ_LOCK_GUARD() {
+        if (memcmp(qemu_map_ram_ptr(NULL, phys_pc), e->code, len)) {
+            tb = NULL;
+        }
+    }
+
+    /*
+     * Do not fault on the second page: if it is not mapped, the guest
+     * must see the fault from the translation of the first page.
+     */
+    virt_page2 = (pc + e->size - 1) & TARGET_PAGE_MASK;
+    if (tb && (pc & TARGET_PAGE_MASK) != virt_page2) {
+        int tlb_flags = probe_access_flags(env, virt_page2, MMU_INST_FETCH,
+                                           cpu_mmu_index(env, true), true,
+                                           &host, 0);
+
+        if ((tlb_flags & (TLB_INVALID_MASK | TLB_MMIO)) || !host ||
+            qemu_ram_addr_from_host(host) != tb->page_addr[1] ||
+            memcmp(host, e->code + len, e->size - len)) {
+            tb = NULL;
+        }
+    }
+    g_free(e);
+
+    if (tb) {
+        qemu_mutex_lock(&tb_cache.lock);
+        tb_cache.adopted++;
+        qemu_mutex_unlock(&tb_cache.lock);
+        trace_tb_cache_adopt(tb, pc);
+    }
+    return tb;
+}
+
+void tb_cache_exclude(TranslationBlock *tb)
+{
+    if (!tb_cache.path) {
+        return;
+    }
+    qemu_mutex_lock(&tb_cache.lock);
+    g_hash_table_add(tb_cache.nocache, tb);
+    qemu_mutex_unlock(&tb_cache.lock);
+}
+
+/* The code buffer is being flushed.  Call from a safe-work context. */
+void tb_cache_reset(void)
+{
+    if (!tb_cache.path) {
+        return;
+    }
+    qemu_mutex_lock(&tb_cache.lock);
+    g_hash_table_remove_all(tb_cache.entries);
+    g_hash_table_remove_all(tb_cache.nocache);
+    qatomic_set(&tb_cache.nb_entries, 0);
+    tb_cache.adopted = 0;
+    tb_cache.flushed = true;
+    qemu_mutex_unlock(&tb_cache.lock);
+}
+
+static gboolean tb_cache_collect(gpointer key, gpointer value, gpointer data)
+{
+    TranslationBlock *tb = value;
+    GPtrArray *tbs = data;
+
+    if (!(tb_cflags(tb) & CF_INVALID) && tb->page_addr[0] != -1 &&
+        !g_hash_table_contains(tb_cache.nocache, tb)) {
+        g_ptr_array_add(tbs, tb);
+    }
+    return false;
+}
+
+static bool tb_cache_write_tb(FILE *f, TranslationBlock *tb)
+{
+    TBCacheRecord rec = { .tb = (uintptr_t)tb, .size = tb->size };
+    size_t len = MIN(tb->size, -(tb->pc | TARGET_PAGE_MASK));
+    tb_page_addr_t addr = tb->page_addr[0] | (tb->pc & ~TARGET_PAGE_MASK);
+
+    return tb_cache_write(f, &rec, sizeof(rec)) &&
+           tb_cache_write(f, qemu_map_ram_ptr(NULL, addr), len) &&
+           (len == tb->size ||
+            tb_cache_write(f, qemu_map_ram_ptr(NULL, tb->page_addr[1]),
+                           tb->size - len));
+}
+
+static bool tb_cache_write_file(FILE *f, GPtrArray *tbs)
+{
+    TBCacheHeader *hdr = &tb_cache.header;
+    GHashTableIter iter;
+    TBCacheEntry *e;
+    size_t i, n;
+
+    if (!tb_cache_write(f, hdr, sizeof(*hdr))) {
+        return false;
+    }
+
+    for (i = 0, n = tcg_nb_regions(); i < n; i++) {
+        TBCacheSegment seg = { .region = i };
+        void *start;
+
+        seg.size = tcg_region_used(i, &start);
+        if (seg.size &&
+            (!tb_cache_write(f, &seg, sizeof(seg)) ||
+             !tb_cache_write(f, tcg_splitwx_to_rx(start), seg.size))) {
+            return false;
+        }
+    }
+
+    WITH_RCU_READ_LOCK_GUARD() {
+        for (i = 0; i < tbs->len; i++) {
+            if (!tb_cache_write_tb(f, g_ptr_array_index(tbs, i))) {
+                return false;
+            }
+        }
+    }
+
+    /* Keep the restored TBs that were not needed this time */
+    g_hash_table_iter_init(&iter, tb_cache.entries);
+    while (g_hash_table_iter_next(&iter, (gpointer *)&e, NULL)) {
+        TBCacheRecord rec = { .tb = (uintptr_t)e->tb, .size = e->size };
+
+        if (!tb_cache_write(f, &rec, sizeof(rec)) ||
+            !tb_cache_write(f, e->code, e->size)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * Write the code buffer to the cache file.  Called on exit, once the
+ * vCPUs have been stopped for good.
+ */
+static void tb_cache_save(Notifier *notifier, void *data)
+{
+    TBCacheHeader *hdr = &tb_cache.header;
+    g_autoptr(GPtrArray) tbs = g_ptr_array_new();
+    g_autofree char *tmp = NULL;
+    size_t i, n;
+    bool ok;
+    FILE *f;
+    int fd;
+
+    if (!tb_cache.path || !first_cpu) {
+        return;
+    }
+
+    tcg_tb_foreach(tb_cache_collect, tbs);
+    if (tbs->len == tb_cache.adopted && !tb_cache.flushed) {
+        /* Nothing new since the file was read */
+        return;
+    }
+
+    memset(hdr, 0, sizeof(*hdr));
+    memcpy(hdr->magic, TB_CACHE_MAGIC, sizeof(hdr->magic));
+    memcpy(hdr->build_id, tb_cache.build_id, TB_CACHE_ID_SIZE);
+    memcpy(hdr->cpu_id, tb_cache.cpu_id, TB_CACHE_ID_SIZE);
+    hdr->base = (uintptr_t)tcg_region_base();
+    for (i = 0, n = tcg_nb_regions(); i < n; i++) {
+        void *start;
+
+        hdr->nb_segments += !!tcg_region_used(i, &start);
+    }
+    hdr->nb_entries = tbs->len + g_hash_table_size(tb_cache.entries);
+
+    /* Write to a temporary file so that concurrent runs do not clash */
+    tmp = g_strdup_printf("%s.XXXXXX", tb_cache.path);
+    fd = g_mkstemp(tmp);
+    if (fd < 0 || !(f = fdopen(fd, "wb"))) {
+        warn_report("tb-cache: cannot create %s: %s", tmp, strerror(errno));
+        if (fd >= 0) {
+            close(fd);
+            unlink(tmp);
+        }
+        return;
+    }
+
+    ok = tb_cache_write_file(f, tbs);
+    if (fclose(f) || !ok || rename(tmp, tb_cache.path)) {
+        warn_report("tb-cache: cannot write %s: %s", tb_cache.path,
+                    strerror(errno));
+        unlink(tmp);
+        return;
+    }
+    trace_tb_cache_save(tb_cache.path, hdr->nb_segments, hdr->nb_entries);
+}
@@ -32,9 +32,15 @@ struct TBContext {
 
     struct qht htable;
 
+    /* translations in progress, see tb_gen_claim() */
+    QemuMutex pending_lock;
+    QemuCond pending_cond;
+    QLIST_HEAD(, TBPending) pending;
+
     /* statistics */
     unsigned tb_flush_count;
     unsigned tb_phys_invalidate_count;
+    unsigned tb_wait_count;
 };
 
 extern TBContext tb_ctx;
@@ -26,35 +26,47 @@
 
 #ifdef CONFIG_SOFTMMU
 
-/* Only the bottom TB_JMP_PAGE_BITS of the jump cache hash bits vary for
-   addresses on the same page.  The top bits are the same.  This allows
-   TLB invalidation to quickly clear a subset of the hash table.  */
-#define TB_JMP_PAGE_BITS (TB_JMP_CACHE_BITS / 2)
-#define TB_JMP_PAGE_SIZE (1 << TB_JMP_PAGE_BITS)
-#define TB_JMP_ADDR_MASK (TB_JMP_PAGE_SIZE - 1)
-#define TB_JMP_PAGE_MASK (TB_JMP_CACHE_SIZE - TB_JMP_PAGE_SIZE)
+/*
+ * The jump cache has 1 << @bits sets. Only the bottom @bits / 2 of the
+ * hash vary for addresses on the same page.  The top bits are the same.
+ * This allows TLB invalidation to quickly clear a subset of the sets.
+ */
+static inline unsigned int tb_jmp_cache_page_sets(unsigned int bits)
+{
+    return 1u << (bits / 2);
+}
 
-static inline unsigned int tb_jmp_cache_hash_page(target_ulong pc)
+static inline unsigned int tb_jmp_cache_hash_page(unsigned int bits,
+                                                  target_ulong pc)
 {
+    unsigned int page_bits = bits / 2;
+    unsigned int page_mask = (1u << bits) - (1u << page_bits);
     target_ulong tmp;
-    tmp = pc ^ (pc >> (TARGET_PAGE_BITS - TB_JMP_PAGE_BITS));
-    return (tmp >> (TARGET_PAGE_BITS - TB_JMP_PAGE_BITS)) & TB_JMP_PAGE_MASK;
+
+    tmp = pc ^ (pc >> (TARGET_PAGE_BITS - page_bits));
+    return (tmp >> (TARGET_PAGE_BITS - page_bits)) & page_mask;
 }
 
-static inline unsigned int tb_jmp_cache_hash_func(target_ulong pc)
+static inline unsigned int tb_jmp_cache_hash_func(unsigned int bits,
+                                                  target_ulong pc)
 {
+    unsigned int page_bits = bits / 2;
+    unsigned int page_mask = (1u << bits) - (1u << page_bits);
+    unsigned int addr_mask = (1u << page_bits) - 1;
     target_ulong tmp;
-    tmp = pc ^ (pc >> (TARGET_PAGE_BITS - TB_JMP_PAGE_BITS));
-    return (((tmp >> (TARGET_PAGE_BITS - TB_JMP_PAGE_BITS)) & TB_JMP_PAGE_MASK)
-           | (tmp & TB_JMP_ADDR_MASK));
+
+    tmp = pc ^ (pc >> (TARGET_PAGE_BITS - page_bits));
+    return (((tmp >> (TARGET_PAGE_BITS - page_bits)) & page_mask)
+           | (tmp & addr_mask));
 }
 
 #else
 
 /* In user-mode we can get better hashing because we do not have a TLB */
-static inline unsigned int tb_jmp_cache_hash_func(target_ulong pc)
+static inline unsigned int tb_jmp_cache_hash_func(unsigned int bits,
+                                                  target_ulong pc)
 {
-    return (pc ^ (pc >> TB_JMP_CACHE_BITS)) & (TB_JMP_CACHE_SIZE - 1);
+    return (pc ^ (pc >> bits)) & ((1u << bits) - 1);
 }
 
 #endif /* CONFIG_SOFTMMU */
@@ -0,0 +1,107 @@
+/*
+ * The per-CPU TranslationBlock jump cache.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#ifndef ACCEL_TCG_TB_JMP_CACHE_H
+#define ACCEL_TCG_TB_JMP_CACHE_H
+
+#include "qemu/rcu.h"
+#include "exec/exec-all.h"
+#include "tb-hash.h"
+
+#define TB_JMP_CACHE_WAYS         2
+#define TB_JMP_VICTIM_SIZE        8
+
+#define TB_JMP_CACHE_BITS_MIN     8
+#define TB_JMP_CACHE_BITS_MAX     18
+#define TB_JMP_CACHE_BITS_DEFAULT 12
+
+/*
+ * In system mode half of the set index comes from the page offset of
+ * the pc (see tb_jmp_cache_hash_func), so small pages bound the size.
+ */
+#if !defined(CONFIG_SOFTMMU)
+# define TB_JMP_CACHE_BITS_LIMIT  TB_JMP_CACHE_BITS_MAX
+#elif defined(TARGET_PAGE_BITS_VARY)
+# define TB_JMP_CACHE_BITS_LIMIT  MIN(TB_JMP_CACHE_BITS_MAX, \
+                                      2 * TARGET_PAGE_BITS_MIN)
+#else
+# define TB_JMP_CACHE_BITS_LIMIT  MIN(TB_JMP_CACHE_BITS_MAX, \
+                                      2 * TARGET_PAGE_BITS)
+#endif
+
+/*
+ * The jump cache maps a guest pc to the TB last executed from it, in
+ * front of the global TB hash table.
+ *
+ * It is set associative: each of the 1 << @bits sets holds
+ * TB_JMP_CACHE_WAYS TBs, most recently used first. A TB pushed out of
+ * a set moves to a small victim array, so that a few pcs that keep
+ * colliding in one set (common with large guest kernels) still hit.
+ *
+ * Only the vCPU thread adds or moves entries; any thread may clear
+ * them, so all accesses to the TB pointers must be atomic. An entry
+ * that survives a concurrent clear is harmless: the TB it points to is
+ * marked CF_INVALID and no longer matches any lookup.
+ */
+struct CPUJumpCache {
+    struct rcu_head rcu;
+    unsigned int bits;
+    unsigned int victim_next;
+    /* Statistics, only written by the vCPU thread */
+    size_t hits;
+    size_t victim_hits;
+    size_t misses;
+    TranslationBlock *victim[TB_JMP_VICTIM_SIZE];
+    TranslationBlock *set[][TB_JMP_CACHE_WAYS];
+};
+
+extern unsigned int tb_jmp_cache_bits;
+
+CPUJumpCache *tb_jmp_cache_new(unsigned int bits);
+
+static inline TranslationBlock **tb_jmp_cache_set(CPUJumpCache *jc,
+                                                  target_ulong pc)
+{
+    return jc->set[tb_jmp_cache_hash_func(jc->bits, pc)];
+}
+
+/* Insert @tb at the head of its set; call from the vCPU thread only */
+static inline void tb_jmp_cache_insert(CPUJumpCache *jc, TranslationBlock *tb)
+{
+    TranslationBlock **set = tb_jmp_cache_set(jc, tb->pc);
+    TranslationBlock *old = qatomic_read(&set[TB_JMP_CACHE_WAYS - 1]);
+    int w;
+
+    for (w = TB_JMP_CACHE_WAYS - 1; w > 0; w--) {
+        qatomic_set(&set[w], qatomic_read(&set[w - 1]));
+    }
+    qatomic_set(&set[0], tb);
+
+    if (old) {
+        qatomic_set(&jc->victim[jc->victim_next], old);
+        jc->victim_next = (jc->victim_next + 1) % TB_JMP_VICTIM_SIZE;
+    }
+}
+
+/* Remove @tb from the cache; may be called from any thread */
+static inline void tb_jmp_cache_remove(CPUJumpCache *jc, TranslationBlock *tb)
+{
+    TranslationBlock **set = tb_jmp_cache_set(jc, tb->pc);
+    int i;
+
+    for (i = 0; i < TB_JMP_CACHE_WAYS; i++) {
+        if (qatomic_read(&set[i]) == tb) {
+            qatomic_set(&set[i], NULL);
+        }
+    }
+    for (i = 0; i < TB_JMP_VICTIM_SIZE; i++) {
+        if (qatomic_read(&jc->victim[i]) == tb) {
+            qatomic_set(&jc->victim[i], NULL);
+        }
+    }
+}
+
+#endif /* ACCEL_TCG_TB_JMP_CACHE_H */
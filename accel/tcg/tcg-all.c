@@ -36,6 +36,7 @@
 #include "hw/boards.h"
 #endif
 #include "internal.h"
+#include "tb-jmp-cache.h"
 
 struct TCGState {
     AccelState parent_obj;
@@ -43,6 +44,9 @@ struct TCGState {
     bool mttcg_enabled;
     int splitwx_enabled;
     unsigned long tb_size;
+    char *tb_cache;
+    uint32_t hot_trace_threshold;
+    uint32_t jmp_cache_bits;
 };
 typedef struct TCGState TCGState;
 
@@ -98,6 +102,7 @@ static void tcg_accel_instance_init(Object *obj)
     TCGState *s = TCG_STATE(obj);
 
     s->mttcg_enabled = default_mttcg_enabled();
+    s->jmp_cache_bits = TB_JMP_CACHE_BITS_DEFAULT;
 
     /* If debugging enabled, default "auto on", otherwise off. */
 #if defined(CONFIG_DEBUG_TCG) && !defined(CONFIG_USER_ONLY)
@@ -123,6 +128,13 @@ static int tcg_init_machine(MachineState *ms)
 
     page_init();
     tb_htable_init();
+    tb_trace_threshold = s->hot_trace_threshold;
+    tb_jmp_cache_bits = s->jmp_cache_bits;
+#if defined(CONFIG_SOFTMMU)
+    if (s->tb_cache) {
+        tb_cache_init(s->tb_cache);
+    }
+#endif
     tcg_init(s->tb_size * MiB, s->splitwx_enabled, max_cpus);
 
 #if defined(CONFIG_SOFTMMU)
@@ -131,6 +143,10 @@ static int tcg_init_machine(MachineState *ms)
      * initialize the prologue now.
      */
     tcg_prologue_init(tcg_ctx);
+
+    if (s->tb_cache) {
+        tb_cache_load();
+    }
 #endif
 
     return 0;
@@ -195,6 +211,59 @@ static void tcg_set_tb_size(Object *obj, Visitor *v,
     s->tb_size = value;
 }
 
+static void tcg_get_hot_trace_threshold(Object *obj, Visitor *v,
+                                        const char *name, void *opaque,
+                                        Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    uint32_t value = s->hot_trace_threshold;
+
+    visit_type_uint32(v, name, &value, errp);
+}
+
+static void tcg_set_hot_trace_threshold(Object *obj, Visitor *v,
+                                        const char *name, void *opaque,
+                                        Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    uint32_t value;
+
+    if (!visit_type_uint32(v, name, &value, errp)) {
+        return;
+    }
+
+    s->hot_trace_threshold = value;
+}
+
+static void tcg_get_jmp_cache_bits(Object *obj, Visitor *v,
+                                   const char *name, void *opaque,
+                                   Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    uint32_t value = s->jmp_cache_bits;
+
+    visit_type_uint32(v, name, &value, errp);
+}
+
+static void tcg_set_jmp_cache_bits(Object *obj, Visitor *v,
+                                   const char *name, void *opaque,
+                                   Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    uint32_t value;
+
+    if (!visit_type_uint32(v, name, &value, errp)) {
+        return;
+    }
+    if (value < TB_JMP_CACHE_BITS_MIN || value > TB_JMP_CACHE_BITS_LIMIT) {
+        error_setg(errp, "jmp-cache-bits must be between %d and %d",
+                   TB_JMP_CACHE_BITS_MIN, (int)TB_JMP_CACHE_BITS_LIMIT);
+        return;
+    }
+
+    s->jmp_cache_bits = value;
+}
+
 static bool tcg_get_splitwx(Object *obj, Error **errp)
 {
     TCGState *s = TCG_STATE(obj);
@@ -207,6 +276,23 @@ static void tcg_set_splitwx(Object *obj, bool value, Error **errp)
     s->splitwx_enabled = value;
 }
 
+#if !defined(CONFIG_USER_ONLY)
+static char *tcg_get_tb_cache(Object *obj, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+
+    return g_strdup(s->tb_cache);
+}
+
+static void tcg_set_tb_cache(Object *obj, const char *value, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+
+    g_free(s->tb_cache);
+    s->tb_cache = g_strdup(value);
+}
+#endif
+
 static void tcg_accel_class_init(ObjectClass *oc, void *data)
 {
     AccelClass *ac = ACCEL_CLASS(oc);
@@ -224,10 +310,30 @@ static void tcg_accel_class_init(ObjectClass *oc, void *data)
     object_class_property_set_description(oc, "tb-size",
         "TCG translation block cache size");
 
+    object_class_property_add(oc, "hot-trace-threshold", "int",
+        tcg_get_hot_trace_threshold, tcg_set_hot_trace_threshold,
+        NULL, NULL);
+    object_class_property_set_description(oc, "hot-trace-threshold",
+        "Executions of a TB before it starts a hot trace (0 to disable)");
+
+    object_class_property_add(oc, "jmp-cache-bits", "int",
+        tcg_get_jmp_cache_bits, tcg_set_jmp_cache_bits,
+        NULL, NULL);
+    object_class_property_set_description(oc, "jmp-cache-bits",
+        "log2 of the number of sets in the per-vCPU TB jump cache");
+
     object_class_property_add_bool(oc, "split-wx",
         tcg_get_splitwx, tcg_set_splitwx);
     object_class_property_set_description(oc, "split-wx",
         "Map jit pages into separate RW and RX regions");
+
+#if !defined(CONFIG_USER_ONLY)
+    object_class_property_add_str(oc, "tb-cache",
+                                  tcg_get_tb_cache,
+                                  tcg_set_tb_cache);
+    object_class_property_set_description(oc, "tb-cache",
+        "File that keeps translated code across runs");
+#endif
 }
 
 static const TypeInfo tcg_accel_type = {
@@ -1295,6 +1295,32 @@ void HELPER(gvec_ussub64)(void *d, void *a, void *b, uint32_t desc)
     clear_high(d, oprsz, desc);
 }
 
+#define DO_RHADD(NAME, TYPE)                                            \
+void HELPER(NAME)(void *d, void *a, void *b, uint32_t desc)             \
+{                                                                       \
+    intptr_t oprsz = simd_oprsz(desc);                                  \
+    intptr_t i;                                                         \
+                                                                        \
+    for (i = 0; i < oprsz; i += sizeof(TYPE)) {                         \
+        TYPE ai = *(TYPE *)(a + i);                                     \
+        TYPE bi = *(TYPE *)(b + i);                                     \
+        *(TYPE *)(d + i) = (ai >> 1) + (bi >> 1) + ((ai | bi) & 1);     \
+    }                                                                   \
+    clear_high(d, oprsz, desc);                                         \
+}
+
+DO_RHADD(gvec_srhadd8, int8_t)
+DO_RHADD(gvec_srhadd16, int16_t)
+DO_RHADD(gvec_srhadd32, int32_t)
+DO_RHADD(gvec_srhadd64, int64_t)
+
+DO_RHADD(gvec_urhadd8, uint8_t)
+DO_RHADD(gvec_urhadd16, uint16_t)
+DO_RHADD(gvec_urhadd32, uint32_t)
+DO_RHADD(gvec_urhadd64, uint64_t)
+
+#undef DO_RHADD
+
 void HELPER(gvec_smin8)(void *d, void *a, void *b, uint32_t desc)
 {
     intptr_t oprsz = simd_oprsz(desc);
@@ -58,6 +58,7 @@
 #include "qapi/error.h"
 #include "hw/core/tcg-cpu-ops.h"
 #include "tb-hash.h"
+#include "tb-jmp-cache.h"
 #include "tb-context.h"
 #include "internal.h"
 
@@ -107,8 +108,13 @@ typedef struct PageDesc {
     /* list of TBs intersecting this ram page */
     uintptr_t first_tb;
 #ifdef CONFIG_SOFTMMU
-    /* in order to optimize self modifying code, we count the number
-       of lookups we do to a given page to use a bitmap */
+    /*
+     * in order to optimize self modifying code, we count the number
+     * of writes we see to a given page to use a bitmap of the bytes
+     * holding translated code. The bitmap is kept up to date as TBs
+     * are added, but bits of invalidated TBs are only dropped when a
+     * write hits them, so it may have false positives.
+     */
     unsigned long *code_bitmap;
     unsigned int code_write_count;
 #else
@@ -904,6 +910,9 @@ void tb_htable_init(void)
     unsigned int mode = QHT_MODE_AUTO_RESIZE;
 
     qht_init(&tb_ctx.htable, tb_cmp, CODE_GEN_HTABLE_SIZE, mode);
+    qemu_mutex_init(&tb_ctx.pending_lock);
+    qemu_cond_init(&tb_ctx.pending_cond);
+    QLIST_INIT(&tb_ctx.pending);
 }
 
 /* call with @p->lock held */
@@ -986,11 +995,13 @@ static void do_tb_flush(CPUState *cpu, run_on_cpu_data tb_flush_count)
 
     CPU_FOREACH(cpu) {
         cpu_tb_jmp_cache_clear(cpu);
+        cpu->tb_hot = NULL;
     }
 
     qht_reset_size(&tb_ctx.htable, CODE_GEN_HTABLE_SIZE);
     page_flush_tb();
 
+    tb_cache_reset();
     tcg_region_reset_all();
     /* XXX: flush processor icache at this point if cache flush is
        expensive */
@@ -1192,23 +1203,27 @@ static void do_tb_phys_invalidate(TranslationBlock *tb, bool rm_from_page_list)
         return;
     }
 
-    /* remove the TB from the page list */
+    /*
+     * remove the TB from the page list; its bits in the code bitmap are
+     * left set until a write hits them
+     */
     if (rm_from_page_list) {
         p = page_find(tb->page_addr[0] >> TARGET_PAGE_BITS);
         tb_page_remove(p, tb);
-        invalidate_page_bitmap(p);
         if (tb->page_addr[1] != -1) {
             p = page_find(tb->page_addr[1] >> TARGET_PAGE_BITS);
             tb_page_remove(p, tb);
-            invalidate_page_bitmap(p);
         }
     }
 
-    /* remove the TB from the hash list */
-    h = tb_jmp_cache_hash_func(tb->pc);
-    CPU_FOREACH(cpu) {
-        if (qatomic_read(&cpu->tb_jmp_cache[h]) == tb) {
-            qatomic_set(&cpu->tb_jmp_cache[h], NULL);
+    /* remove the TB from the jump caches */
+    WITH_RCU_READ_LOCK_GUARD() {
+        CPU_FOREACH(cpu) {
+            CPUJumpCache *jc = qatomic_rcu_read(&cpu->tb_jmp_cache);
+
+            if (jc) {
+                tb_jmp_cache_remove(jc, tb);
+            }
         }
     }
 
@@ -1246,30 +1261,42 @@ void tb_phys_invalidate(TranslationBlock *tb, tb_page_addr_t page_addr)
 }
 
 #ifdef CONFIG_SOFTMMU
-/* call with @p->lock held */
+/* mark the bytes of page @n of @tb in the code bitmap of @p */
+static void page_bitmap_add_tb(PageDesc *p, TranslationBlock *tb, int n)
+{
+    int tb_start, tb_end;
+
+    /* NOTE: this is subtle as a TB may span two physical pages */
+    if (n == 0) {
+        /* NOTE: tb_end may be after the end of the page, but
+           it is not a problem */
+        tb_start = tb->pc & ~TARGET_PAGE_MASK;
+        tb_end = tb_start + tb->size;
+        if (tb_end > TARGET_PAGE_SIZE) {
+            tb_end = TARGET_PAGE_SIZE;
+        }
+    } else {
+        tb_start = 0;
+        tb_end = ((tb->pc + tb->size) & ~TARGET_PAGE_MASK);
+    }
+    bitmap_set(p->code_bitmap, tb_start, tb_end - tb_start);
+}
+
+/* (re)build the code bitmap from scratch; call with @p->lock held */
 static void build_page_bitmap(PageDesc *p)
 {
-    int n, tb_start, tb_end;
     TranslationBlock *tb;
+    int n;
 
     assert_page_locked(p);
-    p->code_bitmap = bitmap_new(TARGET_PAGE_SIZE);
+    if (p->code_bitmap) {
+        bitmap_zero(p->code_bitmap, TARGET_PAGE_SIZE);
+    } else {
+        p->code_bitmap = bitmap_new(TARGET_PAGE_SIZE);
+    }
 
     PAGE_FOR_EACH_TB(p, tb, n) {
-        /* NOTE: this is subtle as a TB may span two physical pages */
-        if (n == 0) {
-            /* NOTE: tb_end may be after the end of the page, but
-               it is not a problem */
-            tb_start = tb->pc & ~TARGET_PAGE_MASK;
-            tb_end = tb_start + tb->size;
-            if (tb_end > TARGET_PAGE_SIZE) {
-                tb_end = TARGET_PAGE_SIZE;
-             }
-        } else {
-            tb_start = 0;
-            tb_end = ((tb->pc + tb->size) & ~TARGET_PAGE_MASK);
-        }
-        bitmap_set(p->code_bitmap, tb_start, tb_end - tb_start);
+        page_bitmap_add_tb(p, tb, n);
     }
 }
 #endif
@@ -1294,7 +1321,11 @@ static inline void tb_page_add(PageDesc *p, TranslationBlock *tb,
     page_already_protected = p->first_tb != (uintptr_t)NULL;
 #endif
     p->first_tb = (uintptr_t)tb | n;
-    invalidate_page_bitmap(p);
+#ifdef CONFIG_SOFTMMU
+    if (p->code_bitmap) {
+        page_bitmap_add_tb(p, tb, n);
+    }
+#endif
 
 #if defined(CONFIG_USER_ONLY)
     /* translator_loop() must have made all TB pages non-writable */
@@ -1356,10 +1387,8 @@ tb_link_page(TranslationBlock *tb, tb_page_addr_t phys_pc,
     /* remove TB from the page(s) if we couldn't insert it */
     if (unlikely(existing_tb)) {
         tb_page_remove(p, tb);
-        invalidate_page_bitmap(p);
         if (p2) {
             tb_page_remove(p2, tb);
-            invalidate_page_bitmap(p2);
         }
         tb = existing_tb;
     }
@@ -1377,12 +1406,150 @@ tb_link_page(TranslationBlock *tb, tb_page_addr_t phys_pc,
     return tb;
 }
 
+/*
+ * Translations in progress.
+ *
+ * When vCPUs miss on the same code at the same time, typically while the
+ * secondary CPUs run through the same kernel paths at boot, each of them
+ * would translate it and all but one would throw the result away in
+ * tb_link_page().  Instead, the first vCPU records the translation it is
+ * doing, and the others wait for it to be linked and then use it.
+ */
+typedef struct TBPending {
+    tb_page_addr_t phys_pc;
+    target_ulong pc;
+    target_ulong cs_base;
+    uint32_t flags;
+    uint32_t cflags;
+    uint32_t trace_vcpu_dstate;
+    QLIST_ENTRY(TBPending) next;
+} TBPending;
+
+/* A thread translates one TB at a time */
+static __thread TBPending tb_pending_self;
+static __thread bool tb_pending_claimed;
+
+/*
+ * Return the TB for this key if another vCPU has translated it, waiting
+ * for its translation if it is in progress.  Otherwise return NULL; the
+ * caller then translates it and must call tb_gen_release() afterwards.
+ */
+static TranslationBlock *tb_gen_claim(CPUState *cpu, tb_page_addr_t phys_pc,
+                                      target_ulong pc, target_ulong cs_base,
+                                      uint32_t flags, uint32_t cflags)
+{
+    TBPending *p = &tb_pending_self;
+    TranslationBlock *tb;
+    TBPending *q;
+
+    p->phys_pc = phys_pc;
+    p->pc = pc;
+    p->cs_base = cs_base;
+    p->flags = flags;
+    p->cflags = cflags;
+    p->trace_vcpu_dstate = *cpu->trace_dstate;
+
+    while (true) {
+        /*
+         * The lookup may fill the TLB, so it is done outside the lock.
+         * A translation that completes right after it is simply done
+         * twice, as it would be without this tracking.
+         */
+        tb = tb_htable_lookup(cpu, pc, cs_base, flags, cflags);
+        if (tb) {
+            return tb;
+        }
+
+        qemu_mutex_lock(&tb_ctx.pending_lock);
+        QLIST_FOREACH(q, &tb_ctx.pending, next) {
+            if (q->phys_pc == p->phys_pc && q->pc == p->pc &&
+                q->cs_base == p->cs_base && q->flags == p->flags &&
+                q->cflags == p->cflags &&
+                q->trace_vcpu_dstate == p->trace_vcpu_dstate) {
+                break;
+            }
+        }
+        if (q == NULL) {
+            QLIST_INSERT_HEAD(&tb_ctx.pending, p, next);
+            tb_pending_claimed = true;
+            qemu_mutex_unlock(&tb_ctx.pending_lock);
+            return NULL;
+        }
+        qatomic_inc(&tb_ctx.tb_wait_count);
+        trace_translate_wait(pc);
+        qemu_cond_wait(&tb_ctx.pending_cond, &tb_ctx.pending_lock);
+        qemu_mutex_unlock(&tb_ctx.pending_lock);
+    }
+}
+
+/*
+ * Drop the translation claimed by this thread, if any.  Also called by
+ * cpu_exec() when the translation was abandoned with a longjmp.
+ */
+void tb_gen_release(void)
+{
+    if (!tb_pending_claimed) {
+        return;
+    }
+    qemu_mutex_lock(&tb_ctx.pending_lock);
+    QLIST_REMOVE(&tb_pending_self, next);
+    tb_pending_claimed = false;
+    qemu_cond_broadcast(&tb_ctx.pending_cond);
+    qemu_mutex_unlock(&tb_ctx.pending_lock);
+}
+
+static void tb_init_jumps(TranslationBlock *tb)
+{
+    qemu_spin_init(&tb->jmp_lock);
+    tb->jmp_list_head = (uintptr_t)NULL;
+    tb->jmp_list_next[0] = (uintptr_t)NULL;
+    tb->jmp_list_next[1] = (uintptr_t)NULL;
+    tb->jmp_dest[0] = (uintptr_t)NULL;
+    tb->jmp_dest[1] = (uintptr_t)NULL;
+
+    /* init original jump addresses which have been set during tcg_gen_code() */
+    if (tb->jmp_reset_offset[0] != TB_JMP_RESET_OFFSET_INVALID) {
+        tb_reset_jump(tb, 0);
+    }
+    if (tb->jmp_reset_offset[1] != TB_JMP_RESET_OFFSET_INVALID) {
+        tb_reset_jump(tb, 1);
+    }
+}
+
+/*
+ * Link a TB restored from the persistent translation cache, the same
+ * way tb_gen_code() links a new translation.
+ */
+static TranslationBlock *tb_link_cached(CPUArchState *env,
+                                        TranslationBlock *tb,
+                                        tb_page_addr_t phys_pc)
+{
+    TranslationBlock *existing_tb;
+    target_ulong virt_page2;
+    tb_page_addr_t phys_page2;
+
+    tb_init_jumps(tb);
+    tcg_tb_insert(tb);
+
+    virt_page2 = (tb->pc + tb->size - 1) & TARGET_PAGE_MASK;
+    phys_page2 = -1;
+    if ((tb->pc & TARGET_PAGE_MASK) != virt_page2) {
+        phys_page2 = get_page_addr_code(env, virt_page2);
+    }
+    existing_tb = tb_link_page(tb, phys_pc, phys_page2);
+    if (unlikely(existing_tb != tb)) {
+        tcg_tb_remove(tb);
+    }
+    return existing_tb;
+}
+
 /* Called with mmap_lock held for user mode emulation.  */
 TranslationBlock *tb_gen_code(CPUState *cpu,
                               target_ulong pc, target_ulong cs_base,
                               uint32_t flags, int cflags)
 {
     CPUArchState *env = cpu->env_ptr;
+    TranslatorTrace *trace = tcg_ctx->trace;
     TranslationBlock *tb, *existing_tb;
     tb_page_addr_t phys_pc, phys_page2;
     target_ulong virt_page2;
@@ -1396,11 +1563,26 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
     assert_memory_lock();
     qemu_thread_jit_write();
 
+    /* Set again for each attempt at translating the trace below.  */
+    tcg_ctx->trace = NULL;
+
     phys_pc = get_page_addr_code(env, pc);
 
     if (phys_pc == -1) {
         /* Generate a one-shot TB with 1 insn in it */
         cflags = (cflags & ~CF_COUNT_MASK) | CF_LAST_IO | 1;
+        trace = NULL;
+    } else if (!trace) {
+        tb = tb_gen_claim(cpu, phys_pc, pc, cs_base, flags, cflags);
+        if (tb) {
+            return tb;
+        }
+        tb = tb_cache_lookup(cpu, phys_pc, pc, cs_base, flags, cflags);
+        if (tb) {
+            tb = tb_link_cached(env, tb, phys_pc);
+            tb_gen_release();
+            return tb;
+        }
     }
 
     max_insns = cflags & CF_COUNT_MASK;
@@ -1427,6 +1609,7 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
     tb->flags = flags;
     tb->cflags = cflags;
     tb->trace_vcpu_dstate = *cpu->trace_dstate;
+    tb->exec_count = 0;
     tcg_ctx->tb_cflags = cflags;
  tb_overflow:
 
@@ -1443,6 +1626,8 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
 
     tcg_func_start(tcg_ctx);
 
+    tcg_ctx->tb_nocache = false;
+    tcg_ctx->trace = trace;
     tcg_ctx->cpu = env_cpu(env);
     gen_intermediate_code(cpu, tb, max_insns);
     assert(tb->size != 0);
@@ -1604,20 +1789,7 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
                  CODE_GEN_ALIGN));
 
     /* init jump list */
-    qemu_spin_init(&tb->jmp_lock);
-    tb->jmp_list_head = (uintptr_t)NULL;
-    tb->jmp_list_next[0] = (uintptr_t)NULL;
-    tb->jmp_list_next[1] = (uintptr_t)NULL;
-    tb->jmp_dest[0] = (uintptr_t)NULL;
-    tb->jmp_dest[1] = (uintptr_t)NULL;
-
-    /* init original jump addresses which have been set during tcg_gen_code() */
-    if (tb->jmp_reset_offset[0] != TB_JMP_RESET_OFFSET_INVALID) {
-        tb_reset_jump(tb, 0);
-    }
-    if (tb->jmp_reset_offset[1] != TB_JMP_RESET_OFFSET_INVALID) {
-        tb_reset_jump(tb, 1);
-    }
+    tb_init_jumps(tb);
 
     /*
      * If the TB is not associated with a physical RAM page then
@@ -1655,11 +1827,132 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
         orig_aligned -= ROUND_UP(sizeof(*tb), qemu_icache_linesize);
         qatomic_set(&tcg_ctx->code_gen_ptr, (void *)orig_aligned);
         tcg_tb_remove(tb);
+        tb_gen_release();
         return existing_tb;
     }
+    if (unlikely(tcg_ctx->tb_nocache)) {
+        tb_cache_exclude(tb);
+    }
+    tb_gen_release();
     return tb;
 }
 
+/*
+ * Hot traces.
+ *
+ * With a non-zero threshold, each TB counts its executions and, when it
+ * reaches the threshold, asks cpu_exec() to look for the path that goes
+ * on from it through its most executed chained exits.  The path is then
+ * translated again as a single TB that replaces the head, so that the
+ * optimizer and the register allocator work across the blocks, and only
+ * the exits off the path leave the trace.
+ */
+unsigned int tb_trace_threshold;
+
+/* Return the most executed TB chained from @tb, and its exit in @hot.  */
+static TranslationBlock *tb_trace_next(TranslationBlock *tb, int *hot)
+{
+    TranslationBlock *next = NULL;
+    int n;
+
+    qemu_spin_lock(&tb->jmp_lock);
+    for (n = 0; n < 2; n++) {
+        uintptr_t dest = tb->jmp_dest[n];
+        TranslationBlock *succ = (TranslationBlock *)(dest & ~(uintptr_t)1);
+
+        if (dest & 1) {
+            /* @tb is being invalidated */
+            next = NULL;
+            break;
+        }
+        if (succ && (!next || qatomic_read(&succ->exec_count) >
+                              qatomic_read(&next->exec_count))) {
+            next = succ;
+            *hot = n;
+        }
+    }
+    qemu_spin_unlock(&tb->jmp_lock);
+    return next;
+}
+
+static bool tb_trace_fits(const TranslatorTrace *trace,
+                          const TranslationBlock *head,
+                          const TranslationBlock *tb, int icount)
+{
+    int i;
+
+    /*
+     * The trace is looked up, invalidated and restored as the head, so
+     * every block must be translated in the same context and lie within
+     * the range of guest code covered by the head.
+     */
+    if (tb->trace_blocks || tb_cflags(tb) != tb_cflags(head) ||
+        tb->cs_base != head->cs_base || tb->flags != head->flags ||
+        tb->pc < head->pc || ((tb->pc ^ head->pc) & TARGET_PAGE_MASK) ||
+        tb->page_addr[0] != head->page_addr[0] || tb->page_addr[1] != -1) {
+        return false;
+    }
+    if (icount + tb->icount > TCG_MAX_INSNS) {
+        return false;
+    }
+    for (i = 0; i < trace->nb_blocks; i++) {
+        if (trace->blocks[i].pc == tb->pc) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Called from cpu_exec() when cpu->tb_hot is set.  */
+void tb_gen_trace(CPUState *cpu)
+{
+    TranslationBlock *head = cpu->tb_hot;
+    TranslationBlock *tb, *next;
+    TranslatorTrace trace;
+    int icount = 0, hot;
+
+    cpu->tb_hot = NULL;
+
+    mmap_lock();
+    if ((tb_cflags(head) & CF_INVALID) || head->page_addr[1] != -1) {
+        goto out;
+    }
+
+    trace.nb_blocks = 0;
+    for (tb = head; tb; tb = next) {
+        int i = trace.nb_blocks++;
+
+        trace.blocks[i].pc = tb->pc;
+        trace.blocks[i].icount = tb->icount;
+        trace.blocks[i].hot = -1;
+        icount += tb->icount;
+
+        if (trace.nb_blocks == TB_TRACE_MAX_BLOCKS) {
+            break;
+        }
+        next = tb_trace_next(tb, &hot);
+        if (next && tb_trace_fits(&trace, head, next, icount)) {
+            trace.blocks[i].hot = hot;
+        } else {
+            next = NULL;
+        }
+    }
+    if (trace.nb_blocks < 2) {
+        goto out;
+    }
+
+    /* Make room for the trace under the key of the head.  */
+    tb_phys_invalidate(head, -1);
+    tcg_ctx->trace = &trace;
+    tb = tb_gen_code(cpu, head->pc, head->cs_base, head->flags,
+                     tb_cflags(head));
+    trace_translate_trace(tb, tb->pc, tb->trace_blocks, tb->icount);
+    tb_jmp_cache_insert(cpu->tb_jmp_cache, tb);
+
+ out:
+    mmap_unlock();
+}
+
 /*
  * @p must be non-NULL.
  * user-mode: call with mmap_lock held.
@@ -1812,44 +2105,67 @@ void tb_invalidate_phys_range(target_ulong start, target_ulong end)
 }
 
 #ifdef CONFIG_SOFTMMU
+/*
+ * Return true if a write of @len bytes at @start may hit translated code
+ * in @p. Call with @p->lock held.
+ */
+static bool page_code_write_hit(PageDesc *p, tb_page_addr_t start, int len)
+{
+    unsigned int nr;
+    unsigned long b;
+
+    assert_page_locked(p);
+    if (!p->first_tb) {
+        /* let the caller drop the stale bitmap and unprotect the page */
+        return true;
+    }
+    if (!p->code_bitmap) {
+        if (++p->code_write_count < SMC_BITMAP_USE_THRESHOLD) {
+            return true;
+        }
+        build_page_bitmap(p);
+    }
+    nr = start & ~TARGET_PAGE_MASK;
+    b = p->code_bitmap[BIT_WORD(nr)] >> (nr & (BITS_PER_LONG - 1));
+    return b & ((1 << len) - 1);
+}
+
 /* len must be <= 8 and start must be a multiple of len.
  * Called via softmmu_template.h when code areas are written to with
  * iothread mutex not held.
  *
- * Call with all @pages in the range [@start, @start + len[ locked.
+ * Writes that miss the code of the page (JITs writing data next to
+ * their code, or patching one stub among many) only take the lock of
+ * the written page. The locks of all the pages spanned by the TBs
+ * here are only taken when a TB has to go.
  */
-void tb_invalidate_phys_page_fast(struct page_collection *pages,
-                                  tb_page_addr_t start, int len,
+void tb_invalidate_phys_page_fast(tb_page_addr_t start, int len,
                                   uintptr_t retaddr)
 {
+    struct page_collection *pages;
     PageDesc *p;
-
-    assert_memory_lock();
+    bool hit;
 
     p = page_find(start >> TARGET_PAGE_BITS);
     if (!p) {
         return;
     }
 
-    assert_page_locked(p);
-    if (!p->code_bitmap &&
-        ++p->code_write_count >= SMC_BITMAP_USE_THRESHOLD) {
-        build_page_bitmap(p);
+    page_lock(p);
+    hit = page_code_write_hit(p, start, len);
+    page_unlock(p);
+    if (!hit) {
+        return;
     }
-    if (p->code_bitmap) {
-        unsigned int nr;
-        unsigned long b;
 
-        nr = start & ~TARGET_PAGE_MASK;
-        b = p->code_bitmap[BIT_WORD(nr)] >> (nr & (BITS_PER_LONG - 1));
-        if (b & ((1 << len) - 1)) {
-            goto do_invalidate;
-        }
-    } else {
-    do_invalidate:
-        tb_invalidate_phys_page_range__locked(pages, p, start, start + len,
-                                              retaddr);
+    pages = page_collection_lock(start, start + len);
+    tb_invalidate_phys_page_range__locked(pages, p, start, start + len,
+                                          retaddr);
+    /* drop the bits of the TBs just invalidated */
+    if (p->code_bitmap) {
+        build_page_bitmap(p);
     }
+    page_collection_unlock(pages);
 }
 #else
 /* Called with mmap_lock held. If pc is not 0 then it indicates the
@@ -2071,6 +2387,34 @@ static gboolean tb_tree_stats_iter(gpointer key, gpointer value, gpointer data)
     return false;
 }
 
+static void dump_jmp_cache_info(GString *buf)
+{
+    size_t hits = 0, victim_hits = 0, misses = 0, lookups;
+    CPUState *cpu;
+
+    RCU_READ_LOCK_GUARD();
+    CPU_FOREACH(cpu) {
+        CPUJumpCache *jc = qatomic_rcu_read(&cpu->tb_jmp_cache);
+
+        if (!jc) {
+            continue;
+        }
+        hits += qatomic_read(&jc->hits);
+        victim_hits += qatomic_read(&jc->victim_hits);
+        misses += qatomic_read(&jc->misses);
+    }
+    lookups = hits + victim_hits + misses;
+
+    g_string_append_printf(buf, "jmp cache           %u sets x %d ways, "
+                           "%d victims per vCPU\n",
+                           1u << tb_jmp_cache_bits, TB_JMP_CACHE_WAYS,
+                           TB_JMP_VICTIM_SIZE);
+    g_string_append_printf(buf, "jmp cache lookups   %zu hit %zu%% "
+                           "victim hit %zu%%\n", lookups,
+                           lookups ? hits * 100 / lookups : 0,
+                           lookups ? victim_hits * 100 / lookups : 0);
+}
+
 void dump_exec_info(GString *buf)
 {
     struct tb_tree_stats tst = {};
@@ -2116,6 +2460,9 @@ void dump_exec_info(GString *buf)
                            qatomic_read(&tb_ctx.tb_flush_count));
     g_string_append_printf(buf, "TB invalidate count %u\n",
                            qatomic_read(&tb_ctx.tb_phys_invalidate_count));
+    g_string_append_printf(buf, "TB wait count       %u\n",
+                           qatomic_read(&tb_ctx.tb_wait_count));
+    dump_jmp_cache_info(buf);
 
     tlb_flush_counts(&flush_full, &flush_part, &flush_elide);
     g_string_append_printf(buf, "TLB full flushes    %zu\n", flush_full);
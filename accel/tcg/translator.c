@@ -17,6 +17,7 @@
 #include "exec/translator.h"
 #include "exec/plugin-gen.h"
 #include "sysemu/replay.h"
+#include "internal.h"
 
 /* Pairs with tcg_clear_temp_count.
    To be called by #TranslatorOps.{translate_insn,tb_stop} if
@@ -51,90 +52,231 @@ static inline void translator_page_protect(DisasContextBase *dcbase,
 #endif
 }
 
+/*
+ * Count the executions of a TB and, once it gets hot, ask the main loop
+ * to form a trace starting at it, see tb_gen_trace().
+ */
+static void gen_tb_count(TranslationBlock *tb)
+{
+    TCGv_ptr ptr = tcg_constant_ptr(tb);
+    TCGv_i32 count = tcg_temp_new_i32();
+    TCGLabel *cold = gen_new_label();
+
+    tcg_gen_ld_i32(count, ptr, offsetof(TranslationBlock, exec_count));
+    tcg_gen_addi_i32(count, count, 1);
+    tcg_gen_st_i32(count, ptr, offsetof(TranslationBlock, exec_count));
+    tcg_gen_brcondi_i32(TCG_COND_NE, count, tb_trace_threshold, cold);
+    gen_helper_tb_hot(cpu_env, ptr);
+    gen_set_label(cold);
+    tcg_temp_free_i32(count);
+}
+
+static bool translator_count_tb(uint32_t cflags)
+{
+    return tb_trace_threshold &&
+           !(cflags & (CF_COUNT_MASK | CF_NO_GOTO_TB | CF_SINGLE_STEP |
+                       CF_LAST_IO | CF_MEMI_ONLY | CF_USE_ICOUNT | CF_NOIRQ));
+}
+
+/*
+ * Route the exits of block @i of @trace: the hot one falls through to
+ * the next block, unless this is the last block.  Targets emit exits
+ * from translate_insn as well as from tb_stop, so this must be done
+ * before translating the first instruction of the block.
+ */
+static void translator_trace_exits(TranslatorTrace *trace, int i, bool last)
+{
+    tcg_ctx->trace_exits = true;
+    tcg_ctx->trace_hot = trace->blocks[i].hot;
+    tcg_ctx->trace_next = last ? NULL : gen_new_label();
+    tcg_ctx->trace_slot[0] = -1;
+    tcg_ctx->trace_slot[1] = -1;
+}
+
+/*
+ * End the trace with the current block, whose hot exit may already
+ * branch to the next block: exits emitted from now on take the exits
+ * of the trace.  Returns the label of the dropped next block, if any.
+ */
+static TCGLabel *translator_trace_cut(void)
+{
+    TCGLabel *next = tcg_ctx->trace_next;
+
+    tcg_ctx->trace_next = NULL;
+    return next;
+}
+
+/*
+ * Start the next block of a trace.  If the previous block ended with
+ * the branch to it, drop the branch so that both blocks stay in the
+ * same basic block for the optimizer.
+ */
+static void translator_trace_link(void)
+{
+    TCGLabel *next = tcg_ctx->trace_next;
+    TCGOp *op = tcg_last_op();
+
+    if (op->opc == INDEX_op_br && arg_label(op->args[0]) == next) {
+        tcg_op_remove(tcg_ctx, op);
+    }
+    gen_set_label(next);
+}
+
+/*
+ * Resolve the branches to the block dropped by translator_trace_cut():
+ * the guest pc is already stored, so look the block up.
+ */
+static void translator_trace_unlink(TCGLabel *next)
+{
+    if (next && next->refs) {
+        gen_set_label(next);
+        tcg_gen_lookup_and_goto_ptr();
+    }
+}
+
 void translator_loop(const TranslatorOps *ops, DisasContextBase *db,
                      CPUState *cpu, TranslationBlock *tb, int max_insns)
 {
     uint32_t cflags = tb_cflags(tb);
-    bool plugin_enabled;
-
-    /* Initialize DisasContext */
-    db->tb = tb;
-    db->pc_first = tb->pc;
-    db->pc_next = db->pc_first;
-    db->is_jmp = DISAS_NEXT;
-    db->num_insns = 0;
-    db->max_insns = max_insns;
-    db->singlestep_enabled = cflags & CF_SINGLE_STEP;
-    translator_page_protect(db, db->pc_next);
-
-    ops->init_disas_context(db, cpu);
-    tcg_debug_assert(db->is_jmp == DISAS_NEXT);  /* no early exit */
-
-    /* Reset the temp count so that we can identify leaks */
-    tcg_clear_temp_count();
-
-    /* Start translating.  */
-    gen_tb_start(db->tb);
-    ops->tb_start(db, cpu);
-    tcg_debug_assert(db->is_jmp == DISAS_NEXT);  /* no early exit */
-
-    plugin_enabled = plugin_gen_tb_start(cpu, tb, cflags & CF_MEMI_ONLY);
-
-    while (true) {
-        db->num_insns++;
-        ops->insn_start(db, cpu);
+    TranslatorTrace *trace = tcg_ctx->trace;
+    target_ulong head = tb->pc, end = tb->pc;
+    TCGLabel *cut = NULL;
+    int i, nb_blocks = 1, total_insns = 0, block_insns = max_insns;
+    bool plugin_enabled = false;
+
+    /* Consumed by this translation only.  */
+    tcg_ctx->trace = NULL;
+    if (trace) {
+        tcg_ctx->trace_nb_slots = 0;
+        nb_blocks = trace->nb_blocks;
+    }
+
+    for (i = 0; i < nb_blocks; i++) {
+        if (trace) {
+            /* Translate the block as if it was a TB of its own.  */
+            tb->pc = trace->blocks[i].pc;
+            block_insns = MIN(max_insns - total_insns,
+                              trace->blocks[i].icount);
+        }
+
+        /* Initialize DisasContext */
+        db->tb = tb;
+        db->pc_first = tb->pc;
+        db->pc_next = db->pc_first;
+        db->is_jmp = DISAS_NEXT;
+        db->num_insns = 0;
+        db->max_insns = block_insns;
+        db->singlestep_enabled = cflags & CF_SINGLE_STEP;
+        translator_page_protect(db, db->pc_next);
+
+        ops->init_disas_context(db, cpu);
+        tcg_debug_assert(db->is_jmp == DISAS_NEXT);  /* no early exit */
+
+        if (i == 0) {
+            /* Reset the temp count so that we can identify leaks */
+            tcg_clear_temp_count();
+
+            /* Start translating.  */
+            gen_tb_start(db->tb);
+        }
+        ops->tb_start(db, cpu);
         tcg_debug_assert(db->is_jmp == DISAS_NEXT);  /* no early exit */
 
-        if (plugin_enabled) {
-            plugin_gen_insn_start(cpu, db);
+        if (i == 0) {
+            plugin_enabled = plugin_gen_tb_start(cpu, tb,
+                                                 cflags & CF_MEMI_ONLY);
+            if (plugin_enabled) {
+                /* Instrumentation refers to the plugin data of this run */
+                tcg_set_tb_nocache();
+                /* and covers one block at a time */
+                nb_blocks = 1;
+            } else if (!trace && translator_count_tb(cflags)) {
+                gen_tb_count(tb);
+            }
         }
 
-        /* Disassemble one instruction.  The translate_insn hook should
-           update db->pc_next and db->is_jmp to indicate what should be
-           done next -- either exiting this loop or locate the start of
-           the next instruction.  */
-        if (db->num_insns == db->max_insns && (cflags & CF_LAST_IO)) {
-            /* Accept I/O on the last instruction.  */
-            gen_io_start();
-            ops->translate_insn(db, cpu);
-        } else {
-            /* we should only see CF_MEMI_ONLY for io_recompile */
-            tcg_debug_assert(!(cflags & CF_MEMI_ONLY));
-            ops->translate_insn(db, cpu);
+        if (trace) {
+            translator_trace_exits(trace, i, i + 1 == nb_blocks);
         }
 
-        /* Stop translation if translate_insn so indicated.  */
-        if (db->is_jmp != DISAS_NEXT) {
-            break;
+        while (true) {
+            db->num_insns++;
+            ops->insn_start(db, cpu);
+            tcg_debug_assert(db->is_jmp == DISAS_NEXT);  /* no early exit */
+
+            if (plugin_enabled) {
+                plugin_gen_insn_start(cpu, db);
+            }
+
+            /* Disassemble one instruction.  The translate_insn hook should
+               update db->pc_next and db->is_jmp to indicate what should be
+               done next -- either exiting this loop or locate the start of
+               the next instruction.  */
+            if (db->num_insns == db->max_insns && (cflags & CF_LAST_IO)) {
+                /* Accept I/O on the last instruction.  */
+                gen_io_start();
+                ops->translate_insn(db, cpu);
+            } else {
+                /* we should only see CF_MEMI_ONLY for io_recompile */
+                tcg_debug_assert(!(cflags & CF_MEMI_ONLY));
+                ops->translate_insn(db, cpu);
+            }
+
+            /* Stop translation if translate_insn so indicated.  */
+            if (db->is_jmp != DISAS_NEXT) {
+                break;
+            }
+
+            /*
+             * We can't instrument after instructions that change control
+             * flow although this only really affects post-load operations.
+             */
+            if (plugin_enabled) {
+                plugin_gen_insn_end();
+            }
+
+            /* Stop translation if the output buffer is full,
+               or we have executed all of the allowed instructions.  */
+            if (tcg_op_buf_full() || db->num_insns >= db->max_insns) {
+                db->is_jmp = DISAS_TOO_MANY;
+                break;
+            }
         }
 
         /*
-         * We can't instrument after instructions that change control
-         * flow although this only really affects post-load operations.
+         * A block cut short does not end with the exits recorded for it,
+         * so the trace cannot go on past it.
          */
-        if (plugin_enabled) {
-            plugin_gen_insn_end();
+        if (trace && i + 1 < nb_blocks &&
+            (db->num_insns < trace->blocks[i].icount ||
+             total_insns + db->num_insns >= max_insns)) {
+            nb_blocks = i + 1;
+            cut = translator_trace_cut();
         }
 
-        /* Stop translation if the output buffer is full,
-           or we have executed all of the allowed instructions.  */
-        if (tcg_op_buf_full() || db->num_insns >= db->max_insns) {
-            db->is_jmp = DISAS_TOO_MANY;
-            break;
+        /* Emit code to exit the TB, as indicated by db->is_jmp.  */
+        ops->tb_stop(db, cpu);
+
+        if (trace && i + 1 < nb_blocks) {
+            translator_trace_link();
         }
+        end = MAX(end, db->pc_next);
+        total_insns += db->num_insns;
     }
-
-    /* Emit code to exit the TB, as indicated by db->is_jmp.  */
-    ops->tb_stop(db, cpu);
-    gen_tb_end(db->tb, db->num_insns);
+    translator_trace_unlink(cut);
+    tcg_ctx->trace_exits = false;
+    gen_tb_end(db->tb, total_insns);
 
     if (plugin_enabled) {
         plugin_gen_tb_end(cpu);
     }
 
     /* The disas_log hook may use these values rather than recompute.  */
-    tb->size = db->pc_next - db->pc_first;
-    tb->icount = db->num_insns;
+    tb->pc = head;
+    db->pc_first = head;
+    tb->size = end - head;
+    tb->icount = total_insns;
+    tb->trace_blocks = trace ? nb_blocks : 0;
 
 #ifdef DEBUG_DISAS
     if (qemu_loglevel_mask(CPU_LOG_TB_IN_ASM)
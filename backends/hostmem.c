@@ -20,6 +20,7 @@
 #include "qom/object_interfaces.h"
 #include "qemu/mmap-alloc.h"
 #include "qemu/madvise.h"
+#include "trace.h"
 
 #ifdef CONFIG_NUMA
 #include <numaif.h>
@@ -232,7 +233,8 @@ static void host_memory_backend_set_prealloc(Object *obj, bool value,
         void *ptr = memory_region_get_ram_ptr(&backend->mr);
         uint64_t sz = memory_region_size(&backend->mr);
 
-        os_mem_prealloc(fd, ptr, sz, backend->prealloc_threads, &local_err);
+        os_mem_prealloc(fd, ptr, sz, backend->prealloc_threads,
+                        backend->host_nodes, MAX_NODES, false, &local_err);
         if (local_err) {
             error_propagate(errp, local_err);
             return;
@@ -391,10 +393,19 @@ host_memory_backend_memory_complete(UserCreatable *uc, Error **errp)
         /* Preallocate memory after the NUMA policy has been instantiated.
          * This is necessary to guarantee memory is allocated with
          * specified NUMA policy in place.
+         *
+         * Until the machine is ready, let the preallocation run in the
+         * background; qemu_machine_creation_done() waits for it.
          */
         if (backend->prealloc) {
+            bool async = !phase_check(PHASE_MACHINE_READY);
+
+            trace_host_memory_backend_prealloc(
+                object_get_canonical_path_component(OBJECT(backend)),
+                ptr, sz, async);
             os_mem_prealloc(memory_region_get_fd(&backend->mr), ptr, sz,
-                            backend->prealloc_threads, &local_err);
+                            backend->prealloc_threads, backend->host_nodes,
+                            MAX_NODES, async, &local_err);
             if (local_err) {
                 goto out;
             }
@@ -18,6 +18,8 @@
 QEMU_PLUGIN_EXPORT int qemu_plugin_version = QEMU_PLUGIN_VERSION;
 
 static bool do_inline;
+static int max_vcpus = 1;
+static size_t vcpu_stride;
 
 /* Plugins need to take care of their own locking */
 static GMutex lock;
@@ -31,14 +33,31 @@ static guint64 limit = 20;
  * get the starting PC for each block. We cheat this slightly by
  * xor'ing the number of instructions to the hash to help
  * differentiate.
+ *
+ * When inlining, each vCPU counts into its own slot of vcpu_count so
+ * that MTTCG runs do not lose increments; the slots are summed into
+ * exec_count at exit.
  */
 typedef struct {
     uint64_t start_addr;
     uint64_t exec_count;
+    uint64_t *vcpu_count;
     int      trans_count;
     unsigned long insns;
 } ExecCount;
 
+static void sum_vcpu_count(gpointer key, gpointer value, gpointer user_data)
+{
+    ExecCount *cnt = (ExecCount *) value;
+    int i;
+
+    if (cnt->vcpu_count) {
+        for (i = 0; i < max_vcpus; i++) {
+            cnt->exec_count += cnt->vcpu_count[i];
+        }
+    }
+}
+
 static gint cmp_exec_count(gconstpointer a, gconstpointer b)
 {
     ExecCount *ea = (ExecCount *) a;
@@ -55,6 +74,7 @@ static void plugin_exit(qemu_plugin_id_t id, void *p)
     g_mutex_lock(&lock);
     g_string_append_printf(report, "%d entries in the hash table\n",
                            g_hash_table_size(hotblocks));
+    g_hash_table_foreach(hotblocks, sum_vcpu_count, NULL);
     counts = g_hash_table_get_values(hotblocks);
     it = g_list_sort(counts, cmp_exec_count);
 
@@ -114,14 +134,18 @@ static void vcpu_tb_trans(qemu_plugin_id_t id, struct qemu_plugin_tb *tb)
         cnt->start_addr = pc;
         cnt->trans_count = 1;
         cnt->insns = insns;
+        if (do_inline) {
+            cnt->vcpu_count = g_new0(uint64_t, max_vcpus);
+        }
         g_hash_table_insert(hotblocks, (gpointer) hash, (gpointer) cnt);
     }
 
     g_mutex_unlock(&lock);
 
     if (do_inline) {
-        qemu_plugin_register_vcpu_tb_exec_inline(tb, QEMU_PLUGIN_INLINE_ADD_U64,
-                                                 &cnt->exec_count, 1);
+        qemu_plugin_register_vcpu_tb_exec_inline_per_vcpu(
+            tb, QEMU_PLUGIN_INLINE_ADD_U64, cnt->vcpu_count,
+            vcpu_stride, 1);
     } else {
         qemu_plugin_register_vcpu_tb_exec_cb(tb, vcpu_tb_exec,
                                              QEMU_PLUGIN_CB_NO_REGS,
@@ -147,6 +171,15 @@ int qemu_plugin_install(qemu_plugin_id_t id, const qemu_info_t *info,
         }
     }
 
+    /*
+     * User-mode vCPUs are created on demand, so there is no bound on
+     * their index: they all share the first slot there.
+     */
+    if (info->system_emulation) {
+        max_vcpus = info->system.max_vcpus;
+        vcpu_stride = sizeof(uint64_t);
+    }
+
     plugin_init();
 
     qemu_plugin_register_vcpu_tb_trans_cb(id, vcpu_tb_trans);
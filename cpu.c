@@ -135,6 +135,10 @@ void cpu_exec_realizefn(CPUState *cpu, Error **errp)
     CPUClass *cc = CPU_GET_CLASS(cpu);
 #endif
 
+    /* CPU_FOREACH walkers may look at the jump cache as soon as it is listed */
+    if (tcg_enabled()) {
+        tcg_exec_jmp_cache_init(cpu);
+    }
     cpu_list_add(cpu);
     if (!accel_cpu_realizefn(cpu, errp)) {
         return;
@@ -174,6 +178,9 @@ void cpu_exec_unrealizefn(CPUState *cpu)
     }
 
     cpu_list_remove(cpu);
+    if (tcg_enabled()) {
+        tcg_exec_jmp_cache_free(cpu);
+    }
 }
 
 /*
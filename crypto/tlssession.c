@@ -33,6 +33,17 @@
 
 #include <gnutls/x509.h>
 
+#ifdef CONFIG_KTLS
+#include <netinet/tcp.h>
+#include <linux/tls.h>
+
+#ifndef SOL_TLS
+#define SOL_TLS 282
+#endif
+#ifndef TCP_ULP
+#define TCP_ULP 31
+#endif
+#endif
 
 struct QCryptoTLSSession {
     QCryptoTLSCreds *creds;
@@ -555,6 +566,153 @@ qcrypto_tls_session_get_peer_name(QCryptoTLSSession *session)
 }
 
 
+#ifdef CONFIG_KTLS
+/*
+ * Fill an AES-GCM crypto_info: the first bytes of the IV are the
+ * implicit salt, and the explicit part is the record sequence number
+ * for TLS 1.2 or the rest of the IV for TLS 1.3
+ */
+#define QCRYPTO_TLS_KTLS_AES_GCM(ci, type, version, iv, key, seq)          \
+    do {                                                                  \
+        (ci).info.version = (version) == GNUTLS_TLS1_3 ?                  \
+            TLS_1_3_VERSION : TLS_1_2_VERSION;                            \
+        (ci).info.cipher_type = TLS_CIPHER_ ## type;                      \
+        if ((key).size != TLS_CIPHER_ ## type ## _KEY_SIZE ||             \
+            (iv).size < TLS_CIPHER_ ## type ## _SALT_SIZE +               \
+                        ((version) == GNUTLS_TLS1_3 ?                     \
+                         TLS_CIPHER_ ## type ## _IV_SIZE : 0)) {          \
+            goto bad_state;                                               \
+        }                                                                 \
+        memcpy((ci).salt, (iv).data, TLS_CIPHER_ ## type ## _SALT_SIZE);  \
+        memcpy((ci).iv, (version) == GNUTLS_TLS1_3 ?                      \
+               (iv).data + TLS_CIPHER_ ## type ## _SALT_SIZE : (seq),     \
+               TLS_CIPHER_ ## type ## _IV_SIZE);                          \
+        memcpy((ci).rec_seq, (seq), TLS_CIPHER_ ## type ## _REC_SEQ_SIZE); \
+        memcpy((ci).key, (key).data, TLS_CIPHER_ ## type ## _KEY_SIZE);   \
+    } while (0)
+
+int
+qcrypto_tls_session_enable_ktls(QCryptoTLSSession *session,
+                                int fd,
+                                bool read,
+                                Error **errp)
+{
+    gnutls_protocol_t version = gnutls_protocol_get_version(session->handle);
+    gnutls_cipher_algorithm_t cipher = gnutls_cipher_get(session->handle);
+    gnutls_datum_t mac_key, iv, cipher_key;
+    unsigned char seq[8];
+    union {
+        struct tls12_crypto_info_aes_gcm_128 aes_gcm_128;
+        struct tls12_crypto_info_aes_gcm_256 aes_gcm_256;
+#ifdef TLS_CIPHER_CHACHA20_POLY1305
+        struct tls12_crypto_info_chacha20_poly1305 chacha20_poly1305;
+#endif
+    } info;
+    socklen_t info_len;
+    int ret;
+
+    if (!session->handshakeComplete) {
+        error_setg(errp, "TLS handshake is not complete");
+        return -1;
+    }
+
+    if (version != GNUTLS_TLS1_2 && version != GNUTLS_TLS1_3) {
+        error_setg(errp, "Kernel TLS does not support %s",
+                   gnutls_protocol_get_name(version));
+        return -1;
+    }
+
+    /* Records already decrypted by gnutls would never reach the reader */
+    if (read && gnutls_record_check_pending(session->handle)) {
+        error_setg(errp, "TLS session has pending data");
+        return -1;
+    }
+
+    ret = gnutls_record_get_state(session->handle, read, &mac_key, &iv,
+                                  &cipher_key, seq);
+    if (ret < 0) {
+        error_setg(errp, "Cannot get TLS record state: %s",
+                   gnutls_strerror(ret));
+        return -1;
+    }
+
+    memset(&info, 0, sizeof(info));
+    switch (cipher) {
+    case GNUTLS_CIPHER_AES_128_GCM:
+        QCRYPTO_TLS_KTLS_AES_GCM(info.aes_gcm_128, AES_GCM_128, version,
+                                 iv, cipher_key, seq);
+        info_len = sizeof(info.aes_gcm_128);
+        break;
+    case GNUTLS_CIPHER_AES_256_GCM:
+        QCRYPTO_TLS_KTLS_AES_GCM(info.aes_gcm_256, AES_GCM_256, version,
+                                 iv, cipher_key, seq);
+        info_len = sizeof(info.aes_gcm_256);
+        break;
+#ifdef TLS_CIPHER_CHACHA20_POLY1305
+    case GNUTLS_CIPHER_CHACHA20_POLY1305:
+        /* The whole IV is implicit, for both TLS 1.2 and 1.3 */
+        info.chacha20_poly1305.info.version = version == GNUTLS_TLS1_3 ?
+            TLS_1_3_VERSION : TLS_1_2_VERSION;
+        info.chacha20_poly1305.info.cipher_type =
+            TLS_CIPHER_CHACHA20_POLY1305;
+        if (cipher_key.size != TLS_CIPHER_CHACHA20_POLY1305_KEY_SIZE ||
+            iv.size != TLS_CIPHER_CHACHA20_POLY1305_IV_SIZE) {
+            goto bad_state;
+        }
+        memcpy(info.chacha20_poly1305.iv, iv.data,
+               TLS_CIPHER_CHACHA20_POLY1305_IV_SIZE);
+        memcpy(info.chacha20_poly1305.rec_seq, seq,
+               TLS_CIPHER_CHACHA20_POLY1305_REC_SEQ_SIZE);
+        memcpy(info.chacha20_poly1305.key, cipher_key.data,
+               TLS_CIPHER_CHACHA20_POLY1305_KEY_SIZE);
+        info_len = sizeof(info.chacha20_poly1305);
+        break;
+#endif
+    default:
+        error_setg(errp, "Kernel TLS does not support cipher %s",
+                   gnutls_cipher_get_name(cipher));
+        return -1;
+    }
+
+    if (setsockopt(fd, IPPROTO_TCP, TCP_ULP, "tls", sizeof("tls")) < 0 &&
+        errno != EEXIST) {
+        error_setg_errno(errp, errno, "Cannot enable kernel TLS");
+        ret = -1;
+    } else if (setsockopt(fd, SOL_TLS, read ? TLS_RX : TLS_TX,
+                          &info, info_len) < 0) {
+        error_setg_errno(errp, errno, "Cannot set kernel TLS %s key",
+                         read ? "receive" : "send");
+        ret = -1;
+    } else {
+        trace_qcrypto_tls_session_enable_ktls(session, fd, read);
+        ret = 0;
+    }
+
+    /* Don't leave the key lying around on the stack */
+    memset(&info, 0, sizeof(info));
+    return ret;
+
+ bad_state:
+    memset(&info, 0, sizeof(info));
+    error_setg(errp, "Unexpected TLS record state for kernel TLS");
+    return -1;
+}
+
+#else /* ! CONFIG_KTLS */
+
+int
+qcrypto_tls_session_enable_ktls(QCryptoTLSSession *session,
+                                int fd,
+                                bool read,
+                                Error **errp)
+{
+    error_setg(errp, "Kernel TLS is not supported on this platform");
+    return -1;
+}
+
+#endif /* ! CONFIG_KTLS */
+
+
 #else /* ! CONFIG_GNUTLS */
 
 
@@ -646,4 +804,15 @@ qcrypto_tls_session_get_peer_name(QCryptoTLSSession *sess)
     return NULL;
 }
 
+
+int
+qcrypto_tls_session_enable_ktls(QCryptoTLSSession *sess,
+                                int fd,
+                                bool read,
+                                Error **errp)
+{
+    error_setg(errp, "TLS requires GNUTLS support");
+    return -1;
+}
+
 #endif
@@ -2803,7 +2803,8 @@ float16 float64_to_float16(float64 a, bool ieee, float_status *s)
     return float16a_round_pack_canonical(&p, s, fmt);
 }
 
-float32 float64_to_float32(float64 a, float_status *s)
+static float32 QEMU_SOFTFLOAT_ATTR
+soft_float64_to_float32(float64 a, float_status *s)
 {
     FloatParts64 p;
 
@@ -2812,6 +2813,23 @@ float32 float64_to_float32(float64 a, float_status *s)
     return float32_round_pack_canonical(&p, s);
 }
 
+float32 float64_to_float32(float64 a, float_status *s)
+{
+    if (likely(can_use_fpu(s) && float64_is_zero_or_normal(a))) {
+        union_float64 ud;
+        union_float32 uf;
+
+        ud.s = a;
+        uf.h = ud.h;
+        /* Leave overflow and underflow to softfloat, as for the ops.  */
+        if (likely(isfinite(uf.h) && fabsf(uf.h) > FLT_MIN) ||
+            float64_is_zero(a)) {
+            return uf.s;
+        }
+    }
+    return soft_float64_to_float32(a, s);
+}
+
 float32 bfloat16_to_float32(bfloat16 a, float_status *s)
 {
     FloatParts64 p;
@@ -3257,13 +3275,51 @@ int16_t float32_to_int16(float32 a, float_status *s)
     return float32_to_int16_scalbn(a, s->float_rounding_mode, 0, s);
 }
 
+/*
+ * Hardfloat conversions to integer: with the inexact flag already set,
+ * an input in range converts without raising anything new.  NaNs,
+ * infinities, denormals and inputs out of range are left to softfloat.
+ * The bounds are chosen so that rounding cannot carry the result out of
+ * range.  Conversions that truncate do not depend on the rounding mode.
+ */
+static inline bool can_use_fpu_to_int(const float_status *s, bool trunc)
+{
+    if (trunc) {
+        return !QEMU_NO_HARDFLOAT &&
+               likely(s->float_exception_flags & float_flag_inexact);
+    }
+    return can_use_fpu(s);
+}
+
+static inline bool f32_to_int_in_range(float32 a, float bound)
+{
+    union_float32 ua = { .s = a };
+
+    return float32_is_zero_or_normal(a) && fabsf(ua.h) < bound;
+}
+
+static inline bool f64_to_int_in_range(float64 a, double bound)
+{
+    union_float64 ua = { .s = a };
+
+    return float64_is_zero_or_normal(a) && fabs(ua.h) < bound;
+}
+
 int32_t float32_to_int32(float32 a, float_status *s)
 {
+    if (can_use_fpu_to_int(s, false) && f32_to_int_in_range(a, 0x1p31f)) {
+        union_float32 ua = { .s = a };
+        return rintf(ua.h);
+    }
     return float32_to_int32_scalbn(a, s->float_rounding_mode, 0, s);
 }
 
 int64_t float32_to_int64(float32 a, float_status *s)
 {
+    if (can_use_fpu_to_int(s, false) && f32_to_int_in_range(a, 0x1p63f)) {
+        union_float32 ua = { .s = a };
+        return rintf(ua.h);
+    }
     return float32_to_int64_scalbn(a, s->float_rounding_mode, 0, s);
 }
 
@@ -3274,11 +3330,19 @@ int16_t float64_to_int16(float64 a, float_status *s)
 
 int32_t float64_to_int32(float64 a, float_status *s)
 {
+    if (can_use_fpu_to_int(s, false) && f64_to_int_in_range(a, INT32_MAX)) {
+        union_float64 ua = { .s = a };
+        return rint(ua.h);
+    }
     return float64_to_int32_scalbn(a, s->float_rounding_mode, 0, s);
 }
 
 int64_t float64_to_int64(float64 a, float_status *s)
 {
+    if (can_use_fpu_to_int(s, false) && f64_to_int_in_range(a, 0x1p63)) {
+        union_float64 ua = { .s = a };
+        return rint(ua.h);
+    }
     return float64_to_int64_scalbn(a, s->float_rounding_mode, 0, s);
 }
 
@@ -3329,11 +3393,19 @@ int16_t float32_to_int16_round_to_zero(float32 a, float_status *s)
 
 int32_t float32_to_int32_round_to_zero(float32 a, float_status *s)
 {
+    if (can_use_fpu_to_int(s, true) && f32_to_int_in_range(a, 0x1p31f)) {
+        union_float32 ua = { .s = a };
+        return ua.h;
+    }
     return float32_to_int32_scalbn(a, float_round_to_zero, 0, s);
 }
 
 int64_t float32_to_int64_round_to_zero(float32 a, float_status *s)
 {
+    if (can_use_fpu_to_int(s, true) && f32_to_int_in_range(a, 0x1p63f)) {
+        union_float32 ua = { .s = a };
+        return ua.h;
+    }
     return float32_to_int64_scalbn(a, float_round_to_zero, 0, s);
 }
 
@@ -3344,11 +3416,19 @@ int16_t float64_to_int16_round_to_zero(float64 a, float_status *s)
 
 int32_t float64_to_int32_round_to_zero(float64 a, float_status *s)
 {
+    if (can_use_fpu_to_int(s, true) && f64_to_int_in_range(a, 0x1p31)) {
+        union_float64 ua = { .s = a };
+        return ua.h;
+    }
     return float64_to_int32_scalbn(a, float_round_to_zero, 0, s);
 }
 
 int64_t float64_to_int64_round_to_zero(float64 a, float_status *s)
 {
+    if (can_use_fpu_to_int(s, true) && f64_to_int_in_range(a, 0x1p63)) {
+        union_float64 ua = { .s = a };
+        return ua.h;
+    }
     return float64_to_int64_scalbn(a, float_round_to_zero, 0, s);
 }
 
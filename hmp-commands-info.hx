@@ -281,6 +281,21 @@ SRST
     Show dynamic compiler opcode counters
 ERST
 
+#if defined(CONFIG_TCG)
+    {
+        .name       = "tlb-stats",
+        .args_type  = "",
+        .params     = "",
+        .help       = "show softmmu TLB flush and refill counters",
+    },
+#endif
+
+SRST
+  ``info tlb-stats``
+    Show the flush and refill counters of the TCG softmmu TLB, per vCPU
+    and MMU index.
+ERST
+
     {
         .name       = "sync-profile",
         .args_type  = "mean:-m,no_coalesce:-n,max:i?",
@@ -865,6 +880,19 @@ SRST
     Display the vcpu dirty rate information.
 ERST
 
+    {
+        .name       = "dirty_heatmap",
+        .args_type  = "",
+        .params     = "",
+        .help       = "show dirty page heatmap",
+        .cmd        = hmp_info_dirty_heatmap,
+    },
+
+SRST
+  ``info dirty_heatmap``
+    Display the dirty page heatmap of the guest RAM.
+ERST
+
     {
         .name       = "vcpu_dirty_limit",
         .args_type  = "",
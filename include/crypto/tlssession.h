@@ -321,4 +321,30 @@ int qcrypto_tls_session_get_key_size(QCryptoTLSSession *sess,
  */
 char *qcrypto_tls_session_get_peer_name(QCryptoTLSSession *sess);
 
+/**
+ * qcrypto_tls_session_enable_ktls:
+ * @sess: the TLS session object
+ * @fd: the TCP socket carrying the session
+ * @read: true to offload received records, false for sent ones
+ * @errp: pointer to a NULL-initialized error object
+ *
+ * Hand the record protection of one direction of an
+ * established session over to the kernel TLS support
+ * of @fd (Linux only). The negotiated protocol must be
+ * TLS 1.2 or 1.3 and the cipher one of AES-GCM or
+ * ChaCha20-Poly1305.
+ *
+ * On success, payload data in that direction must be
+ * sent or received with plain socket I/O on @fd, not
+ * with qcrypto_tls_session_write() or
+ * qcrypto_tls_session_read(). On failure the session
+ * can be used as before.
+ *
+ * Returns: 0 on success, -1 on error
+ */
+int qcrypto_tls_session_enable_ktls(QCryptoTLSSession *sess,
+                                    int fd,
+                                    bool read,
+                                    Error **errp);
+
 #endif /* QCRYPTO_TLSSESSION_H */
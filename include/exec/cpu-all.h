@@ -429,6 +429,8 @@ void dump_exec_info(GString *buf);
 int cpu_exec(CPUState *cpu);
 void tcg_exec_realizefn(CPUState *cpu, Error **errp);
 void tcg_exec_unrealizefn(CPUState *cpu);
+void tcg_exec_jmp_cache_init(CPUState *cpu);
+void tcg_exec_jmp_cache_free(CPUState *cpu);
 
 /**
  * cpu_set_cpustate_pointers(cpu)
@@ -150,13 +150,28 @@ typedef struct CPUIOTLBEntry {
     MemTxAttrs attrs;
 } CPUIOTLBEntry;
 
+/*
+ * The large pages allocated into the tlb are tracked one by one, up to
+ * this many per MMU mode, so that flushing a page within one of them
+ * only evicts the entries of that large page.
+ */
+#define CPU_TLB_LARGE_PAGES 8
+
+typedef struct CPUTLBLargePage {
+    target_ulong addr;
+    target_ulong mask;
+} CPUTLBLargePage;
+
 /*
  * Data elements that are per MMU mode, minus the bits accessed by
  * the TCG fast path.
  */
 typedef struct CPUTLBDesc {
+    /* The large pages tracked one by one. */
+    CPUTLBLargePage large_pages[CPU_TLB_LARGE_PAGES];
+    size_t n_large_pages;
     /*
-     * Describe a region covering all of the large pages allocated
+     * Describe a region covering all of the other large pages allocated
      * into the tlb.  When any page within this region is flushed,
      * we must flush the entire tlb.  The region is matched if
      * (addr & large_page_mask) == large_page_addr.
@@ -175,6 +190,14 @@ typedef struct CPUTLBDesc {
     CPUIOTLBEntry viotlb[CPU_VTLB_SIZE];
     /* The iotlb.  */
     CPUIOTLBEntry *iotlb;
+    /*
+     * Statistics, read and written atomically like those of
+     * CPUTLBCommon.
+     */
+    size_t flush_count;
+    size_t page_flush_count;
+    size_t large_page_flush_count;
+    size_t fill_count;
 } CPUTLBDesc;
 
 /*
@@ -510,6 +510,11 @@ struct TranslationBlock {
      */
     uint16_t jmp_reset_offset[2]; /* offset of original jump target */
 #define TB_JMP_RESET_OFFSET_INVALID 0xffff /* indicates no jump generated */
+
+    /* executions counted by the TB code while looking for hot traces */
+    uint32_t exec_count;
+    /* number of TBs merged into this one by tb_gen_trace(), 0 if none */
+    uint16_t trace_blocks;
     uintptr_t jmp_target_arg[2];  /* target address or offset */
 
     /*
@@ -72,7 +72,10 @@ static inline void fuzz_dma_read_cb(size_t addr,
 /* Dirty tracking enabled because dirty limit */
 #define GLOBAL_DIRTY_LIMIT      (1U << 2)
 
-#define GLOBAL_DIRTY_MASK  (0x7)
+/* Dirty tracking enabled because maintaining the dirty heatmap */
+#define GLOBAL_DIRTY_HEATMAP    (1U << 3)
+
+#define GLOBAL_DIRTY_MASK  (0xf)
 
 extern unsigned int global_dirty_tracking;
 
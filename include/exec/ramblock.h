@@ -62,6 +62,15 @@ struct RAMBlock {
     unsigned long *clear_bmap;
     uint8_t clear_bmap_shift;
 
+    /*
+     * Dirty history of the migration bitmap, one byte for each word of
+     * `bmap'.  Every global sync shifts the byte right and sets the top
+     * bit if the word was found dirty, so the byte records the last
+     * eight syncs.  Only allocated on the source when the
+     * cold-pages-first capability is enabled.
+     */
+    uint8_t *dirty_history;
+
     /*
      * RAM block length that corresponds to the used_length on the migration
      * source (after RAM block sizes were synchronized). Especially, after
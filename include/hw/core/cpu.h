@@ -230,9 +230,6 @@ struct kvm_run;
 struct hax_vcpu_state;
 struct hvf_vcpu_state;
 
-#define TB_JMP_CACHE_BITS 12
-#define TB_JMP_CACHE_SIZE (1 << TB_JMP_CACHE_BITS)
-
 /* work queue */
 
 /* The union type allows passing of 64 bit target pointers on 32 bit
@@ -361,8 +358,10 @@ struct CPUState {
     CPUArchState *env_ptr;
     IcountDecr *icount_decr_ptr;
 
-    /* Accessed in parallel; all accesses must be atomic */
-    TranslationBlock *tb_jmp_cache[TB_JMP_CACHE_SIZE];
+    /* Accessed in parallel; see accel/tcg/tb-jmp-cache.h */
+    CPUJumpCache *tb_jmp_cache;
+    /* TB that reached the hot trace threshold, see tb_gen_trace() */
+    TranslationBlock *tb_hot;
 
     struct GDBRegisterState *gdb_regs;
     int gdb_num_regs;
@@ -448,14 +447,7 @@ extern CPUTailQ cpus;
 
 extern __thread CPUState *current_cpu;
 
-static inline void cpu_tb_jmp_cache_clear(CPUState *cpu)
-{
-    unsigned int i;
-
-    for (i = 0; i < TB_JMP_CACHE_SIZE; i++) {
-        qatomic_set(&cpu->tb_jmp_cache[i], NULL);
-    }
-}
+void cpu_tb_jmp_cache_clear(CPUState *cpu);
 
 /**
  * qemu_tcg_mttcg_enabled:
@@ -48,6 +48,9 @@ struct QIOChannelTLS {
     QIOChannel *master;
     QCryptoTLSSession *session;
     QIOChannelShutdown shutdown;
+    /* Record protection done by the kernel, see qio_channel_tls_enable_ktls */
+    bool ktls_send;
+    bool ktls_recv;
 };
 
 /**
@@ -142,4 +145,24 @@ void qio_channel_tls_handshake(QIOChannelTLS *ioc,
 QCryptoTLSSession *
 qio_channel_tls_get_session(QIOChannelTLS *ioc);
 
+/**
+ * qio_channel_tls_enable_ktls:
+ * @ioc: the TLS channel object
+ * @errp: pointer to a NULL-initialized error object
+ *
+ * Offload the encryption, and if possible the decryption,
+ * of payload data to the kernel TLS support of the master
+ * channel, which must be a TCP socket. Writes and reads
+ * then go straight to the socket, without an extra copy
+ * and the record handling of the TLS library.
+ *
+ * This must be called after the handshake completed and
+ * before any payload data is transferred. On failure the
+ * channel keeps working without offload.
+ *
+ * Returns: 0 if at least sending was offloaded, -1 on error
+ */
+int qio_channel_tls_enable_ktls(QIOChannelTLS *ioc,
+                                Error **errp);
+
 #endif /* QIO_CHANNEL_TLS_H */
@@ -1172,6 +1172,8 @@ int vmstate_save_state_v(QEMUFile *f, const VMStateDescription *vmsd,
                          int version_id);
 
 bool vmstate_save_needed(const VMStateDescription *vmsd, void *opaque);
+bool vmstate_save_is_read_only(const VMStateDescription *vmsd);
+void vmstate_set_compile(bool enable);
 
 #define  VMSTATE_INSTANCE_ID_ANY  -1
 
@@ -568,8 +568,37 @@ unsigned long qemu_getauxval(unsigned long type);
 
 void qemu_set_tty_echo(int fd, bool echo);
 
-void os_mem_prealloc(int fd, char *area, size_t sz, int smp_cpus,
-                     Error **errp);
+/**
+ * os_mem_prealloc:
+ * @fd: the file descriptor backing @area, or -1
+ * @area: the memory to preallocate
+ * @sz: the size of @area
+ * @max_threads: the maximum number of threads to touch memory with
+ * @host_nodes: if not NULL, bitmap of the host NUMA nodes @area is bound to
+ * @nr_nodes: the number of bits in @host_nodes
+ * @async: allow the preallocation to finish in the background
+ * @errp: pointer to a NULL-initialized error object
+ *
+ * Populate @area so that later accesses do not fault. The touching
+ * threads are spread over the CPUs of @host_nodes, so that the pages
+ * are zeroed close to where they are allocated.
+ *
+ * With @async, errors may only be reported by os_mem_prealloc_finish(),
+ * which must be called before @area is used or freed.
+ */
+void os_mem_prealloc(int fd, char *area, size_t sz, int max_threads,
+                     const unsigned long *host_nodes, int nr_nodes,
+                     bool async, Error **errp);
+
+/**
+ * os_mem_prealloc_finish:
+ * @errp: pointer to a NULL-initialized error object
+ *
+ * Wait for all preallocations started with @async to complete.
+ *
+ * Returns: true on success, false if any of them failed.
+ */
+bool os_mem_prealloc_finish(Error **errp);
 
 /**
  * qemu_get_pid_name:
@@ -88,6 +88,7 @@ enum plugin_dyn_cb_type {
 enum plugin_dyn_cb_subtype {
     PLUGIN_CB_REGULAR,
     PLUGIN_CB_INLINE,
+    PLUGIN_CB_COND,
     PLUGIN_N_CB_SUBTYPES,
 };
 
@@ -104,10 +105,22 @@ struct qemu_plugin_dyn_cb {
     enum qemu_plugin_mem_rw rw;
     /* fields specific to each dyn_cb type go here */
     union {
+        /* @userp points at the value of vCPU 0 */
         struct {
             enum qemu_plugin_op op;
             uint64_t imm;
+            size_t stride;
+            /* mem only: accesses outside [lo, hi] are not counted */
+            uint64_t lo;
+            uint64_t hi;
         } inline_insn;
+        /* @userp is passed to the callback */
+        struct {
+            enum qemu_plugin_cond cond;
+            void *ptr;
+            size_t stride;
+            uint64_t imm;
+        } cond;
     };
 };
 
@@ -47,11 +47,15 @@ typedef uint64_t qemu_plugin_id_t;
  *
  * The plugins export the API they were built against by exposing the
  * symbol qemu_plugin_version which can be checked.
+ *
+ * version 2:
+ * - added per-vCPU inline ops, conditional TB callbacks and
+ *   address-filtered memory inline ops
  */
 
 extern QEMU_PLUGIN_EXPORT int qemu_plugin_version;
 
-#define QEMU_PLUGIN_VERSION 1
+#define QEMU_PLUGIN_VERSION 2
 
 /**
  * struct qemu_info_t - system information for plugins
@@ -300,6 +304,78 @@ void qemu_plugin_register_vcpu_tb_exec_inline(struct qemu_plugin_tb *tb,
                                               enum qemu_plugin_op op,
                                               void *ptr, uint64_t imm);
 
+/**
+ * qemu_plugin_register_vcpu_tb_exec_inline_per_vcpu() - per-vCPU inline op
+ * @tb: the opaque qemu_plugin_tb handle for the translation
+ * @op: the type of qemu_plugin_op (e.g. ADD_U64)
+ * @ptr: the target memory location for vCPU 0
+ * @stride: distance in bytes between the locations of consecutive vCPUs
+ * @imm: the op data (e.g. 1)
+ *
+ * Like qemu_plugin_register_vcpu_tb_exec_inline(), but vCPU n operates
+ * on the uint64_t at @ptr + n * @stride. Since every vCPU only touches
+ * its own location the result is exact even with MTTCG; the plugin
+ * sums the per-vCPU values when it reports. Pick @stride so that the
+ * locations do not share a cache line if the counters are hot.
+ */
+void qemu_plugin_register_vcpu_tb_exec_inline_per_vcpu(
+    struct qemu_plugin_tb *tb, enum qemu_plugin_op op,
+    void *ptr, size_t stride, uint64_t imm);
+
+/**
+ * enum qemu_plugin_cond - condition for a conditional callback
+ *
+ * @QEMU_PLUGIN_COND_NEVER: never call the callback
+ * @QEMU_PLUGIN_COND_ALWAYS: always call the callback
+ * @QEMU_PLUGIN_COND_EQ: call if the value is equal to the immediate
+ * @QEMU_PLUGIN_COND_NE: call if the value is not equal to the immediate
+ * @QEMU_PLUGIN_COND_LT: call if the value is below the immediate
+ * @QEMU_PLUGIN_COND_LE: call if the value is below or equal
+ * @QEMU_PLUGIN_COND_GT: call if the value is above the immediate
+ * @QEMU_PLUGIN_COND_GE: call if the value is above or equal
+ *
+ * All comparisons are unsigned 64-bit.
+ */
+enum qemu_plugin_cond {
+    QEMU_PLUGIN_COND_NEVER,
+    QEMU_PLUGIN_COND_ALWAYS,
+    QEMU_PLUGIN_COND_EQ,
+    QEMU_PLUGIN_COND_NE,
+    QEMU_PLUGIN_COND_LT,
+    QEMU_PLUGIN_COND_LE,
+    QEMU_PLUGIN_COND_GT,
+    QEMU_PLUGIN_COND_GE,
+};
+
+/**
+ * qemu_plugin_register_vcpu_tb_exec_cond_cb() - conditional TB exec cb
+ * @tb: the opaque qemu_plugin_tb handle for the translation
+ * @cb: callback function
+ * @flags: does the plugin read or write the CPU's registers?
+ * @cond: condition under which @cb is called
+ * @ptr: the uint64_t compared for vCPU 0
+ * @stride: distance in bytes between the values of consecutive vCPUs
+ * @imm: the value compared against
+ * @userdata: any plugin data to pass to the @cb?
+ *
+ * The @cb function is called when the translated unit executes and
+ * the uint64_t at @ptr + vcpu_index * @stride satisfies @cond against
+ * @imm. The comparison is done inline, so executions that fail it
+ * cost a load and a branch rather than a helper call.
+ *
+ * Combined with a per-vCPU inline add registered on the same TB this
+ * gives cheap sampling: count executions inline, ask for the callback
+ * when the count reaches N, and reset the count from the callback.
+ * Inline ops are always emitted after the callbacks of a TB, so the
+ * callback sees the count from before the current execution.
+ */
+void qemu_plugin_register_vcpu_tb_exec_cond_cb(struct qemu_plugin_tb *tb,
+                                               qemu_plugin_vcpu_udata_cb_t cb,
+                                               enum qemu_plugin_cb_flags flags,
+                                               enum qemu_plugin_cond cond,
+                                               void *ptr, size_t stride,
+                                               uint64_t imm, void *userdata);
+
 /**
  * qemu_plugin_register_vcpu_insn_exec_cb() - register insn execution cb
  * @insn: the opaque qemu_plugin_insn handle for an instruction
@@ -328,6 +404,21 @@ void qemu_plugin_register_vcpu_insn_exec_inline(struct qemu_plugin_insn *insn,
                                                 enum qemu_plugin_op op,
                                                 void *ptr, uint64_t imm);
 
+/**
+ * qemu_plugin_register_vcpu_insn_exec_inline_per_vcpu() - per-vCPU inline op
+ * @insn: the opaque qemu_plugin_insn handle for an instruction
+ * @op: the type of qemu_plugin_op (e.g. ADD_U64)
+ * @ptr: the target memory location for vCPU 0
+ * @stride: distance in bytes between the locations of consecutive vCPUs
+ * @imm: the op data (e.g. 1)
+ *
+ * Like qemu_plugin_register_vcpu_insn_exec_inline(), but vCPU n operates
+ * on the uint64_t at @ptr + n * @stride.
+ */
+void qemu_plugin_register_vcpu_insn_exec_inline_per_vcpu(
+    struct qemu_plugin_insn *insn, enum qemu_plugin_op op,
+    void *ptr, size_t stride, uint64_t imm);
+
 /**
  * qemu_plugin_tb_n_insns() - query helper for number of insns in TB
  * @tb: opaque handle to TB passed to callback
@@ -497,6 +588,27 @@ void qemu_plugin_register_vcpu_mem_inline(struct qemu_plugin_insn *insn,
                                           enum qemu_plugin_op op, void *ptr,
                                           uint64_t imm);
 
+/**
+ * qemu_plugin_register_vcpu_mem_inline_per_vcpu() - per-vCPU mem inline op
+ * @insn: the opaque qemu_plugin_insn handle for an instruction
+ * @rw: monitor reads, writes or both
+ * @op: the type of qemu_plugin_op (e.g. ADD_U64)
+ * @ptr: the target memory location for vCPU 0
+ * @stride: distance in bytes between the locations of consecutive vCPUs
+ * @imm: the op data (e.g. 1)
+ * @lo: lowest virtual address counted
+ * @hi: highest virtual address counted
+ *
+ * Like qemu_plugin_register_vcpu_mem_inline(), but vCPU n operates on
+ * the uint64_t at @ptr + n * @stride, and only accesses whose virtual
+ * address lies in [@lo, @hi] apply the op. The filter is evaluated
+ * inline without a branch; pass 0 and UINT64_MAX to count every access.
+ */
+void qemu_plugin_register_vcpu_mem_inline_per_vcpu(
+    struct qemu_plugin_insn *insn, enum qemu_plugin_mem_rw rw,
+    enum qemu_plugin_op op, void *ptr, size_t stride, uint64_t imm,
+    uint64_t lo, uint64_t hi);
+
 
 
 typedef void
@@ -34,4 +34,6 @@ void dirtylimit_set_vcpu(int cpu_index,
 void dirtylimit_set_all(uint64_t quota,
                         bool enable);
 void dirtylimit_vcpu_execute(CPUState *cpu);
+void dirtylimit_set_budget(uint64_t budget);
+void dirtylimit_cancel_budget(void);
 #endif
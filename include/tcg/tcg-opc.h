@@ -196,7 +196,7 @@ DEF(exit_tb, 0, 0, 1, TCG_OPF_BB_EXIT | TCG_OPF_BB_END)
 DEF(goto_tb, 0, 0, 1, TCG_OPF_BB_EXIT | TCG_OPF_BB_END)
 DEF(goto_ptr, 0, 1, 0, TCG_OPF_BB_EXIT | TCG_OPF_BB_END)
 
-DEF(plugin_cb_start, 0, 0, 3, TCG_OPF_NOT_PRESENT)
+DEF(plugin_cb_start, 0, 0, 4, TCG_OPF_NOT_PRESENT)
 DEF(plugin_cb_end, 0, 0, 0, TCG_OPF_NOT_PRESENT)
 
 DEF(qemu_ld_i32, 1, TLADDR_ARGS, 1,
@@ -235,6 +235,8 @@ DEF(ssadd_vec, 1, 2, 0, IMPLVEC | IMPL(TCG_TARGET_HAS_sat_vec))
 DEF(usadd_vec, 1, 2, 0, IMPLVEC | IMPL(TCG_TARGET_HAS_sat_vec))
 DEF(sssub_vec, 1, 2, 0, IMPLVEC | IMPL(TCG_TARGET_HAS_sat_vec))
 DEF(ussub_vec, 1, 2, 0, IMPLVEC | IMPL(TCG_TARGET_HAS_sat_vec))
+DEF(srhadd_vec, 1, 2, 0, IMPLVEC | IMPL(TCG_TARGET_HAS_rhadd_vec))
+DEF(urhadd_vec, 1, 2, 0, IMPLVEC | IMPL(TCG_TARGET_HAS_rhadd_vec))
 DEF(smin_vec, 1, 2, 0, IMPLVEC | IMPL(TCG_TARGET_HAS_minmax_vec))
 DEF(umin_vec, 1, 2, 0, IMPLVEC | IMPL(TCG_TARGET_HAS_minmax_vec))
 DEF(smax_vec, 1, 2, 0, IMPLVEC | IMPL(TCG_TARGET_HAS_minmax_vec))
@@ -281,6 +283,8 @@ DEF(last_generic, 0, 0, 0, TCG_OPF_NOT_PRESENT)
 /* These opcodes are only for use between the tci generator and interpreter. */
 DEF(tci_movi, 1, 0, 1, TCG_OPF_NOT_PRESENT)
 DEF(tci_movl, 1, 0, 1, TCG_OPF_NOT_PRESENT)
+DEF(tci_brcond_i32, 0, 2, 2, TCG_OPF_NOT_PRESENT)
+DEF(tci_brcond_i64, 0, 2, 2, TCG_OPF_NOT_PRESENT)
 #endif
 
 #undef TLADDR_ARGS
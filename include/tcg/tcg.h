@@ -194,6 +194,7 @@ typedef uint64_t TCGRegSet;
 #define TCG_TARGET_HAS_shv_vec          0
 #define TCG_TARGET_HAS_mul_vec          0
 #define TCG_TARGET_HAS_sat_vec          0
+#define TCG_TARGET_HAS_rhadd_vec        0
 #define TCG_TARGET_HAS_minmax_vec       0
 #define TCG_TARGET_HAS_bitsel_vec       0
 #define TCG_TARGET_HAS_cmpsel_vec       0
@@ -257,6 +258,8 @@ struct TCGRelocation {
     int type;
 };
 
+#define TCG_LABEL_MAX_ENTRY_REGS 8
+
 typedef struct TCGLabel TCGLabel;
 struct TCGLabel {
     unsigned present : 1;
@@ -269,6 +272,14 @@ struct TCGLabel {
     } u;
     QSIMPLEQ_HEAD(, TCGRelocation) relocs;
     QSIMPLEQ_ENTRY(TCGLabel) next;
+    /* Globals held in host registers on entry, set by the first
+       predecessor seen by the register allocator.  */
+    bool has_entry_regs;
+    int nb_entry_regs;
+    struct {
+        struct TCGTemp *ts;
+        TCGReg reg;
+    } entry_regs[TCG_LABEL_MAX_ENTRY_REGS];
 };
 
 typedef struct TCGPool {
@@ -552,6 +563,7 @@ struct TCGContext {
 
     TCGRegSet reserved_regs;
     uint32_t tb_cflags; /* cflags of the current TB */
+    bool tb_nocache; /* the current TB embeds host pointers of this run */
     intptr_t current_frame_offset;
     intptr_t frame_start;
     intptr_t frame_end;
@@ -594,6 +606,19 @@ struct TCGContext {
 
     TCGLabel *exitreq_label;
 
+    /* Hot trace for the next translation, see tb_gen_trace() */
+    struct TranslatorTrace *trace;
+    /*
+     * Exits of the block being translated within a hot trace: the exit
+     * that leads to the next block branches to trace_next, the others
+     * take the exits of the trace in turn.
+     */
+    bool trace_exits;
+    int trace_hot;
+    TCGLabel *trace_next;
+    int8_t trace_slot[2];
+    int trace_nb_slots;
+
 #ifdef CONFIG_PLUGIN
     /*
      * We keep one plugin_tb struct per TCGContext. Note that on every TB
@@ -606,6 +631,13 @@ struct TCGContext {
 
     /* descriptor of the instruction being translated */
     struct qemu_plugin_insn *plugin_insn;
+
+    /*
+     * When non-NULL, tcg_emit_op() inserts new ops before this one
+     * instead of at the end of the stream. Plugin injection uses it to
+     * generate instrumentation in the middle of a translated block.
+     */
+    TCGOp *emit_before_op;
 #endif
 
     GHashTable *const_table[TCG_TYPE_COUNT];
@@ -806,6 +838,11 @@ void tcg_pool_reset(TCGContext *s);
 TranslationBlock *tcg_tb_alloc(TCGContext *s);
 
 void tcg_region_reset_all(void);
+void tcg_region_set_base(void *addr);
+void *tcg_region_base(void);
+size_t tcg_nb_regions(void);
+size_t tcg_region_used(size_t n, void **pstart);
+void *tcg_region_reserve(size_t n, size_t size);
 
 size_t tcg_code_size(void);
 size_t tcg_code_capacity(void);
@@ -816,6 +853,16 @@ TranslationBlock *tcg_tb_lookup(uintptr_t tc_ptr);
 void tcg_tb_foreach(GTraverseFunc func, gpointer user_data);
 size_t tcg_nb_tbs(void);
 
+/*
+ * Called by the translator when the code being generated refers to host
+ * memory that may move in another run (heap objects, plugin data), so
+ * that the TB is left out of the persistent translation cache.
+ */
+static inline void tcg_set_tb_nocache(void)
+{
+    tcg_ctx->tb_nocache = true;
+}
+
 /* user-mode: Called with mmap_lock held.  */
 static inline void *tcg_malloc(int size)
 {
@@ -22,8 +22,23 @@
 #include "qapi/error.h"
 #include "qemu/module.h"
 #include "io/channel-tls.h"
+#include "io/channel-socket.h"
 #include "trace.h"
 #include "qemu/atomic.h"
+#include "qemu/iov.h"
+
+#ifdef CONFIG_KTLS
+#include <linux/tls.h>
+
+#ifndef SOL_TLS
+#define SOL_TLS 282
+#endif
+
+/* TLS record content types */
+#define QIO_CHANNEL_TLS_RECORD_ALERT        21
+#define QIO_CHANNEL_TLS_RECORD_HANDSHAKE    22
+#define QIO_CHANNEL_TLS_RECORD_DATA         23
+#endif
 
 
 static ssize_t qio_channel_tls_write_handler(const char *buf,
@@ -255,6 +270,102 @@ static void qio_channel_tls_finalize(Object *obj)
 }
 
 
+int qio_channel_tls_enable_ktls(QIOChannelTLS *ioc,
+                                Error **errp)
+{
+    QIOChannelSocket *sioc;
+    Error *err = NULL;
+
+    sioc = (QIOChannelSocket *)object_dynamic_cast(OBJECT(ioc->master),
+                                                   TYPE_QIO_CHANNEL_SOCKET);
+    if (!sioc) {
+        error_setg(errp, "Kernel TLS requires a socket channel");
+        return -1;
+    }
+
+    if (qcrypto_tls_session_enable_ktls(ioc->session, sioc->fd,
+                                        false, errp) < 0) {
+        return -1;
+    }
+    ioc->ktls_send = true;
+
+    /* Reads can still go through the TLS library if this fails */
+    if (qcrypto_tls_session_enable_ktls(ioc->session, sioc->fd,
+                                        true, &err) < 0) {
+        trace_qio_channel_tls_ktls_recv_fail(ioc, error_get_pretty(err));
+        error_free(err);
+    } else {
+        ioc->ktls_recv = true;
+    }
+
+    trace_qio_channel_tls_ktls(ioc, ioc->ktls_send, ioc->ktls_recv);
+    return 0;
+}
+
+
+#ifdef CONFIG_KTLS
+static ssize_t qio_channel_tls_readv_ktls(QIOChannelTLS *tioc,
+                                          const struct iovec *iov,
+                                          size_t niov,
+                                          Error **errp)
+{
+    int fd = QIO_CHANNEL_SOCKET(tioc->master)->fd;
+    char control[CMSG_SPACE(sizeof(unsigned char))];
+    struct msghdr msg;
+    struct cmsghdr *cmsg;
+    unsigned char type, alert[2];
+    ssize_t ret;
+
+ retry:
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = (struct iovec *)iov;
+    msg.msg_iovlen = niov;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    ret = recvmsg(fd, &msg, 0);
+    if (ret < 0) {
+        if (errno == EAGAIN) {
+            return QIO_CHANNEL_ERR_BLOCK;
+        } else if (errno == EINTR) {
+            goto retry;
+        }
+
+        error_setg_errno(errp, errno,
+                         "Cannot read from TLS channel");
+        return -1;
+    }
+
+    /* The kernel tells about any record that is not application data */
+    cmsg = CMSG_FIRSTHDR(&msg);
+    if (!cmsg || cmsg->cmsg_level != SOL_TLS ||
+        cmsg->cmsg_type != TLS_GET_RECORD_TYPE) {
+        return ret;
+    }
+
+    type = *CMSG_DATA(cmsg);
+    switch (type) {
+    case QIO_CHANNEL_TLS_RECORD_DATA:
+        return ret;
+    case QIO_CHANNEL_TLS_RECORD_HANDSHAKE:
+        /* TLS 1.3 session tickets, we never resume sessions */
+        goto retry;
+    case QIO_CHANNEL_TLS_RECORD_ALERT:
+        /* A close_notify alert ends the stream like a socket EOF */
+        if (ret == 2 && iov_to_buf(iov, niov, 0, alert, 2) == 2 &&
+            alert[1] == 0) {
+            return 0;
+        }
+        error_setg(errp, "Received TLS alert");
+        return -1;
+    default:
+        error_setg(errp, "Unexpected TLS record type %u", type);
+        return -1;
+    }
+}
+#endif
+
+
 static ssize_t qio_channel_tls_readv(QIOChannel *ioc,
                                      const struct iovec *iov,
                                      size_t niov,
@@ -266,6 +377,12 @@ static ssize_t qio_channel_tls_readv(QIOChannel *ioc,
     size_t i;
     ssize_t got = 0;
 
+#ifdef CONFIG_KTLS
+    if (tioc->ktls_recv) {
+        return qio_channel_tls_readv_ktls(tioc, iov, niov, errp);
+    }
+#endif
+
     for (i = 0 ; i < niov ; i++) {
         ssize_t ret = qcrypto_tls_session_read(tioc->session,
                                                iov[i].iov_base,
@@ -308,6 +425,11 @@ static ssize_t qio_channel_tls_writev(QIOChannel *ioc,
     size_t i;
     ssize_t done = 0;
 
+    if (tioc->ktls_send) {
+        return qio_channel_writev_full(tioc->master, iov, niov,
+                                       NULL, 0, flags, errp);
+    }
+
     for (i = 0 ; i < niov ; i++) {
         ssize_t ret = qcrypto_tls_session_write(tioc->session,
                                                 iov[i].iov_base,
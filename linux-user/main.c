@@ -66,6 +66,7 @@
 char *exec_path;
 
 int singlestep;
+static const char *hot_trace_threshold;
 static const char *argv0;
 static const char *gdbstub;
 static envlist_t *envlist;
@@ -393,6 +394,11 @@ static void handle_arg_singlestep(const char *arg)
     singlestep = 1;
 }
 
+static void handle_arg_hot_trace_threshold(const char *arg)
+{
+    hot_trace_threshold = arg;
+}
+
 static void handle_arg_strace(const char *arg)
 {
     enable_strace = true;
@@ -471,6 +477,9 @@ static const struct qemu_argument arg_table[] = {
      "pagesize",   "set the host page size to 'pagesize'"},
     {"singlestep", "QEMU_SINGLESTEP",  false, handle_arg_singlestep,
      "",           "run in singlestep mode"},
+    {"hot-trace-threshold", "QEMU_HOT_TRACE_THRESHOLD", true,
+     handle_arg_hot_trace_threshold,
+     "n",          "retranslate code paths executed 'n' times as traces"},
     {"strace",     "QEMU_STRACE",      false, handle_arg_strace,
      "",           "log system calls"},
     {"seed",       "QEMU_RAND_SEED",   true,  handle_arg_seed,
@@ -738,6 +747,11 @@ int main(int argc, char **argv, char **envp)
     {
         AccelClass *ac = ACCEL_GET_CLASS(current_accel());
 
+        if (hot_trace_threshold) {
+            object_property_parse(OBJECT(current_accel()),
+                                  "hot-trace-threshold", hot_trace_threshold,
+                                  &error_fatal);
+        }
         accel_init_interfaces(ac);
         ac->init_machine(NULL);
     }
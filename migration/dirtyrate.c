@@ -12,6 +12,7 @@
 
 #include "qemu/osdep.h"
 #include <zlib.h>
+#include <math.h>
 #include "qapi/error.h"
 #include "cpu.h"
 #include "exec/ramblock.h"
@@ -28,6 +29,8 @@
 #include "sysemu/kvm.h"
 #include "sysemu/runstate.h"
 #include "exec/memory.h"
+#include "qemu/units.h"
+#include "migration.h"
 
 /*
  * total_dirty_pages is procted by BQL and is used
@@ -783,6 +786,327 @@ struct DirtyRateInfo *qmp_query_dirty_rate(Error **errp)
     return query_dirty_rate_info();
 }
 
+/*
+ * Dirty heatmap
+ *
+ * A thread collects the dirty log every period and counts the dirty
+ * pages of each region of the migratable RAM blocks.  The count is
+ * folded into an exponentially decayed rate per region.  All the state
+ * below is protected by the BQL, which the thread holds while updating.
+ */
+typedef struct HeatmapBlock {
+    char *idstr;
+    uint64_t size;
+    uint64_t nregions;
+    /* Dirty pages of each region since the last update */
+    uint32_t *count;
+    /* Decayed rate of each region in pages per second */
+    double *rate;
+    bool seen;
+} HeatmapBlock;
+
+static struct {
+    QemuThread thread;
+    QemuSemaphore stop_sem;
+    bool running;
+    bool paused;
+    uint64_t granularity;
+    int64_t period;
+    int64_t half_life;
+    uint64_t samples;
+    int64_t last_update;
+    /* Map of RAM block id to HeatmapBlock */
+    GHashTable *blocks;
+} dirty_heatmap;
+
+#define DIRTY_HEATMAP_DEFAULT_GRANULARITY   (2 * MiB)
+#define DIRTY_HEATMAP_DEFAULT_PERIOD_MS     1000
+#define DIRTY_HEATMAP_DEFAULT_HALF_LIFE_MS  10000
+#define DIRTY_HEATMAP_MIN_PERIOD_MS         100
+#define DIRTY_HEATMAP_MAX_PERIOD_MS         60000
+
+static void dirty_heatmap_block_free(gpointer data)
+{
+    HeatmapBlock *hb = data;
+
+    g_free(hb->idstr);
+    g_free(hb->count);
+    g_free(hb->rate);
+    g_free(hb);
+}
+
+static HeatmapBlock *dirty_heatmap_block_get(RAMBlock *block)
+{
+    HeatmapBlock *hb = g_hash_table_lookup(dirty_heatmap.blocks,
+                                                 block->idstr);
+    uint64_t nregions = DIV_ROUND_UP(block->used_length,
+                                     dirty_heatmap.granularity);
+
+    if (!hb) {
+        hb = g_new0(HeatmapBlock, 1);
+        hb->idstr = g_strdup(block->idstr);
+        g_hash_table_insert(dirty_heatmap.blocks, hb->idstr, hb);
+    }
+    if (hb->nregions != nregions) {
+        /* New or resized block, start from a clean history */
+        hb->size = block->used_length;
+        hb->nregions = nregions;
+        g_free(hb->count);
+        g_free(hb->rate);
+        hb->count = g_new0(uint32_t, nregions);
+        hb->rate = g_new0(double, nregions);
+    }
+    hb->seen = true;
+    return hb;
+}
+
+/*
+ * Count the dirty pages of @block per region and clear them from the
+ * migration dirty bitmap.  RAM blocks start on a bitmap word boundary,
+ * so the words scanned only hold pages of @block.
+ * Called with the BQL and the RCU read lock held.
+ */
+static void dirty_heatmap_scan_block(RAMBlock *block, HeatmapBlock *hb)
+{
+    unsigned long * const *src;
+    uint64_t first = block->offset >> TARGET_PAGE_BITS;
+    uint64_t npages = block->used_length >> TARGET_PAGE_BITS;
+    uint64_t region_pages = dirty_heatmap.granularity >> TARGET_PAGE_BITS;
+    uint64_t word, last_word;
+
+    if (!npages) {
+        return;
+    }
+
+    src = qatomic_rcu_read(
+            &ram_list.dirty_memory[DIRTY_MEMORY_MIGRATION])->blocks;
+    last_word = BIT_WORD(first + npages - 1);
+
+    for (word = BIT_WORD(first); word <= last_word; word++) {
+        unsigned long idx = (word * BITS_PER_LONG) / DIRTY_MEMORY_BLOCK_SIZE;
+        unsigned long offset = BIT_WORD((word * BITS_PER_LONG) %
+                                        DIRTY_MEMORY_BLOCK_SIZE);
+        unsigned long bits;
+
+        if (!src[idx][offset]) {
+            continue;
+        }
+        bits = qatomic_xchg(&src[idx][offset], 0);
+        while (bits) {
+            uint64_t page = word * BITS_PER_LONG + ctzl(bits) - first;
+
+            bits &= bits - 1;
+            if (page < npages) {
+                hb->count[page / region_pages]++;
+            }
+        }
+    }
+
+    /* Re-protect the pages when KVM clears the dirty log manually */
+    memory_region_clear_dirty_bitmap(block->mr, 0, block->used_length);
+}
+
+static gboolean dirty_heatmap_block_unseen(gpointer key, gpointer value,
+                                           gpointer opaque)
+{
+    HeatmapBlock *hb = value;
+
+    return !hb->seen;
+}
+
+/*
+ * Fold the pages dirtied since the last update into the decayed rates,
+ * or just drop them when @discard is set.  Called with the BQL held.
+ */
+static void dirty_heatmap_update(bool discard)
+{
+    int64_t now = qemu_clock_get_ms(QEMU_CLOCK_REALTIME);
+    int64_t elapsed = MAX(now - dirty_heatmap.last_update, 1);
+    double decay = pow(0.5, (double)elapsed / dirty_heatmap.half_life);
+    GHashTableIter iter;
+    HeatmapBlock *hb;
+    RAMBlock *block;
+    uint64_t i;
+
+    memory_global_dirty_log_sync();
+
+    WITH_RCU_READ_LOCK_GUARD() {
+        RAMBLOCK_FOREACH_MIGRATABLE(block) {
+            dirty_heatmap_scan_block(block, dirty_heatmap_block_get(block));
+        }
+    }
+    /* Forget the blocks that were unplugged */
+    g_hash_table_foreach_remove(dirty_heatmap.blocks,
+                                dirty_heatmap_block_unseen, NULL);
+
+    g_hash_table_iter_init(&iter, dirty_heatmap.blocks);
+    while (g_hash_table_iter_next(&iter, NULL, (gpointer *)&hb)) {
+        for (i = 0; i < hb->nregions; i++) {
+            double rate = hb->count[i] * 1000.0 / elapsed;
+
+            if (!discard) {
+                hb->rate[i] = hb->rate[i] * decay + rate * (1 - decay);
+            }
+            hb->count[i] = 0;
+        }
+        hb->seen = false;
+    }
+
+    dirty_heatmap.last_update = now;
+    if (!discard) {
+        dirty_heatmap.samples++;
+        trace_dirty_heatmap_update(dirty_heatmap.samples, elapsed);
+    }
+}
+
+static void *dirty_heatmap_thread(void *opaque)
+{
+    rcu_register_thread();
+
+    while (qemu_sem_timedwait(&dirty_heatmap.stop_sem,
+                              dirty_heatmap.period) < 0) {
+        qemu_mutex_lock_iothread();
+        /*
+         * The migration consumes the same dirty bitmap, leave it alone
+         * until it is over and restart the measure afterwards.
+         */
+        if (migration_is_running(migrate_get_current()->state)) {
+            dirty_heatmap.paused = true;
+        } else {
+            dirty_heatmap_update(dirty_heatmap.paused);
+            dirty_heatmap.paused = false;
+        }
+        qemu_mutex_unlock_iothread();
+    }
+
+    rcu_unregister_thread();
+    return NULL;
+}
+
+void qmp_dirty_heatmap_start(bool has_granularity, uint64_t granularity,
+                             bool has_period, int64_t period,
+                             bool has_half_life, int64_t half_life,
+                             Error **errp)
+{
+    if (dirty_heatmap.running) {
+        error_setg(errp, "the dirty heatmap is already running.");
+        return;
+    }
+
+    if (!has_granularity) {
+        granularity = DIRTY_HEATMAP_DEFAULT_GRANULARITY;
+    }
+    if (!has_period) {
+        period = DIRTY_HEATMAP_DEFAULT_PERIOD_MS;
+    }
+    if (!has_half_life) {
+        half_life = MAX(DIRTY_HEATMAP_DEFAULT_HALF_LIFE_MS, period);
+    }
+
+    if (!is_power_of_2(granularity) || granularity < TARGET_PAGE_SIZE ||
+        granularity > GiB) {
+        error_setg(errp, "granularity must be a power of two between "
+                   "%d and %" PRIu64 ".", TARGET_PAGE_SIZE, (uint64_t)GiB);
+        return;
+    }
+    if (period < DIRTY_HEATMAP_MIN_PERIOD_MS ||
+        period > DIRTY_HEATMAP_MAX_PERIOD_MS) {
+        error_setg(errp, "period is out of range[%d, %d].",
+                   DIRTY_HEATMAP_MIN_PERIOD_MS, DIRTY_HEATMAP_MAX_PERIOD_MS);
+        return;
+    }
+    if (half_life < period) {
+        error_setg(errp, "half-life must be at least the period.");
+        return;
+    }
+
+    if (dirty_heatmap.blocks) {
+        g_hash_table_destroy(dirty_heatmap.blocks);
+    }
+    dirty_heatmap.blocks = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                                 NULL,
+                                                 dirty_heatmap_block_free);
+    dirty_heatmap.granularity = granularity;
+    dirty_heatmap.period = period;
+    dirty_heatmap.half_life = half_life;
+    dirty_heatmap.samples = 0;
+    /* Make the first update discard whatever was logged so far */
+    dirty_heatmap.paused = true;
+    dirty_heatmap.running = true;
+
+    memory_global_dirty_log_start(GLOBAL_DIRTY_HEATMAP);
+
+    qemu_sem_init(&dirty_heatmap.stop_sem, 0);
+    qemu_thread_create(&dirty_heatmap.thread, "dirty-heatmap",
+                       dirty_heatmap_thread, NULL, QEMU_THREAD_JOINABLE);
+}
+
+void qmp_dirty_heatmap_stop(Error **errp)
+{
+    if (!dirty_heatmap.running) {
+        return;
+    }
+
+    qemu_sem_post(&dirty_heatmap.stop_sem);
+    qemu_mutex_unlock_iothread();
+    qemu_thread_join(&dirty_heatmap.thread);
+    qemu_mutex_lock_iothread();
+    qemu_sem_destroy(&dirty_heatmap.stop_sem);
+
+    memory_global_dirty_log_stop(GLOBAL_DIRTY_HEATMAP);
+    dirty_heatmap.running = false;
+    dirty_heatmap.paused = false;
+}
+
+/* Hexadecimal digit n for 2^(n-1) to 2^n - 1 pages per second */
+static char dirty_heatmap_level(double rate)
+{
+    uint64_t pages = rate + 0.5;
+    int level = pages ? MIN(64 - clz64(pages), 15) : 0;
+
+    return "0123456789abcdef"[level];
+}
+
+DirtyHeatmapInfo *qmp_query_dirty_heatmap(Error **errp)
+{
+    DirtyHeatmapInfo *info = g_new0(DirtyHeatmapInfo, 1);
+    DirtyHeatmapBlockList **tail = &info->blocks;
+    GHashTableIter iter;
+    HeatmapBlock *hb;
+    double total = 0;
+    uint64_t i;
+
+    info->running = dirty_heatmap.running;
+    info->paused = dirty_heatmap.paused && dirty_heatmap.samples;
+    info->granularity = dirty_heatmap.granularity;
+    info->period = dirty_heatmap.period;
+    info->half_life = dirty_heatmap.half_life;
+    info->samples = dirty_heatmap.samples;
+
+    if (dirty_heatmap.blocks) {
+        g_hash_table_iter_init(&iter, dirty_heatmap.blocks);
+        while (g_hash_table_iter_next(&iter, NULL, (gpointer *)&hb)) {
+            DirtyHeatmapBlock *block = g_new0(DirtyHeatmapBlock, 1);
+            double rate = 0;
+
+            block->id = g_strdup(hb->idstr);
+            block->size = hb->size;
+            block->heat = g_malloc(hb->nregions + 1);
+            for (i = 0; i < hb->nregions; i++) {
+                block->heat[i] = dirty_heatmap_level(hb->rate[i]);
+                rate += hb->rate[i];
+            }
+            block->heat[hb->nregions] = '\0';
+            block->dirty_rate = rate * TARGET_PAGE_SIZE / MiB;
+            total += rate;
+            QAPI_LIST_APPEND(tail, block);
+        }
+    }
+    info->dirty_rate = total * TARGET_PAGE_SIZE / MiB;
+
+    return info;
+}
+
 void hmp_info_dirty_rate(Monitor *mon, const QDict *qdict)
 {
     DirtyRateInfo *info = query_dirty_rate_info();
@@ -854,3 +1178,32 @@ void hmp_calc_dirty_rate(Monitor *mon, const QDict *qdict)
                    " seconds\n", sec);
     monitor_printf(mon, "[Please use 'info dirty_rate' to check results]\n");
 }
+
+void hmp_info_dirty_heatmap(Monitor *mon, const QDict *qdict)
+{
+    DirtyHeatmapInfo *info = qmp_query_dirty_heatmap(NULL);
+    DirtyHeatmapBlockList *block;
+    size_t len, i;
+
+    monitor_printf(mon, "Status: %s\n", !info->running ? "stopped" :
+                   info->paused ? "paused" : "running");
+    monitor_printf(mon, "Granularity: %" PRIu64 " (bytes)\n",
+                   info->granularity);
+    monitor_printf(mon, "Period: %" PRIi64 " (ms)\n", info->period);
+    monitor_printf(mon, "Half-life: %" PRIi64 " (ms)\n", info->half_life);
+    monitor_printf(mon, "Samples: %" PRIu64 "\n", info->samples);
+    monitor_printf(mon, "Dirty rate: %" PRIi64 " (MB/s)\n", info->dirty_rate);
+
+    for (block = info->blocks; block; block = block->next) {
+        monitor_printf(mon, "%s: %" PRIu64 " bytes, %" PRIi64 " (MB/s)\n",
+                       block->value->id, block->value->size,
+                       block->value->dirty_rate);
+        /* 64 regions per line */
+        len = strlen(block->value->heat);
+        for (i = 0; i < len; i += 64) {
+            monitor_printf(mon, "  %.64s\n", block->value->heat + i);
+        }
+    }
+
+    qapi_free_DirtyHeatmapInfo(info);
+}
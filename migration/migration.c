@@ -24,6 +24,8 @@
 #include "sysemu/runstate.h"
 #include "sysemu/sysemu.h"
 #include "sysemu/cpu-throttle.h"
+#include "sysemu/kvm.h"
+#include "sysemu/dirtylimit.h"
 #include "rdma.h"
 #include "ram.h"
 #include "migration/global_state.h"
@@ -102,6 +104,22 @@
 /* 0: means nocompress, 1: best speed, ... 20: best compress ratio */
 #define DEFAULT_MIGRATE_MULTIFD_ZSTD_LEVEL 1
 
+/* Number of threads used for the dirty bitmap sync, 1 means serial */
+#define DEFAULT_MIGRATE_DIRTY_SYNC_THREADS 1
+#define MAX_MIGRATE_DIRTY_SYNC_THREADS 64
+
+/* Threads resolving write faults during background snapshot */
+#define DEFAULT_MIGRATE_SNAPSHOT_FAULT_THREADS 0
+#define MAX_MIGRATE_SNAPSHOT_FAULT_THREADS 16
+
+/* Threads reading userfaultfd faults during postcopy */
+#define DEFAULT_MIGRATE_POSTCOPY_FAULT_THREADS 1
+#define MAX_MIGRATE_POSTCOPY_FAULT_THREADS 16
+
+/* Threads placing received pages during postcopy, 0 means inline */
+#define DEFAULT_MIGRATE_POSTCOPY_PLACE_THREADS 0
+#define MAX_MIGRATE_POSTCOPY_PLACE_THREADS 16
+
 /* Background transfer rate for postcopy, 0 means unlimited, note
  * that page requests can still exceed this limit.
  */
@@ -164,7 +182,9 @@ INITIALIZE_MIGRATE_CAPS_SET(check_caps_background_snapshot,
     MIGRATION_CAPABILITY_XBZRLE,
     MIGRATION_CAPABILITY_X_COLO,
     MIGRATION_CAPABILITY_VALIDATE_UUID,
-    MIGRATION_CAPABILITY_ZERO_COPY_SEND);
+    MIGRATION_CAPABILITY_ZERO_COPY_SEND,
+    MIGRATION_CAPABILITY_COLD_PAGES_FIRST,
+    MIGRATION_CAPABILITY_DIRTY_LIMIT);
 
 /* When we add fault tolerance, we could have several
    migrations at once.  For now we don't need to add
@@ -225,6 +245,7 @@ void migration_object_init(void)
     current_incoming->page_requested = g_tree_new(page_request_addr_cmp);
 
     migration_object_check(current_migration, &error_fatal);
+    vmstate_set_compile(current_migration->vmstate_compile);
 
     blk_mig_init();
     ram_mig_init();
@@ -354,14 +375,13 @@ static bool migrate_late_block_activate(void)
  * Send a message on the return channel back to the source
  * of the migration.
  */
-static int migrate_send_rp_message(MigrationIncomingState *mis,
-                                   enum mig_rp_message_type message_type,
-                                   uint16_t len, void *data)
+static int migrate_send_rp_message_locked(MigrationIncomingState *mis,
+                                          enum mig_rp_message_type message_type,
+                                          uint16_t len, void *data)
 {
     int ret = 0;
 
     trace_migrate_send_rp_message((int)message_type, len);
-    QEMU_LOCK_GUARD(&mis->rp_mutex);
 
     /*
      * It's possible that the file handle got lost due to network
@@ -383,6 +403,14 @@ static int migrate_send_rp_message(MigrationIncomingState *mis,
     return ret;
 }
 
+static int migrate_send_rp_message(MigrationIncomingState *mis,
+                                   enum mig_rp_message_type message_type,
+                                   uint16_t len, void *data)
+{
+    QEMU_LOCK_GUARD(&mis->rp_mutex);
+    return migrate_send_rp_message_locked(mis, message_type, len, data);
+}
+
 /* Request one page from the source VM at the given start address.
  *   rb: the RAMBlock to request the page in
  *   Start: Address offset within the RB
@@ -402,10 +430,11 @@ int migrate_send_rp_message_req_pages(MigrationIncomingState *mis,
     *(uint32_t *)(bufc + 8) = cpu_to_be32((uint32_t)len);
 
     /*
-     * We maintain the last ramblock that we requested for page.  Note that we
-     * don't need locking because this function will only be called within the
-     * postcopy ram fault thread.
+     * We maintain the last ramblock that we requested for page.  The fault
+     * threads may request pages concurrently, so the message is sent with
+     * rp_mutex held to keep it consistent with last_rb.
      */
+    QEMU_LOCK_GUARD(&mis->rp_mutex);
     if (rb != mis->last_rb) {
         mis->last_rb = rb;
 
@@ -422,7 +451,7 @@ int migrate_send_rp_message_req_pages(MigrationIncomingState *mis,
         msg_type = MIG_RP_MSG_REQ_PAGES;
     }
 
-    return migrate_send_rp_message(mis, msg_type, msglen, bufc);
+    return migrate_send_rp_message_locked(mis, msg_type, msglen, bufc);
 }
 
 int migrate_send_rp_req_pages(MigrationIncomingState *mis,
@@ -436,10 +465,15 @@ int migrate_send_rp_req_pages(MigrationIncomingState *mis,
         if (!received && !g_tree_lookup(mis->page_requested, aligned)) {
             /*
              * The page has not been received, and it's not yet in the page
-             * request list.  Queue it.  Set the value of element to 1, so that
-             * things like g_tree_lookup() will return TRUE (1) when found.
+             * request list.  Queue it.  The value of the element is the
+             * time of the request in microseconds, used to account the
+             * fault latency; it's never 0, so that things like
+             * g_tree_lookup() will return TRUE when found.
              */
-            g_tree_insert(mis->page_requested, aligned, (gpointer)1);
+            uint32_t now = qemu_clock_get_us(QEMU_CLOCK_REALTIME);
+
+            g_tree_insert(mis->page_requested, aligned,
+                          GUINT_TO_POINTER(now | 1));
             mis->page_requested_count++;
             trace_postcopy_page_req_add(aligned, mis->page_requested_count);
         }
@@ -954,6 +988,14 @@ MigrationParameters *qmp_query_migrate_parameters(Error **errp)
     params->announce_rounds = s->parameters.announce_rounds;
     params->has_announce_step = true;
     params->announce_step = s->parameters.announce_step;
+    params->has_dirty_sync_threads = true;
+    params->dirty_sync_threads = s->parameters.dirty_sync_threads;
+    params->has_snapshot_fault_threads = true;
+    params->snapshot_fault_threads = s->parameters.snapshot_fault_threads;
+    params->has_postcopy_fault_threads = true;
+    params->postcopy_fault_threads = s->parameters.postcopy_fault_threads;
+    params->has_postcopy_place_threads = true;
+    params->postcopy_place_threads = s->parameters.postcopy_place_threads;
 
     if (s->parameters.has_block_bitmap_mapping) {
         params->has_block_bitmap_mapping = true;
@@ -1057,6 +1099,7 @@ static void populate_ram_info(MigrationInfo *info, MigrationState *s)
     info->ram->normal_bytes = ram_counters.normal * page_size;
     info->ram->mbps = s->mbps;
     info->ram->dirty_sync_count = ram_counters.dirty_sync_count;
+    info->ram->dirty_sync_time = ram_counters.dirty_sync_time;
     info->ram->dirty_sync_missed_zero_copy =
             ram_counters.dirty_sync_missed_zero_copy;
     info->ram->postcopy_requests = ram_counters.postcopy_requests;
@@ -1096,6 +1139,10 @@ static void populate_ram_info(MigrationInfo *info, MigrationState *s)
         info->cpu_throttle_percentage = cpu_throttle_get_percentage();
     }
 
+    if (migrate_background_snapshot()) {
+        ram_write_tracking_fill_info(info);
+    }
+
     if (s->state != MIGRATION_STATUS_COMPLETED) {
         info->ram->remaining = ram_bytes_remaining();
         info->ram->dirty_pages_rate = ram_counters.dirty_pages_rate;
@@ -1338,6 +1385,20 @@ static bool migrate_caps_check(bool *cap_list,
         }
     }
 
+    if (cap_list[MIGRATION_CAPABILITY_DIRTY_LIMIT]) {
+        if (cap_list[MIGRATION_CAPABILITY_AUTO_CONVERGE]) {
+            error_setg(errp, "dirty-limit is not compatible with "
+                       "auto-converge");
+            return false;
+        }
+
+        if (!kvm_enabled() || !kvm_dirty_ring_enabled()) {
+            error_setg(errp, "dirty-limit requires KVM with accelerator"
+                       " property 'dirty-ring-size' set");
+            return false;
+        }
+    }
+
     return true;
 }
 
@@ -1358,16 +1419,20 @@ static void fill_destination_migration_info(MigrationInfo *info)
     case MIGRATION_STATUS_CANCELLING:
     case MIGRATION_STATUS_CANCELLED:
     case MIGRATION_STATUS_ACTIVE:
+    case MIGRATION_STATUS_FAILED:
+    case MIGRATION_STATUS_COLO:
+        info->has_status = true;
+        break;
     case MIGRATION_STATUS_POSTCOPY_ACTIVE:
     case MIGRATION_STATUS_POSTCOPY_PAUSED:
     case MIGRATION_STATUS_POSTCOPY_RECOVER:
-    case MIGRATION_STATUS_FAILED:
-    case MIGRATION_STATUS_COLO:
         info->has_status = true;
+        fill_destination_postcopy_fault_latency(info);
         break;
     case MIGRATION_STATUS_COMPLETED:
         info->has_status = true;
         fill_destination_postcopy_migration_info(info);
+        fill_destination_postcopy_fault_latency(info);
         break;
     }
     info->status = mis->state;
@@ -1547,6 +1612,44 @@ static bool migrate_params_check(MigrationParameters *params, Error **errp)
        return false;
     }
 
+    if (params->has_dirty_sync_threads &&
+        (params->dirty_sync_threads < 1 ||
+         params->dirty_sync_threads > MAX_MIGRATE_DIRTY_SYNC_THREADS)) {
+        error_setg(errp, QERR_INVALID_PARAMETER_VALUE,
+                   "dirty_sync_threads",
+                   "a value between 1 and "
+                   stringify(MAX_MIGRATE_DIRTY_SYNC_THREADS));
+        return false;
+    }
+
+    if (params->has_snapshot_fault_threads &&
+        params->snapshot_fault_threads > MAX_MIGRATE_SNAPSHOT_FAULT_THREADS) {
+        error_setg(errp, QERR_INVALID_PARAMETER_VALUE,
+                   "snapshot_fault_threads",
+                   "a value between 0 and "
+                   stringify(MAX_MIGRATE_SNAPSHOT_FAULT_THREADS));
+        return false;
+    }
+
+    if (params->has_postcopy_fault_threads &&
+        (params->postcopy_fault_threads < 1 ||
+         params->postcopy_fault_threads > MAX_MIGRATE_POSTCOPY_FAULT_THREADS)) {
+        error_setg(errp, QERR_INVALID_PARAMETER_VALUE,
+                   "postcopy_fault_threads",
+                   "a value between 1 and "
+                   stringify(MAX_MIGRATE_POSTCOPY_FAULT_THREADS));
+        return false;
+    }
+
+    if (params->has_postcopy_place_threads &&
+        params->postcopy_place_threads > MAX_MIGRATE_POSTCOPY_PLACE_THREADS) {
+        error_setg(errp, QERR_INVALID_PARAMETER_VALUE,
+                   "postcopy_place_threads",
+                   "a value between 0 and "
+                   stringify(MAX_MIGRATE_POSTCOPY_PLACE_THREADS));
+        return false;
+    }
+
     if (params->has_block_bitmap_mapping &&
         !check_dirty_bitmap_mig_alias_map(params->block_bitmap_mapping, errp)) {
         error_prepend(errp, "Invalid mapping given for block-bitmap-mapping: ");
@@ -1657,6 +1760,18 @@ static void migrate_params_test_apply(MigrateSetParameters *params,
     if (params->has_announce_step) {
         dest->announce_step = params->announce_step;
     }
+    if (params->has_dirty_sync_threads) {
+        dest->dirty_sync_threads = params->dirty_sync_threads;
+    }
+    if (params->has_snapshot_fault_threads) {
+        dest->snapshot_fault_threads = params->snapshot_fault_threads;
+    }
+    if (params->has_postcopy_fault_threads) {
+        dest->postcopy_fault_threads = params->postcopy_fault_threads;
+    }
+    if (params->has_postcopy_place_threads) {
+        dest->postcopy_place_threads = params->postcopy_place_threads;
+    }
 
     if (params->has_block_bitmap_mapping) {
         dest->has_block_bitmap_mapping = true;
@@ -1774,6 +1889,18 @@ static void migrate_params_apply(MigrateSetParameters *params, Error **errp)
     if (params->has_announce_step) {
         s->parameters.announce_step = params->announce_step;
     }
+    if (params->has_dirty_sync_threads) {
+        s->parameters.dirty_sync_threads = params->dirty_sync_threads;
+    }
+    if (params->has_snapshot_fault_threads) {
+        s->parameters.snapshot_fault_threads = params->snapshot_fault_threads;
+    }
+    if (params->has_postcopy_fault_threads) {
+        s->parameters.postcopy_fault_threads = params->postcopy_fault_threads;
+    }
+    if (params->has_postcopy_place_threads) {
+        s->parameters.postcopy_place_threads = params->postcopy_place_threads;
+    }
 
     if (params->has_block_bitmap_mapping) {
         qapi_free_BitmapMigrationNodeAliasList(
@@ -2574,6 +2701,24 @@ bool migrate_validate_uuid(void)
     return s->enabled_capabilities[MIGRATION_CAPABILITY_VALIDATE_UUID];
 }
 
+bool migrate_cold_pages_first(void)
+{
+    MigrationState *s;
+
+    s = migrate_get_current();
+
+    return s->enabled_capabilities[MIGRATION_CAPABILITY_COLD_PAGES_FIRST];
+}
+
+bool migrate_dirty_limit(void)
+{
+    MigrationState *s;
+
+    s = migrate_get_current();
+
+    return s->enabled_capabilities[MIGRATION_CAPABILITY_DIRTY_LIMIT];
+}
+
 bool migrate_use_events(void)
 {
     MigrationState *s;
@@ -2639,6 +2784,42 @@ int migrate_multifd_zstd_level(void)
     return s->parameters.multifd_zstd_level;
 }
 
+int migrate_dirty_sync_threads(void)
+{
+    MigrationState *s;
+
+    s = migrate_get_current();
+
+    return s->parameters.dirty_sync_threads;
+}
+
+int migrate_snapshot_fault_threads(void)
+{
+    MigrationState *s;
+
+    s = migrate_get_current();
+
+    return s->parameters.snapshot_fault_threads;
+}
+
+int migrate_postcopy_fault_threads(void)
+{
+    MigrationState *s;
+
+    s = migrate_get_current();
+
+    return s->parameters.postcopy_fault_threads;
+}
+
+int migrate_postcopy_place_threads(void)
+{
+    MigrationState *s;
+
+    s = migrate_get_current();
+
+    return s->parameters.postcopy_place_threads;
+}
+
 #ifdef CONFIG_LINUX
 bool migrate_use_zero_copy_send(void)
 {
@@ -3770,6 +3951,8 @@ static void migration_iteration_finish(MigrationState *s)
     cpu_throttle_stop();
 
     qemu_mutex_lock_iothread();
+    /* Likewise for the vCPU dirty page rate limits of dirty-limit. */
+    dirtylimit_cancel_budget();
     switch (s->state) {
     case MIGRATION_STATUS_COMPLETED:
         migration_calculate_complete(s);
@@ -4299,6 +4482,10 @@ void migration_global_dump(Monitor *mon)
                    ms->decompress_error_check ? "on" : "off");
     monitor_printf(mon, "clear-bitmap-shift: %u\n",
                    ms->clear_bitmap_shift);
+    monitor_printf(mon, "vmstate-save-threads: %u\n",
+                   ms->vmstate_save_threads);
+    monitor_printf(mon, "ktls: %s\n",
+                   ms->ktls ? "on" : "off");
 }
 
 #define DEFINE_PROP_MIG_CAP(name, x)             \
@@ -4315,6 +4502,11 @@ static Property migration_properties[] = {
                       decompress_error_check, true),
     DEFINE_PROP_UINT8("x-clear-bitmap-shift", MigrationState,
                       clear_bitmap_shift, CLEAR_BITMAP_SHIFT_DEFAULT),
+    DEFINE_PROP_UINT8("x-vmstate-save-threads", MigrationState,
+                      vmstate_save_threads, 1),
+    DEFINE_PROP_BOOL("x-ktls", MigrationState, ktls, false),
+    DEFINE_PROP_BOOL("x-vmstate-compile", MigrationState,
+                     vmstate_compile, true),
 
     /* Migration parameters */
     DEFINE_PROP_UINT8("x-compress-level", MigrationState,
@@ -4380,6 +4572,18 @@ static Property migration_properties[] = {
     DEFINE_PROP_SIZE("announce-step", MigrationState,
                       parameters.announce_step,
                       DEFAULT_MIGRATE_ANNOUNCE_STEP),
+    DEFINE_PROP_UINT8("dirty-sync-threads", MigrationState,
+                      parameters.dirty_sync_threads,
+                      DEFAULT_MIGRATE_DIRTY_SYNC_THREADS),
+    DEFINE_PROP_UINT8("snapshot-fault-threads", MigrationState,
+                      parameters.snapshot_fault_threads,
+                      DEFAULT_MIGRATE_SNAPSHOT_FAULT_THREADS),
+    DEFINE_PROP_UINT8("postcopy-fault-threads", MigrationState,
+                      parameters.postcopy_fault_threads,
+                      DEFAULT_MIGRATE_POSTCOPY_FAULT_THREADS),
+    DEFINE_PROP_UINT8("postcopy-place-threads", MigrationState,
+                      parameters.postcopy_place_threads,
+                      DEFAULT_MIGRATE_POSTCOPY_PLACE_THREADS),
     DEFINE_PROP_BOOL("x-postcopy-preempt-break-huge", MigrationState,
                       postcopy_preempt_break_huge, true),
     DEFINE_PROP_STRING("tls-creds", MigrationState, parameters.tls_creds),
@@ -4403,6 +4607,9 @@ static Property migration_properties[] = {
     DEFINE_PROP_MIG_CAP("x-multifd", MIGRATION_CAPABILITY_MULTIFD),
     DEFINE_PROP_MIG_CAP("x-background-snapshot",
             MIGRATION_CAPABILITY_BACKGROUND_SNAPSHOT),
+    DEFINE_PROP_MIG_CAP("x-cold-pages-first",
+            MIGRATION_CAPABILITY_COLD_PAGES_FIRST),
+    DEFINE_PROP_MIG_CAP("x-dirty-limit", MIGRATION_CAPABILITY_DIRTY_LIMIT),
 #ifdef CONFIG_LINUX
     DEFINE_PROP_MIG_CAP("x-zero-copy-send",
             MIGRATION_CAPABILITY_ZERO_COPY_SEND),
@@ -4473,6 +4680,10 @@ static void migration_instance_init(Object *obj)
     params->has_announce_max = true;
     params->has_announce_rounds = true;
     params->has_announce_step = true;
+    params->has_dirty_sync_threads = true;
+    params->has_snapshot_fault_threads = true;
+    params->has_postcopy_fault_threads = true;
+    params->has_postcopy_place_threads = true;
     params->has_tls_creds = true;
     params->has_tls_hostname = true;
     params->has_tls_authz = true;
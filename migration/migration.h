@@ -91,6 +91,9 @@ struct MigrationIncomingState {
     QemuThread     fault_thread;
     /* Set this when we want the fault thread to quit */
     bool           fault_thread_quit;
+    /* Additional threads reading the userfault_fd */
+    struct PostcopyFaultShard *fault_shards;
+    unsigned int   fault_shard_count;
 
     bool           have_listen_thread;
     QemuThread     listen_thread;
@@ -139,6 +142,8 @@ struct MigrationIncomingState {
     void     *postcopy_tmp_zero_page;
     /* PostCopyFD's for external userfaultfds & handlers of shared memory */
     GArray   *postcopy_remote_fds;
+    /* Threads placing the pages of the precopy channel during postcopy */
+    struct PostcopyPlaceContext *place_ctx;
 
     QEMUBH *bh;
 
@@ -186,6 +191,12 @@ struct MigrationIncomingState {
      * contains valid information.
      */
     QemuMutex page_request_mutex;
+    /*
+     * Histogram of the time from a page request to the placement of the
+     * page, in power of two microsecond buckets.  Protected by
+     * page_request_mutex.
+     */
+    uint64_t page_request_latency[32];
 };
 
 MigrationIncomingState *migration_incoming_get_current(void);
@@ -195,6 +206,7 @@ void migration_incoming_transport_cleanup(MigrationIncomingState *mis);
  * Functions to work with blocktime context
  */
 void fill_destination_postcopy_migration_info(MigrationInfo *info);
+void fill_destination_postcopy_fault_latency(MigrationInfo *info);
 
 #define TYPE_MIGRATION "migration"
 
@@ -369,6 +381,29 @@ struct MigrationState {
      */
     uint8_t clear_bitmap_shift;
 
+    /*
+     * Number of threads used to save the state of devices while the VM
+     * is stopped.  Only devices whose state can be saved without side
+     * effects are handled by the extra threads, see
+     * vmstate_save_is_read_only().  1 means everything is saved by the
+     * migration thread.
+     */
+    uint8_t vmstate_save_threads;
+
+    /*
+     * Whether to hand the record encryption of TLS channels over to
+     * the kernel once the handshake is done, when it supports the
+     * negotiated cipher.  The peer does not need to do the same.
+     */
+    bool ktls;
+
+    /*
+     * Whether to save and load device state through the compiled form
+     * of the VMStateDescriptions, see vmstate_set_compile().  The
+     * stream is the same either way.
+     */
+    bool vmstate_compile;
+
     /*
      * This save hostname when out-going migration starts
      */
@@ -407,6 +442,8 @@ bool migrate_zero_blocks(void);
 bool migrate_dirty_bitmaps(void);
 bool migrate_ignore_shared(void);
 bool migrate_validate_uuid(void);
+bool migrate_cold_pages_first(void);
+bool migrate_dirty_limit(void);
 
 bool migrate_auto_converge(void);
 bool migrate_use_multifd(void);
@@ -415,6 +452,10 @@ int migrate_multifd_channels(void);
 MultiFDCompression migrate_multifd_compression(void);
 int migrate_multifd_zlib_level(void);
 int migrate_multifd_zstd_level(void);
+int migrate_dirty_sync_threads(void);
+int migrate_snapshot_fault_threads(void);
+int migrate_postcopy_fault_threads(void);
+int migrate_postcopy_place_threads(void);
 
 #ifdef CONFIG_LINUX
 bool migrate_use_zero_copy_send(void);
@@ -776,6 +776,7 @@ static void multifd_tls_outgoing_handshake(QIOTask *task,
         trace_multifd_tls_outgoing_handshake_error(ioc, error_get_pretty(err));
     } else {
         trace_multifd_tls_outgoing_handshake_complete(ioc);
+        migration_tls_enable_ktls(ioc);
     }
 
     if (!multifd_channel_connect(p, ioc, err)) {
@@ -19,6 +19,7 @@
 #include "qemu/osdep.h"
 #include "qemu/rcu.h"
 #include "qemu/madvise.h"
+#include "qemu/host-utils.h"
 #include "exec/target_page.h"
 #include "migration.h"
 #include "qemu-file.h"
@@ -55,6 +56,14 @@ struct PostcopyDiscardState {
     unsigned int nsentcmds;
 };
 
+/* Additional thread reading the userfaultfd of QEMU during postcopy */
+typedef struct PostcopyFaultShard {
+    MigrationIncomingState *mis;
+    QemuThread thread;
+    /* To notify the shard to wake, like userfault_event_fd */
+    int event_fd;
+} PostcopyFaultShard;
+
 static NotifierWithReturnList postcopy_notifier_list;
 
 void postcopy_infrastructure_init(void)
@@ -564,6 +573,9 @@ static void postcopy_temp_pages_cleanup(MigrationIncomingState *mis)
     }
 }
 
+static void postcopy_fault_shards_cleanup(MigrationIncomingState *mis);
+static void postcopy_place_cleanup(MigrationIncomingState *mis);
+
 /*
  * At the end of a migration where postcopy_ram_incoming_init was called.
  */
@@ -579,11 +591,15 @@ int postcopy_ram_incoming_cleanup(MigrationIncomingState *mis)
     if (mis->have_fault_thread) {
         Error *local_err = NULL;
 
+        /* All the pages are received, stop the place threads */
+        postcopy_place_cleanup(mis);
+
         /* Let the fault thread quit */
         qatomic_set(&mis->fault_thread_quit, 1);
         postcopy_fault_thread_notify(mis);
         trace_postcopy_ram_incoming_cleanup_join();
         qemu_thread_join(&mis->fault_thread);
+        postcopy_fault_shards_cleanup(mis);
 
         if (postcopy_notify(POSTCOPY_NOTIFY_INBOUND_END, &local_err)) {
             error_report_err(local_err);
@@ -907,6 +923,177 @@ static void postcopy_pause_fault_thread(MigrationIncomingState *mis)
     trace_postcopy_pause_fault_thread_continued();
 }
 
+/* Faults read from the userfaultfd at once */
+#define POSTCOPY_FAULT_BATCH 16
+
+/*
+ * Read a batch of faults from the userfaultfd and request the missing
+ * pages from the source.
+ *
+ * Returns 0 on success, -1 if the userfaultfd can't be used anymore
+ */
+static int postcopy_ram_fault_read(MigrationIncomingState *mis)
+{
+    struct uffd_msg msgs[POSTCOPY_FAULT_BATCH];
+    ram_addr_t rb_offset;
+    RAMBlock *rb;
+    ssize_t len;
+    int i, ret;
+
+    len = read(mis->userfault_fd, msgs, sizeof(msgs));
+    if (len < 0) {
+        if (errno == EAGAIN) {
+            /*
+             * if a wake up happens on the other thread just after
+             * the poll, there is nothing to read.
+             */
+            return 0;
+        }
+        error_report("%s: Failed to read full userfault message: %s",
+                     __func__, strerror(errno));
+        return -1;
+    }
+    if (len == 0 || len % sizeof(msgs[0])) {
+        error_report("%s: Read %zd bytes from userfaultfd expected a "
+                     "multiple of %zd", __func__, len, sizeof(msgs[0]));
+        return -1; /* Lost alignment, don't know what we'd read next */
+    }
+
+    for (i = 0; i < len / sizeof(msgs[0]); i++) {
+        struct uffd_msg *msg = &msgs[i];
+
+        if (msg->event != UFFD_EVENT_PAGEFAULT) {
+            error_report("%s: Read unexpected event %ud from userfaultfd",
+                         __func__, msg->event);
+            continue; /* It's not a page fault, shouldn't happen */
+        }
+
+        rb = qemu_ram_block_from_host(
+                 (void *)(uintptr_t)msg->arg.pagefault.address,
+                 true, &rb_offset);
+        if (!rb) {
+            error_report("postcopy_ram_fault_thread: Fault outside guest: %"
+                         PRIx64, (uint64_t)msg->arg.pagefault.address);
+            return -1;
+        }
+
+        rb_offset = ROUND_DOWN(rb_offset, qemu_ram_pagesize(rb));
+        trace_postcopy_ram_fault_thread_request(msg->arg.pagefault.address,
+                                                qemu_ram_get_idstr(rb),
+                                                rb_offset,
+                                                msg->arg.pagefault.feat.ptid);
+        mark_postcopy_blocktime_begin(
+                (uintptr_t)(msg->arg.pagefault.address),
+                            msg->arg.pagefault.feat.ptid, rb);
+
+retry:
+        /*
+         * Send the request to the source - we want to request one
+         * of our host page sizes (which is >= TPS)
+         */
+        ret = postcopy_request_page(mis, rb, rb_offset,
+                                    msg->arg.pagefault.address);
+        if (ret) {
+            /* May be network failure, try to wait for recovery */
+            postcopy_pause_fault_thread(mis);
+            goto retry;
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * Additional fault threads: they only serve the userfaultfd of QEMU, the
+ * shared userfaultfds of other processes are left to the default thread.
+ * The kernel hands each fault to one reader, so a thread blocked sending
+ * a request doesn't hold back the faults of the other vCPUs.
+ */
+static void *postcopy_ram_fault_shard_thread(void *opaque)
+{
+    PostcopyFaultShard *shard = opaque;
+    MigrationIncomingState *mis = shard->mis;
+    struct pollfd pfd[2];
+
+    rcu_register_thread();
+
+    pfd[0].fd = mis->userfault_fd;
+    pfd[0].events = POLLIN;
+    pfd[1].fd = shard->event_fd;
+    pfd[1].events = POLLIN;
+
+    while (true) {
+        if (poll(pfd, ARRAY_SIZE(pfd), -1) == -1) {
+            error_report("%s: userfault poll: %s", __func__, strerror(errno));
+            break;
+        }
+
+        if (!mis->to_src_file) {
+            /* Hold until the return path is rebuilt, see the default thread */
+            postcopy_pause_fault_thread(mis);
+        }
+
+        if (pfd[1].revents) {
+            uint64_t tmp64 = 0;
+
+            /* Consume the signal */
+            if (read(shard->event_fd, &tmp64, 8) != 8) {
+                error_report("%s: read() failed", __func__);
+            }
+
+            if (qatomic_read(&mis->fault_thread_quit)) {
+                break;
+            }
+        }
+
+        if (pfd[0].revents && postcopy_ram_fault_read(mis)) {
+            break;
+        }
+    }
+
+    rcu_unregister_thread();
+    return NULL;
+}
+
+static int postcopy_fault_shards_setup(MigrationIncomingState *mis)
+{
+    unsigned int count = migrate_postcopy_fault_threads() - 1;
+    unsigned int i;
+
+    mis->fault_shards = g_new0(PostcopyFaultShard, count);
+    for (i = 0; i < count; i++) {
+        PostcopyFaultShard *shard = &mis->fault_shards[i];
+
+        shard->mis = mis;
+        shard->event_fd = eventfd(0, EFD_CLOEXEC);
+        if (shard->event_fd == -1) {
+            error_report("%s: Opening event fd: %s", __func__,
+                         strerror(errno));
+            return -1;
+        }
+        qemu_thread_create(&shard->thread, "fault-shard",
+                           postcopy_ram_fault_shard_thread, shard,
+                           QEMU_THREAD_JOINABLE);
+        mis->fault_shard_count++;
+    }
+
+    return 0;
+}
+
+/* To be called after fault_thread_quit is set and the threads notified */
+static void postcopy_fault_shards_cleanup(MigrationIncomingState *mis)
+{
+    unsigned int i;
+
+    for (i = 0; i < mis->fault_shard_count; i++) {
+        qemu_thread_join(&mis->fault_shards[i].thread);
+        close(mis->fault_shards[i].event_fd);
+    }
+    g_free(mis->fault_shards);
+    mis->fault_shards = NULL;
+    mis->fault_shard_count = 0;
+}
+
 /*
  * Handle faults detected by the USERFAULT markings
  */
@@ -916,7 +1103,6 @@ static void *postcopy_ram_fault_thread(void *opaque)
     struct uffd_msg msg;
     int ret;
     size_t index;
-    RAMBlock *rb = NULL;
 
     trace_postcopy_ram_fault_thread_entry();
     rcu_register_thread();
@@ -943,7 +1129,6 @@ static void *postcopy_ram_fault_thread(void *opaque)
     }
 
     while (true) {
-        ram_addr_t rb_offset;
         int poll_result;
 
         /*
@@ -984,63 +1169,9 @@ static void *postcopy_ram_fault_thread(void *opaque)
 
         if (pfd[0].revents) {
             poll_result--;
-            ret = read(mis->userfault_fd, &msg, sizeof(msg));
-            if (ret != sizeof(msg)) {
-                if (errno == EAGAIN) {
-                    /*
-                     * if a wake up happens on the other thread just after
-                     * the poll, there is nothing to read.
-                     */
-                    continue;
-                }
-                if (ret < 0) {
-                    error_report("%s: Failed to read full userfault "
-                                 "message: %s",
-                                 __func__, strerror(errno));
-                    break;
-                } else {
-                    error_report("%s: Read %d bytes from userfaultfd "
-                                 "expected %zd",
-                                 __func__, ret, sizeof(msg));
-                    break; /* Lost alignment, don't know what we'd read next */
-                }
-            }
-            if (msg.event != UFFD_EVENT_PAGEFAULT) {
-                error_report("%s: Read unexpected event %ud from userfaultfd",
-                             __func__, msg.event);
-                continue; /* It's not a page fault, shouldn't happen */
-            }
-
-            rb = qemu_ram_block_from_host(
-                     (void *)(uintptr_t)msg.arg.pagefault.address,
-                     true, &rb_offset);
-            if (!rb) {
-                error_report("postcopy_ram_fault_thread: Fault outside guest: %"
-                             PRIx64, (uint64_t)msg.arg.pagefault.address);
+            if (postcopy_ram_fault_read(mis)) {
                 break;
             }
-
-            rb_offset = ROUND_DOWN(rb_offset, qemu_ram_pagesize(rb));
-            trace_postcopy_ram_fault_thread_request(msg.arg.pagefault.address,
-                                                qemu_ram_get_idstr(rb),
-                                                rb_offset,
-                                                msg.arg.pagefault.feat.ptid);
-            mark_postcopy_blocktime_begin(
-                    (uintptr_t)(msg.arg.pagefault.address),
-                                msg.arg.pagefault.feat.ptid, rb);
-
-retry:
-            /*
-             * Send the request to the source - we want to request one
-             * of our host page sizes (which is >= TPS)
-             */
-            ret = postcopy_request_page(mis, rb, rb_offset,
-                                        msg.arg.pagefault.address);
-            if (ret) {
-                /* May be network failure, try to wait for recovery */
-                postcopy_pause_fault_thread(mis);
-                goto retry;
-            }
         }
 
         /* Now handle any requests from external processes on shared memory */
@@ -1157,6 +1288,8 @@ static int postcopy_temp_pages_setup(MigrationIncomingState *mis)
     return 0;
 }
 
+static void postcopy_place_setup(MigrationIncomingState *mis);
+
 int postcopy_ram_incoming_setup(MigrationIncomingState *mis)
 {
     /* Open the fd for the kernel to give us userfaults */
@@ -1184,10 +1317,20 @@ int postcopy_ram_incoming_setup(MigrationIncomingState *mis)
         return -1;
     }
 
+    WITH_QEMU_LOCK_GUARD(&mis->page_request_mutex) {
+        memset(mis->page_request_latency, 0,
+               sizeof(mis->page_request_latency));
+    }
+
     postcopy_thread_create(mis, &mis->fault_thread, "fault-default",
                            postcopy_ram_fault_thread, QEMU_THREAD_JOINABLE);
     mis->have_fault_thread = true;
 
+    if (postcopy_fault_shards_setup(mis)) {
+        /* Error dumped in the sub-function */
+        return -1;
+    }
+
     /* Mark so that we get notified of accesses to unwritten areas */
     if (foreach_not_ignored_block(ram_block_enable_notify, mis)) {
         error_report("ram_block_enable_notify failed");
@@ -1199,6 +1342,8 @@ int postcopy_ram_incoming_setup(MigrationIncomingState *mis)
         return -1;
     }
 
+    postcopy_place_setup(mis);
+
     if (migrate_postcopy_preempt()) {
         /*
          * This thread needs to be created after the temp pages because
@@ -1214,42 +1359,77 @@ int postcopy_ram_incoming_setup(MigrationIncomingState *mis)
     return 0;
 }
 
+/* Account the time from the request of a page to its placement */
+static void postcopy_fault_latency_add(MigrationIncomingState *mis,
+                                       uint32_t requested)
+{
+    uint32_t latency = (uint32_t)qemu_clock_get_us(QEMU_CLOCK_REALTIME) -
+                       requested;
+    int bucket = latency ? 32 - clz32(latency) : 0;
+
+    mis->page_request_latency[MIN(bucket, 31)]++;
+}
+
+/*
+ * Place @len bytes (a multiple of the host page size of @rb) at
+ * @host_addr, copied from @from_addr or zeroed if it is NULL.
+ */
 static int qemu_ufd_copy_ioctl(MigrationIncomingState *mis, void *host_addr,
-                               void *from_addr, uint64_t pagesize, RAMBlock *rb)
+                               void *from_addr, uint64_t len, RAMBlock *rb)
 {
     int userfault_fd = mis->userfault_fd;
-    int ret;
+    size_t pagesize = qemu_ram_pagesize(rb);
+    uint64_t placed, offset;
+    int ret, err;
 
     if (from_addr) {
         struct uffdio_copy copy_struct;
         copy_struct.dst = (uint64_t)(uintptr_t)host_addr;
         copy_struct.src = (uint64_t)(uintptr_t)from_addr;
-        copy_struct.len = pagesize;
+        copy_struct.len = len;
         copy_struct.mode = 0;
         ret = ioctl(userfault_fd, UFFDIO_COPY, &copy_struct);
+        /* A failed copy of several pages may still have placed a few */
+        placed = ret ? MAX(copy_struct.copy, 0) : len;
     } else {
         struct uffdio_zeropage zero_struct;
         zero_struct.range.start = (uint64_t)(uintptr_t)host_addr;
-        zero_struct.range.len = pagesize;
+        zero_struct.range.len = len;
         zero_struct.mode = 0;
         ret = ioctl(userfault_fd, UFFDIO_ZEROPAGE, &zero_struct);
+        placed = ret ? 0 : len;
+    }
+    placed = ROUND_DOWN(placed, pagesize);
+    if (!placed) {
+        return ret;
     }
-    if (!ret) {
-        qemu_mutex_lock(&mis->page_request_mutex);
-        ramblock_recv_bitmap_set_range(rb, host_addr,
-                                       pagesize / qemu_target_page_size());
+
+    /* Callers report the errno of a failed copy */
+    err = errno;
+    qemu_mutex_lock(&mis->page_request_mutex);
+    ramblock_recv_bitmap_set_range(rb, host_addr,
+                                   placed / qemu_target_page_size());
+    for (offset = 0; offset < placed; offset += pagesize) {
+        void *page = host_addr + offset;
+        gpointer requested = g_tree_lookup(mis->page_requested, page);
+
         /*
          * If this page resolves a page fault for a previous recorded faulted
          * address, take a special note to maintain the requested page list.
          */
-        if (g_tree_lookup(mis->page_requested, host_addr)) {
-            g_tree_remove(mis->page_requested, host_addr);
+        if (requested) {
+            postcopy_fault_latency_add(mis, GPOINTER_TO_UINT(requested));
+            g_tree_remove(mis->page_requested, page);
             mis->page_requested_count--;
-            trace_postcopy_page_req_del(host_addr, mis->page_requested_count);
+            trace_postcopy_page_req_del(page, mis->page_requested_count);
         }
-        qemu_mutex_unlock(&mis->page_request_mutex);
-        mark_postcopy_blocktime_end((uintptr_t)host_addr);
     }
+    qemu_mutex_unlock(&mis->page_request_mutex);
+
+    for (offset = 0; offset < placed; offset += pagesize) {
+        mark_postcopy_blocktime_end((uintptr_t)host_addr + offset);
+    }
+    errno = err;
     return ret;
 }
 
@@ -1325,12 +1505,329 @@ int postcopy_place_page_zero(MigrationIncomingState *mis, void *host,
     }
 }
 
+/* Host pages placed with a single UFFDIO_COPY at most */
+#define POSTCOPY_PLACE_BATCH_PAGES 64
+
+/* A run of contiguous host pages waiting to be placed */
+typedef struct PostcopyPlaceBatch {
+    RAMBlock *rb;
+    /* Host address of the first page */
+    void *host;
+    /* Number of host pages */
+    unsigned int pages;
+    uint8_t *buf;
+    QSIMPLEQ_ENTRY(PostcopyPlaceBatch) next;
+} PostcopyPlaceBatch;
+
+typedef struct PostcopyPlaceContext {
+    QemuThread *threads;
+    int thread_count;
+    QemuMutex lock;
+    /* Signaled when a batch is queued, or when one is placed */
+    QemuCond cond;
+    PostcopyPlaceBatch *batches;
+    uint8_t *buf;
+    QSIMPLEQ_HEAD(, PostcopyPlaceBatch) free;
+    QSIMPLEQ_HEAD(, PostcopyPlaceBatch) queued;
+    /* Batches queued or being placed */
+    int in_flight;
+    /* First placement error, reported by postcopy_place_flush() */
+    int error;
+    bool quit;
+    /* Batch being filled, only accessed by the ram load thread */
+    PostcopyPlaceBatch *current;
+} PostcopyPlaceContext;
+
+static int postcopy_place_batch(MigrationIncomingState *mis,
+                                PostcopyPlaceBatch *batch)
+{
+    size_t pagesize = qemu_ram_pagesize(batch->rb);
+    unsigned int i;
+    int ret;
+
+    if (batch->pages > 1 &&
+        !qemu_ufd_copy_ioctl(mis, batch->host, batch->buf,
+                             batch->pages * pagesize, batch->rb)) {
+        trace_postcopy_place_batch(batch->host, batch->pages);
+        for (i = 0; i < batch->pages; i++) {
+            ret = postcopy_notify_shared_wake(batch->rb,
+                      qemu_ram_block_host_offset(batch->rb, batch->host) +
+                      i * pagesize);
+            if (ret) {
+                return ret;
+            }
+        }
+        return 0;
+    }
+
+    /* Go page by page to report the page that can't be placed */
+    for (i = 0; i < batch->pages; i++) {
+        void *host = batch->host + i * pagesize;
+
+        if (ramblock_recv_bitmap_test(batch->rb, host)) {
+            continue;
+        }
+        /*
+         * EEXIST means the page is there already, e.g. placed by the part
+         * of the batch copy that went through: still wake up the sharers
+         */
+        if (qemu_ufd_copy_ioctl(mis, host, batch->buf + i * pagesize,
+                                pagesize, batch->rb) && errno != EEXIST) {
+            int e = errno;
+            error_report("%s: %s copy host: %p (size: %zd)",
+                         __func__, strerror(e), host, pagesize);
+            return -e;
+        }
+        ret = postcopy_notify_shared_wake(batch->rb,
+                  qemu_ram_block_host_offset(batch->rb, host));
+        if (ret) {
+            return ret;
+        }
+    }
+    return 0;
+}
+
+static void *postcopy_place_thread(void *opaque)
+{
+    MigrationIncomingState *mis = opaque;
+    PostcopyPlaceContext *ctx = mis->place_ctx;
+    PostcopyPlaceBatch *batch;
+    int ret;
+
+    rcu_register_thread();
+
+    qemu_mutex_lock(&ctx->lock);
+    while (true) {
+        while (!ctx->quit && QSIMPLEQ_EMPTY(&ctx->queued)) {
+            qemu_cond_wait(&ctx->cond, &ctx->lock);
+        }
+        batch = QSIMPLEQ_FIRST(&ctx->queued);
+        if (!batch) {
+            break;
+        }
+        QSIMPLEQ_REMOVE_HEAD(&ctx->queued, next);
+        qemu_mutex_unlock(&ctx->lock);
+
+        ret = postcopy_place_batch(mis, batch);
+
+        qemu_mutex_lock(&ctx->lock);
+        if (ret && !ctx->error) {
+            ctx->error = ret;
+        }
+        QSIMPLEQ_INSERT_TAIL(&ctx->free, batch, next);
+        ctx->in_flight--;
+        qemu_cond_broadcast(&ctx->cond);
+    }
+    qemu_mutex_unlock(&ctx->lock);
+
+    rcu_unregister_thread();
+    return NULL;
+}
+
+static void postcopy_place_setup(MigrationIncomingState *mis)
+{
+    size_t pagesize = qemu_real_host_page_size();
+    size_t batch_size = POSTCOPY_PLACE_BATCH_PAGES * pagesize;
+    int thread_count = migrate_postcopy_place_threads();
+    PostcopyPlaceContext *ctx;
+    int i, nr_batches;
+
+    if (!thread_count) {
+        return;
+    }
+
+    /* Enough batches to fill one while the others are placed */
+    nr_batches = thread_count + 1;
+    ctx = g_new0(PostcopyPlaceContext, 1);
+    qemu_mutex_init(&ctx->lock);
+    qemu_cond_init(&ctx->cond);
+    QSIMPLEQ_INIT(&ctx->free);
+    QSIMPLEQ_INIT(&ctx->queued);
+    ctx->buf = qemu_memalign(pagesize, nr_batches * batch_size);
+    ctx->batches = g_new0(PostcopyPlaceBatch, nr_batches);
+    for (i = 0; i < nr_batches; i++) {
+        ctx->batches[i].buf = ctx->buf + i * batch_size;
+        QSIMPLEQ_INSERT_TAIL(&ctx->free, &ctx->batches[i], next);
+    }
+    mis->place_ctx = ctx;
+
+    ctx->thread_count = thread_count;
+    ctx->threads = g_new0(QemuThread, thread_count);
+    for (i = 0; i < thread_count; i++) {
+        qemu_thread_create(&ctx->threads[i], "postcopy/place",
+                           postcopy_place_thread, mis, QEMU_THREAD_JOINABLE);
+    }
+}
+
+static void postcopy_place_cleanup(MigrationIncomingState *mis)
+{
+    PostcopyPlaceContext *ctx = mis->place_ctx;
+    int i;
+
+    if (!ctx) {
+        return;
+    }
+
+    postcopy_place_flush(mis);
+
+    qemu_mutex_lock(&ctx->lock);
+    ctx->quit = true;
+    qemu_cond_broadcast(&ctx->cond);
+    qemu_mutex_unlock(&ctx->lock);
+    for (i = 0; i < ctx->thread_count; i++) {
+        qemu_thread_join(&ctx->threads[i]);
+    }
+
+    g_free(ctx->threads);
+    g_free(ctx->batches);
+    qemu_vfree(ctx->buf);
+    qemu_cond_destroy(&ctx->cond);
+    qemu_mutex_destroy(&ctx->lock);
+    g_free(ctx);
+    mis->place_ctx = NULL;
+}
+
+/* Hand the batch being filled over to the place threads */
+static void postcopy_place_submit(PostcopyPlaceContext *ctx)
+{
+    if (!ctx->current) {
+        return;
+    }
+
+    qemu_mutex_lock(&ctx->lock);
+    QSIMPLEQ_INSERT_TAIL(&ctx->queued, ctx->current, next);
+    qemu_cond_signal(&ctx->cond);
+    qemu_mutex_unlock(&ctx->lock);
+    ctx->current = NULL;
+}
+
+static bool postcopy_page_is_requested(MigrationIncomingState *mis,
+                                       void *host)
+{
+    QEMU_LOCK_GUARD(&mis->page_request_mutex);
+    return g_tree_lookup(mis->page_requested, host);
+}
+
+int postcopy_place_page_batched(MigrationIncomingState *mis, void *host,
+                                void *from, RAMBlock *rb, bool flush)
+{
+    PostcopyPlaceContext *ctx = mis->place_ctx;
+    size_t pagesize = qemu_ram_pagesize(rb);
+    PostcopyPlaceBatch *batch;
+
+    if (!ctx || pagesize != qemu_real_host_page_size()) {
+        return postcopy_place_page(mis, host, from, rb);
+    }
+
+    batch = ctx->current;
+    if (batch && (batch->rb != rb ||
+                  batch->host + batch->pages * pagesize != host)) {
+        postcopy_place_submit(ctx);
+        batch = NULL;
+    }
+
+    if (!batch) {
+        qemu_mutex_lock(&ctx->lock);
+        while (QSIMPLEQ_EMPTY(&ctx->free)) {
+            qemu_cond_wait(&ctx->cond, &ctx->lock);
+        }
+        batch = QSIMPLEQ_FIRST(&ctx->free);
+        QSIMPLEQ_REMOVE_HEAD(&ctx->free, next);
+        ctx->in_flight++;
+        qemu_mutex_unlock(&ctx->lock);
+
+        batch->rb = rb;
+        batch->host = host;
+        batch->pages = 0;
+        ctx->current = batch;
+    }
+
+    memcpy(batch->buf + batch->pages * pagesize, from, pagesize);
+    batch->pages++;
+
+    /* Don't delay the pages a vCPU is waiting for */
+    if (flush || batch->pages == POSTCOPY_PLACE_BATCH_PAGES ||
+        postcopy_page_is_requested(mis, host)) {
+        postcopy_place_submit(ctx);
+    }
+
+    return qatomic_read(&ctx->error);
+}
+
+int postcopy_place_flush(MigrationIncomingState *mis)
+{
+    PostcopyPlaceContext *ctx = mis->place_ctx;
+    int ret;
+
+    if (!ctx) {
+        return 0;
+    }
+
+    postcopy_place_submit(ctx);
+
+    qemu_mutex_lock(&ctx->lock);
+    while (ctx->in_flight) {
+        qemu_cond_wait(&ctx->cond, &ctx->lock);
+    }
+    ret = ctx->error;
+    qemu_mutex_unlock(&ctx->lock);
+
+    return ret;
+}
+
+/*
+ * Populate MigrationInfo with the latency of the page faults on the
+ * destination, once postcopy requested a page.
+ *
+ * @info: pointer to MigrationInfo to populate
+ */
+void fill_destination_postcopy_fault_latency(MigrationInfo *info)
+{
+    MigrationIncomingState *mis = migration_incoming_get_current();
+    uint64_t hist[ARRAY_SIZE(mis->page_request_latency)];
+    PostcopyFaultLatency *lat;
+    uint64_t count = 0, sum = 0;
+    int i;
+
+    WITH_QEMU_LOCK_GUARD(&mis->page_request_mutex) {
+        memcpy(hist, mis->page_request_latency, sizeof(hist));
+    }
+    for (i = 0; i < ARRAY_SIZE(hist); i++) {
+        count += hist[i];
+    }
+    if (!count) {
+        return;
+    }
+
+    lat = g_new0(PostcopyFaultLatency, 1);
+    lat->count = count;
+    for (i = 0; i < ARRAY_SIZE(hist); i++) {
+        sum += hist[i];
+        if (!lat->p50 && sum * 100 >= count * 50) {
+            lat->p50 = 1ULL << i;
+        }
+        if (!lat->p90 && sum * 100 >= count * 90) {
+            lat->p90 = 1ULL << i;
+        }
+        if (!lat->p99 && sum * 100 >= count * 99) {
+            lat->p99 = 1ULL << i;
+        }
+    }
+
+    info->has_postcopy_fault_latency = true;
+    info->postcopy_fault_latency = lat;
+}
+
 #else
 /* No target OS support, stubs just fail */
 void fill_destination_postcopy_migration_info(MigrationInfo *info)
 {
 }
 
+void fill_destination_postcopy_fault_latency(MigrationInfo *info)
+{
+}
+
 bool postcopy_ram_supported_by_host(MigrationIncomingState *mis)
 {
     error_report("%s: No OS support", __func__);
@@ -1382,6 +1879,18 @@ int postcopy_place_page_zero(MigrationIncomingState *mis, void *host,
     return -1;
 }
 
+int postcopy_place_page_batched(MigrationIncomingState *mis, void *host,
+                                void *from, RAMBlock *rb, bool flush)
+{
+    assert(0);
+    return -1;
+}
+
+int postcopy_place_flush(MigrationIncomingState *mis)
+{
+    return 0;
+}
+
 int postcopy_wake_shared(struct PostCopyFD *pcfd,
                          uint64_t client_addr,
                          RAMBlock *rb)
@@ -1406,6 +1915,7 @@ void postcopy_temp_page_reset(PostcopyTmpPage *tmp_page)
 void postcopy_fault_thread_notify(MigrationIncomingState *mis)
 {
     uint64_t tmp64 = 1;
+    unsigned int i;
 
     /*
      * Wakeup the fault_thread.  It's an eventfd that should currently
@@ -1416,6 +1926,14 @@ void postcopy_fault_thread_notify(MigrationIncomingState *mis)
         error_report("%s: incrementing failed: %s", __func__,
                      strerror(errno));
     }
+
+    /* The additional fault threads each have their own eventfd */
+    for (i = 0; i < mis->fault_shard_count; i++) {
+        if (write(mis->fault_shards[i].event_fd, &tmp64, 8) != 8) {
+            error_report("%s: incrementing failed: %s", __func__,
+                         strerror(errno));
+        }
+    }
 }
 
 /**
@@ -1584,7 +2102,9 @@ postcopy_preempt_tls_handshake(QIOTask *task, gpointer opaque)
     MigrationState *s = opaque;
     Error *local_err = NULL;
 
-    qio_task_propagate_error(task, &local_err);
+    if (!qio_task_propagate_error(task, &local_err)) {
+        migration_tls_enable_ktls(ioc);
+    }
     postcopy_preempt_send_channel_done(s, ioc, local_err);
 }
 
@@ -78,6 +78,23 @@ int postcopy_place_page(MigrationIncomingState *mis, void *host, void *from,
 int postcopy_place_page_zero(MigrationIncomingState *mis, void *host,
                              RAMBlock *rb);
 
+/*
+ * Place a page (from) at (host) from the postcopy place threads, together
+ * with the contiguous pages queued before it.  The data is copied, so
+ * (from) can be reused right away.  Pages that were requested by a fault
+ * and all the pages queued so far when (flush) is set are handed to the
+ * threads at once, the others can wait for more pages to batch.
+ * returns 0 on success, or the error of a previous placement
+ */
+int postcopy_place_page_batched(MigrationIncomingState *mis, void *host,
+                                void *from, RAMBlock *rb, bool flush);
+
+/*
+ * Wait for the pages queued by postcopy_place_page_batched() to be placed
+ * returns 0 on success
+ */
+int postcopy_place_flush(MigrationIncomingState *mis);
+
 /* The current postcopy state is read/set by postcopy_state_get/set
  * which update it atomically.
  * The state is updated as postcopy messages are received, and
@@ -556,6 +556,17 @@ void qemu_file_skip(QEMUFile *f, int size)
     }
 }
 
+/*
+ * Return the number of bytes that can be read without going back to the
+ * channel, i.e. without blocking.
+ */
+size_t qemu_file_buffered_bytes(QEMUFile *f)
+{
+    assert(!qemu_file_is_writable(f));
+
+    return f->buf_size - f->buf_index;
+}
+
 /*
  * Read 'size' bytes from file (at 'offset') without moving the
  * pointer and set 'buf' to point to that data.
@@ -121,6 +121,7 @@ int qemu_put_qemu_file(QEMUFile *f_des, QEMUFile *f_src);
  */
 int qemu_peek_byte(QEMUFile *f, int offset);
 void qemu_file_skip(QEMUFile *f, int size);
+size_t qemu_file_buffered_bytes(QEMUFile *f);
 /*
  * qemu_file_credit_transfer:
  *
@@ -53,14 +53,19 @@
 #include "migration/colo.h"
 #include "block.h"
 #include "sysemu/cpu-throttle.h"
+#include "sysemu/dirtylimit.h"
 #include "savevm.h"
 #include "qemu/iov.h"
+#include "qemu/stats64.h"
 #include "multifd.h"
 #include "sysemu/runstate.h"
 
 #include "hw/boards.h" /* for machine_dump_guest_core() */
+#include "hw/core/cpu.h"
 
 #if defined(__linux__)
+#include <poll.h>
+#include "qemu/event_notifier.h"
 #include "qemu/userfaultfd.h"
 #endif /* defined(__linux__) */
 
@@ -326,6 +331,12 @@ struct RAMState {
     uint32_t last_version;
     /* How many times we have dirty too many pages */
     int dirty_rate_high_cnt;
+    /*
+     * Percentage of the dirty page rate allowed by
+     * throttle-trigger-threshold that the guest gets with the
+     * dirty-limit capability
+     */
+    uint64_t dirty_limit_pct;
     /* these variables are used for bitmap sync */
     /* last time we did a full bitmap_sync */
     int64_t time_last_bitmap_sync;
@@ -343,6 +354,17 @@ struct RAMState {
     bool xbzrle_enabled;
     /* Are we on the last stage of migration */
     bool last_stage;
+    /*
+     * Skip frequently dirtied pages while searching for dirty pages, see
+     * the cold-pages-first capability.  Set at every bitmap sync and
+     * cleared once only such pages are left in the bitmap.
+     */
+    bool defer_hot_pages;
+    /*
+     * The dirty bitmap is also cleared by the write fault threads of
+     * background snapshot, so it must be updated with atomic operations
+     */
+    bool bmap_shared;
     /* compression statistics since the beginning of the period */
     /* amount of count that no free thread to compress data */
     uint64_t compress_thread_busy_prev;
@@ -713,6 +735,45 @@ static void mig_throttle_guest_down(uint64_t bytes_dirty_period,
     }
 }
 
+/**
+ * mig_dirty_limit_guest: limit the dirty page rate of the fastest vCPUs
+ *
+ * The guest gets a dirty page rate budget of dirty_limit_pct percent of
+ * the rate allowed by throttle-trigger-threshold over the last period,
+ * and it is spread among the vCPUs so that only those dirtying faster
+ * than their share are limited.  dirty_limit_pct shrinks by
+ * cpu-throttle-increment percent after every period in which too many
+ * pages got dirty, and grows back when there is plenty of headroom.
+ *
+ * @rs: current RAM state
+ * @bytes_dirty_period: bytes dirtied during the period
+ * @bytes_dirty_threshold: dirty bytes allowed during the period
+ * @period_ms: length of the period
+ */
+static void mig_dirty_limit_guest(RAMState *rs, uint64_t bytes_dirty_period,
+                                  uint64_t bytes_dirty_threshold,
+                                  int64_t period_ms)
+{
+    MigrationState *s = migrate_get_current();
+    uint64_t pct_increment = s->parameters.cpu_throttle_increment;
+    uint64_t budget;
+
+    if (bytes_dirty_period > bytes_dirty_threshold) {
+        rs->dirty_limit_pct = rs->dirty_limit_pct * (100 - pct_increment) / 100;
+        rs->dirty_limit_pct = MAX(rs->dirty_limit_pct, 1);
+    } else if (bytes_dirty_period < bytes_dirty_threshold / 2) {
+        rs->dirty_limit_pct = MIN(rs->dirty_limit_pct + pct_increment, 100);
+    }
+
+    /* dirtylimit works in MB/s */
+    budget = (bytes_dirty_threshold * 1000 / period_ms) >> 20;
+    budget = MAX(budget * rs->dirty_limit_pct / 100, 1);
+
+    trace_mig_dirty_limit_guest(bytes_dirty_period, bytes_dirty_threshold,
+                                rs->dirty_limit_pct, budget);
+    dirtylimit_set_budget(budget);
+}
+
 void mig_throttle_counter_reset(void)
 {
     RAMState *rs = ram_state;
@@ -871,6 +932,50 @@ unsigned long migration_bitmap_find_dirty(RAMState *rs, RAMBlock *rb,
     return find_next_bit(bitmap, size, start);
 }
 
+/*
+ * A word of the migration bitmap is hot if it was found dirty by at
+ * least two of the last four bitmap syncs.
+ */
+#define DIRTY_HISTORY_HOT_MASK  0xf0
+#define DIRTY_HISTORY_HOT_SYNCS 2
+
+static bool migration_bitmap_page_is_hot(RAMBlock *rb, unsigned long page)
+{
+    uint8_t history = rb->dirty_history[BIT_WORD(page)];
+
+    return ctpop8(history & DIRTY_HISTORY_HOT_MASK) >= DIRTY_HISTORY_HOT_SYNCS;
+}
+
+/**
+ * migration_bitmap_find_cold_dirty: find the next dirty page from start,
+ *   skipping the pages that are frequently dirtied
+ *
+ * Returns the page offset within memory region of the start of a dirty page
+ *
+ * @rs: current RAM state
+ * @rb: RAMBlock where to search for dirty pages
+ * @start: page where we start the search
+ */
+static unsigned long migration_bitmap_find_cold_dirty(RAMState *rs,
+                                                      RAMBlock *rb,
+                                                      unsigned long start)
+{
+    unsigned long size = rb->used_length >> TARGET_PAGE_BITS;
+    unsigned long page = migration_bitmap_find_dirty(rs, rb, start);
+
+    if (!rb->dirty_history) {
+        return page;
+    }
+
+    while (page < size && migration_bitmap_page_is_hot(rb, page)) {
+        page = migration_bitmap_find_dirty(rs, rb,
+                                           QEMU_ALIGN_UP(page + 1,
+                                                         BITS_PER_LONG));
+    }
+
+    return page;
+}
+
 static void migration_clear_memory_region_dirty_bitmap(RAMBlock *rb,
                                                        unsigned long page)
 {
@@ -951,6 +1056,14 @@ unsigned long colo_bitmap_find_dirty(RAMState *rs, RAMBlock *rb,
     return first;
 }
 
+/* Like test_and_clear_bit(), but safe against concurrent updates */
+static inline bool test_and_clear_bit_atomic(long nr, unsigned long *addr)
+{
+    unsigned long mask = BIT_MASK(nr);
+
+    return qatomic_fetch_and(&addr[BIT_WORD(nr)], ~mask) & mask;
+}
+
 static inline bool migration_bitmap_clear_dirty(RAMState *rs,
                                                 RAMBlock *rb,
                                                 unsigned long page)
@@ -967,7 +1080,11 @@ static inline bool migration_bitmap_clear_dirty(RAMState *rs,
      */
     migration_clear_memory_region_dirty_bitmap(rb, page);
 
-    ret = test_and_clear_bit(page, rb->bmap);
+    if (rs->bmap_shared) {
+        ret = test_and_clear_bit_atomic(page, rb->bmap);
+    } else {
+        ret = test_and_clear_bit(page, rb->bmap);
+    }
     if (ret) {
         rs->migration_dirty_pages--;
     }
@@ -1060,6 +1177,200 @@ static void ramblock_sync_dirty_bitmap(RAMState *rs, RAMBlock *rb)
     rs->num_dirty_pages_period += new_dirty_pages;
 }
 
+/* Part of a RAMBlock synchronized by one of the dirty sync threads */
+typedef struct {
+    RAMBlock *block;
+    ram_addr_t start;
+    ram_addr_t length;
+} DirtySyncChunk;
+
+/*
+ * Thread pool used to split the migration dirty bitmap sync of big
+ * RAMBlocks.  The migration thread queues the chunks, kicks the
+ * threads and then takes chunks itself until the queue is empty.
+ */
+static struct {
+    QemuThread *threads;
+    int thread_count;
+    bool quit;
+    /* posted once per thread to start processing the chunk queue */
+    QemuSemaphore sem;
+    /* posted by each thread when it found the chunk queue empty */
+    QemuSemaphore sem_done;
+    DirtySyncChunk *chunks;
+    unsigned int nr_chunks;
+    unsigned int max_chunks;
+    /* next chunk to process, atomically incremented by the threads */
+    unsigned int next_chunk;
+    /* new dirty pages found in this sync */
+    Stat64 num_dirty;
+} dirty_sync;
+
+/* Called with RCU critical section */
+static void dirty_sync_process_chunks(void)
+{
+    uint64_t num_dirty = 0;
+    unsigned int i;
+
+    while ((i = qatomic_fetch_inc(&dirty_sync.next_chunk)) <
+           dirty_sync.nr_chunks) {
+        DirtySyncChunk *chunk = &dirty_sync.chunks[i];
+
+        num_dirty += cpu_physical_memory_sync_dirty_bitmap(chunk->block,
+                                                           chunk->start,
+                                                           chunk->length);
+    }
+    stat64_add(&dirty_sync.num_dirty, num_dirty);
+}
+
+static void *dirty_sync_thread(void *opaque)
+{
+    rcu_register_thread();
+
+    while (true) {
+        qemu_sem_wait(&dirty_sync.sem);
+        if (qatomic_read(&dirty_sync.quit)) {
+            break;
+        }
+        WITH_RCU_READ_LOCK_GUARD() {
+            dirty_sync_process_chunks();
+        }
+        qemu_sem_post(&dirty_sync.sem_done);
+    }
+
+    rcu_unregister_thread();
+    return NULL;
+}
+
+static void dirty_sync_threads_cleanup(void)
+{
+    int i;
+
+    if (!dirty_sync.threads) {
+        return;
+    }
+
+    qatomic_set(&dirty_sync.quit, true);
+    for (i = 0; i < dirty_sync.thread_count; i++) {
+        qemu_sem_post(&dirty_sync.sem);
+    }
+    for (i = 0; i < dirty_sync.thread_count; i++) {
+        qemu_thread_join(dirty_sync.threads + i);
+    }
+    qemu_sem_destroy(&dirty_sync.sem);
+    qemu_sem_destroy(&dirty_sync.sem_done);
+    g_free(dirty_sync.threads);
+    g_free(dirty_sync.chunks);
+    memset(&dirty_sync, 0, sizeof(dirty_sync));
+}
+
+static void dirty_sync_threads_setup(void)
+{
+    int i;
+
+    if (dirty_sync.threads) {
+        return;
+    }
+
+    /* The migration thread is the first of the dirty sync threads */
+    dirty_sync.thread_count = migrate_dirty_sync_threads() - 1;
+    if (dirty_sync.thread_count <= 0) {
+        dirty_sync.thread_count = 0;
+        return;
+    }
+
+    dirty_sync.quit = false;
+    qemu_sem_init(&dirty_sync.sem, 0);
+    qemu_sem_init(&dirty_sync.sem_done, 0);
+    dirty_sync.threads = g_new0(QemuThread, dirty_sync.thread_count);
+    for (i = 0; i < dirty_sync.thread_count; i++) {
+        qemu_thread_create(dirty_sync.threads + i, "mig/dirtysync",
+                           dirty_sync_thread, NULL, QEMU_THREAD_JOINABLE);
+    }
+}
+
+/*
+ * Queue @rb for a parallel sync if its bitmap can be processed in
+ * chunks, i.e. it takes the word-aligned fast path of
+ * cpu_physical_memory_sync_dirty_bitmap() and defers the clear of the
+ * dirty log through clear_bmap.  Chunks are aligned to the clear_bmap
+ * granularity so that no two threads share a clear_bmap bit.
+ *
+ * Returns false if the block must be synchronized as a whole.
+ */
+static bool dirty_sync_queue_block(RAMBlock *rb)
+{
+    ram_addr_t word_size = (ram_addr_t)BITS_PER_LONG << TARGET_PAGE_BITS;
+    ram_addr_t chunk_size, start;
+
+    if (!rb->clear_bmap || (rb->offset & (word_size - 1)) ||
+        (rb->used_length & (word_size - 1))) {
+        return false;
+    }
+
+    chunk_size = (ram_addr_t)1 << (rb->clear_bmap_shift + TARGET_PAGE_BITS);
+    chunk_size = MAX(chunk_size, word_size);
+    if (rb->used_length <= chunk_size) {
+        return false;
+    }
+
+    for (start = 0; start < rb->used_length; start += chunk_size) {
+        DirtySyncChunk *chunk;
+
+        if (dirty_sync.nr_chunks == dirty_sync.max_chunks) {
+            dirty_sync.max_chunks = MAX(dirty_sync.max_chunks * 2, 64);
+            dirty_sync.chunks = g_renew(DirtySyncChunk, dirty_sync.chunks,
+                                        dirty_sync.max_chunks);
+        }
+        chunk = &dirty_sync.chunks[dirty_sync.nr_chunks++];
+        chunk->block = rb;
+        chunk->start = start;
+        chunk->length = MIN(chunk_size, rb->used_length - start);
+    }
+
+    return true;
+}
+
+/* Called with RCU critical section and bitmap_mutex held */
+static void ram_sync_dirty_bitmaps(RAMState *rs)
+{
+    RAMBlock *block;
+    uint64_t num_dirty;
+    int i;
+
+    if (!dirty_sync.thread_count) {
+        RAMBLOCK_FOREACH_NOT_IGNORED(block) {
+            ramblock_sync_dirty_bitmap(rs, block);
+        }
+        return;
+    }
+
+    dirty_sync.nr_chunks = 0;
+    dirty_sync.next_chunk = 0;
+    stat64_init(&dirty_sync.num_dirty, 0);
+    RAMBLOCK_FOREACH_NOT_IGNORED(block) {
+        if (!dirty_sync_queue_block(block)) {
+            ramblock_sync_dirty_bitmap(rs, block);
+        }
+    }
+
+    if (!dirty_sync.nr_chunks) {
+        return;
+    }
+
+    for (i = 0; i < dirty_sync.thread_count; i++) {
+        qemu_sem_post(&dirty_sync.sem);
+    }
+    dirty_sync_process_chunks();
+    for (i = 0; i < dirty_sync.thread_count; i++) {
+        qemu_sem_wait(&dirty_sync.sem_done);
+    }
+
+    num_dirty = stat64_get(&dirty_sync.num_dirty);
+    rs->migration_dirty_pages += num_dirty;
+    rs->num_dirty_pages_period += num_dirty;
+}
+
 /**
  * ram_pagesize_summary: calculate all the pagesizes of a VM
  *
@@ -1139,7 +1450,7 @@ static void migration_update_rates(RAMState *rs, int64_t end_time)
     }
 }
 
-static void migration_trigger_throttle(RAMState *rs)
+static void migration_trigger_throttle(RAMState *rs, int64_t end_time)
 {
     MigrationState *s = migrate_get_current();
     uint64_t threshold = s->parameters.throttle_trigger_threshold;
@@ -1165,13 +1476,15 @@ static void migration_trigger_throttle(RAMState *rs)
             mig_throttle_guest_down(bytes_dirty_period,
                                     bytes_dirty_threshold);
         }
+    } else if (migrate_dirty_limit() && !blk_mig_bulk_active()) {
+        mig_dirty_limit_guest(rs, bytes_dirty_period, bytes_dirty_threshold,
+                              end_time - rs->time_last_bitmap_sync);
     }
 }
 
 static void migration_bitmap_sync(RAMState *rs)
 {
-    RAMBlock *block;
-    int64_t end_time;
+    int64_t start_time_us, end_time;
 
     ram_counters.dirty_sync_count++;
 
@@ -1180,25 +1493,28 @@ static void migration_bitmap_sync(RAMState *rs)
     }
 
     trace_migration_bitmap_sync_start();
+    start_time_us = qemu_clock_get_us(QEMU_CLOCK_REALTIME);
     memory_global_dirty_log_sync();
 
     qemu_mutex_lock(&rs->bitmap_mutex);
     WITH_RCU_READ_LOCK_GUARD() {
-        RAMBLOCK_FOREACH_NOT_IGNORED(block) {
-            ramblock_sync_dirty_bitmap(rs, block);
-        }
+        ram_sync_dirty_bitmaps(rs);
         ram_counters.remaining = ram_bytes_remaining();
     }
     qemu_mutex_unlock(&rs->bitmap_mutex);
 
     memory_global_after_dirty_log_sync();
-    trace_migration_bitmap_sync_end(rs->num_dirty_pages_period);
+    ram_counters.dirty_sync_time = qemu_clock_get_us(QEMU_CLOCK_REALTIME) -
+                                   start_time_us;
+    rs->defer_hot_pages = migrate_cold_pages_first();
+    trace_migration_bitmap_sync_end(rs->num_dirty_pages_period,
+                                    ram_counters.dirty_sync_time);
 
     end_time = qemu_clock_get_ms(QEMU_CLOCK_REALTIME);
 
     /* more than 1 second = 1000 millisecons */
     if (end_time > rs->time_last_bitmap_sync + 1000) {
-        migration_trigger_throttle(rs);
+        migration_trigger_throttle(rs, end_time);
 
         migration_update_rates(rs, end_time);
 
@@ -1551,7 +1867,12 @@ static bool find_dirty_block(RAMState *rs, PageSearchStatus *pss, bool *again)
     pss->postcopy_requested = false;
     pss->postcopy_target_channel = RAM_CHANNEL_PRECOPY;
 
-    pss->page = migration_bitmap_find_dirty(rs, pss->block, pss->page);
+    if (rs->defer_hot_pages) {
+        pss->page = migration_bitmap_find_cold_dirty(rs, pss->block,
+                                                     pss->page);
+    } else {
+        pss->page = migration_bitmap_find_dirty(rs, pss->block, pss->page);
+    }
     if (pss->complete_round && pss->block == rs->last_seen_block &&
         pss->page >= rs->last_page) {
         /*
@@ -1642,6 +1963,30 @@ static RAMBlock *unqueue_page(RAMState *rs, ram_addr_t *offset)
     return block;
 }
 
+/**
+ * migration_page_queue_add: queue pages to be sent urgently
+ *
+ * @rs: current RAM state
+ * @block: block that contains the pages
+ * @start: offset of the first page inside the block
+ * @len: length of the range in bytes
+ */
+static void migration_page_queue_add(RAMState *rs, RAMBlock *block,
+                                     ram_addr_t start, ram_addr_t len)
+{
+    struct RAMSrcPageRequest *new_entry =
+        g_new0(struct RAMSrcPageRequest, 1);
+    new_entry->rb = block;
+    new_entry->offset = start;
+    new_entry->len = len;
+
+    memory_region_ref(block->mr);
+    qemu_mutex_lock(&rs->src_page_req_mutex);
+    QSIMPLEQ_INSERT_TAIL(&rs->src_page_requests, new_entry, next_req);
+    migration_make_urgent_request();
+    qemu_mutex_unlock(&rs->src_page_req_mutex);
+}
+
 #if defined(__linux__)
 /**
  * poll_fault_page: try to get next UFFD write fault page and, if pending fault
@@ -1660,7 +2005,8 @@ static RAMBlock *poll_fault_page(RAMState *rs, ram_addr_t *offset)
     RAMBlock *block;
     int res;
 
-    if (!migrate_background_snapshot()) {
+    /* The write fault threads read the events when they run */
+    if (!migrate_background_snapshot() || rs->bmap_shared) {
         return NULL;
     }
 
@@ -1675,6 +2021,9 @@ static RAMBlock *poll_fault_page(RAMState *rs, ram_addr_t *offset)
     return block;
 }
 
+static void bg_fault_unprotected(RAMBlock *block, ram_addr_t offset,
+                                 ram_addr_t len);
+
 /**
  * ram_save_release_protection: release UFFD write protection after
  *   a range of pages has been saved
@@ -1700,11 +2049,502 @@ static int ram_save_release_protection(RAMState *rs, PageSearchStatus *pss,
         /* Un-protect memory range. */
         res = uffd_change_protection(rs->uffdio_fd, page_address, run_length,
                 false, false);
+        bg_fault_unprotected(pss->block, start_page << TARGET_PAGE_BITS,
+                             run_length);
     }
 
     return res;
 }
 
+/* Host pages that can wait in the staging ring of the fault threads */
+#define BG_FAULT_STAGING_PAGES  256
+/* Write faults read from userfaultfd at once */
+#define BG_FAULT_BATCH          16
+
+typedef struct BgFaultPage {
+    RAMBlock *block;
+    /* Offset of the host page inside the block */
+    ram_addr_t offset;
+    /* Copy of the host page, taken before it was un-protected */
+    uint8_t *data;
+    /* Number of dirty target pages claimed from the migration bitmap */
+    unsigned long claimed;
+    QSIMPLEQ_ENTRY(BgFaultPage) next;
+} BgFaultPage;
+
+/* A write fault left to the migration thread to resolve */
+typedef struct BgFaultWait {
+    RAMBlock *block;
+    ram_addr_t offset;
+    int64_t start_us;
+} BgFaultWait;
+
+/*
+ * Write fault threads of background snapshot.  Instead of leaving the
+ * faulting vCPU blocked until the migration thread has written the page
+ * to the stream, they copy the page into a staging ring, un-protect it
+ * right away and let the migration thread send the copy later.
+ */
+static struct {
+    QemuThread *threads;
+    int thread_count;
+    EventNotifier quit;
+    QemuMutex lock;
+    /* Signaled when a page is staged or a claim is dropped */
+    QemuCond ready_cond;
+    BgFaultPage *pages;
+    uint8_t *buf;
+    QSIMPLEQ_HEAD(, BgFaultPage) free;
+    QSIMPLEQ_HEAD(, BgFaultPage) ready;
+    /* Pages taken off the free list and not sent yet */
+    int pending;
+    /*
+     * Time each vCPU spent blocked on faults, in microseconds, from the
+     * moment a fault thread read the fault until its page was un-protected
+     */
+    Stat64 *vcpu_stall;
+    /* Per vCPU, protected by the lock */
+    BgFaultWait *vcpu_wait;
+    int nr_waiting;
+    int nr_vcpus;
+} bg_faults;
+
+typedef struct BgFaultRange {
+    RAMBlock *block;
+    ram_addr_t offset;
+    ram_addr_t len;
+    int vcpu;
+} BgFaultRange;
+
+static int bg_fault_range_cmp(const void *a, const void *b)
+{
+    const BgFaultRange *ra = a, *rb = b;
+
+    if (ra->block != rb->block) {
+        return (uintptr_t)ra->block < (uintptr_t)rb->block ? -1 : 1;
+    }
+    return (ra->offset > rb->offset) - (ra->offset < rb->offset);
+}
+
+static int bg_fault_vcpu_index(uint32_t tid)
+{
+    CPUState *cpu;
+
+    CPU_FOREACH(cpu) {
+        if (cpu->thread_id == tid) {
+            return cpu->cpu_index;
+        }
+    }
+    return -1;
+}
+
+/*
+ * Remember that @vcpu waits for the migration thread to un-protect the
+ * host page at @offset of @block, see bg_fault_unprotected()
+ */
+static void bg_fault_wait(int vcpu, RAMBlock *block, ram_addr_t offset,
+                          int64_t start_us)
+{
+    BgFaultWait *wait;
+
+    if (vcpu < 0 || vcpu >= bg_faults.nr_vcpus) {
+        return;
+    }
+
+    qemu_mutex_lock(&bg_faults.lock);
+    wait = &bg_faults.vcpu_wait[vcpu];
+    /*
+     * A vCPU has a single fault outstanding: an older entry is one that
+     * the migration thread resolved before it was recorded
+     */
+    if (!wait->block) {
+        qatomic_set(&bg_faults.nr_waiting, bg_faults.nr_waiting + 1);
+    }
+    wait->block = block;
+    wait->offset = offset;
+    wait->start_us = start_us;
+    qemu_mutex_unlock(&bg_faults.lock);
+}
+
+/* Charge the vCPUs waiting for a range the migration thread un-protected */
+static void bg_fault_unprotected(RAMBlock *block, ram_addr_t offset,
+                                 ram_addr_t len)
+{
+    int64_t now_us;
+    int i;
+
+    if (!qatomic_read(&bg_faults.nr_waiting)) {
+        return;
+    }
+
+    now_us = qemu_clock_get_us(QEMU_CLOCK_REALTIME);
+    qemu_mutex_lock(&bg_faults.lock);
+    for (i = 0; i < bg_faults.nr_vcpus; i++) {
+        BgFaultWait *wait = &bg_faults.vcpu_wait[i];
+
+        if (wait->block == block && wait->offset >= offset &&
+            wait->offset < offset + len) {
+            stat64_add(&bg_faults.vcpu_stall[i], now_us - wait->start_us);
+            wait->block = NULL;
+            qatomic_set(&bg_faults.nr_waiting, bg_faults.nr_waiting - 1);
+        }
+    }
+    qemu_mutex_unlock(&bg_faults.lock);
+}
+
+/* Put back a page that was not staged after all */
+static void bg_fault_page_release(BgFaultPage *page)
+{
+    qemu_mutex_lock(&bg_faults.lock);
+    QSIMPLEQ_INSERT_HEAD(&bg_faults.free, page, next);
+    bg_faults.pending--;
+    qemu_cond_signal(&bg_faults.ready_cond);
+    qemu_mutex_unlock(&bg_faults.lock);
+}
+
+/**
+ * bg_fault_stage_page: copy a write-protected host page to the staging ring
+ *
+ * Returns true if the page can be un-protected now, false if it is left
+ *   to the migration thread
+ *
+ * @rs: current RAM state
+ * @block: block that contains the page
+ * @offset: offset of the host page inside the block
+ */
+static bool bg_fault_stage_page(RAMState *rs, RAMBlock *block,
+                                ram_addr_t offset)
+{
+    size_t host_page_size = qemu_real_host_page_size();
+    unsigned long page = offset >> TARGET_PAGE_BITS;
+    unsigned long end = (offset + host_page_size) >> TARGET_PAGE_BITS;
+    BgFaultPage *staged;
+    unsigned long claimed = 0;
+
+    /* Not part of the snapshot */
+    if (offset >= block->used_length) {
+        return true;
+    }
+
+    if (block->page_size != host_page_size) {
+        migration_page_queue_add(rs, block, offset, block->page_size);
+        return false;
+    }
+
+    qemu_mutex_lock(&bg_faults.lock);
+    staged = QSIMPLEQ_FIRST(&bg_faults.free);
+    if (staged) {
+        QSIMPLEQ_REMOVE_HEAD(&bg_faults.free, next);
+        bg_faults.pending++;
+    }
+    qemu_mutex_unlock(&bg_faults.lock);
+
+    if (!staged) {
+        /* The ring is full, fall back to the migration thread */
+        migration_page_queue_add(rs, block, offset, host_page_size);
+        return false;
+    }
+
+    /*
+     * Copy the page before claiming its dirty bits.  The migration thread
+     * un-protects the whole host page it has been working on even when we
+     * took some of the bits from under it, so a page must never be clean
+     * in the bitmap before its content is safe in the staging ring.
+     */
+    memcpy(staged->data, block->host + offset, host_page_size);
+    for (; page < end; page++) {
+        claimed += test_and_clear_bit_atomic(page, block->bmap);
+    }
+    if (!claimed) {
+        /*
+         * The migration thread is saving the page; it will un-protect it
+         * once the data is out of its buffers
+         */
+        bg_fault_page_release(staged);
+        return false;
+    }
+
+    staged->block = block;
+    staged->offset = offset;
+    staged->claimed = claimed;
+
+    qemu_mutex_lock(&bg_faults.lock);
+    QSIMPLEQ_INSERT_TAIL(&bg_faults.ready, staged, next);
+    qemu_cond_signal(&bg_faults.ready_cond);
+    qemu_mutex_unlock(&bg_faults.lock);
+
+    return true;
+}
+
+/**
+ * bg_fault_handle: resolve a batch of write faults
+ *
+ * The staged pages are un-protected with one UFFDIO_WRITEPROTECT per
+ * contiguous range, which also wakes up the faulting vCPUs.  The others
+ * are left to the migration thread, which accounts for the vCPU stall
+ * once it un-protects them.
+ *
+ * @rs: current RAM state
+ * @msgs: write fault events read from userfaultfd
+ * @count: number of events
+ * @read_us: time at which the events were read
+ */
+static void bg_fault_handle(RAMState *rs, struct uffd_msg *msgs, int count,
+                            int64_t read_us)
+{
+    BgFaultRange ranges[BG_FAULT_BATCH];
+    int64_t stall_us = 0;
+    int nr_ranges = 0;
+    int i, j, k;
+
+    for (i = 0; i < count; i++) {
+        void *addr = (void *)(uintptr_t)msgs[i].arg.pagefault.address;
+        RAMBlock *block;
+        ram_addr_t offset;
+        int vcpu = -1;
+
+        if (msgs[i].event != UFFD_EVENT_PAGEFAULT) {
+            continue;
+        }
+
+        block = qemu_ram_block_from_host(addr, false, &offset);
+        assert(block && (block->flags & RAM_UF_WRITEPROTECT) != 0);
+        offset = ROUND_DOWN(offset, qemu_real_host_page_size());
+
+        if (bg_faults.vcpu_stall) {
+            vcpu = bg_fault_vcpu_index(msgs[i].arg.pagefault.feat.ptid);
+        }
+        if (!bg_fault_stage_page(rs, block, offset)) {
+            bg_fault_wait(vcpu, block, offset, read_us);
+            continue;
+        }
+
+        ranges[nr_ranges].block = block;
+        ranges[nr_ranges].offset = offset;
+        ranges[nr_ranges].len = qemu_real_host_page_size();
+        ranges[nr_ranges].vcpu = vcpu;
+        nr_ranges++;
+    }
+
+    qsort(ranges, nr_ranges, sizeof(ranges[0]), bg_fault_range_cmp);
+    for (i = 0; i < nr_ranges; i = j) {
+        ram_addr_t len = ranges[i].len;
+
+        for (j = i + 1; j < nr_ranges &&
+             ranges[j].block == ranges[i].block &&
+             ranges[j].offset <= ranges[i].offset + len; j++) {
+            len = MAX(len, ranges[j].offset + ranges[j].len -
+                           ranges[i].offset);
+        }
+        uffd_change_protection(rs->uffdio_fd,
+                               ranges[i].block->host + ranges[i].offset,
+                               len, false, false);
+
+        stall_us = qemu_clock_get_us(QEMU_CLOCK_REALTIME) - read_us;
+        for (k = i; k < j; k++) {
+            if (ranges[k].vcpu >= 0 && ranges[k].vcpu < bg_faults.nr_vcpus) {
+                stat64_add(&bg_faults.vcpu_stall[ranges[k].vcpu], stall_us);
+            }
+        }
+    }
+    trace_bg_fault_handle(count, nr_ranges, stall_us);
+}
+
+static void *bg_fault_thread(void *opaque)
+{
+    RAMState *rs = opaque;
+    struct uffd_msg msgs[BG_FAULT_BATCH];
+    struct pollfd pfd[2] = {
+        { .fd = rs->uffdio_fd, .events = POLLIN },
+        { .fd = event_notifier_get_fd(&bg_faults.quit), .events = POLLIN },
+    };
+    int64_t read_us;
+    int count;
+
+    rcu_register_thread();
+
+    while (true) {
+        if (poll(pfd, ARRAY_SIZE(pfd), -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            error_report("%s: poll failed: %s", __func__, strerror(errno));
+            break;
+        }
+        if (pfd[1].revents) {
+            break;
+        }
+
+        /* Other threads may have taken the events already */
+        count = uffd_read_events(rs->uffdio_fd, msgs, BG_FAULT_BATCH);
+        read_us = qemu_clock_get_us(QEMU_CLOCK_REALTIME);
+        if (count > 0) {
+            WITH_RCU_READ_LOCK_GUARD() {
+                bg_fault_handle(rs, msgs, count, read_us);
+            }
+        }
+    }
+
+    rcu_unregister_thread();
+    return NULL;
+}
+
+static void bg_fault_threads_start(RAMState *rs, bool thread_id)
+{
+    MachineState *ms = MACHINE(qdev_get_machine());
+    size_t host_page_size = qemu_real_host_page_size();
+    int thread_count = migrate_snapshot_fault_threads();
+    int i;
+
+    g_free(bg_faults.vcpu_stall);
+    bg_faults.vcpu_stall = NULL;
+    g_free(bg_faults.vcpu_wait);
+    bg_faults.vcpu_wait = NULL;
+    bg_faults.nr_waiting = 0;
+    bg_faults.nr_vcpus = 0;
+
+    if (!thread_count) {
+        return;
+    }
+
+    if (event_notifier_init(&bg_faults.quit, false) < 0) {
+        error_report("%s: cannot create event notifier", __func__);
+        return;
+    }
+    qemu_mutex_init(&bg_faults.lock);
+    qemu_cond_init(&bg_faults.ready_cond);
+    QSIMPLEQ_INIT(&bg_faults.free);
+    QSIMPLEQ_INIT(&bg_faults.ready);
+    bg_faults.pending = 0;
+
+    bg_faults.buf = qemu_memalign(host_page_size,
+                                  BG_FAULT_STAGING_PAGES * host_page_size);
+    bg_faults.pages = g_new0(BgFaultPage, BG_FAULT_STAGING_PAGES);
+    for (i = 0; i < BG_FAULT_STAGING_PAGES; i++) {
+        bg_faults.pages[i].data = bg_faults.buf + i * host_page_size;
+        QSIMPLEQ_INSERT_TAIL(&bg_faults.free, &bg_faults.pages[i], next);
+    }
+
+    if (thread_id) {
+        bg_faults.nr_vcpus = ms->smp.max_cpus;
+        bg_faults.vcpu_stall = g_new0(Stat64, bg_faults.nr_vcpus);
+        bg_faults.vcpu_wait = g_new0(BgFaultWait, bg_faults.nr_vcpus);
+    }
+
+    rs->bmap_shared = true;
+    bg_faults.thread_count = thread_count;
+    bg_faults.threads = g_new0(QemuThread, thread_count);
+    for (i = 0; i < thread_count; i++) {
+        qemu_thread_create(bg_faults.threads + i, "mig/snap/fault",
+                           bg_fault_thread, rs, QEMU_THREAD_JOINABLE);
+    }
+}
+
+static void bg_fault_threads_stop(RAMState *rs)
+{
+    int i;
+
+    if (!bg_faults.threads) {
+        return;
+    }
+
+    event_notifier_set(&bg_faults.quit);
+    for (i = 0; i < bg_faults.thread_count; i++) {
+        qemu_thread_join(bg_faults.threads + i);
+    }
+    g_free(bg_faults.threads);
+    bg_faults.threads = NULL;
+    bg_faults.thread_count = 0;
+    rs->bmap_shared = false;
+    /* The lock goes away, stop looking for waiting vCPUs */
+    qatomic_set(&bg_faults.nr_waiting, 0);
+
+    /* Pages still staged here were not needed: the snapshot was cancelled */
+    g_free(bg_faults.pages);
+    bg_faults.pages = NULL;
+    qemu_vfree(bg_faults.buf);
+    bg_faults.buf = NULL;
+    qemu_cond_destroy(&bg_faults.ready_cond);
+    qemu_mutex_destroy(&bg_faults.lock);
+    event_notifier_cleanup(&bg_faults.quit);
+}
+
+static int bg_fault_save_target_page(RAMState *rs, RAMBlock *block,
+                                     ram_addr_t offset, uint8_t *p)
+{
+    int len;
+
+    if (!buffer_is_zero(p, TARGET_PAGE_SIZE)) {
+        return save_normal_page(rs, block, offset, p, false);
+    }
+
+    len = save_page_header(rs, rs->f, block, offset | RAM_SAVE_FLAG_ZERO);
+    qemu_put_byte(rs->f, 0);
+    ram_counters.duplicate++;
+    ram_transferred_add(len + 1);
+    return 1;
+}
+
+/**
+ * bg_fault_save_page: send a host page staged by the write fault threads
+ *
+ * Returns the number of target pages written, 0 if nothing is staged
+ *
+ * @rs: current RAM state
+ * @wait: if nothing is staged, wait for the pages being copied
+ */
+static int bg_fault_save_page(RAMState *rs, bool wait)
+{
+    size_t host_page_size = qemu_real_host_page_size();
+    BgFaultPage *page;
+    ram_addr_t offset;
+    int pages = 0;
+
+    if (!bg_faults.threads) {
+        return 0;
+    }
+
+    qemu_mutex_lock(&bg_faults.lock);
+    while (wait && QSIMPLEQ_EMPTY(&bg_faults.ready) && bg_faults.pending) {
+        qemu_cond_wait(&bg_faults.ready_cond, &bg_faults.lock);
+    }
+    page = QSIMPLEQ_FIRST(&bg_faults.ready);
+    if (page) {
+        QSIMPLEQ_REMOVE_HEAD(&bg_faults.ready, next);
+    }
+    qemu_mutex_unlock(&bg_faults.lock);
+
+    if (!page) {
+        return 0;
+    }
+
+    for (offset = 0; offset < host_page_size; offset += TARGET_PAGE_SIZE) {
+        pages += bg_fault_save_target_page(rs, page->block,
+                                           page->offset + offset,
+                                           page->data + offset);
+    }
+    rs->migration_dirty_pages -= page->claimed;
+
+    bg_fault_page_release(page);
+    return pages;
+}
+
+void ram_write_tracking_fill_info(MigrationInfo *info)
+{
+    uint64List *list = NULL;
+    int i;
+
+    if (!bg_faults.vcpu_stall) {
+        return;
+    }
+
+    for (i = bg_faults.nr_vcpus - 1; i >= 0; i--) {
+        QAPI_LIST_PREPEND(list, stat64_get(&bg_faults.vcpu_stall[i]));
+    }
+    info->has_snapshot_vcpu_stall = true;
+    info->snapshot_vcpu_stall = list;
+}
+
 /* ram_write_tracking_available: check if kernel supports required UFFD features
  *
  * Returns true if supports, false otherwise
@@ -1861,12 +2701,21 @@ void ram_write_tracking_prepare(void)
  */
 int ram_write_tracking_start(void)
 {
+    uint64_t features = UFFD_FEATURE_PAGEFAULT_FLAG_WP;
+    uint64_t supported;
     int uffd_fd;
     RAMState *rs = ram_state;
     RAMBlock *block;
 
+    /* The fault threads account the stall time to the faulting vCPU */
+    if (migrate_snapshot_fault_threads() &&
+        !uffd_query_features(&supported) &&
+        (supported & UFFD_FEATURE_THREAD_ID)) {
+        features |= UFFD_FEATURE_THREAD_ID;
+    }
+
     /* Open UFFD file descriptor */
-    uffd_fd = uffd_create_fd(UFFD_FEATURE_PAGEFAULT_FLAG_WP, true);
+    uffd_fd = uffd_create_fd(features, true);
     if (uffd_fd < 0) {
         return uffd_fd;
     }
@@ -1897,6 +2746,8 @@ int ram_write_tracking_start(void)
                 block->host, block->max_length);
     }
 
+    bg_fault_threads_start(rs, features & UFFD_FEATURE_THREAD_ID);
+
     return 0;
 
 fail:
@@ -1931,6 +2782,8 @@ void ram_write_tracking_stop(void)
     RAMState *rs = ram_state;
     RAMBlock *block;
 
+    bg_fault_threads_stop(rs);
+
     RCU_READ_LOCK_GUARD();
 
     RAMBLOCK_FOREACH_NOT_IGNORED(block) {
@@ -1976,6 +2829,14 @@ static int ram_save_release_protection(RAMState *rs, PageSearchStatus *pss,
     return 0;
 }
 
+static int bg_fault_save_page(RAMState *rs, bool wait)
+{
+    (void) rs;
+    (void) wait;
+
+    return 0;
+}
+
 bool ram_write_tracking_available(void)
 {
     return false;
@@ -1997,6 +2858,10 @@ void ram_write_tracking_stop(void)
 {
     assert(0);
 }
+
+void ram_write_tracking_fill_info(MigrationInfo *info)
+{
+}
 #endif /* defined(__linux__) */
 
 /*
@@ -2202,17 +3067,7 @@ int ram_save_queue_pages(const char *rbname, ram_addr_t start, ram_addr_t len)
         return -1;
     }
 
-    struct RAMSrcPageRequest *new_entry =
-        g_new0(struct RAMSrcPageRequest, 1);
-    new_entry->rb = ramblock;
-    new_entry->offset = start;
-    new_entry->len = len;
-
-    memory_region_ref(ramblock->mr);
-    qemu_mutex_lock(&rs->src_page_req_mutex);
-    QSIMPLEQ_INSERT_TAIL(&rs->src_page_requests, new_entry, next_req);
-    migration_make_urgent_request();
-    qemu_mutex_unlock(&rs->src_page_req_mutex);
+    migration_page_queue_add(rs, ramblock, start, len);
 
     return 0;
 }
@@ -2522,6 +3377,19 @@ static int ram_save_host_page(RAMState *rs, PageSearchStatus *pss)
     return (res < 0 ? res : pages);
 }
 
+/*
+ * Whether the frequently dirtied pages left at the end of an iteration
+ * can stay dirty: they are resent anyway if the guest dirties them again
+ * before the next sync, and the stop-and-copy phase can take them all.
+ */
+static bool ram_hot_pages_can_wait(RAMState *rs)
+{
+    MigrationState *s = migrate_get_current();
+
+    return !rs->last_stage && !migration_in_postcopy() &&
+           rs->migration_dirty_pages * TARGET_PAGE_SIZE < s->threshold_size;
+}
+
 /**
  * ram_find_and_save_block: finds a dirty page and sends it to f
  *
@@ -2546,6 +3414,12 @@ static int ram_find_and_save_block(RAMState *rs)
         return pages;
     }
 
+    /* Pages copied by the write fault threads of background snapshot */
+    pages = bg_fault_save_page(rs, false);
+    if (pages) {
+        return pages;
+    }
+
     pss.block = rs->last_seen_block;
     pss.page = rs->last_page;
     pss.complete_round = false;
@@ -2575,8 +3449,31 @@ static int ram_find_and_save_block(RAMState *rs)
         if (found) {
             pages = ram_save_host_page(rs, &pss);
         }
+
+        if (!pages && !again && rs->defer_hot_pages) {
+            bool wait = ram_hot_pages_can_wait(rs);
+
+            /*
+             * Only frequently dirtied pages are left.  Leave them dirty
+             * for the next sync or the stop-and-copy phase if they fit in
+             * the downtime budget, send them now otherwise.
+             */
+            trace_ram_find_and_save_block_hot_pages(rs->migration_dirty_pages,
+                                                    wait);
+            rs->defer_hot_pages = false;
+            if (wait) {
+                break;
+            }
+            pss.complete_round = false;
+            again = true;
+        }
     } while (!pages && again);
 
+    if (!pages) {
+        /* Don't finish while the fault threads still copy claimed pages */
+        pages = bg_fault_save_page(rs, true);
+    }
+
     rs->last_seen_block = pss.block;
     rs->last_page = pss.page;
 
@@ -2683,10 +3580,13 @@ static void ram_save_cleanup(void *opaque)
         block->clear_bmap = NULL;
         g_free(block->bmap);
         block->bmap = NULL;
+        g_free(block->dirty_history);
+        block->dirty_history = NULL;
     }
 
     xbzrle_cleanup();
     compress_threads_save_cleanup();
+    dirty_sync_threads_cleanup();
     ram_state_cleanup(rsp);
 }
 
@@ -2999,6 +3899,7 @@ static int ram_state_init(RAMState **rsp)
     qemu_mutex_init(&(*rsp)->bitmap_mutex);
     qemu_mutex_init(&(*rsp)->src_page_req_mutex);
     QSIMPLEQ_INIT(&(*rsp)->src_page_requests);
+    (*rsp)->dirty_limit_pct = 100;
 
     /*
      * Count the total number of pages used by ram blocks not including any
@@ -3050,6 +3951,21 @@ static void ram_list_init_bitmaps(void)
     }
 }
 
+static void ram_list_init_dirty_history(void)
+{
+    RAMBlock *block;
+    unsigned long pages;
+
+    if (!migrate_cold_pages_first()) {
+        return;
+    }
+
+    RAMBLOCK_FOREACH_NOT_IGNORED(block) {
+        pages = block->max_length >> TARGET_PAGE_BITS;
+        block->dirty_history = g_new0(uint8_t, BITS_TO_LONGS(pages));
+    }
+}
+
 static void migration_bitmap_clear_discarded_pages(RAMState *rs)
 {
     unsigned long pages;
@@ -3075,6 +3991,11 @@ static void ram_init_bitmaps(RAMState *rs)
         if (!migrate_background_snapshot()) {
             memory_global_dirty_log_start(GLOBAL_DIRTY_MIGRATION);
             migration_bitmap_sync_precopy(rs);
+            /*
+             * The first sync finds the whole RAM dirty, only start
+             * recording the dirty history after it.
+             */
+            ram_list_init_dirty_history();
         }
     }
     qemu_mutex_unlock_ramlist();
@@ -3208,10 +4129,12 @@ static int ram_save_setup(QEMUFile *f, void *opaque)
     if (compress_threads_save_setup()) {
         return -1;
     }
+    dirty_sync_threads_setup();
 
     /* migration has already setup the bitmap, reuse it. */
     if (!migration_in_colo_state()) {
         if (ram_init_all(rsp) != 0) {
+            dirty_sync_threads_cleanup();
             compress_threads_save_cleanup();
             return -1;
         }
@@ -4121,6 +5044,16 @@ int ram_load_postcopy(QEMUFile *f, int channel)
         if (!ret && place_needed) {
             if (tmp_page->all_zero) {
                 ret = postcopy_place_page_zero(mis, tmp_page->host_addr, block);
+            } else if (channel == RAM_CHANNEL_PRECOPY) {
+                /*
+                 * Batch the background pages, but hand them over before
+                 * the next page has to wait for the channel.
+                 */
+                bool flush = qemu_file_buffered_bytes(f) <
+                             TARGET_PAGE_SIZE + sizeof(uint64_t);
+
+                ret = postcopy_place_page_batched(mis, tmp_page->host_addr,
+                                                  place_source, block, flush);
             } else {
                 ret = postcopy_place_page(mis, tmp_page->host_addr,
                                           place_source, block);
@@ -4130,6 +5063,12 @@ int ram_load_postcopy(QEMUFile *f, int channel)
         }
     }
 
+    if (channel == RAM_CHANNEL_PRECOPY) {
+        int place_ret = postcopy_place_flush(mis);
+
+        ret = ret ? ret : place_ret;
+    }
+
     return ret;
 }
 
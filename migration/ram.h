@@ -88,6 +88,7 @@ bool ram_write_tracking_compatible(void);
 void ram_write_tracking_prepare(void);
 int ram_write_tracking_start(void);
 void ram_write_tracking_stop(void);
+void ram_write_tracking_fill_info(MigrationInfo *info);
 
 void dirty_sync_missed_zero_copy(void);
 
@@ -1360,14 +1360,165 @@ int qemu_savevm_state_complete_precopy_iterable(QEMUFile *f, bool in_postcopy)
     return 0;
 }
 
+/* Device section serialized into a buffer by a vmstate save thread */
+typedef struct VMStateSaveJob {
+    SaveStateEntry *se;
+    QIOChannelBuffer *bioc;
+    QEMUFile *file;
+    JSONWriter *vmdesc;
+    int ret;
+} VMStateSaveJob;
+
+typedef struct VMStateSaveJobs {
+    VMStateSaveJob *jobs;
+    unsigned int nr_jobs;
+    /* Next job to run, atomically incremented by the save threads */
+    unsigned int next_job;
+} VMStateSaveJobs;
+
+static void vmstate_save_jobs_run(VMStateSaveJobs *jobs)
+{
+    unsigned int i;
+
+    while ((i = qatomic_fetch_inc(&jobs->next_job)) < jobs->nr_jobs) {
+        VMStateSaveJob *job = &jobs->jobs[i];
+
+        trace_savevm_section_start(job->se->idstr, job->se->section_id);
+        json_writer_start_object(job->vmdesc, NULL);
+        json_writer_str(job->vmdesc, "name", job->se->idstr);
+        json_writer_int64(job->vmdesc, "instance_id", job->se->instance_id);
+        job->ret = vmstate_save(job->file, job->se, job->vmdesc);
+        json_writer_end_object(job->vmdesc);
+        if (!job->ret) {
+            qemu_fflush(job->file);
+            job->ret = qemu_file_get_error(job->file);
+        }
+        trace_savevm_section_end(job->se->idstr, job->se->section_id,
+                                 job->ret);
+    }
+}
+
+static void *vmstate_save_thread(void *opaque)
+{
+    vmstate_save_jobs_run(opaque);
+    return NULL;
+}
+
+/* Whether the section of @se can be saved by a vmstate save thread */
+static bool vmstate_save_in_thread(SaveStateEntry *se)
+{
+    /* Such a vmsd has no needed() callback, so it is always saved */
+    return se->vmsd && vmstate_save_is_read_only(se->vmsd);
+}
+
+/* Whether @se has no device section, so that saving it runs no code */
+static bool vmstate_save_no_section(SaveStateEntry *se)
+{
+    return (!se->ops || !se->ops->save_state) && !se->vmsd;
+}
+
+/*
+ * Serialize, in parallel, the sections of the run of consecutive devices
+ * starting at @first whose state can be saved without the iothread lock.
+ * The sections are written to memory buffers and are copied to the
+ * migration stream in the usual order by
+ * qemu_savevm_state_complete_precopy_non_iterable(), so the stream does
+ * not change.
+ *
+ * A run stops at the first device that is saved by the migration thread:
+ * its pre_save hook may update the state of other devices, and the
+ * devices that come before it must be saved as they were before the
+ * hook ran.
+ */
+static void vmstate_save_jobs_start(VMStateSaveJobs *jobs,
+                                    SaveStateEntry *first)
+{
+    int thread_count = migrate_get_current()->vmstate_save_threads;
+    g_autofree QemuThread *threads = NULL;
+    SaveStateEntry *se;
+    int i;
+
+    memset(jobs, 0, sizeof(*jobs));
+    if (thread_count <= 1) {
+        return;
+    }
+
+    for (se = first; se; se = QTAILQ_NEXT(se, entry)) {
+        if (vmstate_save_in_thread(se)) {
+            jobs->nr_jobs++;
+        } else if (!vmstate_save_no_section(se)) {
+            break;
+        }
+    }
+    if (jobs->nr_jobs < 2) {
+        jobs->nr_jobs = 0;
+        return;
+    }
+
+    jobs->jobs = g_new0(VMStateSaveJob, jobs->nr_jobs);
+    i = 0;
+    for (se = first; i < jobs->nr_jobs; se = QTAILQ_NEXT(se, entry)) {
+        if (vmstate_save_in_thread(se)) {
+            VMStateSaveJob *job = &jobs->jobs[i++];
+
+            job->se = se;
+            job->bioc = qio_channel_buffer_new(4096);
+            qio_channel_set_name(QIO_CHANNEL(job->bioc),
+                                 "migration-vmstate-buffer");
+            job->file = qemu_file_new_output(QIO_CHANNEL(job->bioc));
+            job->vmdesc = json_writer_new(false);
+        }
+    }
+
+    thread_count = MIN(thread_count - 1, jobs->nr_jobs - 1);
+    threads = g_new0(QemuThread, thread_count);
+    for (i = 0; i < thread_count; i++) {
+        qemu_thread_create(&threads[i], "mig/vmstate", vmstate_save_thread,
+                           jobs, QEMU_THREAD_JOINABLE);
+    }
+    vmstate_save_jobs_run(jobs);
+    for (i = 0; i < thread_count; i++) {
+        qemu_thread_join(&threads[i]);
+    }
+}
+
+static int vmstate_save_job_put(QEMUFile *f, VMStateSaveJob *job,
+                                JSONWriter *vmdesc)
+{
+    if (job->ret) {
+        return job->ret;
+    }
+
+    save_section_header(f, job->se, QEMU_VM_SECTION_FULL);
+    qemu_put_buffer(f, job->bioc->data, job->bioc->usage);
+    save_section_footer(f, job->se);
+    json_writer_raw(vmdesc, NULL, json_writer_get(job->vmdesc));
+    return 0;
+}
+
+static void vmstate_save_jobs_cleanup(VMStateSaveJobs *jobs)
+{
+    unsigned int i;
+
+    for (i = 0; i < jobs->nr_jobs; i++) {
+        qemu_fclose(jobs->jobs[i].file);
+        object_unref(OBJECT(jobs->jobs[i].bioc));
+        json_writer_free(jobs->jobs[i].vmdesc);
+    }
+    g_free(jobs->jobs);
+    memset(jobs, 0, sizeof(*jobs));
+}
+
 int qemu_savevm_state_complete_precopy_non_iterable(QEMUFile *f,
                                                     bool in_postcopy,
                                                     bool inactivate_disks)
 {
     g_autoptr(JSONWriter) vmdesc = NULL;
+    VMStateSaveJobs jobs = {};
+    unsigned int next_job = 0;
     int vmdesc_len;
     SaveStateEntry *se;
-    int ret;
+    int ret = 0;
 
     vmdesc = json_writer_new(false);
     json_writer_start_object(vmdesc, NULL);
@@ -1375,6 +1526,19 @@ int qemu_savevm_state_complete_precopy_non_iterable(QEMUFile *f,
     json_writer_start_array(vmdesc, "devices");
     QTAILQ_FOREACH(se, &savevm_state.handlers, entry) {
 
+        if (next_job == jobs.nr_jobs && vmstate_save_in_thread(se)) {
+            vmstate_save_jobs_cleanup(&jobs);
+            vmstate_save_jobs_start(&jobs, se);
+            next_job = 0;
+        }
+        if (next_job < jobs.nr_jobs && jobs.jobs[next_job].se == se) {
+            ret = vmstate_save_job_put(f, &jobs.jobs[next_job++], vmdesc);
+            if (ret) {
+                qemu_file_set_error(f, ret);
+                goto out;
+            }
+            continue;
+        }
         if ((!se->ops || !se->ops->save_state) && !se->vmsd) {
             continue;
         }
@@ -1393,13 +1557,14 @@ int qemu_savevm_state_complete_precopy_non_iterable(QEMUFile *f,
         ret = vmstate_save(f, se, vmdesc);
         if (ret) {
             qemu_file_set_error(f, ret);
-            return ret;
+            goto out;
         }
         trace_savevm_section_end(se->idstr, se->section_id, 0);
         save_section_footer(f, se);
 
         json_writer_end_object(vmdesc);
     }
+    vmstate_save_jobs_cleanup(&jobs);
 
     if (inactivate_disks) {
         /* Inactivate before sending QEMU_VM_EOF so that the
@@ -1428,6 +1593,10 @@ int qemu_savevm_state_complete_precopy_non_iterable(QEMUFile *f,
     }
 
     return 0;
+
+out:
+    vmstate_save_jobs_cleanup(&jobs);
+    return ret;
 }
 
 int qemu_savevm_state_complete_precopy(QEMUFile *f, bool iterable_only,
@@ -2072,6 +2241,8 @@ static void migrate_send_rp_req_pages_pending(MigrationIncomingState *mis)
 
 static int loadvm_postcopy_handle_resume(MigrationIncomingState *mis)
 {
+    unsigned int i;
+
     if (mis->state != MIGRATION_STATUS_POSTCOPY_RECOVER) {
         error_report("%s: illegal resume received", __func__);
         /* Don't fail the load, only for this. */
@@ -2110,12 +2281,15 @@ static int loadvm_postcopy_handle_resume(MigrationIncomingState *mis)
     migrate_send_rp_req_pages_pending(mis);
 
     /*
-     * It's time to switch state and release the fault thread to continue
+     * It's time to switch state and release the fault threads to continue
      * service page faults.  Note that this should be explicitly after the
-     * above call to migrate_send_rp_req_pages_pending().  In short:
-     * migrate_send_rp_message_req_pages() is not thread safe, yet.
+     * above call to migrate_send_rp_req_pages_pending(), so that the
+     * pending requests are sent before any new one.  Each fault thread
+     * pauses once per interruption.
      */
-    qemu_sem_post(&mis->postcopy_pause_sem_fault);
+    for (i = 0; i <= mis->fault_shard_count; i++) {
+        qemu_sem_post(&mis->postcopy_pause_sem_fault);
+    }
 
     if (migrate_postcopy_preempt()) {
         /* The channel should already be setup again; make sure of it */
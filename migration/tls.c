@@ -57,6 +57,26 @@ migration_tls_get_creds(MigrationState *s,
 }
 
 
+/*
+ * Once the handshake is done, let the kernel encrypt and decrypt the
+ * records if it can: this saves a copy of all the data through the TLS
+ * library.  The stream on the wire is the same, so this is purely local.
+ */
+void migration_tls_enable_ktls(QIOChannel *ioc)
+{
+    MigrationState *s = migrate_get_current();
+    Error *err = NULL;
+
+    if (!s->ktls) {
+        return;
+    }
+
+    if (qio_channel_tls_enable_ktls(QIO_CHANNEL_TLS(ioc), &err) < 0) {
+        trace_migration_tls_ktls_unavailable(error_get_pretty(err));
+        error_free(err);
+    }
+}
+
 static void migration_tls_incoming_handshake(QIOTask *task,
                                              gpointer opaque)
 {
@@ -68,6 +88,7 @@ static void migration_tls_incoming_handshake(QIOTask *task,
         error_report_err(err);
     } else {
         trace_migration_tls_incoming_handshake_complete();
+        migration_tls_enable_ktls(ioc);
         migration_channel_process_incoming(ioc);
     }
     object_unref(OBJECT(ioc));
@@ -115,6 +136,7 @@ static void migration_tls_outgoing_handshake(QIOTask *task,
         trace_migration_tls_outgoing_handshake_error(error_get_pretty(err));
     } else {
         trace_migration_tls_outgoing_handshake_complete();
+        migration_tls_enable_ktls(ioc);
     }
     migration_channel_connect(s, ioc, NULL, err);
     object_unref(OBJECT(ioc));
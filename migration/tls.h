@@ -38,6 +38,8 @@ void migration_tls_channel_connect(MigrationState *s,
                                    const char *hostname,
                                    Error **errp);
 
+void migration_tls_enable_ktls(QIOChannel *ioc);
+
 /* Whether the QIO channel requires further TLS handshake? */
 bool migrate_channel_requires_tls_upgrade(QIOChannel *ioc);
 
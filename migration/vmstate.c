@@ -75,10 +75,268 @@ static void vmstate_handle_alloc(void *ptr, const VMStateField *field,
     }
 }
 
+static int vmstate_load_field(QEMUFile *f, const VMStateDescription *vmsd,
+                              const VMStateField *field, void *opaque,
+                              int version_id)
+{
+    int ret = 0;
+
+    trace_vmstate_load_state_field(vmsd->name, field->name);
+    if ((field->field_exists &&
+         field->field_exists(opaque, version_id)) ||
+        (!field->field_exists &&
+         field->version_id <= version_id)) {
+        void *first_elem = opaque + field->offset;
+        int i, n_elems = vmstate_n_elems(opaque, field);
+        int size = vmstate_size(opaque, field);
+
+        vmstate_handle_alloc(first_elem, field, opaque);
+        if (field->flags & VMS_POINTER) {
+            first_elem = *(void **)first_elem;
+            assert(first_elem || !n_elems || !size);
+        }
+        for (i = 0; i < n_elems; i++) {
+            void *curr_elem = first_elem + size * i;
+
+            if (field->flags & VMS_ARRAY_OF_POINTER) {
+                curr_elem = *(void **)curr_elem;
+            }
+            if (!curr_elem && size) {
+                /* if null pointer check placeholder and do not follow */
+                assert(field->flags & VMS_ARRAY_OF_POINTER);
+                ret = vmstate_info_nullptr.get(f, curr_elem, size, NULL);
+            } else if (field->flags & VMS_STRUCT) {
+                ret = vmstate_load_state(f, field->vmsd, curr_elem,
+                                         field->vmsd->version_id);
+            } else if (field->flags & VMS_VSTRUCT) {
+                ret = vmstate_load_state(f, field->vmsd, curr_elem,
+                                         field->struct_version_id);
+            } else {
+                ret = field->info->get(f, curr_elem, size, field);
+            }
+            if (ret >= 0) {
+                ret = qemu_file_get_error(f);
+            }
+            if (ret < 0) {
+                qemu_file_set_error(f, ret);
+                error_report("Failed to load %s:%s", vmsd->name,
+                             field->name);
+                trace_vmstate_load_field_error(field->name, ret);
+                return ret;
+            }
+        }
+    } else if (field->flags & VMS_MUST_EXIST) {
+        error_report("Input validation failed: %s/%s",
+                     vmsd->name, field->name);
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * Compiled descriptions
+ *
+ * The first time a VMStateDescription is used, its fields are
+ * flattened into a list of operations.  Fields that sit back to back
+ * in memory and whose wire format is their host representation are
+ * coalesced into a single block, moved with one qemu_put_buffer() or
+ * qemu_get_buffer() call.  All other fields are left to the
+ * interpreter.  The resulting stream is the same in both cases.
+ */
+typedef struct VMStateOp {
+    /* First field covered by the operation */
+    const VMStateField *field;
+    /* Number of fields in the block, 0 to interpret @field */
+    int nfields;
+    /* Highest version_id among the fields of the block */
+    int version_id;
+    size_t offset;
+    size_t size;
+} VMStateOp;
+
+typedef struct VMStateCompiled {
+    int nops;
+    VMStateOp ops[];
+} VMStateCompiled;
+
+static bool vmstate_compile_enabled = true;
+/* Protects vmstate_compiled, which maps descriptions to their ops */
+static QemuMutex vmstate_compiled_lock;
+static GHashTable *vmstate_compiled;
+
+void vmstate_set_compile(bool enable)
+{
+    vmstate_compile_enabled = enable;
+}
+
+static bool vmstate_info_is_raw(const VMStateInfo *info)
+{
+    if (info == &vmstate_info_uint8 ||
+        info == &vmstate_info_int8 ||
+        info == &vmstate_info_buffer) {
+        return true;
+    }
+#if HOST_BIG_ENDIAN
+    /* Integers go big endian on the wire */
+    if (info == &vmstate_info_uint16 ||
+        info == &vmstate_info_uint32 ||
+        info == &vmstate_info_uint64 ||
+        info == &vmstate_info_int16 ||
+        info == &vmstate_info_int32 ||
+        info == &vmstate_info_int64) {
+        return true;
+    }
+#endif
+    return false;
+}
+
+static bool vmstate_field_is_raw(const VMStateField *field)
+{
+    if (field->field_exists ||
+        field->flags & ~(VMS_SINGLE | VMS_ARRAY | VMS_BUFFER |
+                         VMS_MUST_EXIST)) {
+        return false;
+    }
+
+    return field->info && vmstate_info_is_raw(field->info);
+}
+
+static VMStateCompiled *vmstate_compile(const VMStateDescription *vmsd)
+{
+    const VMStateField *field;
+    VMStateCompiled *plan;
+    VMStateOp *block = NULL;
+    int nfields = 0, nblocks = 0;
+
+    for (field = vmsd->fields; field->name; field++) {
+        nfields++;
+    }
+    plan = g_malloc0(sizeof(*plan) + nfields * sizeof(VMStateOp));
+
+    for (field = vmsd->fields; field->name; field++) {
+        size_t size = field->size;
+        VMStateOp *op;
+
+        if (!vmstate_field_is_raw(field)) {
+            op = &plan->ops[plan->nops++];
+            op->field = field;
+            block = NULL;
+            continue;
+        }
+
+        if (field->flags & VMS_ARRAY) {
+            size *= field->num;
+        }
+        if (block && block->offset + block->size == field->offset) {
+            block->nfields++;
+            block->version_id = MAX(block->version_id, field->version_id);
+            block->size += size;
+            continue;
+        }
+
+        block = &plan->ops[plan->nops++];
+        block->field = field;
+        block->nfields = 1;
+        block->version_id = field->version_id;
+        block->offset = field->offset;
+        block->size = size;
+        nblocks++;
+    }
+
+    trace_vmstate_compile(vmsd->name, nfields, plan->nops);
+    if (!nblocks) {
+        /* Nothing to gain, keep interpreting it */
+        g_free(plan);
+        return NULL;
+    }
+    return plan;
+}
+
+static const VMStateCompiled *
+vmstate_get_compiled(const VMStateDescription *vmsd)
+{
+    VMStateCompiled *plan;
+
+    if (!vmstate_compile_enabled) {
+        return NULL;
+    }
+
+    qemu_mutex_lock(&vmstate_compiled_lock);
+    if (!g_hash_table_lookup_extended(vmstate_compiled, vmsd, NULL,
+                                      (gpointer *)&plan)) {
+        plan = vmstate_compile(vmsd);
+        g_hash_table_insert(vmstate_compiled, (gpointer)vmsd, plan);
+    }
+    qemu_mutex_unlock(&vmstate_compiled_lock);
+
+    return plan;
+}
+
+static void __attribute__((__constructor__)) vmstate_compiled_init(void)
+{
+    qemu_mutex_init(&vmstate_compiled_lock);
+    vmstate_compiled = g_hash_table_new(NULL, NULL);
+}
+
+static int vmstate_load_block(QEMUFile *f, const VMStateDescription *vmsd,
+                              const VMStateOp *op, void *opaque)
+{
+    int ret;
+
+    trace_vmstate_load_state_block(vmsd->name, op->field->name,
+                                   op->nfields, op->size);
+    qemu_get_buffer(f, opaque + op->offset, op->size);
+    ret = qemu_file_get_error(f);
+    if (ret < 0) {
+        error_report("Failed to load %s:%s", vmsd->name, op->field->name);
+        trace_vmstate_load_field_error(op->field->name, ret);
+    }
+    return ret;
+}
+
+static int vmstate_load_fields(QEMUFile *f, const VMStateDescription *vmsd,
+                               void *opaque, int version_id)
+{
+    const VMStateCompiled *plan = vmstate_get_compiled(vmsd);
+    const VMStateField *field;
+    int i, ret;
+
+    if (!plan) {
+        for (field = vmsd->fields; field->name; field++) {
+            ret = vmstate_load_field(f, vmsd, field, opaque, version_id);
+            if (ret) {
+                return ret;
+            }
+        }
+        return 0;
+    }
+
+    for (i = 0; i < plan->nops; i++) {
+        const VMStateOp *op = &plan->ops[i];
+
+        if (op->nfields && op->version_id <= version_id) {
+            ret = vmstate_load_block(f, vmsd, op, opaque);
+            if (ret) {
+                return ret;
+            }
+            continue;
+        }
+        /* Older streams may lack part of the block, go field by field */
+        for (field = op->field; field < op->field + MAX(op->nfields, 1);
+             field++) {
+            ret = vmstate_load_field(f, vmsd, field, opaque, version_id);
+            if (ret) {
+                return ret;
+            }
+        }
+    }
+    return 0;
+}
+
 int vmstate_load_state(QEMUFile *f, const VMStateDescription *vmsd,
                        void *opaque, int version_id)
 {
-    const VMStateField *field = vmsd->fields;
     int ret = 0;
 
     trace_vmstate_load_state(vmsd->name, version_id);
@@ -102,57 +360,9 @@ int vmstate_load_state(QEMUFile *f, const VMStateDescription *vmsd,
             return ret;
         }
     }
-    while (field->name) {
-        trace_vmstate_load_state_field(vmsd->name, field->name);
-        if ((field->field_exists &&
-             field->field_exists(opaque, version_id)) ||
-            (!field->field_exists &&
-             field->version_id <= version_id)) {
-            void *first_elem = opaque + field->offset;
-            int i, n_elems = vmstate_n_elems(opaque, field);
-            int size = vmstate_size(opaque, field);
-
-            vmstate_handle_alloc(first_elem, field, opaque);
-            if (field->flags & VMS_POINTER) {
-                first_elem = *(void **)first_elem;
-                assert(first_elem || !n_elems || !size);
-            }
-            for (i = 0; i < n_elems; i++) {
-                void *curr_elem = first_elem + size * i;
-
-                if (field->flags & VMS_ARRAY_OF_POINTER) {
-                    curr_elem = *(void **)curr_elem;
-                }
-                if (!curr_elem && size) {
-                    /* if null pointer check placeholder and do not follow */
-                    assert(field->flags & VMS_ARRAY_OF_POINTER);
-                    ret = vmstate_info_nullptr.get(f, curr_elem, size, NULL);
-                } else if (field->flags & VMS_STRUCT) {
-                    ret = vmstate_load_state(f, field->vmsd, curr_elem,
-                                             field->vmsd->version_id);
-                } else if (field->flags & VMS_VSTRUCT) {
-                    ret = vmstate_load_state(f, field->vmsd, curr_elem,
-                                             field->struct_version_id);
-                } else {
-                    ret = field->info->get(f, curr_elem, size, field);
-                }
-                if (ret >= 0) {
-                    ret = qemu_file_get_error(f);
-                }
-                if (ret < 0) {
-                    qemu_file_set_error(f, ret);
-                    error_report("Failed to load %s:%s", vmsd->name,
-                                 field->name);
-                    trace_vmstate_load_field_error(field->name, ret);
-                    return ret;
-                }
-            }
-        } else if (field->flags & VMS_MUST_EXIST) {
-            error_report("Input validation failed: %s/%s",
-                         vmsd->name, field->name);
-            return -1;
-        }
-        field++;
+    ret = vmstate_load_fields(f, vmsd, opaque, version_id);
+    if (ret) {
+        return ret;
     }
     ret = vmstate_subsection_load(f, vmsd, opaque);
     if (ret != 0) {
@@ -311,17 +521,219 @@ bool vmstate_save_needed(const VMStateDescription *vmsd, void *opaque)
 }
 
 
+static bool vmstate_info_is_read_only(const VMStateInfo *info)
+{
+    static const VMStateInfo *const read_only_infos[] = {
+        &vmstate_info_bool,
+        &vmstate_info_int8,
+        &vmstate_info_int16,
+        &vmstate_info_int32,
+        &vmstate_info_int64,
+        &vmstate_info_uint8_equal,
+        &vmstate_info_uint16_equal,
+        &vmstate_info_int32_equal,
+        &vmstate_info_uint32_equal,
+        &vmstate_info_uint64_equal,
+        &vmstate_info_int32_le,
+        &vmstate_info_uint8,
+        &vmstate_info_uint16,
+        &vmstate_info_uint32,
+        &vmstate_info_uint64,
+        &vmstate_info_nullptr,
+        &vmstate_info_cpudouble,
+        &vmstate_info_buffer,
+        &vmstate_info_unused_buffer,
+        &vmstate_info_bitmap,
+    };
+    int i;
+
+    for (i = 0; i < ARRAY_SIZE(read_only_infos); i++) {
+        if (info == read_only_infos[i]) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+ * Return true if saving @vmsd only reads the state it describes: there
+ * are no pre_save/post_save hooks, needed() or field_exists() callbacks
+ * in the description, its nested structures and subsections, and all
+ * fields use the basic VMStateInfo types.  While the VM is stopped, such
+ * state can be saved by a thread that does not hold the iothread lock.
+ */
+bool vmstate_save_is_read_only(const VMStateDescription *vmsd)
+{
+    const VMStateField *field;
+    const VMStateDescription **sub;
+
+    if (vmsd->pre_save || vmsd->post_save || vmsd->needed) {
+        return false;
+    }
+
+    for (field = vmsd->fields; field->name; field++) {
+        if (field->field_exists) {
+            return false;
+        }
+        if (field->flags & (VMS_STRUCT | VMS_VSTRUCT)) {
+            if (!vmstate_save_is_read_only(field->vmsd)) {
+                return false;
+            }
+        } else if (!vmstate_info_is_read_only(field->info)) {
+            return false;
+        }
+    }
+
+    for (sub = vmsd->subsections; sub && *sub; sub++) {
+        if (!vmstate_save_is_read_only(*sub)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
 int vmstate_save_state(QEMUFile *f, const VMStateDescription *vmsd,
                        void *opaque, JSONWriter *vmdesc_id)
 {
     return vmstate_save_state_v(f, vmsd, opaque, vmdesc_id, vmsd->version_id);
 }
 
+static int vmstate_save_field(QEMUFile *f, const VMStateDescription *vmsd,
+                              const VMStateField *field, void *opaque,
+                              JSONWriter *vmdesc, int version_id)
+{
+    int ret = 0;
+
+    if ((field->field_exists &&
+         field->field_exists(opaque, version_id)) ||
+        (!field->field_exists &&
+         field->version_id <= version_id)) {
+        void *first_elem = opaque + field->offset;
+        int i, n_elems = vmstate_n_elems(opaque, field);
+        int size = vmstate_size(opaque, field);
+        int64_t old_offset, written_bytes;
+        JSONWriter *vmdesc_loop = vmdesc;
+
+        trace_vmstate_save_state_loop(vmsd->name, field->name, n_elems);
+        if (field->flags & VMS_POINTER) {
+            first_elem = *(void **)first_elem;
+            assert(first_elem || !n_elems || !size);
+        }
+        for (i = 0; i < n_elems; i++) {
+            void *curr_elem = first_elem + size * i;
+
+            vmsd_desc_field_start(vmsd, vmdesc_loop, field, i, n_elems);
+            old_offset = qemu_file_total_transferred_fast(f);
+            if (field->flags & VMS_ARRAY_OF_POINTER) {
+                assert(curr_elem);
+                curr_elem = *(void **)curr_elem;
+            }
+            if (!curr_elem && size) {
+                /* if null pointer write placeholder and do not follow */
+                assert(field->flags & VMS_ARRAY_OF_POINTER);
+                ret = vmstate_info_nullptr.put(f, curr_elem, size, NULL,
+                                               NULL);
+            } else if (field->flags & VMS_STRUCT) {
+                ret = vmstate_save_state(f, field->vmsd, curr_elem,
+                                         vmdesc_loop);
+            } else if (field->flags & VMS_VSTRUCT) {
+                ret = vmstate_save_state_v(f, field->vmsd, curr_elem,
+                                           vmdesc_loop,
+                                           field->struct_version_id);
+            } else {
+                ret = field->info->put(f, curr_elem, size, field,
+                                 vmdesc_loop);
+            }
+            if (ret) {
+                error_report("Save of field %s/%s failed",
+                             vmsd->name, field->name);
+                return ret;
+            }
+
+            written_bytes = qemu_file_total_transferred_fast(f) -
+                                old_offset;
+            vmsd_desc_field_end(vmsd, vmdesc_loop, field, written_bytes, i);
+
+            /* Compressed arrays only care about the first element */
+            if (vmdesc_loop && vmsd_can_compress(field)) {
+                vmdesc_loop = NULL;
+            }
+        }
+    } else {
+        if (field->flags & VMS_MUST_EXIST) {
+            error_report("Output state validation failed: %s/%s",
+                    vmsd->name, field->name);
+            assert(!(field->flags & VMS_MUST_EXIST));
+        }
+    }
+
+    return 0;
+}
+
+static void vmstate_save_block(QEMUFile *f, const VMStateDescription *vmsd,
+                               const VMStateOp *op, void *opaque,
+                               JSONWriter *vmdesc)
+{
+    const VMStateField *field;
+    int n_elems;
+
+    trace_vmstate_save_state_block(vmsd->name, op->field->name,
+                                   op->nfields, op->size);
+    /* Describe each field as the interpreter does, as compressed arrays */
+    for (field = op->field; vmdesc && field < op->field + op->nfields;
+         field++) {
+        n_elems = vmstate_n_elems(opaque, field);
+        if (n_elems) {
+            vmsd_desc_field_start(vmsd, vmdesc, field, 0, n_elems);
+            vmsd_desc_field_end(vmsd, vmdesc, field, field->size, 0);
+        }
+    }
+    qemu_put_buffer(f, opaque + op->offset, op->size);
+}
+
+static int vmstate_save_fields(QEMUFile *f, const VMStateDescription *vmsd,
+                               void *opaque, JSONWriter *vmdesc,
+                               int version_id)
+{
+    const VMStateCompiled *plan = vmstate_get_compiled(vmsd);
+    const VMStateField *field;
+    int i, ret;
+
+    if (!plan) {
+        for (field = vmsd->fields; field->name; field++) {
+            ret = vmstate_save_field(f, vmsd, field, opaque, vmdesc,
+                                     version_id);
+            if (ret) {
+                return ret;
+            }
+        }
+        return 0;
+    }
+
+    for (i = 0; i < plan->nops; i++) {
+        const VMStateOp *op = &plan->ops[i];
+
+        if (op->nfields && op->version_id <= version_id) {
+            vmstate_save_block(f, vmsd, op, opaque, vmdesc);
+            continue;
+        }
+        for (field = op->field; field < op->field + MAX(op->nfields, 1);
+             field++) {
+            ret = vmstate_save_field(f, vmsd, field, opaque, vmdesc,
+                                     version_id);
+            if (ret) {
+                return ret;
+            }
+        }
+    }
+    return 0;
+}
+
 int vmstate_save_state_v(QEMUFile *f, const VMStateDescription *vmsd,
                          void *opaque, JSONWriter *vmdesc, int version_id)
 {
     int ret = 0;
-    const VMStateField *field = vmsd->fields;
 
     trace_vmstate_save_state_top(vmsd->name);
 
@@ -340,73 +752,12 @@ int vmstate_save_state_v(QEMUFile *f, const VMStateDescription *vmsd,
         json_writer_start_array(vmdesc, "fields");
     }
 
-    while (field->name) {
-        if ((field->field_exists &&
-             field->field_exists(opaque, version_id)) ||
-            (!field->field_exists &&
-             field->version_id <= version_id)) {
-            void *first_elem = opaque + field->offset;
-            int i, n_elems = vmstate_n_elems(opaque, field);
-            int size = vmstate_size(opaque, field);
-            int64_t old_offset, written_bytes;
-            JSONWriter *vmdesc_loop = vmdesc;
-
-            trace_vmstate_save_state_loop(vmsd->name, field->name, n_elems);
-            if (field->flags & VMS_POINTER) {
-                first_elem = *(void **)first_elem;
-                assert(first_elem || !n_elems || !size);
-            }
-            for (i = 0; i < n_elems; i++) {
-                void *curr_elem = first_elem + size * i;
-
-                vmsd_desc_field_start(vmsd, vmdesc_loop, field, i, n_elems);
-                old_offset = qemu_file_total_transferred_fast(f);
-                if (field->flags & VMS_ARRAY_OF_POINTER) {
-                    assert(curr_elem);
-                    curr_elem = *(void **)curr_elem;
-                }
-                if (!curr_elem && size) {
-                    /* if null pointer write placeholder and do not follow */
-                    assert(field->flags & VMS_ARRAY_OF_POINTER);
-                    ret = vmstate_info_nullptr.put(f, curr_elem, size, NULL,
-                                                   NULL);
-                } else if (field->flags & VMS_STRUCT) {
-                    ret = vmstate_save_state(f, field->vmsd, curr_elem,
-                                             vmdesc_loop);
-                } else if (field->flags & VMS_VSTRUCT) {
-                    ret = vmstate_save_state_v(f, field->vmsd, curr_elem,
-                                               vmdesc_loop,
-                                               field->struct_version_id);
-                } else {
-                    ret = field->info->put(f, curr_elem, size, field,
-                                     vmdesc_loop);
-                }
-                if (ret) {
-                    error_report("Save of field %s/%s failed",
-                                 vmsd->name, field->name);
-                    if (vmsd->post_save) {
-                        vmsd->post_save(opaque);
-                    }
-                    return ret;
-                }
-
-                written_bytes = qemu_file_total_transferred_fast(f) -
-                                    old_offset;
-                vmsd_desc_field_end(vmsd, vmdesc_loop, field, written_bytes, i);
-
-                /* Compressed arrays only care about the first element */
-                if (vmdesc_loop && vmsd_can_compress(field)) {
-                    vmdesc_loop = NULL;
-                }
-            }
-        } else {
-            if (field->flags & VMS_MUST_EXIST) {
-                error_report("Output state validation failed: %s/%s",
-                        vmsd->name, field->name);
-                assert(!(field->flags & VMS_MUST_EXIST));
-            }
+    ret = vmstate_save_fields(f, vmsd, opaque, vmdesc, version_id);
+    if (ret) {
+        if (vmsd->post_save) {
+            vmsd->post_save(opaque);
         }
-        field++;
+        return ret;
     }
 
     if (vmdesc) {
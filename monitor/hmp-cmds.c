@@ -280,6 +280,8 @@ void hmp_info_migrate(Monitor *mon, const QDict *qdict)
                        info->ram->normal_bytes >> 10);
         monitor_printf(mon, "dirty sync count: %" PRIu64 "\n",
                        info->ram->dirty_sync_count);
+        monitor_printf(mon, "dirty sync time: %" PRIu64 " us\n",
+                       info->ram->dirty_sync_time);
         monitor_printf(mon, "page size: %" PRIu64 " kbytes\n",
                        info->ram->page_size >> 10);
         monitor_printf(mon, "multifd bytes: %" PRIu64 " kbytes\n",
@@ -374,6 +376,27 @@ void hmp_info_migrate(Monitor *mon, const QDict *qdict)
         g_free(str);
         visit_free(v);
     }
+
+    if (info->has_snapshot_vcpu_stall) {
+        Visitor *v;
+        char *str;
+        v = string_output_visitor_new(false, &str);
+        visit_type_uint64List(v, NULL, &info->snapshot_vcpu_stall,
+                              &error_abort);
+        visit_complete(v, &str);
+        monitor_printf(mon, "snapshot vcpu stall: %s us\n", str);
+        g_free(str);
+        visit_free(v);
+    }
+
+    if (info->has_postcopy_fault_latency) {
+        PostcopyFaultLatency *lat = info->postcopy_fault_latency;
+
+        monitor_printf(mon, "postcopy fault latency: count %" PRIu64
+                       " p50 %" PRIu64 " us p90 %" PRIu64
+                       " us p99 %" PRIu64 " us\n",
+                       lat->count, lat->p50, lat->p90, lat->p99);
+    }
     if (info->has_socket_address) {
         SocketAddressList *addr;
 
@@ -503,6 +526,22 @@ void hmp_info_migrate_parameters(Monitor *mon, const QDict *qdict)
         monitor_printf(mon, "%s: %" PRIu64 "\n",
             MigrationParameter_str(MIGRATION_PARAMETER_MAX_POSTCOPY_BANDWIDTH),
             params->max_postcopy_bandwidth);
+        assert(params->has_dirty_sync_threads);
+        monitor_printf(mon, "%s: %u\n",
+            MigrationParameter_str(MIGRATION_PARAMETER_DIRTY_SYNC_THREADS),
+            params->dirty_sync_threads);
+        assert(params->has_snapshot_fault_threads);
+        monitor_printf(mon, "%s: %u\n",
+            MigrationParameter_str(MIGRATION_PARAMETER_SNAPSHOT_FAULT_THREADS),
+            params->snapshot_fault_threads);
+        assert(params->has_postcopy_fault_threads);
+        monitor_printf(mon, "%s: %u\n",
+            MigrationParameter_str(MIGRATION_PARAMETER_POSTCOPY_FAULT_THREADS),
+            params->postcopy_fault_threads);
+        assert(params->has_postcopy_place_threads);
+        monitor_printf(mon, "%s: %u\n",
+            MigrationParameter_str(MIGRATION_PARAMETER_POSTCOPY_PLACE_THREADS),
+            params->postcopy_place_threads);
         monitor_printf(mon, "%s: '%s'\n",
             MigrationParameter_str(MIGRATION_PARAMETER_TLS_AUTHZ),
             params->tls_authz);
@@ -1347,6 +1386,22 @@ void hmp_migrate_set_parameter(Monitor *mon, const QDict *qdict)
         p->has_announce_step = true;
         visit_type_size(v, param, &p->announce_step, &err);
         break;
+    case MIGRATION_PARAMETER_DIRTY_SYNC_THREADS:
+        p->has_dirty_sync_threads = true;
+        visit_type_uint8(v, param, &p->dirty_sync_threads, &err);
+        break;
+    case MIGRATION_PARAMETER_SNAPSHOT_FAULT_THREADS:
+        p->has_snapshot_fault_threads = true;
+        visit_type_uint8(v, param, &p->snapshot_fault_threads, &err);
+        break;
+    case MIGRATION_PARAMETER_POSTCOPY_FAULT_THREADS:
+        p->has_postcopy_fault_threads = true;
+        visit_type_uint8(v, param, &p->postcopy_fault_threads, &err);
+        break;
+    case MIGRATION_PARAMETER_POSTCOPY_PLACE_THREADS:
+        p->has_postcopy_place_threads = true;
+        visit_type_uint8(v, param, &p->postcopy_place_threads, &err);
+        break;
     case MIGRATION_PARAMETER_BLOCK_BITMAP_MAPPING:
         error_setg(&err, "The block-bitmap-mapping parameter can only be set "
                    "through QMP");
@@ -53,6 +53,7 @@ static NotifierList colo_compare_notifiers =
 
 #define REGULAR_PACKET_CHECK_MS 1000
 #define DEFAULT_TIME_OUT_MS 3000
+#define MAX_COMPARE_THREADS 64
 
 /* #define DEBUG_COLO_PACKETS */
 
@@ -102,6 +103,37 @@ typedef struct SendEntry {
     uint8_t *buf;
 } SendEntry;
 
+/*
+ * The connections are split across shards by the hash of their key.
+ * Without compare threads there is a single shard, handled by the
+ * iothread; otherwise each shard has its own thread.
+ */
+typedef struct CompareShard {
+    struct CompareState *s;
+    QemuThread thread;
+
+    /*
+     * Protects the connections, taken by the shard thread while it
+     * compares and by the iothread to scan or flush them
+     */
+    QemuMutex lock;
+    /*
+     * Record the connection that through the NIC
+     * Element type: Connection
+     */
+    GQueue conn_list;
+    /* Record the connection without repetition */
+    GHashTable *connection_track_table;
+
+    /* Protects the queues of incoming packets and quit, nests inside lock */
+    QemuMutex in_lock;
+    QemuCond in_cond;
+    /* Packets parsed by the iothread, element type: Packet */
+    GQueue primary_in;
+    GQueue secondary_in;
+    bool quit;
+} CompareShard;
+
 struct CompareState {
     Object parent;
 
@@ -121,14 +153,21 @@ struct CompareState {
     bool vnet_hdr;
     uint64_t compare_timeout;
     uint32_t expired_scan_cycle;
+    /* Number of compare threads, 0 means comparing in the iothread */
+    uint32_t compare_threads;
+
+    CompareShard *shards;
+    uint32_t nr_shards;
 
     /*
-     * Record the connection that through the NIC
-     * Element type: Connection
+     * Primary packets released by the compare threads, sent out by
+     * release_bh from the iothread.  Element type: Packet
      */
-    GQueue conn_list;
-    /* Record the connection without repetition */
-    GHashTable *connection_track_table;
+    QemuMutex release_lock;
+    GQueue release_list;
+    QEMUBH *release_bh;
+    /* A compare thread found an inconsistency */
+    bool notify_pending;
 
     IOThread *iothread;
     GMainContext *worker_context;
@@ -183,7 +222,7 @@ static void notify_remote_frame(CompareState *s)
     }
 }
 
-static void colo_compare_inconsistency_notify(CompareState *s)
+static void colo_compare_do_notify(CompareState *s)
 {
     if (s->notify_dev) {
         notify_remote_frame(s);
@@ -193,6 +232,18 @@ static void colo_compare_inconsistency_notify(CompareState *s)
     }
 }
 
+static void colo_compare_inconsistency_notify(CompareState *s)
+{
+    if (s->compare_threads) {
+        /* Notify from the iothread, which owns notify_dev */
+        qatomic_set(&s->notify_pending, true);
+        qemu_bh_schedule(s->release_bh);
+        return;
+    }
+
+    colo_compare_do_notify(s);
+}
+
 /* Use restricted to colo_insert_packet() */
 static gint seq_sorter(Packet *a, Packet *b, gpointer data)
 {
@@ -223,13 +274,21 @@ static void fill_pkt_tcp_info(void *data, uint32_t *max_ack)
  */
 static int colo_insert_packet(GQueue *queue, Packet *pkt, uint32_t *max_ack)
 {
+    Packet *head;
+
     if (g_queue_get_length(queue) <= max_queue_size) {
         if (pkt->ip->ip_p == IPPROTO_TCP) {
             fill_pkt_tcp_info(pkt, max_ack);
-            g_queue_insert_sorted(queue,
-                                  pkt,
-                                  (GCompareDataFunc)seq_sorter,
-                                  NULL);
+            head = g_queue_peek_head(queue);
+            /* Segments mostly arrive in order, skip the sorted insertion */
+            if (!head || seq_sorter(pkt, head, NULL) <= 0) {
+                g_queue_push_head(queue, pkt);
+            } else {
+                g_queue_insert_sorted(queue,
+                                      pkt,
+                                      (GCompareDataFunc)seq_sorter,
+                                      NULL);
+            }
         } else {
             g_queue_push_tail(queue, pkt);
         }
@@ -239,15 +298,12 @@ static int colo_insert_packet(GQueue *queue, Packet *pkt, uint32_t *max_ack)
 }
 
 /*
- * Return 0 on success, if return -1 means the pkt
+ * Return the packet read from @mode, or NULL if it
  * is unsupported(arp and ipv6) and will be sent later
  */
-static int packet_enqueue(CompareState *s, int mode, Connection **con)
+static Packet *packet_read(CompareState *s, int mode)
 {
-    ConnectionKey key;
     Packet *pkt = NULL;
-    Connection *conn;
-    int ret;
 
     if (mode == PRIMARY_IN) {
         pkt = packet_new(s->pri_rs.buf,
@@ -261,17 +317,31 @@ static int packet_enqueue(CompareState *s, int mode, Connection **con)
 
     if (parse_packet_early(pkt)) {
         packet_destroy(pkt, NULL);
-        pkt = NULL;
-        return -1;
+        return NULL;
     }
+
+    return pkt;
+}
+
+/*
+ * Queue the packet to its connection in @shard.
+ * Called with shard->lock held.
+ */
+static Connection *packet_enqueue(CompareState *s, CompareShard *shard,
+                                  Packet *pkt, int mode)
+{
+    ConnectionKey key;
+    Connection *conn;
+    int ret;
+
     fill_connection_key(pkt, &key, false);
 
-    conn = connection_get(s->connection_track_table,
+    conn = connection_get(shard->connection_track_table,
                           &key,
-                          &s->conn_list);
+                          &shard->conn_list);
 
     if (!conn->processing) {
-        g_queue_push_tail(&s->conn_list, conn);
+        g_queue_push_tail(&shard->conn_list, conn);
         conn->processing = true;
     }
 
@@ -288,9 +358,7 @@ static int packet_enqueue(CompareState *s, int mode, Connection **con)
         pkt = NULL;
     }
 
-    *con = conn;
-
-    return 0;
+    return conn;
 }
 
 static inline bool after(uint32_t seq1, uint32_t seq2)
@@ -301,6 +369,16 @@ static inline bool after(uint32_t seq1, uint32_t seq2)
 static void colo_release_primary_pkt(CompareState *s, Packet *pkt)
 {
     int ret;
+
+    if (s->compare_threads) {
+        /* The chardev belongs to the iothread, let it send the packet */
+        qemu_mutex_lock(&s->release_lock);
+        g_queue_push_head(&s->release_list, pkt);
+        qemu_mutex_unlock(&s->release_lock);
+        qemu_bh_schedule(s->release_bh);
+        return;
+    }
+
     ret = compare_chr_send(s,
                            pkt->data,
                            pkt->size,
@@ -655,12 +733,24 @@ static void colo_old_packet_check(void *opaque)
 {
     CompareState *s = opaque;
 
+    CompareShard *shard;
+    uint32_t i;
+    GList *found;
+
     /*
      * If we find one old packet, stop finding job and notify
      * COLO frame do checkpoint.
      */
-    g_queue_find_custom(&s->conn_list, s,
-                        (GCompareFunc)colo_old_packet_check_one_conn);
+    for (i = 0; i < s->nr_shards; i++) {
+        shard = &s->shards[i];
+        qemu_mutex_lock(&shard->lock);
+        found = g_queue_find_custom(&shard->conn_list, s,
+                            (GCompareFunc)colo_old_packet_check_one_conn);
+        qemu_mutex_unlock(&shard->lock);
+        if (found) {
+            break;
+        }
+    }
 }
 
 static void colo_compare_packet(CompareState *s, Connection *conn,
@@ -945,15 +1035,76 @@ static void colo_compare_timer_del(CompareState *s)
     }
  }
 
+/*
+ * Send out the primary packets released by the compare threads,
+ * in the order they were released.
+ */
+static void colo_compare_release_packets(CompareState *s)
+{
+    Packet *pkt;
+
+    if (!s->compare_threads) {
+        return;
+    }
+
+    qemu_mutex_lock(&s->release_lock);
+    while (!g_queue_is_empty(&s->release_list)) {
+        pkt = g_queue_pop_tail(&s->release_list);
+        compare_chr_send(s,
+                         pkt->data,
+                         pkt->size,
+                         pkt->vnet_hdr_len,
+                         false,
+                         true);
+        packet_destroy_partial(pkt, NULL);
+    }
+    qemu_mutex_unlock(&s->release_lock);
+}
+
+static void colo_compare_release_bh(void *opaque)
+{
+    CompareState *s = opaque;
+
+    colo_compare_release_packets(s);
+    if (qatomic_xchg(&s->notify_pending, false)) {
+        colo_compare_do_notify(s);
+    }
+}
+
+static void colo_flush_queues(CompareState *s, GQueue *primary,
+                              GQueue *secondary);
 static void colo_flush_packets(void *opaque, void *user_data);
 
+/*
+ * Called from the iothread on checkpoint: flush primary packets and
+ * remove secondary packets of all connections, including the ones
+ * the compare threads have not picked up yet.
+ */
+static void colo_compare_flush_shards(CompareState *s)
+{
+    CompareShard *shard;
+    uint32_t i;
+
+    for (i = 0; i < s->nr_shards; i++) {
+        shard = &s->shards[i];
+
+        qemu_mutex_lock(&shard->lock);
+        colo_compare_release_packets(s);
+        g_queue_foreach(&shard->conn_list, colo_flush_packets, s);
+        qemu_mutex_lock(&shard->in_lock);
+        colo_flush_queues(s, &shard->primary_in, &shard->secondary_in);
+        qemu_mutex_unlock(&shard->in_lock);
+        qemu_mutex_unlock(&shard->lock);
+    }
+}
+
 static void colo_compare_handle_event(void *opaque)
 {
     CompareState *s = opaque;
 
     switch (s->event) {
     case COLO_EVENT_CHECKPOINT:
-        g_queue_foreach(&s->conn_list, colo_flush_packets, s);
+        colo_compare_flush_shards(s);
         break;
     case COLO_EVENT_FAILOVER:
         break;
@@ -988,6 +1139,9 @@ static void colo_compare_iothread(CompareState *s)
 
     colo_compare_timer_init(s);
     s->event_bh = aio_bh_new(ctx, colo_compare_handle_event, s);
+    if (s->compare_threads) {
+        s->release_bh = aio_bh_new(ctx, colo_compare_release_bh, s);
+    }
 }
 
 static char *compare_get_pri_indev(Object *obj, Error **errp)
@@ -1122,6 +1276,34 @@ static void compare_set_expired_scan_cycle(Object *obj, Visitor *v,
     s->expired_scan_cycle = value;
 }
 
+static void compare_get_compare_threads(Object *obj, Visitor *v,
+                                        const char *name, void *opaque,
+                                        Error **errp)
+{
+    CompareState *s = COLO_COMPARE(obj);
+    uint32_t value = s->compare_threads;
+
+    visit_type_uint32(v, name, &value, errp);
+}
+
+static void compare_set_compare_threads(Object *obj, Visitor *v,
+                                        const char *name, void *opaque,
+                                        Error **errp)
+{
+    CompareState *s = COLO_COMPARE(obj);
+    uint32_t value;
+
+    if (!visit_type_uint32(v, name, &value, errp)) {
+        return;
+    }
+    if (value > MAX_COMPARE_THREADS) {
+        error_setg(errp, "Property '%s.%s' must not exceed %d",
+                   object_get_typename(obj), name, MAX_COMPARE_THREADS);
+        return;
+    }
+    s->compare_threads = value;
+}
+
 static void get_max_queue_size(Object *obj, Visitor *v,
                                const char *name, void *opaque,
                                Error **errp)
@@ -1153,12 +1335,88 @@ out:
     error_propagate(errp, local_err);
 }
 
+static void *colo_compare_shard_thread(void *opaque)
+{
+    CompareShard *shard = opaque;
+    CompareState *s = shard->s;
+    GQueue primary, secondary;
+    Connection *conn;
+    Packet *pkt;
+
+    while (true) {
+        qemu_mutex_lock(&shard->in_lock);
+        while (!shard->quit && g_queue_is_empty(&shard->primary_in) &&
+               g_queue_is_empty(&shard->secondary_in)) {
+            qemu_cond_wait(&shard->in_cond, &shard->in_lock);
+        }
+        if (shard->quit) {
+            qemu_mutex_unlock(&shard->in_lock);
+            break;
+        }
+        qemu_mutex_unlock(&shard->in_lock);
+
+        /*
+         * Take the whole batch with shard->lock held, so that a checkpoint
+         * flush sees the packets either in the input queues or in the
+         * connections.  The iothread keeps queueing meanwhile.
+         */
+        qemu_mutex_lock(&shard->lock);
+        qemu_mutex_lock(&shard->in_lock);
+        primary = shard->primary_in;
+        secondary = shard->secondary_in;
+        g_queue_init(&shard->primary_in);
+        g_queue_init(&shard->secondary_in);
+        qemu_mutex_unlock(&shard->in_lock);
+
+        while ((pkt = g_queue_pop_tail(&secondary))) {
+            conn = packet_enqueue(s, shard, pkt, SECONDARY_IN);
+            colo_compare_connection(conn, s);
+        }
+        while ((pkt = g_queue_pop_tail(&primary))) {
+            conn = packet_enqueue(s, shard, pkt, PRIMARY_IN);
+            colo_compare_connection(conn, s);
+        }
+        qemu_mutex_unlock(&shard->lock);
+    }
+
+    return NULL;
+}
+
+/*
+ * Hand the packet to the shard owning its connection: compare it right
+ * away without compare threads, queue it to the shard thread otherwise.
+ */
+static void colo_compare_dispatch(CompareState *s, Packet *pkt, int mode)
+{
+    CompareShard *shard = &s->shards[0];
+    ConnectionKey key;
+    Connection *conn;
+
+    if (!s->compare_threads) {
+        qemu_mutex_lock(&shard->lock);
+        conn = packet_enqueue(s, shard, pkt, mode);
+        /* compare packet in the specified connection */
+        colo_compare_connection(conn, s);
+        qemu_mutex_unlock(&shard->lock);
+        return;
+    }
+
+    fill_connection_key(pkt, &key, false);
+    shard = &s->shards[connection_key_hash(&key) % s->nr_shards];
+
+    qemu_mutex_lock(&shard->in_lock);
+    g_queue_push_head(mode == PRIMARY_IN ? &shard->primary_in :
+                      &shard->secondary_in, pkt);
+    qemu_cond_signal(&shard->in_cond);
+    qemu_mutex_unlock(&shard->in_lock);
+}
+
 static void compare_pri_rs_finalize(SocketReadState *pri_rs)
 {
     CompareState *s = container_of(pri_rs, CompareState, pri_rs);
-    Connection *conn = NULL;
+    Packet *pkt = packet_read(s, PRIMARY_IN);
 
-    if (packet_enqueue(s, PRIMARY_IN, &conn)) {
+    if (!pkt) {
         trace_colo_compare_main("primary: unsupported packet in");
         compare_chr_send(s,
                          pri_rs->buf,
@@ -1167,21 +1425,19 @@ static void compare_pri_rs_finalize(SocketReadState *pri_rs)
                          false,
                          false);
     } else {
-        /* compare packet in the specified connection */
-        colo_compare_connection(conn, s);
+        colo_compare_dispatch(s, pkt, PRIMARY_IN);
     }
 }
 
 static void compare_sec_rs_finalize(SocketReadState *sec_rs)
 {
     CompareState *s = container_of(sec_rs, CompareState, sec_rs);
-    Connection *conn = NULL;
+    Packet *pkt = packet_read(s, SECONDARY_IN);
 
-    if (packet_enqueue(s, SECONDARY_IN, &conn)) {
+    if (!pkt) {
         trace_colo_compare_main("secondary: unsupported packet in");
     } else {
-        /* compare packet in the specified connection */
-        colo_compare_connection(conn, s);
+        colo_compare_dispatch(s, pkt, SECONDARY_IN);
     }
 }
 
@@ -1203,7 +1459,7 @@ static void compare_notify_rs_finalize(SocketReadState *notify_rs)
                                   notify_rs->buf,
                                   notify_rs->packet_len)) {
         /* colo-compare do checkpoint, flush pri packet and remove sec packet */
-        g_queue_foreach(&s->conn_list, colo_flush_packets, s);
+        colo_compare_flush_shards(s);
     } else {
         error_report("COLO compare got unsupported instruction");
     }
@@ -1247,6 +1503,7 @@ static void colo_compare_complete(UserCreatable *uc, Error **errp)
 {
     CompareState *s = COLO_COMPARE(uc);
     Chardev *chr;
+    uint32_t i;
 
     if (!s->pri_indev || !s->sec_indev || !s->outdev || !s->iothread) {
         error_setg(errp, "colo compare needs 'primary_in' ,"
@@ -1318,15 +1575,38 @@ static void colo_compare_complete(UserCreatable *uc, Error **errp)
         g_queue_init(&s->notify_sendco.send_list);
     }
 
-    g_queue_init(&s->conn_list);
+    s->nr_shards = s->compare_threads ? s->compare_threads : 1;
+    s->shards = g_new0(CompareShard, s->nr_shards);
+    for (i = 0; i < s->nr_shards; i++) {
+        CompareShard *shard = &s->shards[i];
+
+        shard->s = s;
+        qemu_mutex_init(&shard->lock);
+        g_queue_init(&shard->conn_list);
+        shard->connection_track_table =
+            g_hash_table_new_full(connection_key_hash,
+                                  connection_key_equal,
+                                  g_free,
+                                  NULL);
+        qemu_mutex_init(&shard->in_lock);
+        qemu_cond_init(&shard->in_cond);
+        g_queue_init(&shard->primary_in);
+        g_queue_init(&shard->secondary_in);
+    }
 
-    s->connection_track_table = g_hash_table_new_full(connection_key_hash,
-                                                      connection_key_equal,
-                                                      g_free,
-                                                      NULL);
+    if (s->compare_threads) {
+        qemu_mutex_init(&s->release_lock);
+        g_queue_init(&s->release_list);
+    }
 
     colo_compare_iothread(s);
 
+    for (i = 0; i < s->compare_threads; i++) {
+        qemu_thread_create(&s->shards[i].thread, "colo-compare",
+                           colo_compare_shard_thread, &s->shards[i],
+                           QEMU_THREAD_JOINABLE);
+    }
+
     qemu_mutex_lock(&colo_compare_mutex);
     if (!colo_compare_active) {
         qemu_mutex_init(&event_mtx);
@@ -1339,14 +1619,13 @@ static void colo_compare_complete(UserCreatable *uc, Error **errp)
     return;
 }
 
-static void colo_flush_packets(void *opaque, void *user_data)
+static void colo_flush_queues(CompareState *s, GQueue *primary,
+                              GQueue *secondary)
 {
-    CompareState *s = user_data;
-    Connection *conn = opaque;
     Packet *pkt = NULL;
 
-    while (!g_queue_is_empty(&conn->primary_list)) {
-        pkt = g_queue_pop_tail(&conn->primary_list);
+    while (!g_queue_is_empty(primary)) {
+        pkt = g_queue_pop_tail(primary);
         compare_chr_send(s,
                          pkt->data,
                          pkt->size,
@@ -1355,12 +1634,20 @@ static void colo_flush_packets(void *opaque, void *user_data)
                          true);
         packet_destroy_partial(pkt, NULL);
     }
-    while (!g_queue_is_empty(&conn->secondary_list)) {
-        pkt = g_queue_pop_tail(&conn->secondary_list);
+    while (!g_queue_is_empty(secondary)) {
+        pkt = g_queue_pop_tail(secondary);
         packet_destroy(pkt, NULL);
     }
 }
 
+static void colo_flush_packets(void *opaque, void *user_data)
+{
+    CompareState *s = user_data;
+    Connection *conn = opaque;
+
+    colo_flush_queues(s, &conn->primary_list, &conn->secondary_list);
+}
+
 static void colo_compare_class_init(ObjectClass *oc, void *data)
 {
     UserCreatableClass *ucc = USER_CREATABLE_CLASS(oc);
@@ -1398,6 +1685,10 @@ static void colo_compare_init(Object *obj)
                         get_max_queue_size,
                         set_max_queue_size, NULL, NULL);
 
+    object_property_add(obj, "compare_threads", "uint32",
+                        compare_get_compare_threads,
+                        compare_set_compare_threads, NULL, NULL);
+
     s->vnet_hdr = false;
     object_property_add_bool(obj, "vnet_hdr_support", compare_get_vnet_hdr,
                              compare_set_vnet_hdr);
@@ -1417,6 +1708,7 @@ static void colo_compare_finalize(Object *obj)
 {
     CompareState *s = COLO_COMPARE(obj);
     CompareState *tmp = NULL;
+    uint32_t i;
 
     qemu_mutex_lock(&colo_compare_mutex);
     QTAILQ_FOREACH(tmp, &net_compares, next) {
@@ -1441,7 +1733,20 @@ static void colo_compare_finalize(Object *obj)
 
     colo_compare_timer_del(s);
 
+    for (i = 0; i < s->compare_threads && s->shards; i++) {
+        CompareShard *shard = &s->shards[i];
+
+        qemu_mutex_lock(&shard->in_lock);
+        shard->quit = true;
+        qemu_cond_signal(&shard->in_cond);
+        qemu_mutex_unlock(&shard->in_lock);
+        qemu_thread_join(&shard->thread);
+    }
+
     qemu_bh_delete(s->event_bh);
+    if (s->release_bh) {
+        qemu_bh_delete(s->release_bh);
+    }
 
     AioContext *ctx = iothread_get_aio_context(s->iothread);
     aio_context_acquire(ctx);
@@ -1452,19 +1757,28 @@ static void colo_compare_finalize(Object *obj)
     aio_context_release(ctx);
 
     /* Release all unhandled packets after compare thead exited */
-    g_queue_foreach(&s->conn_list, colo_flush_packets, s);
+    colo_compare_flush_shards(s);
     AIO_WAIT_WHILE(NULL, !s->out_sendco.done);
 
-    g_queue_clear(&s->conn_list);
+    for (i = 0; i < s->nr_shards; i++) {
+        CompareShard *shard = &s->shards[i];
+
+        g_queue_clear(&shard->conn_list);
+        g_hash_table_destroy(shard->connection_track_table);
+        qemu_mutex_destroy(&shard->lock);
+        qemu_mutex_destroy(&shard->in_lock);
+        qemu_cond_destroy(&shard->in_cond);
+    }
+    g_free(s->shards);
+    if (s->compare_threads && s->nr_shards) {
+        qemu_mutex_destroy(&s->release_lock);
+    }
+
     g_queue_clear(&s->out_sendco.send_list);
     if (s->notify_dev) {
         g_queue_clear(&s->notify_sendco.send_list);
     }
 
-    if (s->connection_track_table) {
-        g_hash_table_destroy(s->connection_track_table);
-    }
-
     object_unref(OBJECT(s->iothread));
 
     g_free(s->pri_indev);
@@ -103,6 +103,29 @@ void qemu_plugin_register_vcpu_tb_exec_inline(struct qemu_plugin_tb *tb,
     }
 }
 
+void qemu_plugin_register_vcpu_tb_exec_inline_per_vcpu(
+    struct qemu_plugin_tb *tb, enum qemu_plugin_op op,
+    void *ptr, size_t stride, uint64_t imm)
+{
+    if (!tb->mem_only) {
+        plugin_register_inline_op_per_vcpu(&tb->cbs[PLUGIN_CB_INLINE], 0, op,
+                                           ptr, stride, imm, 0, UINT64_MAX);
+    }
+}
+
+void qemu_plugin_register_vcpu_tb_exec_cond_cb(struct qemu_plugin_tb *tb,
+                                               qemu_plugin_vcpu_udata_cb_t cb,
+                                               enum qemu_plugin_cb_flags flags,
+                                               enum qemu_plugin_cond cond,
+                                               void *ptr, size_t stride,
+                                               uint64_t imm, void *udata)
+{
+    if (!tb->mem_only) {
+        plugin_register_dyn_cb__cond(&tb->cbs[PLUGIN_CB_COND], cb, flags,
+                                     cond, ptr, stride, imm, udata);
+    }
+}
+
 void qemu_plugin_register_vcpu_insn_exec_cb(struct qemu_plugin_insn *insn,
                                             qemu_plugin_vcpu_udata_cb_t cb,
                                             enum qemu_plugin_cb_flags flags,
@@ -124,6 +147,17 @@ void qemu_plugin_register_vcpu_insn_exec_inline(struct qemu_plugin_insn *insn,
     }
 }
 
+void qemu_plugin_register_vcpu_insn_exec_inline_per_vcpu(
+    struct qemu_plugin_insn *insn, enum qemu_plugin_op op,
+    void *ptr, size_t stride, uint64_t imm)
+{
+    if (!insn->mem_only) {
+        plugin_register_inline_op_per_vcpu(
+            &insn->cbs[PLUGIN_CB_INSN][PLUGIN_CB_INLINE], 0, op,
+            ptr, stride, imm, 0, UINT64_MAX);
+    }
+}
+
 
 /*
  * We always plant memory instrumentation because they don't finalise until
@@ -148,6 +182,16 @@ void qemu_plugin_register_vcpu_mem_inline(struct qemu_plugin_insn *insn,
                               rw, op, ptr, imm);
 }
 
+void qemu_plugin_register_vcpu_mem_inline_per_vcpu(
+    struct qemu_plugin_insn *insn, enum qemu_plugin_mem_rw rw,
+    enum qemu_plugin_op op, void *ptr, size_t stride, uint64_t imm,
+    uint64_t lo, uint64_t hi)
+{
+    plugin_register_inline_op_per_vcpu(
+        &insn->cbs[PLUGIN_CB_MEM][PLUGIN_CB_INLINE], rw, op,
+        ptr, stride, imm, lo, hi);
+}
+
 void qemu_plugin_register_vcpu_tb_trans_cb(qemu_plugin_id_t id,
                                            qemu_plugin_vcpu_tb_trans_cb_t cb)
 {
@@ -283,6 +283,16 @@ void plugin_register_inline_op(GArray **arr,
                                enum qemu_plugin_mem_rw rw,
                                enum qemu_plugin_op op, void *ptr,
                                uint64_t imm)
+{
+    plugin_register_inline_op_per_vcpu(arr, rw, op, ptr, 0, imm,
+                                       0, UINT64_MAX);
+}
+
+void plugin_register_inline_op_per_vcpu(GArray **arr,
+                                        enum qemu_plugin_mem_rw rw,
+                                        enum qemu_plugin_op op, void *ptr,
+                                        size_t stride, uint64_t imm,
+                                        uint64_t lo, uint64_t hi)
 {
     struct qemu_plugin_dyn_cb *dyn_cb;
 
@@ -292,6 +302,9 @@ void plugin_register_inline_op(GArray **arr,
     dyn_cb->rw = rw;
     dyn_cb->inline_insn.op = op;
     dyn_cb->inline_insn.imm = imm;
+    dyn_cb->inline_insn.stride = stride;
+    dyn_cb->inline_insn.lo = lo;
+    dyn_cb->inline_insn.hi = hi;
 }
 
 void plugin_register_dyn_cb__udata(GArray **arr,
@@ -307,6 +320,29 @@ void plugin_register_dyn_cb__udata(GArray **arr,
     dyn_cb->type = PLUGIN_CB_REGULAR;
 }
 
+void plugin_register_dyn_cb__cond(GArray **arr,
+                                  qemu_plugin_vcpu_udata_cb_t cb,
+                                  enum qemu_plugin_cb_flags flags,
+                                  enum qemu_plugin_cond cond,
+                                  void *ptr, size_t stride, uint64_t imm,
+                                  void *udata)
+{
+    struct qemu_plugin_dyn_cb *dyn_cb;
+
+    if (cond == QEMU_PLUGIN_COND_NEVER) {
+        return;
+    }
+    dyn_cb = plugin_get_dyn_cb(arr);
+    dyn_cb->userp = udata;
+    /* Note flags are discarded as unused. */
+    dyn_cb->f.vcpu_udata = cb;
+    dyn_cb->type = PLUGIN_CB_COND;
+    dyn_cb->cond.cond = cond;
+    dyn_cb->cond.ptr = ptr;
+    dyn_cb->cond.stride = stride;
+    dyn_cb->cond.imm = imm;
+}
+
 void plugin_register_vcpu_mem_cb(GArray **arr,
                                  void *cb,
                                  enum qemu_plugin_cb_flags flags,
@@ -432,9 +468,14 @@ void qemu_plugin_flush_cb(void)
     plugin_cb__simple(QEMU_PLUGIN_EV_FLUSH);
 }
 
-void exec_inline_op(struct qemu_plugin_dyn_cb *cb)
+void exec_inline_op(struct qemu_plugin_dyn_cb *cb, unsigned int cpu_index,
+                    uint64_t vaddr)
 {
-    uint64_t *val = cb->userp;
+    uint64_t *val = cb->userp + cpu_index * cb->inline_insn.stride;
+
+    if (vaddr - cb->inline_insn.lo > cb->inline_insn.hi - cb->inline_insn.lo) {
+        return;
+    }
 
     switch (cb->inline_insn.op) {
     case QEMU_PLUGIN_INLINE_ADD_U64:
@@ -467,7 +508,7 @@ void qemu_plugin_vcpu_mem_cb(CPUState *cpu, uint64_t vaddr,
                            vaddr, cb->userp);
             break;
         case PLUGIN_CB_INLINE:
-            exec_inline_op(cb);
+            exec_inline_op(cb, cpu->cpu_index, vaddr);
             break;
         default:
             g_assert_not_reached();
@@ -184,6 +184,9 @@ DEF("accel", HAS_ARG, QEMU_OPTION_accel,
     "                kvm-shadow-mem=size of KVM shadow MMU in bytes\n"
     "                split-wx=on|off (enable TCG split w^x mapping)\n"
     "                tb-size=n (TCG translation block cache size)\n"
+    "                tb-cache=file (keep TCG translations across runs)\n"
+    "                hot-trace-threshold=n (optimize hot TCG paths as traces)\n"
+    "                jmp-cache-bits=n (TCG jump cache has 2^n sets per vCPU)\n"
     "                dirty-ring-size=n (KVM dirty ring GFN count, default 0)\n"
     "                thread=single|multi (enable multi-threaded TCG)\n", QEMU_ARCH_ALL)
 SRST
@@ -218,6 +221,32 @@ SRST
     ``tb-size=n``
         Controls the size (in MiB) of the TCG translation block cache.
 
+    ``tb-cache=file``
+        Saves the code generated by TCG to ``file`` on exit, and reuses
+        it in the next runs instead of translating the same guest code
+        again. The file is only used by the same QEMU binary, with the
+        same ``tb-size``, ``thread`` and CPU model, and it requires the
+        code of QEMU and of the translation buffer to be at the same host
+        addresses in every run: use a build configured with
+        ``--disable-pie``, or disable address space randomization. It is
+        not compatible with ``split-wx=on``.
+
+    ``hot-trace-threshold=n``
+        Counts the executions of each TCG translation block, and after
+        ``n`` of them translates again the path of blocks most often
+        executed from it as a single block, so that the code generator
+        can optimize across the blocks. The default, 0, disables the
+        counting. It has no effect with icount or TCG plugins.
+
+    ``jmp-cache-bits=n``
+        Sets the size of the per-vCPU cache that maps guest addresses to
+        TCG translation blocks to 2^n sets of two blocks each, plus a few
+        entries that catch blocks evicted from any set. The default is
+        12; large guest kernels with big working sets may benefit from
+        higher values, up to 18, or twice the number of guest page
+        offset bits if that is smaller. ``info jit`` reports the hit
+        rate.
+
     ``thread=single|multi``
         Controls number of TCG threads. When the TCG is multi-threaded
         there will be one thread per vCPU therefore taking advantage of
@@ -5139,7 +5168,7 @@ SRST
         stored. The file format is libpcap, so it can be analyzed with
         tools such as tcpdump or Wireshark.
 
-    ``-object colo-compare,id=id,primary_in=chardevid,secondary_in=chardevid,outdev=chardevid,iothread=id[,vnet_hdr_support][,notify_dev=id][,compare_timeout=@var{ms}][,expired_scan_cycle=@var{ms}][,max_queue_size=@var{size}]``
+    ``-object colo-compare,id=id,primary_in=chardevid,secondary_in=chardevid,outdev=chardevid,iothread=id[,vnet_hdr_support][,notify_dev=id][,compare_timeout=@var{ms}][,expired_scan_cycle=@var{ms}][,max_queue_size=@var{size}][,compare_threads=@var{n}]``
         Colo-compare gets packet from primary\_in chardevid and
         secondary\_in, then compare whether the payload of primary packet
         and secondary packet are the same. If same, it will output
@@ -5153,6 +5182,9 @@ SRST
         is to set the period of scanning expired primary node network packets.
         The max\_queue\_size=@var{size} is to set the max compare queue
         size depend on user environment.
+        The compare\_threads=@var{n} spreads the connections over @var{n}
+        threads doing the comparison, the iothread then only reads and
+        sends packets. It defaults to 0, comparing in the iothread.
         If user want to use Xen COLO, need to add the notify\_dev to
         notify Xen colo-frame to do checkpoint.
 
@@ -245,3 +245,13 @@ void json_writer_str(JSONWriter *writer, const char *name, const char *str)
     maybe_comma_name(writer, name);
     quoted_str(writer, str);
 }
+
+/*
+ * Append @json, a complete JSON value such as the result of
+ * json_writer_get() on another writer, without any validation.
+ */
+void json_writer_raw(JSONWriter *writer, const char *name, const char *json)
+{
+    maybe_comma_name(writer, name);
+    g_string_append(writer->contents, json);
+}
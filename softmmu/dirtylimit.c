@@ -73,6 +73,12 @@ static QemuMutex dirtylimit_mutex;
 /* dirtylimit thread quit if dirtylimit_quit is true */
 static bool dirtylimit_quit;
 
+/*
+ * The limits are set by migration through dirtylimit_set_budget(),
+ * protected by dirtylimit_mutex
+ */
+static bool dirtylimit_budget_active;
+
 static void vcpu_dirty_rate_stat_collect(void)
 {
     VcpuStat stat;
@@ -426,6 +432,99 @@ static void dirtylimit_cleanup(void)
     dirtylimit_state_finalize();
 }
 
+static int dirtylimit_rate_cmp(const void *a, const void *b)
+{
+    int64_t ra = *(const int64_t *)a;
+    int64_t rb = *(const int64_t *)b;
+
+    return (ra > rb) - (ra < rb);
+}
+
+/*
+ * Find the largest per-vCPU quota q such that the sum of MIN(rate, q)
+ * over all vCPUs stays within @budget MB/s.  Only the vCPUs that dirty
+ * memory faster than q need to be limited to meet the budget.
+ */
+static uint64_t dirtylimit_budget_quota(uint64_t budget)
+{
+    int nvcpu = dirtylimit_state->max_cpus;
+    g_autofree int64_t *rates = g_new(int64_t, nvcpu);
+    uint64_t quota = budget, sum = 0;
+    int i;
+
+    for (i = 0; i < nvcpu; i++) {
+        rates[i] = MAX(vcpu_dirty_rate_get(i), 0);
+    }
+    qsort(rates, nvcpu, sizeof(*rates), dirtylimit_rate_cmp);
+
+    for (i = 0; i < nvcpu; i++) {
+        /* vCPUs i..nvcpu-1 share what the slower ones left over */
+        quota = (budget - sum) / (nvcpu - i);
+        if (rates[i] > quota) {
+            break;
+        }
+        sum += rates[i];
+    }
+
+    return MAX(quota, 1);
+}
+
+/*
+ * Limit the total dirty page rate of the guest to @budget MB/s by
+ * capping the vCPUs that dirty memory fastest; the vCPUs dirtying below
+ * the common quota keep running at full speed.  Meant to be called
+ * periodically by migration with the latest budget: the first call
+ * starts measuring the per-vCPU dirty page rates, and once a vCPU got a
+ * limit it keeps one, adjusted to the new quota, until
+ * dirtylimit_cancel_budget().
+ *
+ * Must be called with the iothread lock held.
+ */
+void dirtylimit_set_budget(uint64_t budget)
+{
+    uint64_t quota;
+    int i;
+
+    dirtylimit_state_lock();
+
+    if (!dirtylimit_in_service()) {
+        dirtylimit_init();
+    }
+    dirtylimit_budget_active = true;
+
+    quota = dirtylimit_budget_quota(budget);
+    trace_dirtylimit_set_budget(budget, quota);
+
+    for (i = 0; i < dirtylimit_state->max_cpus; i++) {
+        if (dirtylimit_vcpu_get_state(i)->enabled ||
+            vcpu_dirty_rate_get(i) > quota) {
+            dirtylimit_set_vcpu(i, quota, true);
+        }
+    }
+
+    dirtylimit_state_unlock();
+}
+
+/*
+ * Drop the limits set by dirtylimit_set_budget(), if any.
+ *
+ * Must be called with the iothread lock held.
+ */
+void dirtylimit_cancel_budget(void)
+{
+    dirtylimit_state_lock();
+
+    if (dirtylimit_budget_active) {
+        dirtylimit_budget_active = false;
+        if (dirtylimit_in_service()) {
+            dirtylimit_set_all(0, false);
+            dirtylimit_cleanup();
+        }
+    }
+
+    dirtylimit_state_unlock();
+}
+
 void qmp_cancel_vcpu_dirty_limit(bool has_cpu_index,
                                  int64_t cpu_index,
                                  Error **errp)
@@ -445,6 +544,12 @@ void qmp_cancel_vcpu_dirty_limit(bool has_cpu_index,
 
     dirtylimit_state_lock();
 
+    if (dirtylimit_budget_active) {
+        error_setg(errp, "dirty page limit is in use by migration");
+        dirtylimit_state_unlock();
+        return;
+    }
+
     if (has_cpu_index) {
         dirtylimit_set_vcpu(cpu_index, 0, false);
     } else {
@@ -496,6 +601,12 @@ void qmp_set_vcpu_dirty_limit(bool has_cpu_index,
 
     dirtylimit_state_lock();
 
+    if (dirtylimit_budget_active) {
+        error_setg(errp, "dirty page limit is in use by migration");
+        dirtylimit_state_unlock();
+        return;
+    }
+
     if (!dirtylimit_in_service()) {
         dirtylimit_init();
     }
@@ -48,6 +48,8 @@ static QTAILQ_HEAD(, AddressSpace) address_spaces
     = QTAILQ_HEAD_INITIALIZER(address_spaces);
 
 static GHashTable *flat_views;
+/* Aliases that are mapped in a container, see flatviews_invalidate() */
+static GPtrArray *mapped_aliases;
 
 typedef struct AddrRange AddrRange;
 
@@ -1001,14 +1003,62 @@ static void flatviews_init(void)
     }
 }
 
-static void flatviews_reset(void)
+/* Drop all FlatViews, so that the next commit renders them again. */
+static void flatviews_invalidate_all(void)
 {
-    AddressSpace *as;
-
     if (flat_views) {
         g_hash_table_unref(flat_views);
         flat_views = NULL;
     }
+}
+
+/*
+ * A change to @mr only affects the FlatViews rendered from a region that
+ * contains @mr, either directly or through an alias.  Drop just those, so
+ * that the next commit renders them again and keeps all the others.
+ */
+static void flatviews_invalidate(MemoryRegion *mr)
+{
+    g_autoptr(GPtrArray) work = NULL;
+    g_autoptr(GHashTable) seen = NULL;
+    unsigned i;
+
+    if (!flat_views) {
+        return;
+    }
+
+    work = g_ptr_array_new();
+    seen = g_hash_table_new(NULL, NULL);
+    g_ptr_array_add(work, mr);
+    while (work->len) {
+        mr = g_ptr_array_remove_index_fast(work, work->len - 1);
+        if (!g_hash_table_add(seen, mr)) {
+            continue;
+        }
+
+        g_hash_table_remove(flat_views, mr);
+        if (mr->container) {
+            g_ptr_array_add(work, mr->container);
+        }
+        for (i = 0; mr->mapped_via_alias && i < mapped_aliases->len; i++) {
+            MemoryRegion *alias = g_ptr_array_index(mapped_aliases, i);
+            MemoryRegion *target;
+
+            for (target = alias->alias; target; target = target->alias) {
+                if (target == mr) {
+                    g_ptr_array_add(work, alias);
+                    break;
+                }
+            }
+        }
+    }
+}
+
+/* Render the FlatViews that are missing after invalidation. */
+static void flatviews_render(void)
+{
+    AddressSpace *as;
+
     flatviews_init();
 
     /* Render unique FVs */
@@ -1023,6 +1073,38 @@ static void flatviews_reset(void)
     }
 }
 
+static gboolean flatview_unused(gpointer key, gpointer value,
+                                gpointer user_data)
+{
+    GHashTable *used = user_data;
+
+    return key && !g_hash_table_contains(used, value);
+}
+
+/*
+ * Drop the FlatViews no address space uses anymore, so that they do not
+ * keep their MemoryRegions alive.
+ */
+static void flatviews_prune(void)
+{
+    g_autoptr(GHashTable) used = g_hash_table_new(NULL, NULL);
+    AddressSpace *as;
+
+    QTAILQ_FOREACH(as, &address_spaces, address_spaces_link) {
+        g_hash_table_add(used, address_space_to_flatview(as));
+    }
+    g_hash_table_foreach_remove(flat_views, flatview_unused, used);
+}
+
+/* Note that @mr changed; @visible says whether this can affect rendering. */
+static void memory_region_update_pending_mark(MemoryRegion *mr, bool visible)
+{
+    if (visible) {
+        flatviews_invalidate(mr);
+        memory_region_update_pending = true;
+    }
+}
+
 static void address_space_set_flatview(AddressSpace *as)
 {
     FlatView *old_view = address_space_to_flatview(as);
@@ -1095,14 +1177,21 @@ void memory_region_transaction_commit(void)
     --memory_region_transaction_depth;
     if (!memory_region_transaction_depth) {
         if (memory_region_update_pending) {
-            flatviews_reset();
+            flatviews_render();
 
             MEMORY_LISTENER_CALL_GLOBAL(begin, Forward);
 
             QTAILQ_FOREACH(as, &address_spaces, address_spaces_link) {
+                FlatView *old_view = address_space_to_flatview(as);
+
+                /* Address spaces whose FlatView was kept did not change */
                 address_space_set_flatview(as);
-                address_space_update_ioeventfds(as);
+                if (ioeventfd_update_pending ||
+                    address_space_to_flatview(as) != old_view) {
+                    address_space_update_ioeventfds(as);
+                }
             }
+            flatviews_prune();
             memory_region_update_pending = false;
             ioeventfd_update_pending = false;
             MEMORY_LISTENER_CALL_GLOBAL(commit, Forward);
@@ -2135,7 +2224,7 @@ void memory_region_set_log(MemoryRegion *mr, bool log, unsigned client)
 
     memory_region_transaction_begin();
     mr->dirty_log_mask = (mr->dirty_log_mask & ~mask) | (log * mask);
-    memory_region_update_pending |= mr->enabled;
+    memory_region_update_pending_mark(mr, mr->enabled);
     memory_region_transaction_commit();
 }
 
@@ -2265,7 +2354,7 @@ void memory_region_set_readonly(MemoryRegion *mr, bool readonly)
     if (mr->readonly != readonly) {
         memory_region_transaction_begin();
         mr->readonly = readonly;
-        memory_region_update_pending |= mr->enabled;
+        memory_region_update_pending_mark(mr, mr->enabled);
         memory_region_transaction_commit();
     }
 }
@@ -2275,7 +2364,7 @@ void memory_region_set_nonvolatile(MemoryRegion *mr, bool nonvolatile)
     if (mr->nonvolatile != nonvolatile) {
         memory_region_transaction_begin();
         mr->nonvolatile = nonvolatile;
-        memory_region_update_pending |= mr->enabled;
+        memory_region_update_pending_mark(mr, mr->enabled);
         memory_region_transaction_commit();
     }
 }
@@ -2285,7 +2374,7 @@ void memory_region_rom_device_set_romd(MemoryRegion *mr, bool romd_mode)
     if (mr->romd_mode != romd_mode) {
         memory_region_transaction_begin();
         mr->romd_mode = romd_mode;
-        memory_region_update_pending |= mr->enabled;
+        memory_region_update_pending_mark(mr, mr->enabled);
         memory_region_transaction_commit();
     }
 }
@@ -2537,7 +2626,7 @@ static void memory_region_update_container_subregions(MemoryRegion *subregion)
     }
     QTAILQ_INSERT_TAIL(&mr->subregions, subregion, subregions_link);
 done:
-    memory_region_update_pending |= mr->enabled && subregion->enabled;
+    memory_region_update_pending_mark(mr, mr->enabled && subregion->enabled);
     memory_region_transaction_commit();
 }
 
@@ -2552,6 +2641,12 @@ static void memory_region_add_subregion_common(MemoryRegion *mr,
     for (alias = subregion->alias; alias; alias = alias->alias) {
         alias->mapped_via_alias++;
     }
+    if (subregion->alias) {
+        if (!mapped_aliases) {
+            mapped_aliases = g_ptr_array_new();
+        }
+        g_ptr_array_add(mapped_aliases, subregion);
+    }
     subregion->addr = offset;
     memory_region_update_container_subregions(subregion);
 }
@@ -2585,9 +2680,12 @@ void memory_region_del_subregion(MemoryRegion *mr,
         alias->mapped_via_alias--;
         assert(alias->mapped_via_alias >= 0);
     }
+    if (subregion->alias) {
+        g_ptr_array_remove_fast(mapped_aliases, subregion);
+    }
     QTAILQ_REMOVE(&mr->subregions, subregion, subregions_link);
     memory_region_unref(subregion);
-    memory_region_update_pending |= mr->enabled && subregion->enabled;
+    memory_region_update_pending_mark(mr, mr->enabled && subregion->enabled);
     memory_region_transaction_commit();
 }
 
@@ -2598,7 +2696,7 @@ void memory_region_set_enabled(MemoryRegion *mr, bool enabled)
     }
     memory_region_transaction_begin();
     mr->enabled = enabled;
-    memory_region_update_pending = true;
+    memory_region_update_pending_mark(mr, true);
     memory_region_transaction_commit();
 }
 
@@ -2614,7 +2712,7 @@ void memory_region_set_size(MemoryRegion *mr, uint64_t size)
     }
     memory_region_transaction_begin();
     mr->size = s;
-    memory_region_update_pending = true;
+    memory_region_update_pending_mark(mr, true);
     memory_region_transaction_commit();
 }
 
@@ -2650,7 +2748,7 @@ void memory_region_set_alias_offset(MemoryRegion *mr, hwaddr offset)
 
     memory_region_transaction_begin();
     mr->alias_offset = offset;
-    memory_region_update_pending |= mr->enabled;
+    memory_region_update_pending_mark(mr, mr->enabled);
     memory_region_transaction_commit();
 }
 
@@ -2821,6 +2919,7 @@ void memory_global_dirty_log_start(unsigned int flags)
     if (!old_flags) {
         MEMORY_LISTENER_CALL_GLOBAL(log_global_start, Forward);
         memory_region_transaction_begin();
+        flatviews_invalidate_all();
         memory_region_update_pending = true;
         memory_region_transaction_commit();
     }
@@ -2836,6 +2935,7 @@ static void memory_global_dirty_log_do_stop(unsigned int flags)
 
     if (!global_dirty_tracking) {
         memory_region_transaction_begin();
+        flatviews_invalidate_all();
         memory_region_update_pending = true;
         memory_region_transaction_commit();
         MEMORY_LISTENER_CALL_GLOBAL(log_global_stop, Reverse);
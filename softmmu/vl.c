@@ -2542,6 +2542,9 @@ static void qemu_machine_creation_done(void)
 {
     MachineState *machine = MACHINE(qdev_get_machine());
 
+    /* Guest RAM must be fully preallocated before it is first written. */
+    os_mem_prealloc_finish(&error_fatal);
+
     /* Did we create any drives that we failed to create a device for? */
     drive_check_orphaned();
 
@@ -302,12 +302,6 @@ DEF_HELPER_2(neon_hadd_s16, i32, i32, i32)
 DEF_HELPER_2(neon_hadd_u16, i32, i32, i32)
 DEF_HELPER_2(neon_hadd_s32, s32, s32, s32)
 DEF_HELPER_2(neon_hadd_u32, i32, i32, i32)
-DEF_HELPER_2(neon_rhadd_s8, i32, i32, i32)
-DEF_HELPER_2(neon_rhadd_u8, i32, i32, i32)
-DEF_HELPER_2(neon_rhadd_s16, i32, i32, i32)
-DEF_HELPER_2(neon_rhadd_u16, i32, i32, i32)
-DEF_HELPER_2(neon_rhadd_s32, s32, s32, s32)
-DEF_HELPER_2(neon_rhadd_u32, i32, i32, i32)
 DEF_HELPER_2(neon_hsub_s8, i32, i32, i32)
 DEF_HELPER_2(neon_hsub_u8, i32, i32, i32)
 DEF_HELPER_2(neon_hsub_s16, i32, i32, i32)
@@ -4702,6 +4702,9 @@ static void do_coproc_insn(DisasContext *s, int cpnum, int is64,
             return;
         }
 
+        /* The helpers are passed @ri, which only exists in this run */
+        tcg_set_tb_nocache();
+
         if (s->hstr_active || ri->accessfn ||
             (arm_dc_feature(s, ARM_FEATURE_XSCALE) && cpnum < 14)) {
             /* Emit code to perform further access permissions checks at
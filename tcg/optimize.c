@@ -49,6 +49,7 @@ typedef struct TempOptInfo {
 typedef struct OptContext {
     TCGContext *tcg;
     TCGOp *prev_mb;
+    TCGBar mb_unordered;  /* orderings not yet enforced by a barrier */
     TCGTempSet temps_used;
 
     /* In flight values from optimization. */
@@ -698,6 +699,7 @@ static void finish_folding(OptContext *ctx, TCGOp *op)
     if (def->flags & TCG_OPF_BB_END) {
         memset(&ctx->temps_used, 0, sizeof(ctx->temps_used));
         ctx->prev_mb = NULL;
+        ctx->mb_unordered = TCG_MO_ALL;
         return;
     }
 
@@ -1227,8 +1229,9 @@ static bool fold_call(OptContext *ctx, TCGOp *op)
         reset_temp(op->args[i]);
     }
 
-    /* Stop optimizing MB across calls. */
+    /* Stop optimizing MB across calls, which may access guest memory. */
     ctx->prev_mb = NULL;
+    ctx->mb_unordered = TCG_MO_ALL;
     return true;
 }
 
@@ -1478,6 +1481,26 @@ static bool fold_extu(OptContext *ctx, TCGOp *op)
 
 static bool fold_mb(OptContext *ctx, TCGOp *op)
 {
+    TCGBar type = op->args[0];
+
+    /*
+     * A barrier ordering accesses of kind A before accesses of kind B
+     * is redundant if there has been no access of kind A since the
+     * last barrier that ordered A before B.  Keep only the orderings
+     * still needed, so that e.g. the barrier before a store that only
+     * follows other stores becomes a store-store barrier.
+     */
+    if (type & TCG_MO_ALL) {
+        TCGBar need = type & ctx->mb_unordered;
+
+        if (!need) {
+            tcg_op_remove(ctx->tcg, op);
+            return true;
+        }
+        op->args[0] = need | (type & TCG_BAR_SC);
+        ctx->mb_unordered &= ~need;
+    }
+
     /* Eliminate duplicate and redundant fence instructions.  */
     if (ctx->prev_mb) {
         /*
@@ -1725,6 +1748,7 @@ static bool fold_qemu_ld(OptContext *ctx, TCGOp *op)
 
     /* Opcodes that touch guest memory stop the mb optimization.  */
     ctx->prev_mb = NULL;
+    ctx->mb_unordered |= TCG_MO_LD_LD | TCG_MO_LD_ST;
     return false;
 }
 
@@ -1732,6 +1756,7 @@ static bool fold_qemu_st(OptContext *ctx, TCGOp *op)
 {
     /* Opcodes that touch guest memory stop the mb optimization.  */
     ctx->prev_mb = NULL;
+    ctx->mb_unordered |= TCG_MO_ST_LD | TCG_MO_ST_ST;
     return false;
 }
 
@@ -2027,7 +2052,7 @@ void tcg_optimize(TCGContext *s)
 {
     int nb_temps, i;
     TCGOp *op, *op_next;
-    OptContext ctx = { .tcg = s };
+    OptContext ctx = { .tcg = s, .mb_unordered = TCG_MO_ALL };
 
     /* Array VALS has an element for each temp.
        If this temp holds a constant then its value is kept in VALS' element.
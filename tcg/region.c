@@ -60,10 +60,15 @@ struct tcg_region_state {
     /* fields protected by the lock */
     size_t current; /* current region index */
     size_t agg_size_full; /* aggregate size of full regions */
+    size_t *reserved; /* per-region size of code restored from a file */
+    size_t *filled; /* per-region size of code in regions that filled up */
 };
 
 static struct tcg_region_state region;
 
+/* Preferred address of code_gen_buffer, see tcg_region_set_base() */
+static void *code_gen_base_hint;
+
 /*
  * This is an array of struct tcg_region_tree's, with padding.
  * We use void * to simplify the computation of region_trees[i]; each
@@ -328,7 +333,8 @@ static void tcg_region_assign(TCGContext *s, size_t curr_region)
     tcg_region_bounds(curr_region, &start, &end);
 
     s->code_gen_buffer = start;
-    s->code_gen_ptr = start;
+    s->code_gen_ptr = start + (region.reserved ? region.reserved[curr_region]
+                                               : 0);
     s->code_gen_buffer_size = end - start;
     s->code_gen_highwater = end - TCG_HIGHWATER;
 }
@@ -352,11 +358,18 @@ bool tcg_region_alloc(TCGContext *s)
     bool err;
     /* read the region size now; alloc__locked will overwrite it on success */
     size_t size_full = s->code_gen_buffer_size;
+    size_t used = s->code_gen_ptr - s->code_gen_buffer;
+    size_t n = ((void *)s->code_gen_buffer - region.start_aligned) /
+               region.stride;
 
     qemu_mutex_lock(&region.lock);
     err = tcg_region_alloc__locked(s);
     if (!err) {
         region.agg_size_full += size_full - TCG_HIGHWATER;
+        if (!region.filled) {
+            region.filled = g_new0(size_t, region.n);
+        }
+        region.filled[n] = used;
     }
     qemu_mutex_unlock(&region.lock);
     return err;
@@ -388,6 +401,10 @@ void tcg_region_reset_all(void)
     qemu_mutex_lock(&region.lock);
     region.current = 0;
     region.agg_size_full = 0;
+    g_free(region.reserved);
+    region.reserved = NULL;
+    g_free(region.filled);
+    region.filled = NULL;
 
     for (i = 0; i < n_ctxs; i++) {
         TCGContext *s = qatomic_read(&tcg_ctxs[i]);
@@ -398,6 +415,95 @@ void tcg_region_reset_all(void)
     tcg_region_tree_reset_all();
 }
 
+/*
+ * Ask for code_gen_buffer to be mapped at @addr if that range is free,
+ * so that code saved by a previous run can be used in place.
+ * Must be called before tcg_init().
+ */
+void tcg_region_set_base(void *addr)
+{
+    code_gen_base_hint = addr;
+}
+
+void *tcg_region_base(void)
+{
+    return region.start_aligned;
+}
+
+size_t tcg_nb_regions(void)
+{
+    return region.n;
+}
+
+/*
+ * Returns the size of the code emitted so far in region @n, whose start
+ * is stored in @pstart.  Regions that no context generated code into,
+ * such as the one the initial context holds in softmmu, only report the
+ * code restored into them by tcg_region_reserve().
+ * Call from a safe-work context.
+ */
+size_t tcg_region_used(size_t n, void **pstart)
+{
+    unsigned int n_ctxs = qatomic_read(&tcg_cur_ctxs);
+    void *start, *end;
+    size_t used = 0;
+    unsigned int i;
+
+    tcg_region_bounds(n, &start, &end);
+    *pstart = start;
+
+    qemu_mutex_lock(&region.lock);
+    if (region.filled && region.filled[n]) {
+        used = region.filled[n];
+    } else if (region.reserved) {
+        used = region.reserved[n];
+    }
+    if (n < region.current) {
+        for (i = 0; i < n_ctxs; i++) {
+            const TCGContext *s = qatomic_read(&tcg_ctxs[i]);
+
+            if (s->code_gen_buffer == start) {
+                used = s->code_gen_ptr - start;
+                break;
+            }
+        }
+    }
+    qemu_mutex_unlock(&region.lock);
+    return used;
+}
+
+/*
+ * Set aside the first @size bytes of region @n for code restored from a
+ * previous run, so that code generation starts after it.  Must be called
+ * before any TCG thread is registered.
+ * Returns the start of the region, or NULL if @size does not fit.
+ */
+void *tcg_region_reserve(size_t n, size_t size)
+{
+    void *start, *end;
+
+    g_assert(qatomic_read(&tcg_cur_ctxs) == 0);
+    if (n >= region.n) {
+        return NULL;
+    }
+    tcg_region_bounds(n, &start, &end);
+    if (size > end - start - TCG_HIGHWATER) {
+        return NULL;
+    }
+
+    qemu_mutex_lock(&region.lock);
+    if (!region.reserved) {
+        region.reserved = g_new0(size_t, region.n);
+    }
+    region.reserved[n] = size;
+    /* The first region already belongs to the initial context */
+    if (n < region.current) {
+        tcg_region_assign(&tcg_init_ctx, n);
+    }
+    qemu_mutex_unlock(&region.lock);
+    return start;
+}
+
 static size_t tcg_n_regions(size_t tb_size, unsigned max_cpus)
 {
 #ifdef CONFIG_USER_ONLY
@@ -532,7 +638,7 @@ static int alloc_code_gen_buffer_anon(size_t size, int prot,
 {
     void *buf;
 
-    buf = mmap(NULL, size, prot, flags, -1, 0);
+    buf = mmap(code_gen_base_hint, size, prot, flags, -1, 0);
     if (buf == MAP_FAILED) {
         error_setg_errno(errp, errno,
                          "allocate %zu bytes for jit buffer", size);
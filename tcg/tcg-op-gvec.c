@@ -2352,6 +2352,125 @@ void tcg_gen_gvec_ussub(unsigned vece, uint32_t dofs, uint32_t aofs,
     tcg_gen_gvec_3(dofs, aofs, bofs, oprsz, maxsz, &g[vece]);
 }
 
+/* rhadd(a, b) = (a >> 1) + (b >> 1) + ((a | b) & 1), with no overflow.  */
+static void gen_rhadd_i32(TCGv_i32 d, TCGv_i32 a, TCGv_i32 b, bool sign)
+{
+    TCGv_i32 t = tcg_temp_new_i32();
+    TCGv_i32 u = tcg_temp_new_i32();
+
+    tcg_gen_or_i32(t, a, b);
+    tcg_gen_andi_i32(t, t, 1);
+    if (sign) {
+        tcg_gen_sari_i32(u, a, 1);
+        tcg_gen_add_i32(t, t, u);
+        tcg_gen_sari_i32(u, b, 1);
+    } else {
+        tcg_gen_shri_i32(u, a, 1);
+        tcg_gen_add_i32(t, t, u);
+        tcg_gen_shri_i32(u, b, 1);
+    }
+    tcg_gen_add_i32(d, t, u);
+    tcg_temp_free_i32(t);
+    tcg_temp_free_i32(u);
+}
+
+static void gen_rhadd_i64(TCGv_i64 d, TCGv_i64 a, TCGv_i64 b, bool sign)
+{
+    TCGv_i64 t = tcg_temp_new_i64();
+    TCGv_i64 u = tcg_temp_new_i64();
+
+    tcg_gen_or_i64(t, a, b);
+    tcg_gen_andi_i64(t, t, 1);
+    if (sign) {
+        tcg_gen_sari_i64(u, a, 1);
+        tcg_gen_add_i64(t, t, u);
+        tcg_gen_sari_i64(u, b, 1);
+    } else {
+        tcg_gen_shri_i64(u, a, 1);
+        tcg_gen_add_i64(t, t, u);
+        tcg_gen_shri_i64(u, b, 1);
+    }
+    tcg_gen_add_i64(d, t, u);
+    tcg_temp_free_i64(t);
+    tcg_temp_free_i64(u);
+}
+
+static void tcg_gen_srhadd_i32(TCGv_i32 d, TCGv_i32 a, TCGv_i32 b)
+{
+    gen_rhadd_i32(d, a, b, true);
+}
+
+static void tcg_gen_srhadd_i64(TCGv_i64 d, TCGv_i64 a, TCGv_i64 b)
+{
+    gen_rhadd_i64(d, a, b, true);
+}
+
+static void tcg_gen_urhadd_i32(TCGv_i32 d, TCGv_i32 a, TCGv_i32 b)
+{
+    gen_rhadd_i32(d, a, b, false);
+}
+
+static void tcg_gen_urhadd_i64(TCGv_i64 d, TCGv_i64 a, TCGv_i64 b)
+{
+    gen_rhadd_i64(d, a, b, false);
+}
+
+void tcg_gen_gvec_srhadd(unsigned vece, uint32_t dofs, uint32_t aofs,
+                         uint32_t bofs, uint32_t oprsz, uint32_t maxsz)
+{
+    static const TCGOpcode vecop_list[] = { INDEX_op_srhadd_vec, 0 };
+    static const GVecGen3 g[4] = {
+        { .fniv = tcg_gen_srhadd_vec,
+          .fno = gen_helper_gvec_srhadd8,
+          .opt_opc = vecop_list,
+          .vece = MO_8 },
+        { .fniv = tcg_gen_srhadd_vec,
+          .fno = gen_helper_gvec_srhadd16,
+          .opt_opc = vecop_list,
+          .vece = MO_16 },
+        { .fni4 = tcg_gen_srhadd_i32,
+          .fniv = tcg_gen_srhadd_vec,
+          .fno = gen_helper_gvec_srhadd32,
+          .opt_opc = vecop_list,
+          .vece = MO_32 },
+        { .fni8 = tcg_gen_srhadd_i64,
+          .fniv = tcg_gen_srhadd_vec,
+          .fno = gen_helper_gvec_srhadd64,
+          .opt_opc = vecop_list,
+          .vece = MO_64 }
+    };
+    tcg_debug_assert(vece <= MO_64);
+    tcg_gen_gvec_3(dofs, aofs, bofs, oprsz, maxsz, &g[vece]);
+}
+
+void tcg_gen_gvec_urhadd(unsigned vece, uint32_t dofs, uint32_t aofs,
+                         uint32_t bofs, uint32_t oprsz, uint32_t maxsz)
+{
+    static const TCGOpcode vecop_list[] = { INDEX_op_urhadd_vec, 0 };
+    static const GVecGen3 g[4] = {
+        { .fniv = tcg_gen_urhadd_vec,
+          .fno = gen_helper_gvec_urhadd8,
+          .opt_opc = vecop_list,
+          .vece = MO_8 },
+        { .fniv = tcg_gen_urhadd_vec,
+          .fno = gen_helper_gvec_urhadd16,
+          .opt_opc = vecop_list,
+          .vece = MO_16 },
+        { .fni4 = tcg_gen_urhadd_i32,
+          .fniv = tcg_gen_urhadd_vec,
+          .fno = gen_helper_gvec_urhadd32,
+          .opt_opc = vecop_list,
+          .vece = MO_32 },
+        { .fni8 = tcg_gen_urhadd_i64,
+          .fniv = tcg_gen_urhadd_vec,
+          .fno = gen_helper_gvec_urhadd64,
+          .opt_opc = vecop_list,
+          .vece = MO_64 }
+    };
+    tcg_debug_assert(vece <= MO_64);
+    tcg_gen_gvec_3(dofs, aofs, bofs, oprsz, maxsz, &g[vece]);
+}
+
 void tcg_gen_gvec_smin(unsigned vece, uint32_t dofs, uint32_t aofs,
                        uint32_t bofs, uint32_t oprsz, uint32_t maxsz)
 {
@@ -2728,8 +2728,38 @@ void tcg_gen_extr32_i64(TCGv_i64 lo, TCGv_i64 hi, TCGv_i64 arg)
 
 /* QEMU specific operations.  */
 
+/*
+ * Within a hot trace, return the exit of the trace used for exit @idx
+ * of the current block, or -1 when there is none left and the block
+ * must leave through tcg_gen_lookup_and_goto_ptr.
+ */
+static int tcg_trace_slot(unsigned idx)
+{
+    TCGContext *s = tcg_ctx;
+
+    if (s->trace_slot[idx] < 0 && s->trace_nb_slots <= TB_EXIT_IDXMAX) {
+        s->trace_slot[idx] = s->trace_nb_slots++;
+    }
+    return s->trace_slot[idx];
+}
+
 void tcg_gen_exit_tb(const TranslationBlock *tb, unsigned idx)
 {
+    uintptr_t val;
+
+    if (tb && idx <= TB_EXIT_IDXMAX && tcg_ctx->trace_exits) {
+        if (tcg_ctx->trace_next && idx == tcg_ctx->trace_hot) {
+            /* Continue with the next block of the trace.  */
+            tcg_gen_br(tcg_ctx->trace_next);
+            return;
+        }
+        if (tcg_trace_slot(idx) < 0) {
+            tcg_gen_lookup_and_goto_ptr();
+            return;
+        }
+        idx = tcg_trace_slot(idx);
+    }
+
     /*
      * Let the jit code return the read-only version of the
      * TranslationBlock, so that we minimize the pc-relative
@@ -2741,7 +2771,7 @@ void tcg_gen_exit_tb(const TranslationBlock *tb, unsigned idx)
      * This requires coordination with targets that do not use
      * the translator_loop.
      */
-    uintptr_t val = (uintptr_t)tcg_splitwx_to_rx((void *)tb) + idx;
+    val = (uintptr_t)tcg_splitwx_to_rx((void *)tb) + idx;
 
     if (tb == NULL) {
         tcg_debug_assert(idx == 0);
@@ -2766,6 +2796,16 @@ void tcg_gen_goto_tb(unsigned idx)
     tcg_debug_assert(!(tcg_ctx->tb_cflags & CF_NO_GOTO_TB));
     /* We only support two chained exits.  */
     tcg_debug_assert(idx <= TB_EXIT_IDXMAX);
+    if (tcg_ctx->trace_exits) {
+        /* The exit is emitted by tcg_gen_exit_tb, if at all.  */
+        if (tcg_ctx->trace_next && idx == tcg_ctx->trace_hot) {
+            return;
+        }
+        if (tcg_trace_slot(idx) < 0) {
+            return;
+        }
+        idx = tcg_trace_slot(idx);
+    }
 #ifdef CONFIG_DEBUG_TCG
     /* Verify that we haven't seen this numbered exit before.  */
     tcg_debug_assert((tcg_ctx->goto_tb_issue_mask & (1 << idx)) == 0);
@@ -819,6 +819,7 @@ void tcg_func_start(TCGContext *s)
     s->nb_ops = 0;
     s->nb_labels = 0;
     s->current_frame_offset = s->frame_start;
+    s->trace_exits = false;
 
 #ifdef CONFIG_DEBUG_TCG
     s->goto_tb_issue_mask = 0;
@@ -1451,6 +1452,9 @@ bool tcg_op_supported(TCGOpcode op)
     case INDEX_op_sssub_vec:
     case INDEX_op_ussub_vec:
         return have_vec && TCG_TARGET_HAS_sat_vec;
+    case INDEX_op_srhadd_vec:
+    case INDEX_op_urhadd_vec:
+        return have_vec && TCG_TARGET_HAS_rhadd_vec;
     case INDEX_op_smin_vec:
     case INDEX_op_umin_vec:
     case INDEX_op_smax_vec:
@@ -2244,6 +2248,13 @@ static TCGOp *tcg_op_alloc(TCGOpcode opc)
 TCGOp *tcg_emit_op(TCGOpcode opc)
 {
     TCGOp *op = tcg_op_alloc(opc);
+
+#ifdef CONFIG_PLUGIN
+    if (tcg_ctx->emit_before_op) {
+        QTAILQ_INSERT_BEFORE(tcg_ctx->emit_before_op, op, link);
+        return op;
+    }
+#endif
     QTAILQ_INSERT_TAIL(&tcg_ctx->ops, op, link);
     return op;
 }
@@ -2450,6 +2461,23 @@ static void la_bb_sync(TCGContext *s, int ng, int nt)
     }
 }
 
+/*
+ * liveness analysis: label: globals need only be synced, as the register
+ * allocator may keep them cached in host registers across the label;
+ * all other temps are treated as at the end of a basic block.
+ */
+static void la_label(TCGContext *s, int ng, int nt)
+{
+    la_global_sync(s, ng);
+
+    for (int i = ng; i < nt; ++i) {
+        TCGTemp *ts = &s->temps[i];
+
+        ts->state = ts->kind == TEMP_LOCAL ? TS_DEAD | TS_MEM : TS_DEAD;
+        la_reset_pref(ts);
+    }
+}
+
 /* liveness analysis: sync globals back to memory and kill.  */
 static void la_global_kill(TCGContext *s, int ng)
 {
@@ -2728,6 +2756,8 @@ static void liveness_pass_1(TCGContext *s)
                 la_func_end(s, nb_globals, nb_temps);
             } else if (def->flags & TCG_OPF_COND_BRANCH) {
                 la_bb_sync(s, nb_globals, nb_temps);
+            } else if (opc == INDEX_op_set_label) {
+                la_label(s, nb_globals, nb_temps);
             } else if (def->flags & TCG_OPF_BB_END) {
                 la_bb_end(s, nb_globals, nb_temps);
             } else if (def->flags & TCG_OPF_SIDE_EFFECTS) {
@@ -3323,6 +3353,12 @@ static void temp_load(TCGContext *s, TCGTemp *ts, TCGRegSet desired_regs,
    temporary registers needs to be allocated to store a constant.  */
 static void temp_save(TCGContext *s, TCGTemp *ts, TCGRegSet allocated_regs)
 {
+    /* A global may still be cached in the register it was loaded into
+       for a label (see tcg_reg_alloc_label); drop that copy.  */
+    if (ts->kind == TEMP_GLOBAL && ts->val_type == TEMP_VAL_REG) {
+        tcg_debug_assert(ts->mem_coherent);
+        temp_free_or_dead(s, ts, -1);
+    }
     /* The liveness analysis already ensures that globals are back
        in memory. Keep an tcg_debug_assert for safety. */
     tcg_debug_assert(ts->val_type == TEMP_VAL_MEM || temp_readonly(ts));
@@ -3386,6 +3422,134 @@ static void tcg_reg_alloc_bb_end(TCGContext *s, TCGRegSet allocated_regs)
     save_globals(s, allocated_regs);
 }
 
+/*
+ * Globals may stay cached in host registers across a label, as long as
+ * every predecessor agrees on which register holds which global.  The
+ * first predecessor seen (the fall-through into the label, or a branch
+ * to it) records the globals it holds in registers as the entry state
+ * of the label; every later predecessor moves or reloads its globals to
+ * match.  Globals are always synced at a label, so a register copy may
+ * be dropped at any time and any global may be reloaded from memory.
+ */
+static TCGLabel *op_branch_label(const TCGOp *op)
+{
+    switch (op->opc) {
+    case INDEX_op_br:
+        return arg_label(op->args[0]);
+    case INDEX_op_brcond_i32:
+    case INDEX_op_brcond_i64:
+        return arg_label(op->args[3]);
+    case INDEX_op_brcond2_i32:
+        return arg_label(op->args[5]);
+    default:
+        return NULL;
+    }
+}
+
+static void label_record_entry(TCGContext *s, TCGLabel *l)
+{
+    /* Leave enough registers for the inputs of later branches.  */
+    TCGRegSet avail = tcg_target_available_regs[TCG_TYPE_I32];
+    int max = MIN(ctpop64(avail & ~s->reserved_regs) / 2,
+                  TCG_LABEL_MAX_ENTRY_REGS);
+    int i, n = 0;
+
+    for (i = 0; i < TCG_TARGET_NB_REGS && n < max; i++) {
+        TCGTemp *ts = s->reg_to_temp[i];
+
+        if (ts && ts->kind == TEMP_GLOBAL) {
+            tcg_debug_assert(ts->mem_coherent);
+            l->entry_regs[n].ts = ts;
+            l->entry_regs[n].reg = i;
+            n++;
+        }
+    }
+    l->nb_entry_regs = n;
+    l->has_entry_regs = true;
+}
+
+/* Load the globals of the entry state of L into their registers.  */
+static void label_load_entry(TCGContext *s, TCGLabel *l,
+                             TCGRegSet allocated_regs)
+{
+    int i;
+
+    for (i = 0; i < l->nb_entry_regs; i++) {
+        TCGTemp *ts = l->entry_regs[i].ts;
+        TCGReg reg = l->entry_regs[i].reg;
+
+        if (ts->val_type == TEMP_VAL_REG && ts->reg == reg) {
+            continue;
+        }
+        tcg_reg_free(s, reg, allocated_regs);
+        if (ts->val_type == TEMP_VAL_REG) {
+            tcg_debug_assert(ts->mem_coherent);
+            tcg_out_mov(s, ts->type, reg, ts->reg);
+            s->reg_to_temp[ts->reg] = NULL;
+        } else {
+            tcg_debug_assert(ts->val_type == TEMP_VAL_MEM);
+            tcg_out_ld(s, ts->type, reg, ts->mem_base->reg, ts->mem_offset);
+        }
+        ts->reg = reg;
+        ts->val_type = TEMP_VAL_REG;
+        ts->mem_coherent = 1;
+        s->reg_to_temp[reg] = ts;
+    }
+}
+
+/*
+ * Before a branch to L, put the globals where L expects them.  Return
+ * the registers used, which must survive until the branch itself.
+ */
+static TCGRegSet tcg_reg_alloc_label_jump(TCGContext *s, TCGLabel *l)
+{
+    TCGRegSet regs = 0;
+    int i;
+
+    if (l->has_entry_regs) {
+        label_load_entry(s, l, s->reserved_regs);
+    } else {
+        label_record_entry(s, l);
+    }
+    for (i = 0; i < l->nb_entry_regs; i++) {
+        tcg_regset_set_reg(regs, l->entry_regs[i].reg);
+    }
+    return regs;
+}
+
+static void tcg_reg_alloc_label(TCGContext *s, TCGOp *op)
+{
+    TCGLabel *l = arg_label(op->args[0]);
+    TCGOp *prev = QTAILQ_PREV(op, link);
+    bool fallthrough = true;
+    int i;
+
+    if (prev && prev->opc != INDEX_op_set_label) {
+        int flags = tcg_op_defs[prev->opc].flags;
+
+        fallthrough = (!(flags & TCG_OPF_BB_END)
+                       || (flags & TCG_OPF_COND_BRANCH));
+    }
+
+    if (!l->has_entry_regs) {
+        label_record_entry(s, l);
+    } else if (fallthrough) {
+        label_load_entry(s, l, s->reserved_regs);
+    }
+
+    /* Drop every other global, then adopt the entry state.  */
+    tcg_reg_alloc_bb_end(s, s->reserved_regs);
+    for (i = 0; i < l->nb_entry_regs; i++) {
+        TCGTemp *ts = l->entry_regs[i].ts;
+        TCGReg reg = l->entry_regs[i].reg;
+
+        ts->reg = reg;
+        ts->val_type = TEMP_VAL_REG;
+        ts->mem_coherent = 1;
+        s->reg_to_temp[reg] = ts;
+    }
+}
+
 /*
  * At a conditional branch, we assume all temporaries are dead unless
  * explicitly live-across-conditional-branch; all globals and local
@@ -3675,6 +3839,13 @@ static void tcg_reg_alloc_op(TCGContext *s, const TCGOp *op)
     i_allocated_regs = s->reserved_regs;
     o_allocated_regs = s->reserved_regs;
 
+    if (def->flags & TCG_OPF_BB_END) {
+        TCGLabel *l = op_branch_label(op);
+        if (l) {
+            i_allocated_regs |= tcg_reg_alloc_label_jump(s, l);
+        }
+    }
+
     /* satisfy input constraints */ 
     for (k = 0; k < nb_iargs; k++) {
         TCGRegSet i_preferred_regs, o_preferred_regs;
@@ -4355,7 +4526,7 @@ int tcg_gen_code(TCGContext *s, TranslationBlock *tb)
             temp_dead(s, arg_temp(op->args[0]));
             break;
         case INDEX_op_set_label:
-            tcg_reg_alloc_bb_end(s, s->reserved_regs);
+            tcg_reg_alloc_label(s, op);
             tcg_out_label(s, arg_label(op->args[0]));
             break;
         case INDEX_op_call:
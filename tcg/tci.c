@@ -61,6 +61,7 @@ static uint64_t tci_uint64(uint32_t high, uint32_t low)
  *   i = immediate (uint32_t)
  *   I = immediate (tcg_target_ulong)
  *   l = label or pointer
+ *   L = label in the following word
  *   m = immediate (MemOpIdx)
  *   n = immediate (call return length)
  *   r = register
@@ -144,6 +145,17 @@ static void tci_args_rrrc(uint32_t insn,
     *c3 = extract32(insn, 20, 4);
 }
 
+static void tci_args_rrcL(uint32_t insn, const uint32_t **tb_ptr,
+                          TCGReg *r0, TCGReg *r1, TCGCond *c2, void **l3)
+{
+    int32_t diff = *(*tb_ptr)++;
+
+    *r0 = extract32(insn, 8, 4);
+    *r1 = extract32(insn, 12, 4);
+    *c2 = extract32(insn, 16, 4);
+    *l3 = (void *)*tb_ptr + diff;
+}
+
 static void tci_args_rrrm(uint32_t insn,
                           TCGReg *r0, TCGReg *r1, TCGReg *r2, MemOpIdx *m3)
 {
@@ -458,6 +470,19 @@ static void tci_qemu_st(CPUArchState *env, target_ulong taddr, uint64_t val,
 # define CASE_64(x)
 #endif
 
+/*
+ * Threaded dispatch: the most frequent operations fetch the next
+ * instruction and jump straight to its handler instead of going back
+ * through the switch, so that each of them has its own indirect branch
+ * for the host to predict.  Everything else takes tci_switch.
+ */
+#define TCI_NEXT()                              \
+    do {                                        \
+        insn = *tb_ptr++;                       \
+        opc = extract32(insn, 0, 8);            \
+        goto *tci_dispatch[opc];                \
+    } while (0)
+
 /* Interpret pseudo code in tb. */
 /*
  * Disable CFI checks.
@@ -472,6 +497,43 @@ uintptr_t QEMU_DISABLE_CFI tcg_qemu_tb_exec(CPUArchState *env,
     uint64_t stack[(TCG_STATIC_CALL_ARGS_SIZE + TCG_STATIC_FRAME_SIZE)
                    / sizeof(uint64_t)];
     void *call_slots[TCG_STATIC_CALL_ARGS_SIZE / sizeof(uint64_t)];
+    static const void * const tci_dispatch[NB_OPS] = {
+        [0 ... NB_OPS - 1] = &&tci_switch,
+        [INDEX_op_br] = &&tci_br,
+        [INDEX_op_tci_brcond_i32] = &&tci_brcond_i32,
+        [INDEX_op_tci_brcond_i64] = &&tci_brcond_i64,
+        [INDEX_op_goto_tb] = &&tci_goto_tb,
+        [INDEX_op_mov_i32] = &&tci_mov,
+        [INDEX_op_mov_i64] = &&tci_mov,
+        [INDEX_op_tci_movi] = &&tci_movi,
+        [INDEX_op_tci_movl] = &&tci_movl,
+        [INDEX_op_ld8u_i32] = &&tci_ld8u,
+        [INDEX_op_ld8u_i64] = &&tci_ld8u,
+        [INDEX_op_ld16u_i32] = &&tci_ld16u,
+        [INDEX_op_ld16u_i64] = &&tci_ld16u,
+        [INDEX_op_ld_i32] = &&tci_ld32u,
+        [INDEX_op_ld32u_i64] = &&tci_ld32u,
+        [INDEX_op_st8_i32] = &&tci_st8,
+        [INDEX_op_st8_i64] = &&tci_st8,
+        [INDEX_op_st16_i32] = &&tci_st16,
+        [INDEX_op_st16_i64] = &&tci_st16,
+        [INDEX_op_st_i32] = &&tci_st32,
+        [INDEX_op_st32_i64] = &&tci_st32,
+        [INDEX_op_add_i32] = &&tci_add,
+        [INDEX_op_add_i64] = &&tci_add,
+        [INDEX_op_sub_i32] = &&tci_sub,
+        [INDEX_op_sub_i64] = &&tci_sub,
+        [INDEX_op_and_i32] = &&tci_and,
+        [INDEX_op_and_i64] = &&tci_and,
+        [INDEX_op_or_i32] = &&tci_or,
+        [INDEX_op_or_i64] = &&tci_or,
+        [INDEX_op_xor_i32] = &&tci_xor,
+        [INDEX_op_xor_i64] = &&tci_xor,
+#if TCG_TARGET_REG_BITS == 64
+        [INDEX_op_ld_i64] = &&tci_ld64,
+        [INDEX_op_st_i64] = &&tci_st64,
+#endif
+    };
 
     regs[TCG_AREG0] = (tcg_target_ulong)env;
     regs[TCG_REG_CALL_STACK] = (uintptr_t)stack;
@@ -494,9 +556,9 @@ uintptr_t QEMU_DISABLE_CFI tcg_qemu_tb_exec(CPUArchState *env,
         int32_t ofs;
         void *ptr;
 
-        insn = *tb_ptr++;
-        opc = extract32(insn, 0, 8);
+        TCI_NEXT();
 
+    tci_switch:
         switch (opc) {
         case INDEX_op_call:
             /*
@@ -548,9 +610,24 @@ uintptr_t QEMU_DISABLE_CFI tcg_qemu_tb_exec(CPUArchState *env,
             break;
 
         case INDEX_op_br:
+        tci_br:
             tci_args_l(insn, tb_ptr, &ptr);
             tb_ptr = ptr;
-            continue;
+            TCI_NEXT();
+        case INDEX_op_tci_brcond_i32:
+        tci_brcond_i32:
+            tci_args_rrcL(insn, &tb_ptr, &r0, &r1, &condition, &ptr);
+            if (tci_compare32(regs[r0], regs[r1], condition)) {
+                tb_ptr = ptr;
+            }
+            TCI_NEXT();
+        case INDEX_op_tci_brcond_i64:
+        tci_brcond_i64:
+            tci_args_rrcL(insn, &tb_ptr, &r0, &r1, &condition, &ptr);
+            if (tci_compare64(regs[r0], regs[r1], condition)) {
+                tb_ptr = ptr;
+            }
+            TCI_NEXT();
         case INDEX_op_setcond_i32:
             tci_args_rrrc(insn, &r0, &r1, &r2, &condition);
             regs[r0] = tci_compare32(regs[r1], regs[r2], condition);
@@ -579,35 +656,40 @@ uintptr_t QEMU_DISABLE_CFI tcg_qemu_tb_exec(CPUArchState *env,
             break;
 #endif
         CASE_32_64(mov)
+        tci_mov:
             tci_args_rr(insn, &r0, &r1);
             regs[r0] = regs[r1];
-            break;
+            TCI_NEXT();
         case INDEX_op_tci_movi:
+        tci_movi:
             tci_args_ri(insn, &r0, &t1);
             regs[r0] = t1;
-            break;
+            TCI_NEXT();
         case INDEX_op_tci_movl:
+        tci_movl:
             tci_args_rl(insn, tb_ptr, &r0, &ptr);
             regs[r0] = *(tcg_target_ulong *)ptr;
-            break;
+            TCI_NEXT();
 
             /* Load/store operations (32 bit). */
 
         CASE_32_64(ld8u)
+        tci_ld8u:
             tci_args_rrs(insn, &r0, &r1, &ofs);
             ptr = (void *)(regs[r1] + ofs);
             regs[r0] = *(uint8_t *)ptr;
-            break;
+            TCI_NEXT();
         CASE_32_64(ld8s)
             tci_args_rrs(insn, &r0, &r1, &ofs);
             ptr = (void *)(regs[r1] + ofs);
             regs[r0] = *(int8_t *)ptr;
             break;
         CASE_32_64(ld16u)
+        tci_ld16u:
             tci_args_rrs(insn, &r0, &r1, &ofs);
             ptr = (void *)(regs[r1] + ofs);
             regs[r0] = *(uint16_t *)ptr;
-            break;
+            TCI_NEXT();
         CASE_32_64(ld16s)
             tci_args_rrs(insn, &r0, &r1, &ofs);
             ptr = (void *)(regs[r1] + ofs);
@@ -615,53 +697,62 @@ uintptr_t QEMU_DISABLE_CFI tcg_qemu_tb_exec(CPUArchState *env,
             break;
         case INDEX_op_ld_i32:
         CASE_64(ld32u)
+        tci_ld32u:
             tci_args_rrs(insn, &r0, &r1, &ofs);
             ptr = (void *)(regs[r1] + ofs);
             regs[r0] = *(uint32_t *)ptr;
-            break;
+            TCI_NEXT();
         CASE_32_64(st8)
+        tci_st8:
             tci_args_rrs(insn, &r0, &r1, &ofs);
             ptr = (void *)(regs[r1] + ofs);
             *(uint8_t *)ptr = regs[r0];
-            break;
+            TCI_NEXT();
         CASE_32_64(st16)
+        tci_st16:
             tci_args_rrs(insn, &r0, &r1, &ofs);
             ptr = (void *)(regs[r1] + ofs);
             *(uint16_t *)ptr = regs[r0];
-            break;
+            TCI_NEXT();
         case INDEX_op_st_i32:
         CASE_64(st32)
+        tci_st32:
             tci_args_rrs(insn, &r0, &r1, &ofs);
             ptr = (void *)(regs[r1] + ofs);
             *(uint32_t *)ptr = regs[r0];
-            break;
+            TCI_NEXT();
 
             /* Arithmetic operations (mixed 32/64 bit). */
 
         CASE_32_64(add)
+        tci_add:
             tci_args_rrr(insn, &r0, &r1, &r2);
             regs[r0] = regs[r1] + regs[r2];
-            break;
+            TCI_NEXT();
         CASE_32_64(sub)
+        tci_sub:
             tci_args_rrr(insn, &r0, &r1, &r2);
             regs[r0] = regs[r1] - regs[r2];
-            break;
+            TCI_NEXT();
         CASE_32_64(mul)
             tci_args_rrr(insn, &r0, &r1, &r2);
             regs[r0] = regs[r1] * regs[r2];
             break;
         CASE_32_64(and)
+        tci_and:
             tci_args_rrr(insn, &r0, &r1, &r2);
             regs[r0] = regs[r1] & regs[r2];
-            break;
+            TCI_NEXT();
         CASE_32_64(or)
+        tci_or:
             tci_args_rrr(insn, &r0, &r1, &r2);
             regs[r0] = regs[r1] | regs[r2];
-            break;
+            TCI_NEXT();
         CASE_32_64(xor)
+        tci_xor:
             tci_args_rrr(insn, &r0, &r1, &r2);
             regs[r0] = regs[r1] ^ regs[r2];
-            break;
+            TCI_NEXT();
 #if TCG_TARGET_HAS_andc_i32 || TCG_TARGET_HAS_andc_i64
         CASE_32_64(andc)
             tci_args_rrr(insn, &r0, &r1, &r2);
@@ -868,15 +959,17 @@ uintptr_t QEMU_DISABLE_CFI tcg_qemu_tb_exec(CPUArchState *env,
             regs[r0] = *(int32_t *)ptr;
             break;
         case INDEX_op_ld_i64:
+        tci_ld64:
             tci_args_rrs(insn, &r0, &r1, &ofs);
             ptr = (void *)(regs[r1] + ofs);
             regs[r0] = *(uint64_t *)ptr;
-            break;
+            TCI_NEXT();
         case INDEX_op_st_i64:
+        tci_st64:
             tci_args_rrs(insn, &r0, &r1, &ofs);
             ptr = (void *)(regs[r1] + ofs);
             *(uint64_t *)ptr = regs[r0];
-            break;
+            TCI_NEXT();
 
             /* Arithmetic operations (64 bit). */
 
@@ -987,12 +1080,6 @@ uintptr_t QEMU_DISABLE_CFI tcg_qemu_tb_exec(CPUArchState *env,
             regs[r0] = sextract64(regs[r1], pos, len);
             break;
 #endif
-        case INDEX_op_brcond_i64:
-            tci_args_rl(insn, tb_ptr, &r0, &ptr);
-            if (regs[r0]) {
-                tb_ptr = ptr;
-            }
-            break;
         case INDEX_op_ext32s_i64:
         case INDEX_op_ext_i32_i64:
             tci_args_rr(insn, &r0, &r1);
@@ -1018,9 +1105,10 @@ uintptr_t QEMU_DISABLE_CFI tcg_qemu_tb_exec(CPUArchState *env,
             return (uintptr_t)ptr;
 
         case INDEX_op_goto_tb:
+        tci_goto_tb:
             tci_args_l(insn, tb_ptr, &ptr);
             tb_ptr = *(void **)ptr;
-            break;
+            TCI_NEXT();
 
         case INDEX_op_goto_ptr:
             tci_args_r(insn, &r0);
@@ -1188,12 +1276,18 @@ int print_insn_tci(bfd_vma addr, disassemble_info *info)
         break;
 
     case INDEX_op_brcond_i32:
-    case INDEX_op_brcond_i64:
         tci_args_rl(insn, tb_ptr, &r0, &ptr);
         info->fprintf_func(info->stream, "%-12s  %s, 0, ne, %p",
                            op_name, str_r(r0), ptr);
         break;
 
+    case INDEX_op_tci_brcond_i32:
+    case INDEX_op_tci_brcond_i64:
+        tci_args_rrcL(insn, &tb_ptr, &r0, &r1, &c, &ptr);
+        info->fprintf_func(info->stream, "%-12s  %s, %s, %s, %p",
+                           op_name, str_r(r0), str_r(r1), str_c(c), ptr);
+        break;
+
     case INDEX_op_setcond_i32:
     case INDEX_op_setcond_i64:
         tci_args_rrrc(insn, &r0, &r1, &r2, &c);
@@ -1404,5 +1498,5 @@ int print_insn_tci(bfd_vma addr, disassemble_info *info)
         break;
     }
 
-    return sizeof(insn);
+    return (uintptr_t)tb_ptr - (uintptr_t)addr;
 }
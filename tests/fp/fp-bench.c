@@ -34,6 +34,9 @@ enum op {
     OP_FMA,
     OP_SQRT,
     OP_CMP,
+    OP_CVT,
+    OP_TO_INT,
+    OP_TO_INT_RZ,
     OP_MAX_NR,
 };
 
@@ -45,6 +48,9 @@ static const char * const op_names[] = {
     [OP_FMA] = "mulAdd",
     [OP_SQRT] = "sqrt",
     [OP_CMP] = "cmp",
+    [OP_CVT] = "cvt",
+    [OP_TO_INT] = "toInt",
+    [OP_TO_INT_RZ] = "toIntRZ",
     [OP_MAX_NR] = NULL,
 };
 
@@ -191,8 +197,39 @@ static void update_random_ops(int n_ops, enum precision prec)
     }
 }
 
+/*
+ * Narrow the exponent so that |x| lies in [1, 2^31); random normals are
+ * nearly always out of range for an integer conversion, which would only
+ * time the saturation path.
+ */
+static void fit_int_range(union fp *op, enum precision prec)
+{
+    uint32_t e32;
+    uint64_t e64;
+
+    switch (prec) {
+    case PREC_SINGLE:
+    case PREC_FLOAT32:
+        e32 = 127 + extract32(float32_val(op->f32), 23, 8) % 31;
+        op->f32 = make_float32(deposit32(float32_val(op->f32), 23, 8, e32));
+        break;
+    case PREC_DOUBLE:
+    case PREC_FLOAT64:
+        e64 = 1023 + extract64(float64_val(op->f64), 52, 11) % 31;
+        op->f64 = make_float64(deposit64(float64_val(op->f64), 52, 11, e64));
+        break;
+    case PREC_QUAD:
+    case PREC_FLOAT128:
+        e64 = 16383 + extract64(op->f128.high, 48, 15) % 31;
+        op->f128.high = deposit64(op->f128.high, 48, 15, e64);
+        break;
+    default:
+        g_assert_not_reached();
+    }
+}
+
 static void fill_random(union fp *ops, int n_ops, enum precision prec,
-                        bool no_neg)
+                        enum op op, bool no_neg)
 {
     int i;
 
@@ -222,6 +259,9 @@ static void fill_random(union fp *ops, int n_ops, enum precision prec,
         default:
             g_assert_not_reached();
         }
+        if (op == OP_TO_INT || op == OP_TO_INT_RZ) {
+            fit_int_range(&ops[i], prec);
+        }
     }
 }
 
@@ -241,7 +281,7 @@ static void bench(enum precision prec, enum op op, int n_ops, bool no_neg)
         update_random_ops(n_ops, prec);
         switch (prec) {
         case PREC_SINGLE:
-            fill_random(ops, n_ops, prec, no_neg);
+            fill_random(ops, n_ops, prec, op, no_neg);
             t0 = get_clock();
             for (i = 0; i < OPS_PER_ITER; i++) {
                 float a = ops[0].f;
@@ -270,13 +310,22 @@ static void bench(enum precision prec, enum op op, int n_ops, bool no_neg)
                 case OP_CMP:
                     res.u64 = isgreater(a, b);
                     break;
+                case OP_CVT:
+                    res.d = a;
+                    break;
+                case OP_TO_INT:
+                    res.u64 = llrintf(a);
+                    break;
+                case OP_TO_INT_RZ:
+                    res.u64 = (int64_t)a;
+                    break;
                 default:
                     g_assert_not_reached();
                 }
             }
             break;
         case PREC_DOUBLE:
-            fill_random(ops, n_ops, prec, no_neg);
+            fill_random(ops, n_ops, prec, op, no_neg);
             t0 = get_clock();
             for (i = 0; i < OPS_PER_ITER; i++) {
                 double a = ops[0].d;
@@ -305,13 +354,22 @@ static void bench(enum precision prec, enum op op, int n_ops, bool no_neg)
                 case OP_CMP:
                     res.u64 = isgreater(a, b);
                     break;
+                case OP_CVT:
+                    res.f = a;
+                    break;
+                case OP_TO_INT:
+                    res.u64 = llrint(a);
+                    break;
+                case OP_TO_INT_RZ:
+                    res.u64 = (int64_t)a;
+                    break;
                 default:
                     g_assert_not_reached();
                 }
             }
             break;
         case PREC_FLOAT32:
-            fill_random(ops, n_ops, prec, no_neg);
+            fill_random(ops, n_ops, prec, op, no_neg);
             t0 = get_clock();
             for (i = 0; i < OPS_PER_ITER; i++) {
                 float32 a = ops[0].f32;
@@ -340,13 +398,22 @@ static void bench(enum precision prec, enum op op, int n_ops, bool no_neg)
                 case OP_CMP:
                     res.u64 = float32_compare_quiet(a, b, &soft_status);
                     break;
+                case OP_CVT:
+                    res.f64 = float32_to_float64(a, &soft_status);
+                    break;
+                case OP_TO_INT:
+                    res.u64 = float32_to_int64(a, &soft_status);
+                    break;
+                case OP_TO_INT_RZ:
+                    res.u64 = float32_to_int64_round_to_zero(a, &soft_status);
+                    break;
                 default:
                     g_assert_not_reached();
                 }
             }
             break;
         case PREC_FLOAT64:
-            fill_random(ops, n_ops, prec, no_neg);
+            fill_random(ops, n_ops, prec, op, no_neg);
             t0 = get_clock();
             for (i = 0; i < OPS_PER_ITER; i++) {
                 float64 a = ops[0].f64;
@@ -375,13 +442,22 @@ static void bench(enum precision prec, enum op op, int n_ops, bool no_neg)
                 case OP_CMP:
                     res.u64 = float64_compare_quiet(a, b, &soft_status);
                     break;
+                case OP_CVT:
+                    res.f32 = float64_to_float32(a, &soft_status);
+                    break;
+                case OP_TO_INT:
+                    res.u64 = float64_to_int64(a, &soft_status);
+                    break;
+                case OP_TO_INT_RZ:
+                    res.u64 = float64_to_int64_round_to_zero(a, &soft_status);
+                    break;
                 default:
                     g_assert_not_reached();
                 }
             }
             break;
         case PREC_FLOAT128:
-            fill_random(ops, n_ops, prec, no_neg);
+            fill_random(ops, n_ops, prec, op, no_neg);
             t0 = get_clock();
             for (i = 0; i < OPS_PER_ITER; i++) {
                 float128 a = ops[0].f128;
@@ -410,6 +486,15 @@ static void bench(enum precision prec, enum op op, int n_ops, bool no_neg)
                 case OP_CMP:
                     res.u64 = float128_compare_quiet(a, b, &soft_status);
                     break;
+                case OP_CVT:
+                    res.f64 = float128_to_float64(a, &soft_status);
+                    break;
+                case OP_TO_INT:
+                    res.u64 = float128_to_int64(a, &soft_status);
+                    break;
+                case OP_TO_INT_RZ:
+                    res.u64 = float128_to_int64_round_to_zero(a, &soft_status);
+                    break;
                 default:
                     g_assert_not_reached();
                 }
@@ -448,6 +533,9 @@ GEN_BENCH_ALL_TYPES(mul, OP_MUL, 2)
 GEN_BENCH_ALL_TYPES(div, OP_DIV, 2)
 GEN_BENCH_ALL_TYPES(fma, OP_FMA, 3)
 GEN_BENCH_ALL_TYPES(cmp, OP_CMP, 2)
+GEN_BENCH_ALL_TYPES(cvt, OP_CVT, 1)
+GEN_BENCH_ALL_TYPES(to_int, OP_TO_INT, 1)
+GEN_BENCH_ALL_TYPES(to_int_rz, OP_TO_INT_RZ, 1)
 #undef GEN_BENCH_ALL_TYPES
 
 #define GEN_BENCH_ALL_TYPES_NO_NEG(name, op, n)                         \
@@ -480,6 +568,9 @@ static const bench_func_t bench_funcs[OP_MAX_NR][PREC_MAX_NR] = {
     GEN_BENCH_FUNCS(fma, OP_FMA),
     GEN_BENCH_FUNCS(sqrt, OP_SQRT),
     GEN_BENCH_FUNCS(cmp, OP_CMP),
+    GEN_BENCH_FUNCS(cvt, OP_CVT),
+    GEN_BENCH_FUNCS(to_int, OP_TO_INT),
+    GEN_BENCH_FUNCS(to_int_rz, OP_TO_INT_RZ),
 };
 
 #undef GEN_BENCH_FUNCS
@@ -0,0 +1,175 @@
+/*
+ * Check the per-vCPU inline ops, the address filter of memory inline
+ * ops and conditional callbacks against plain inline ops and callbacks
+ * counting the same events.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <glib.h>
+
+#include <qemu-plugin.h>
+
+QEMU_PLUGIN_EXPORT int qemu_plugin_version = QEMU_PLUGIN_VERSION;
+
+#define MAX_VCPUS   1024
+/* Executions of a TB between two conditional callbacks */
+#define COND_PERIOD 16
+/* Memory accesses counted by the filtered inline op */
+#define FILTER_LO   0x10000
+#define FILTER_HI   0x7fffffff
+
+typedef struct {
+    /* Updated by inline ops */
+    uint64_t tb;
+    uint64_t insn;
+    uint64_t mem;
+    uint64_t mem_filtered;
+    uint64_t tb_since_cond;
+    /* Updated by callbacks */
+    uint64_t tb_cb;
+    uint64_t insn_cb;
+    uint64_t mem_cb;
+    uint64_t mem_filtered_cb;
+    uint64_t cond_cb;
+} VCPUCounts;
+
+static VCPUCounts counts[MAX_VCPUS];
+/* Updated by plain inline ops, exact with a single vCPU only */
+static uint64_t tb_shared;
+static uint64_t insn_shared;
+static unsigned int nr_vcpus;
+
+static void check(const char *what, unsigned int vcpu, uint64_t inline_count,
+                  uint64_t cb_count)
+{
+    if (inline_count != cb_count) {
+        g_autofree char *msg =
+            g_strdup_printf("vCPU %u: %s: inline %" PRIu64 " != %" PRIu64
+                            "\n", vcpu, what, inline_count, cb_count);
+
+        qemu_plugin_outs(msg);
+        g_assert_not_reached();
+    }
+}
+
+static void plugin_exit(qemu_plugin_id_t id, void *p)
+{
+    uint64_t tb = 0, insn = 0, mem = 0, mem_filtered = 0;
+    g_autofree char *report = NULL;
+    unsigned int i;
+
+    for (i = 0; i < nr_vcpus && i < MAX_VCPUS; i++) {
+        VCPUCounts *c = &counts[i];
+
+        check("tb", i, c->tb, c->tb_cb);
+        check("insn", i, c->insn, c->insn_cb);
+        check("mem", i, c->mem, c->mem_cb);
+        check("mem filtered", i, c->mem_filtered, c->mem_filtered_cb);
+        check("cond", i, c->tb,
+              c->cond_cb * COND_PERIOD + c->tb_since_cond);
+        tb += c->tb;
+        insn += c->insn;
+        mem += c->mem;
+        mem_filtered += c->mem_filtered;
+    }
+    if (nr_vcpus == 1) {
+        check("tb shared", 0, tb_shared, tb);
+        check("insn shared", 0, insn_shared, insn);
+    }
+
+    report = g_strdup_printf("tbs: %" PRIu64 ", insns: %" PRIu64
+                             ", mem: %" PRIu64 " (%" PRIu64 " filtered)\n",
+                             tb, insn, mem, mem_filtered);
+    qemu_plugin_outs(report);
+}
+
+static void vcpu_init(qemu_plugin_id_t id, unsigned int vcpu_index)
+{
+    if (vcpu_index >= MAX_VCPUS) {
+        qemu_plugin_outs("too many vCPUs\n");
+        g_assert_not_reached();
+    }
+    /* vCPU indexes are reused in user mode, count each one once */
+    nr_vcpus = MAX(nr_vcpus, vcpu_index + 1);
+}
+
+static void vcpu_tb_exec(unsigned int vcpu_index, void *udata)
+{
+    counts[vcpu_index].tb_cb++;
+}
+
+static void vcpu_tb_cond(unsigned int vcpu_index, void *udata)
+{
+    counts[vcpu_index].cond_cb++;
+    counts[vcpu_index].tb_since_cond = 0;
+}
+
+static void vcpu_insn_exec(unsigned int vcpu_index, void *udata)
+{
+    counts[vcpu_index].insn_cb++;
+}
+
+static void vcpu_mem(unsigned int vcpu_index, qemu_plugin_meminfo_t info,
+                     uint64_t vaddr, void *udata)
+{
+    counts[vcpu_index].mem_cb++;
+    if (vaddr >= FILTER_LO && vaddr <= FILTER_HI) {
+        counts[vcpu_index].mem_filtered_cb++;
+    }
+}
+
+static void vcpu_tb_trans(qemu_plugin_id_t id, struct qemu_plugin_tb *tb)
+{
+    size_t n = qemu_plugin_tb_n_insns(tb);
+    size_t i;
+
+    qemu_plugin_register_vcpu_tb_exec_inline_per_vcpu(
+        tb, QEMU_PLUGIN_INLINE_ADD_U64, &counts[0].tb, sizeof(VCPUCounts), 1);
+    qemu_plugin_register_vcpu_tb_exec_inline(tb, QEMU_PLUGIN_INLINE_ADD_U64,
+                                             &tb_shared, 1);
+    qemu_plugin_register_vcpu_tb_exec_cb(tb, vcpu_tb_exec,
+                                         QEMU_PLUGIN_CB_NO_REGS, NULL);
+
+    qemu_plugin_register_vcpu_tb_exec_cond_cb(
+        tb, vcpu_tb_cond, QEMU_PLUGIN_CB_NO_REGS, QEMU_PLUGIN_COND_GE,
+        &counts[0].tb_since_cond, sizeof(VCPUCounts), COND_PERIOD, NULL);
+    qemu_plugin_register_vcpu_tb_exec_inline_per_vcpu(
+        tb, QEMU_PLUGIN_INLINE_ADD_U64, &counts[0].tb_since_cond,
+        sizeof(VCPUCounts), 1);
+
+    for (i = 0; i < n; i++) {
+        struct qemu_plugin_insn *insn = qemu_plugin_tb_get_insn(tb, i);
+
+        qemu_plugin_register_vcpu_insn_exec_inline_per_vcpu(
+            insn, QEMU_PLUGIN_INLINE_ADD_U64, &counts[0].insn,
+            sizeof(VCPUCounts), 1);
+        qemu_plugin_register_vcpu_insn_exec_inline(
+            insn, QEMU_PLUGIN_INLINE_ADD_U64, &insn_shared, 1);
+        qemu_plugin_register_vcpu_insn_exec_cb(insn, vcpu_insn_exec,
+                                               QEMU_PLUGIN_CB_NO_REGS, NULL);
+
+        qemu_plugin_register_vcpu_mem_inline_per_vcpu(
+            insn, QEMU_PLUGIN_MEM_RW, QEMU_PLUGIN_INLINE_ADD_U64,
+            &counts[0].mem, sizeof(VCPUCounts), 1, 0, UINT64_MAX);
+        qemu_plugin_register_vcpu_mem_inline_per_vcpu(
+            insn, QEMU_PLUGIN_MEM_RW, QEMU_PLUGIN_INLINE_ADD_U64,
+            &counts[0].mem_filtered, sizeof(VCPUCounts), 1,
+            FILTER_LO, FILTER_HI);
+        qemu_plugin_register_vcpu_mem_cb(insn, vcpu_mem,
+                                         QEMU_PLUGIN_CB_NO_REGS,
+                                         QEMU_PLUGIN_MEM_RW, NULL);
+    }
+}
+
+QEMU_PLUGIN_EXPORT int qemu_plugin_install(qemu_plugin_id_t id,
+                                           const qemu_info_t *info,
+                                           int argc, char **argv)
+{
+    qemu_plugin_register_vcpu_init_cb(id, vcpu_init);
+    qemu_plugin_register_vcpu_tb_trans_cb(id, vcpu_tb_trans);
+    qemu_plugin_register_atexit_cb(id, plugin_exit, NULL);
+    return 0;
+}
@@ -278,6 +278,74 @@ static void test_i440fx_pam(gconstpointer opaque)
     qtest_end();
 }
 
+/* Offset of the width field in the header of a pci-testdev test */
+#define TESTDEV_WIDTH   1
+
+/*
+ * The BARs of pci-testdev both read the header of the selected test:
+ * check that they answer at their current addresses only.
+ */
+static void bar_move_check(uint32_t mmio, uint32_t old_mmio,
+                           uint16_t pio, uint16_t old_pio)
+{
+    g_assert_cmpint(readb(mmio + TESTDEV_WIDTH), ==, 1);
+    g_assert_cmpint(inb(pio + TESTDEV_WIDTH), ==, 1);
+    if (old_mmio != mmio) {
+        g_assert_cmpint(readb(old_mmio + TESTDEV_WIDTH), !=, 1);
+    }
+    if (old_pio != pio) {
+        g_assert_cmpint(inb(old_pio + TESTDEV_WIDTH), !=, 1);
+    }
+}
+
+/*
+ * Moving a BAR changes the memory map of one address space only.  The
+ * others keep their FlatView, and must still reach the other BAR.
+ */
+static void test_i440fx_bar_move(gconstpointer opaque)
+{
+    const TestData *s = opaque;
+    const uint32_t mmio[2] = { 0xe0000000, 0xe0100000 };
+    const uint16_t pio[2] = { 0xc000, 0xc100 };
+    QPCIBus *bus;
+    QPCIDevice *dev;
+    char *cmdline;
+
+    if (!qtest_has_device("pci-testdev")) {
+        g_test_skip("pci-testdev is not available");
+        return;
+    }
+
+    cmdline = g_strdup_printf("-machine pc -smp %d "
+                              "-device pci-testdev,addr=0x10", s->num_cpus);
+    qtest_start(cmdline);
+    g_free(cmdline);
+    bus = qpci_new_pc(global_qtest, NULL);
+    dev = qpci_device_find(bus, QPCI_DEVFN(0x10, 0));
+    g_assert(dev != NULL);
+    qpci_device_enable(dev);
+
+    qpci_config_writel(dev, PCI_BASE_ADDRESS_0, mmio[0]);
+    qpci_config_writel(dev, PCI_BASE_ADDRESS_1, pio[0]);
+    /* Select the first test, whose header has a width of 1 */
+    writeb(mmio[0], 0);
+    bar_move_check(mmio[0], mmio[0], pio[0], pio[0]);
+
+    qpci_config_writel(dev, PCI_BASE_ADDRESS_1, pio[1]);
+    bar_move_check(mmio[0], mmio[0], pio[1], pio[0]);
+
+    qpci_config_writel(dev, PCI_BASE_ADDRESS_0, mmio[1]);
+    bar_move_check(mmio[1], mmio[0], pio[1], pio[1]);
+
+    qpci_config_writel(dev, PCI_BASE_ADDRESS_0, mmio[0]);
+    qpci_config_writel(dev, PCI_BASE_ADDRESS_1, pio[0]);
+    bar_move_check(mmio[0], mmio[1], pio[0], pio[1]);
+
+    g_free(dev);
+    qpci_free_pc(bus);
+    qtest_end();
+}
+
 #define BLOB_SIZE ((size_t)65536)
 #define ISA_BIOS_MAXSZ ((size_t)(128 * 1024))
 
@@ -406,6 +474,7 @@ int main(int argc, char **argv)
 
     qtest_add_data_func("i440fx/defaults", &data, test_i440fx_defaults);
     qtest_add_data_func("i440fx/pam", &data, test_i440fx_pam);
+    qtest_add_data_func("i440fx/bar-move", &data, test_i440fx_bar_move);
     add_firmware_test("i440fx/firmware/bios", request_bios);
     add_firmware_test("i440fx/firmware/pflash", request_pflash);
 
@@ -127,6 +127,11 @@ bool qtest_probe_child(QTestState *s)
     return false;
 }
 
+pid_t qtest_pid(QTestState *s)
+{
+    return s->qemu_pid;
+}
+
 void qtest_set_expected_status(QTestState *s, int status)
 {
     s->expected_status = status;
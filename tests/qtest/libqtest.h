@@ -770,6 +770,14 @@ void qtest_qmp_device_del(QTestState *qts, const char *id);
  */
 bool qtest_probe_child(QTestState *s);
 
+/**
+ * qtest_pid:
+ * @s: QTestState instance to operate on.
+ *
+ * Returns: the process ID of the QEMU child, or -1 once it has been reaped.
+ */
+pid_t qtest_pid(QTestState *s);
+
 /**
  * qtest_set_expected_status:
  * @s: QTestState instance to operate on.
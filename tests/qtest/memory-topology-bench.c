@@ -0,0 +1,171 @@
+/*
+ * Memory topology update benchmark
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ *
+ * Plugs a number of pci-testdev devices and then keeps moving their
+ * BARs around through config space writes, like a guest that reprograms
+ * BARs during boot or hotplug, and reports the number of memory topology
+ * updates per second.
+ *
+ * Moving an MMIO BAR changes the PCI memory space, which is seen by the
+ * system memory and, through the pci-hole alias, by the bus master
+ * address space of every device: all their FlatViews are rendered again.
+ * Moving an I/O BAR only changes the I/O address space, and all the
+ * other address spaces keep their FlatView.  The io-bar-moves case shows
+ * what that saves.
+ *
+ * The cases are tuned through the environment:
+ *
+ *   MEMORY_BENCH_DEVICES   number of pci-testdev devices (default: 24)
+ *   MEMORY_BENCH_MOVES     BAR moves per device (default: 1000)
+ *   MEMORY_BENCH_BASELINE  another QEMU binary, for instance one that
+ *                          renders every FlatView on each update, to run
+ *                          each case with as well for comparison
+ */
+
+#include "qemu/osdep.h"
+
+#include "libqtest.h"
+#include "libqos/pci-pc.h"
+#include "hw/pci/pci_regs.h"
+
+#define BENCH_FIRST_SLOT    2
+#define BENCH_MAX_DEVICES   29
+#define BENCH_MMIO_BASE     0xe0000000u
+/* Each device moves its 4 KiB BAR around its own 1 MiB window */
+#define BENCH_WINDOW_SIZE   0x100000u
+#define BENCH_BAR_SIZE      0x1000u
+#define BENCH_PIO_BASE      0xc000u
+/* Each device moves its 256 byte I/O BAR around its own 512 byte window */
+#define BENCH_PIO_WINDOW    0x200u
+#define BENCH_PIO_SIZE      0x100u
+
+typedef struct BenchCase {
+    const char *name;
+    int bar;
+    uint32_t base;
+    uint32_t window;
+    uint32_t step;
+    uint32_t mask;
+} BenchCase;
+
+static const BenchCase bench_cases[] = {
+    {
+        .name = "bar-moves",
+        .bar = PCI_BASE_ADDRESS_0,
+        .base = BENCH_MMIO_BASE,
+        .window = BENCH_WINDOW_SIZE,
+        .step = BENCH_BAR_SIZE,
+        .mask = PCI_BASE_ADDRESS_MEM_MASK,
+    }, {
+        .name = "io-bar-moves",
+        .bar = PCI_BASE_ADDRESS_1,
+        .base = BENCH_PIO_BASE,
+        .window = BENCH_PIO_WINDOW,
+        .step = BENCH_PIO_SIZE,
+        .mask = PCI_BASE_ADDRESS_IO_MASK,
+    },
+};
+
+static unsigned bench_devices = 24;
+static unsigned bench_moves = 1000;
+static const char *bench_baseline;
+
+static unsigned bench_getenv_uint(const char *name, unsigned def)
+{
+    const char *str = g_getenv(name);
+
+    return str ? atoi(str) : def;
+}
+
+static uint32_t bench_bar_addr(const BenchCase *c, unsigned dev,
+                               unsigned move)
+{
+    return c->base + dev * c->window + (move % (c->window / c->step)) * c->step;
+}
+
+/* Run case @c with the QEMU binary @qemu, returns the time it took */
+static double bench_run_qemu(const BenchCase *c, const char *qemu)
+{
+    g_autoptr(GString) args = g_string_new("-machine pc");
+    g_autofree char *saved = g_strdup(g_getenv("QTEST_QEMU_BINARY"));
+    QPCIDevice *devs[BENCH_MAX_DEVICES];
+    QTestState *qts;
+    QPCIBus *bus;
+    double elapsed;
+    unsigned i, j;
+
+    for (i = 0; i < bench_devices; i++) {
+        g_string_append_printf(args, " -device pci-testdev,addr=0x%x",
+                               BENCH_FIRST_SLOT + i);
+    }
+    g_setenv("QTEST_QEMU_BINARY", qemu, true);
+    qts = qtest_init(args->str);
+    g_setenv("QTEST_QEMU_BINARY", saved, true);
+    bus = qpci_new_pc(qts, NULL);
+
+    for (i = 0; i < bench_devices; i++) {
+        devs[i] = qpci_device_find(bus, QPCI_DEVFN(BENCH_FIRST_SLOT + i, 0));
+        g_assert(devs[i]);
+        qpci_device_enable(devs[i]);
+    }
+
+    g_test_timer_start();
+    for (j = 0; j < bench_moves; j++) {
+        for (i = 0; i < bench_devices; i++) {
+            qpci_config_writel(devs[i], c->bar, bench_bar_addr(c, i, j));
+        }
+    }
+    /* Make sure the last moves went through */
+    g_assert_cmphex(qpci_config_readl(devs[0], c->bar) & c->mask, ==,
+                    bench_bar_addr(c, 0, bench_moves - 1));
+    elapsed = g_test_timer_elapsed();
+
+    for (i = 0; i < bench_devices; i++) {
+        g_free(devs[i]);
+    }
+    qpci_free_pc(bus);
+    qtest_quit(qts);
+    return elapsed;
+}
+
+static void bench_bar_moves(const void *opaque)
+{
+    const BenchCase *c = opaque;
+    unsigned moves = bench_devices * bench_moves;
+    double elapsed, baseline;
+
+    elapsed = bench_run_qemu(c, g_getenv("QTEST_QEMU_BINARY"));
+    g_test_message("%s: %u devices, %u BAR moves in %.3f s: %.0f moves/s",
+                   c->name, bench_devices, moves, elapsed, moves / elapsed);
+
+    if (bench_baseline) {
+        baseline = bench_run_qemu(c, bench_baseline);
+        g_test_message("%s: baseline %.3f s: %.0f moves/s, speedup %.2fx",
+                       c->name, baseline, moves / baseline,
+                       baseline / elapsed);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int i;
+
+    g_test_init(&argc, &argv, NULL);
+
+    bench_devices = bench_getenv_uint("MEMORY_BENCH_DEVICES", bench_devices);
+    bench_devices = MIN(MAX(bench_devices, 1), BENCH_MAX_DEVICES);
+    bench_moves = MAX(bench_getenv_uint("MEMORY_BENCH_MOVES", bench_moves), 1);
+    bench_baseline = g_getenv("MEMORY_BENCH_BASELINE");
+
+    for (i = 0; i < ARRAY_SIZE(bench_cases); i++) {
+        g_autofree char *name = g_strdup_printf("/memory-topology-bench/%s",
+                                                bench_cases[i].name);
+
+        qtest_add_data_func(name, &bench_cases[i], bench_bar_moves);
+    }
+
+    return g_test_run();
+}
@@ -0,0 +1,412 @@
+/*
+ * Migration throughput benchmark
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ *
+ * Migrates a guest without any OS: the "none" machine only has RAM, which
+ * the benchmark dirties itself through the qtest protocol while the
+ * migration runs.  Each case pairs a dirtying pattern with a set of
+ * migration capabilities, and reports throughput, downtime, number of
+ * dirty sync rounds and the CPU time both QEMU processes spent per GiB
+ * transferred.
+ *
+ * The cases are tuned through the environment:
+ *
+ *   MIGRATION_BENCH_MEM        guest RAM in MiB (default: 128)
+ *   MIGRATION_BENCH_TRANSPORT  "unix" to migrate over a local socket,
+ *                              "file" to save to a file and load it
+ *                              afterwards (default: unix)
+ *   MIGRATION_BENCH_ROUNDS     keep dirtying memory until this many dirty
+ *                              sync rounds happened (default: 4)
+ *   MIGRATION_BENCH_BANDWIDTH  max-bandwidth in MiB/s, 0 for no limit
+ *                              (default: 0)
+ *   MIGRATION_BENCH_CSV        append one line per case to this file
+ */
+
+#include "qemu/osdep.h"
+
+#include <sys/resource.h>
+
+#include "libqtest.h"
+#include "qapi/qmp/qdict.h"
+#include "qemu/cutils.h"
+#include "qemu/units.h"
+
+#include "migration-helpers.h"
+
+#define BENCH_PAGE_SIZE     4096
+/* Pages dirtied between two polls of the migration status */
+#define BENCH_DIRTY_BATCH   256
+#define BENCH_DOWNTIME_MS   300
+
+typedef struct BenchPattern {
+    const char *name;
+    /* Percentage of RAM taking most of the writes, 100 for none */
+    unsigned hot_percent;
+    /* Percentage of the dirtied pages that are written with zeroes */
+    unsigned zero_percent;
+    /* Fill pages with a repeated text rather than random bytes */
+    bool compressible;
+} BenchPattern;
+
+static const BenchPattern bench_patterns[] = {
+    { .name = "uniform", .hot_percent = 100 },
+    { .name = "hotspot", .hot_percent = 10 },
+    { .name = "zero-heavy", .hot_percent = 100, .zero_percent = 90 },
+    { .name = "compressible", .hot_percent = 100, .compressible = true },
+};
+
+typedef struct BenchCaps {
+    const char *name;
+    const char *caps[3];
+    /* The capabilities need a socket, they do not work with a file */
+    bool needs_socket;
+    /* The source pins guest RAM, which counts against RLIMIT_MEMLOCK */
+    bool needs_memlock;
+} BenchCaps;
+
+static const BenchCaps bench_caps[] = {
+    { .name = "none" },
+    { .name = "multifd", .caps = { "multifd" }, .needs_socket = true },
+    { .name = "compress", .caps = { "compress" } },
+    { .name = "xbzrle", .caps = { "xbzrle" } },
+    { .name = "multifd+zero-copy", .caps = { "multifd", "zero-copy-send" },
+      .needs_socket = true, .needs_memlock = true },
+};
+
+typedef struct BenchCase {
+    const BenchPattern *pattern;
+    const BenchCaps *caps;
+} BenchCase;
+
+typedef struct BenchState {
+    const BenchPattern *pattern;
+    GRand *rand;
+    uint64_t pages;
+    uint8_t buf[BENCH_PAGE_SIZE];
+} BenchState;
+
+static char *tmpfs;
+static uint64_t bench_mem_mib = 128;
+static bool bench_file;
+static int64_t bench_rounds = 4;
+static uint64_t bench_bandwidth_mib;
+static const char *bench_csv;
+
+static uint64_t bench_getenv_uint(const char *name, uint64_t def)
+{
+    const char *str = g_getenv(name);
+    uint64_t value;
+
+    if (!str) {
+        return def;
+    }
+    if (qemu_strtou64(str, NULL, 0, &value)) {
+        g_printerr("%s: invalid value '%s'\n", name, str);
+        exit(1);
+    }
+    return value;
+}
+
+static uint64_t bench_pick_page(BenchState *b)
+{
+    uint64_t hot = MAX(b->pages * b->pattern->hot_percent / 100, 1);
+
+    /* With a hotspot, 9 writes out of 10 go to it */
+    if (hot < b->pages && g_rand_int_range(b->rand, 0, 10)) {
+        return g_rand_int_range(b->rand, 0, hot);
+    }
+    return g_rand_int_range(b->rand, 0, b->pages);
+}
+
+static void bench_dirty_page(QTestState *who, BenchState *b, uint64_t page)
+{
+    uint64_t addr = page * BENCH_PAGE_SIZE;
+    size_t i;
+
+    if (g_rand_int_range(b->rand, 0, 100) < b->pattern->zero_percent) {
+        qtest_memset(who, addr, 0, BENCH_PAGE_SIZE);
+        return;
+    }
+
+    if (b->pattern->compressible) {
+        static const char text[] = "migration benchmark compressible page ";
+
+        for (i = 0; i < BENCH_PAGE_SIZE; i++) {
+            b->buf[i] = text[i % (sizeof(text) - 1)];
+        }
+        /* Change a few bytes so that consecutive writes differ */
+        for (i = 0; i < 8; i++) {
+            b->buf[g_rand_int_range(b->rand, 0, BENCH_PAGE_SIZE)] =
+                g_rand_int(b->rand);
+        }
+    } else {
+        for (i = 0; i < BENCH_PAGE_SIZE; i += sizeof(uint32_t)) {
+            uint32_t r = g_rand_int(b->rand);
+
+            memcpy(b->buf + i, &r, sizeof(r));
+        }
+    }
+    qtest_bufwrite(who, addr, b->buf, BENCH_PAGE_SIZE);
+}
+
+/* Write the initial image: every page once, following the pattern */
+static void bench_fill(QTestState *who, BenchState *b)
+{
+    uint64_t page;
+
+    for (page = 0; page < b->pages; page++) {
+        bench_dirty_page(who, b, page);
+    }
+}
+
+static bool bench_set_capability(QTestState *who, const char *capability)
+{
+    QDict *rsp;
+    bool ok;
+
+    rsp = qtest_qmp(who,
+                    "{ 'execute': 'migrate-set-capabilities',"
+                    "'arguments': { "
+                    "'capabilities': [ { "
+                    "'capability': %s, 'state': true } ] } }",
+                    capability);
+    ok = qdict_haskey(rsp, "return");
+    qobject_unref(rsp);
+    return ok;
+}
+
+static void bench_set_parameter_int(QTestState *who, const char *parameter,
+                                    long long value)
+{
+    QDict *rsp;
+
+    rsp = wait_command(who,
+                       "{ 'execute': 'migrate-set-parameters',"
+                       "'arguments': { %s: %lld } }",
+                       parameter, value);
+    qobject_unref(rsp);
+}
+
+static void bench_migrate_incoming(QTestState *to, const char *uri)
+{
+    QDict *rsp;
+
+    rsp = wait_command(to, "{ 'execute': 'migrate-incoming',"
+                           "  'arguments': { 'uri': %s } }",
+                       uri);
+    qobject_unref(rsp);
+}
+
+/* CPU time used so far by a running QEMU process */
+static double bench_cpu_seconds(QTestState *who)
+{
+    g_autofree char *path = g_strdup_printf("/proc/%d/stat", qtest_pid(who));
+    g_autofree char *stat = NULL;
+    unsigned long utime, stime;
+    char *p;
+
+    /* The command name in the second field can contain anything but ')' */
+    if (!g_file_get_contents(path, &stat, NULL, NULL) ||
+        !(p = strrchr(stat, ')')) ||
+        sscanf(p + 1, " %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu",
+               &utime, &stime) != 2) {
+        g_test_message("cannot read %s", path);
+        return 0;
+    }
+    return (double)(utime + stime) / sysconf(_SC_CLK_TCK);
+}
+
+static void bench_report(const BenchCase *c, uint64_t transferred,
+                         int64_t total_ms, int64_t downtime_ms,
+                         int64_t rounds, double cpu)
+{
+    double mib = (double)transferred / MiB;
+    double throughput = total_ms ? mib * 1000 / total_ms : 0;
+    double cpu_per_gib = transferred ? cpu * GiB / transferred : 0;
+    FILE *csv;
+
+    g_test_message("%s/%s/%s: %.1f MiB in %" PRId64 " ms, %.1f MiB/s, "
+                   "downtime %" PRId64 " ms, %" PRId64 " rounds, "
+                   "%.2f cpu s/GiB",
+                   c->pattern->name, c->caps->name,
+                   bench_file ? "file" : "unix", mib, total_ms, throughput,
+                   downtime_ms, rounds, cpu_per_gib);
+
+    if (!bench_csv) {
+        return;
+    }
+    csv = fopen(bench_csv, "a");
+    if (!csv) {
+        g_test_message("cannot open %s: %s", bench_csv, strerror(errno));
+        return;
+    }
+    fprintf(csv, "%s,%s,%s,%" PRIu64 ",%" PRId64 ",%.1f,%" PRId64 ",%"
+            PRId64 ",%.3f\n",
+            c->pattern->name, c->caps->name, bench_file ? "file" : "unix",
+            transferred, total_ms, throughput, downtime_ms, rounds,
+            cpu_per_gib);
+    fclose(csv);
+}
+
+static void bench_run(const void *opaque)
+{
+    const BenchCase *c = opaque;
+    g_autofree char *uri = NULL;
+    g_autofree char *path = NULL;
+    BenchState b = {
+        .pattern = c->pattern,
+        .pages = bench_mem_mib * MiB / BENCH_PAGE_SIZE,
+    };
+    QTestState *from, *to;
+    uint64_t transferred = 0;
+    int64_t total_ms = 0, downtime_ms = 0, rounds = 0;
+    double cpu = 0;
+    struct rlimit rlim;
+    const char **cap;
+    QDict *rsp, *ram;
+    const char *status;
+    int i;
+
+    if (bench_file && c->caps->needs_socket) {
+        g_test_skip("needs a socket transport");
+        return;
+    }
+    if (c->caps->needs_memlock &&
+        (getrlimit(RLIMIT_MEMLOCK, &rlim) ||
+         (rlim.rlim_cur != RLIM_INFINITY &&
+          rlim.rlim_cur < bench_mem_mib * MiB))) {
+        g_test_skip("RLIMIT_MEMLOCK too low to lock guest RAM");
+        return;
+    }
+
+    path = g_strdup_printf("%s/migration-bench", tmpfs);
+    if (bench_file) {
+        uri = g_strdup_printf("exec:cat > %s", path);
+    } else {
+        uri = g_strdup_printf("unix:%s", path);
+    }
+
+    from = qtest_initf("-M none -m %" PRIu64 "M -nodefaults "
+                       "-name source,debug-threads=on%s", bench_mem_mib,
+                       c->caps->needs_memlock ? " -overcommit mem-lock=on"
+                                              : "");
+    to = qtest_initf("-M none -m %" PRIu64 "M -nodefaults "
+                     "-name target,debug-threads=on -incoming defer",
+                     bench_mem_mib);
+
+    for (cap = (const char **)c->caps->caps; *cap; cap++) {
+        if (!bench_set_capability(from, *cap) ||
+            !bench_set_capability(to, *cap)) {
+            g_test_skip("capability not supported on this host");
+            goto out;
+        }
+    }
+    bench_set_parameter_int(from, "downtime-limit", BENCH_DOWNTIME_MS);
+    /* 100 GiB/s is as good as no limit on a local transport */
+    bench_set_parameter_int(from, "max-bandwidth",
+                            (bench_bandwidth_mib ?: 100 * KiB) * MiB);
+
+    b.rand = g_rand_new_with_seed(0x5eed);
+    bench_fill(from, &b);
+
+    if (!bench_file) {
+        bench_migrate_incoming(to, uri);
+    }
+    /* Leave start up and the initial fill out of the CPU time */
+    cpu = bench_cpu_seconds(from) + bench_cpu_seconds(to);
+    migrate_qmp(from, uri, "{}");
+
+    while (true) {
+        rsp = migrate_query_not_failed(from);
+        status = qdict_get_str(rsp, "status");
+        if (!strcmp(status, "completed")) {
+            total_ms = qdict_get_try_int(rsp, "total-time", 0);
+            downtime_ms = qdict_get_try_int(rsp, "downtime", 0);
+            ram = qdict_get_qdict(rsp, "ram");
+            if (ram) {
+                transferred = qdict_get_try_int(ram, "transferred", 0);
+                rounds = qdict_get_try_int(ram, "dirty-sync-count", 0);
+            }
+            qobject_unref(rsp);
+            break;
+        }
+
+        ram = qdict_get_qdict(rsp, "ram");
+        if (ram && qdict_get_try_int(ram, "dirty-sync-count", 0) >=
+            bench_rounds) {
+            /* Enough rounds, stop dirtying and let it converge */
+            g_usleep(1000);
+        } else {
+            for (i = 0; i < BENCH_DIRTY_BATCH; i++) {
+                bench_dirty_page(from, &b, bench_pick_page(&b));
+            }
+        }
+        qobject_unref(rsp);
+    }
+
+    if (bench_file) {
+        g_free(uri);
+        uri = g_strdup_printf("exec:cat %s", path);
+        bench_migrate_incoming(to, uri);
+    }
+    qtest_qmp_eventwait(to, "RESUME");
+    cpu = bench_cpu_seconds(from) + bench_cpu_seconds(to) - cpu;
+    g_rand_free(b.rand);
+
+out:
+    qtest_quit(from);
+    qtest_quit(to);
+    unlink(path);
+
+    if (!g_test_failed() && transferred) {
+        bench_report(c, transferred, total_ms, downtime_ms, rounds, cpu);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    char template[] = "/tmp/migration-bench-XXXXXX";
+    const char *transport;
+    int i, j, ret;
+
+    g_test_init(&argc, &argv, NULL);
+
+    bench_mem_mib = bench_getenv_uint("MIGRATION_BENCH_MEM", bench_mem_mib);
+    bench_rounds = bench_getenv_uint("MIGRATION_BENCH_ROUNDS", bench_rounds);
+    bench_bandwidth_mib = bench_getenv_uint("MIGRATION_BENCH_BANDWIDTH", 0);
+    bench_csv = g_getenv("MIGRATION_BENCH_CSV");
+    transport = g_getenv("MIGRATION_BENCH_TRANSPORT");
+    if (transport && !strcmp(transport, "file")) {
+        bench_file = true;
+    } else if (transport && strcmp(transport, "unix")) {
+        g_printerr("MIGRATION_BENCH_TRANSPORT: unknown transport '%s'\n",
+                   transport);
+        return 1;
+    }
+
+    tmpfs = mkdtemp(template);
+    if (!tmpfs) {
+        g_test_message("mkdtemp on path (%s): %s", template, strerror(errno));
+    }
+    g_assert(tmpfs);
+
+    for (i = 0; i < ARRAY_SIZE(bench_patterns); i++) {
+        for (j = 0; j < ARRAY_SIZE(bench_caps); j++) {
+            BenchCase *c = g_new0(BenchCase, 1);
+            g_autofree char *name = NULL;
+
+            c->pattern = &bench_patterns[i];
+            c->caps = &bench_caps[j];
+            name = g_strdup_printf("/migration-bench/%s/%s",
+                                   c->pattern->name, c->caps->name);
+            qtest_add_data_func_full(name, c, bench_run, g_free);
+        }
+    }
+
+    ret = g_test_run();
+
+    ret |= rmdir(tmpfs);
+    return ret;
+}
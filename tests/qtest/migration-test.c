@@ -46,6 +46,7 @@
 unsigned start_address;
 unsigned end_address;
 static bool uffd_feature_thread_id;
+static bool uffd_feature_wp;
 
 /*
  * Dirtylimit stop working if dirty page rate error
@@ -82,6 +83,7 @@ static bool ufd_version_check(void)
         return false;
     }
     uffd_feature_thread_id = api_struct.features & UFFD_FEATURE_THREAD_ID;
+    uffd_feature_wp = api_struct.features & UFFD_FEATURE_PAGEFAULT_FLAG_WP;
 
     ioctl_mask = (__u64)1 << _UFFDIO_REGISTER |
                  (__u64)1 << _UFFDIO_UNREGISTER;
@@ -499,6 +501,8 @@ typedef struct {
     bool only_target;
     /* Use dirty ring if true; dirty logging otherwise */
     bool use_dirty_ring;
+    /* Do not use KVM, whose clock state differs on every save */
+    bool use_tcg;
     const char *opts_source;
     const char *opts_target;
 } MigrateStart;
@@ -663,11 +667,12 @@ static int test_migrate_start(QTestState **from, QTestState **to,
         shmem_opts = g_strdup("");
     }
 
-    cmd_source = g_strdup_printf("-accel kvm%s -accel tcg%s%s "
+    cmd_source = g_strdup_printf("%s%s -accel tcg%s%s "
                                  "-name source,debug-threads=on "
                                  "-m %s "
                                  "-serial file:%s/src_serial "
                                  "%s %s %s %s",
+                                 args->use_tcg ? "" : "-accel kvm",
                                  args->use_dirty_ring ?
                                  ",dirty-ring-size=4096" : "",
                                  machine_opts ? " -machine " : "",
@@ -680,12 +685,13 @@ static int test_migrate_start(QTestState **from, QTestState **to,
         *from = qtest_init(cmd_source);
     }
 
-    cmd_target = g_strdup_printf("-accel kvm%s -accel tcg%s%s "
+    cmd_target = g_strdup_printf("%s%s -accel tcg%s%s "
                                  "-name target,debug-threads=on "
                                  "-m %s "
                                  "-serial file:%s/dest_serial "
                                  "-incoming %s "
                                  "%s %s %s %s",
+                                 args->use_tcg ? "" : "-accel kvm",
                                  args->use_dirty_ring ?
                                  ",dirty-ring-size=4096" : "",
                                  machine_opts ? " -machine " : "",
@@ -1140,6 +1146,44 @@ static void test_postcopy(void)
     test_postcopy_common(&args);
 }
 
+static void *
+test_migrate_postcopy_parallel_start(QTestState *from,
+                                     QTestState *to)
+{
+    /* Several fault readers, pages placed by the place threads */
+    migrate_set_parameter_int(to, "postcopy-fault-threads", 2);
+    migrate_set_parameter_int(to, "postcopy-place-threads", 2);
+
+    return NULL;
+}
+
+static void test_postcopy_parallel(void)
+{
+    MigrateCommon args = {
+        .start_hook = test_migrate_postcopy_parallel_start,
+    };
+
+    test_postcopy_common(&args);
+}
+
+static void *
+test_migrate_cold_pages_first_start(QTestState *from,
+                                    QTestState *to)
+{
+    migrate_set_capability(from, "cold-pages-first", true);
+
+    return NULL;
+}
+
+static void test_postcopy_cold_pages_first(void)
+{
+    MigrateCommon args = {
+        .start_hook = test_migrate_cold_pages_first_start,
+    };
+
+    test_postcopy_common(&args);
+}
+
 static void test_postcopy_preempt(void)
 {
     MigrateCommon args = {
@@ -1382,6 +1426,37 @@ static void test_precopy_unix_dirty_ring(void)
     test_precopy_common(&args);
 }
 
+/*
+ * Take a background snapshot straight into the destination while the
+ * guest keeps writing, with the write faults resolved by the fault
+ * threads.  The destination must see the memory as it was when the
+ * snapshot started.
+ */
+static void test_background_snapshot_fault_threads(void)
+{
+    g_autofree char *uri = g_strdup_printf("unix:%s/migsocket", tmpfs);
+    MigrateStart args = {};
+    QTestState *from, *to;
+
+    if (test_migrate_start(&from, &to, uri, &args)) {
+        return;
+    }
+
+    migrate_set_capability(from, "background-snapshot", true);
+    migrate_set_parameter_int(from, "snapshot-fault-threads", 2);
+
+    /* Wait for the first serial output from the source */
+    wait_for_serial("src_serial");
+
+    migrate_qmp(from, uri, "{}");
+    wait_for_migration_complete(from);
+
+    qtest_qmp_eventwait(to, "RESUME");
+    wait_for_serial("dest_serial");
+
+    test_migrate_end(from, to, true);
+}
+
 #ifdef CONFIG_GNUTLS
 static void test_precopy_unix_tls_psk(void)
 {
@@ -1493,6 +1568,45 @@ static void test_precopy_unix_xbzrle(void)
     test_precopy_common(&args);
 }
 
+static void *
+test_migrate_dirty_sync_threads_start(QTestState *from,
+                                      QTestState *to)
+{
+    migrate_set_parameter_int(from, "dirty-sync-threads", 4);
+
+    return NULL;
+}
+
+static void test_precopy_unix_dirty_sync_threads(void)
+{
+    g_autofree char *uri = g_strdup_printf("unix:%s/migsocket", tmpfs);
+    MigrateCommon args = {
+        .connect_uri = uri,
+        .listen_uri = uri,
+
+        .start_hook = test_migrate_dirty_sync_threads_start,
+
+        .iterations = 2,
+    };
+
+    test_precopy_common(&args);
+}
+
+static void test_precopy_unix_cold_pages_first(void)
+{
+    g_autofree char *uri = g_strdup_printf("unix:%s/migsocket", tmpfs);
+    MigrateCommon args = {
+        .connect_uri = uri,
+        .listen_uri = uri,
+
+        .start_hook = test_migrate_cold_pages_first_start,
+
+        .iterations = 4,
+    };
+
+    test_precopy_common(&args);
+}
+
 static void test_precopy_tcp_plain(void)
 {
     MigrateCommon args = {
@@ -1502,6 +1616,33 @@ static void test_precopy_tcp_plain(void)
     test_precopy_common(&args);
 }
 
+static void *
+test_migrate_dirty_limit_start(QTestState *from,
+                               QTestState *to)
+{
+    migrate_set_capability(from, "dirty-limit", true);
+
+    return NULL;
+}
+
+static void test_precopy_unix_dirty_limit(void)
+{
+    g_autofree char *uri = g_strdup_printf("unix:%s/migsocket", tmpfs);
+    MigrateCommon args = {
+        .start = {
+            .use_dirty_ring = true,
+        },
+        .connect_uri = uri,
+        .listen_uri = uri,
+
+        .start_hook = test_migrate_dirty_limit_start,
+
+        .iterations = 4,
+    };
+
+    test_precopy_common(&args);
+}
+
 #ifdef CONFIG_GNUTLS
 static void test_precopy_tcp_tls_psk_match(void)
 {
@@ -1514,6 +1655,26 @@ static void test_precopy_tcp_tls_psk_match(void)
     test_precopy_common(&args);
 }
 
+/*
+ * Kernel TLS offload falls back to the userspace TLS path when the host
+ * has no TLS ULP, so this passes either way; it exercises whichever
+ * path the host supports.
+ */
+static void test_precopy_tcp_tls_psk_ktls(void)
+{
+    MigrateCommon args = {
+        .start = {
+            .opts_source = "-global migration.x-ktls=on",
+            .opts_target = "-global migration.x-ktls=on",
+        },
+        .listen_uri = "tcp:127.0.0.1:0",
+        .start_hook = test_migrate_tls_psk_start_match,
+        .finish_hook = test_migrate_tls_psk_finish,
+    };
+
+    test_precopy_common(&args);
+}
+
 static void test_precopy_tcp_tls_psk_mismatch(void)
 {
     MigrateCommon args = {
@@ -1763,6 +1924,53 @@ static void test_validate_uuid_dst_not_set(void)
     do_test_validate_uuid(&args, false);
 }
 
+/* Save a guest that never ran to @file, with @threads vmstate save threads */
+static void vmstate_save_threads_save(int threads, const char *file)
+{
+    g_autofree char *opts = g_strdup_printf(
+        "-S -global migration.x-vmstate-save-threads=%d", threads);
+    g_autofree char *uri = g_strdup_printf("exec:cat > %s", file);
+    MigrateStart args = {
+        .use_tcg = true,
+        .opts_source = opts,
+    };
+    QTestState *from, *to;
+
+    if (test_migrate_start(&from, &to, "defer", &args)) {
+        return;
+    }
+    migrate_qmp(from, uri, "{}");
+    wait_for_migration_complete(from);
+    test_migrate_end(from, to, false);
+}
+
+/*
+ * Device state saved by the vmstate save threads is copied to the stream
+ * in handler order, so the stream must not depend on the thread count.
+ */
+static void test_vmstate_save_threads(void)
+{
+    g_autofree char *serial = g_strdup_printf("%s/vmstate-1", tmpfs);
+    g_autofree char *parallel = g_strdup_printf("%s/vmstate-4", tmpfs);
+    g_autofree char *serial_data = NULL;
+    g_autofree char *parallel_data = NULL;
+    gsize serial_len, parallel_len;
+
+    vmstate_save_threads_save(1, serial);
+    vmstate_save_threads_save(4, parallel);
+
+    g_assert_true(g_file_get_contents(serial, &serial_data, &serial_len,
+                                      NULL));
+    g_assert_true(g_file_get_contents(parallel, &parallel_data,
+                                      &parallel_len, NULL));
+    g_assert_cmpuint(serial_len, >, 0);
+    g_assert_cmpuint(serial_len, ==, parallel_len);
+    g_assert_true(memcmp(serial_data, parallel_data, serial_len) == 0);
+
+    unlink(serial);
+    unlink(parallel);
+}
+
 static void test_migrate_auto_converge(void)
 {
     g_autofree char *uri = g_strdup_printf("unix:%s/migsocket", tmpfs);
@@ -1976,6 +2184,20 @@ static void test_multifd_tcp_tls_psk_match(void)
     test_precopy_common(&args);
 }
 
+static void test_multifd_tcp_tls_psk_ktls(void)
+{
+    MigrateCommon args = {
+        .start = {
+            .opts_source = "-global migration.x-ktls=on",
+            .opts_target = "-global migration.x-ktls=on",
+        },
+        .listen_uri = "defer",
+        .start_hook = test_migrate_multifd_tcp_tls_psk_start_match,
+        .finish_hook = test_migrate_tls_psk_finish,
+    };
+    test_precopy_common(&args);
+}
+
 static void test_multifd_tcp_tls_psk_mismatch(void)
 {
     MigrateCommon args = {
@@ -2461,6 +2683,9 @@ int main(int argc, char **argv)
     if (has_uffd) {
         qtest_add_func("/migration/postcopy/unix", test_postcopy);
         qtest_add_func("/migration/postcopy/plain", test_postcopy);
+        qtest_add_func("/migration/postcopy/parallel", test_postcopy_parallel);
+        qtest_add_func("/migration/postcopy/cold-pages-first",
+                       test_postcopy_cold_pages_first);
         qtest_add_func("/migration/postcopy/recovery/plain",
                        test_postcopy_recovery);
         qtest_add_func("/migration/postcopy/preempt/plain", test_postcopy_preempt);
@@ -2471,6 +2696,14 @@ int main(int argc, char **argv)
     qtest_add_func("/migration/bad_dest", test_baddest);
     qtest_add_func("/migration/precopy/unix/plain", test_precopy_unix_plain);
     qtest_add_func("/migration/precopy/unix/xbzrle", test_precopy_unix_xbzrle);
+    qtest_add_func("/migration/precopy/unix/dirty-sync-threads",
+                   test_precopy_unix_dirty_sync_threads);
+    qtest_add_func("/migration/precopy/unix/cold-pages-first",
+                   test_precopy_unix_cold_pages_first);
+    if (has_uffd && uffd_feature_wp) {
+        qtest_add_func("/migration/background-snapshot/fault-threads",
+                       test_background_snapshot_fault_threads);
+    }
 #ifdef CONFIG_GNUTLS
     qtest_add_func("/migration/precopy/unix/tls/psk",
                    test_precopy_unix_tls_psk);
@@ -2501,6 +2734,8 @@ int main(int argc, char **argv)
 #ifdef CONFIG_GNUTLS
     qtest_add_func("/migration/precopy/tcp/tls/psk/match",
                    test_precopy_tcp_tls_psk_match);
+    qtest_add_func("/migration/precopy/tcp/tls/psk/ktls",
+                   test_precopy_tcp_tls_psk_ktls);
     qtest_add_func("/migration/precopy/tcp/tls/psk/mismatch",
                    test_precopy_tcp_tls_psk_mismatch);
 #ifdef CONFIG_TASN1
@@ -2529,6 +2764,8 @@ int main(int argc, char **argv)
                    test_validate_uuid_src_not_set);
     qtest_add_func("/migration/validate_uuid_dst_not_set",
                    test_validate_uuid_dst_not_set);
+    qtest_add_func("/migration/vmstate_save_threads",
+                   test_vmstate_save_threads);
 
     qtest_add_func("/migration/auto_converge", test_migrate_auto_converge);
     qtest_add_func("/migration/multifd/tcp/plain/none",
@@ -2544,6 +2781,8 @@ int main(int argc, char **argv)
 #ifdef CONFIG_GNUTLS
     qtest_add_func("/migration/multifd/tcp/tls/psk/match",
                    test_multifd_tcp_tls_psk_match);
+    qtest_add_func("/migration/multifd/tcp/tls/psk/ktls",
+                   test_multifd_tcp_tls_psk_ktls);
     qtest_add_func("/migration/multifd/tcp/tls/psk/mismatch",
                    test_multifd_tcp_tls_psk_mismatch);
 #ifdef CONFIG_TASN1
@@ -2565,6 +2804,8 @@ int main(int argc, char **argv)
                        test_precopy_unix_dirty_ring);
         qtest_add_func("/migration/vcpu_dirty_limit",
                        test_vcpu_dirty_limit);
+        qtest_add_func("/migration/dirty_limit",
+                       test_precopy_unix_dirty_limit);
     }
 
     ret = g_test_run();
@@ -0,0 +1,229 @@
+/*
+ * QTest testcase for colo-compare
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * later.  See the COPYING file in the top-level directory.
+ *
+ * Feeds UDP packets of many connections to a colo-compare object with
+ * compare threads, so that the connections are spread across the
+ * shards, and checks that:
+ *
+ * - primary packets matched by identical secondary packets are released
+ *   to the output;
+ * - primary packets without a secondary counterpart are released by a
+ *   checkpoint, whether the shard thread already picked them up or not.
+ */
+
+#include "qemu/osdep.h"
+#include "libqtest.h"
+#include "qapi/qmp/qdict.h"
+#include "qemu/iov.h"
+#include "qemu/sockets.h"
+#include "net/eth.h"
+
+/* TODO actually test the results and get rid of this */
+#define qmp_discard_response(qs, ...) qobject_unref(qtest_qmp(qs, __VA_ARGS__))
+
+#define COMPARE_THREADS     4
+#define COMPARE_CONNECTIONS 64
+#define COMPARE_PAYLOAD     32
+
+typedef struct {
+    struct eth_header eth;
+    struct ip_header ip;
+    struct udp_header udp;
+    uint8_t payload[COMPARE_PAYLOAD];
+} QEMU_PACKED ComparePacket;
+
+typedef struct {
+    QTestState *qts;
+    int pri_sock[2];
+    int sec_sock[2];
+    int out_sock[2];
+    int notify_sock[2];
+} CompareTest;
+
+static void compare_test_start(CompareTest *t)
+{
+    struct timeval tv = { .tv_usec = 100 * 1000 };
+    int ret;
+
+    ret = socketpair(PF_UNIX, SOCK_STREAM, 0, t->pri_sock);
+    g_assert_cmpint(ret, !=, -1);
+    ret = socketpair(PF_UNIX, SOCK_STREAM, 0, t->sec_sock);
+    g_assert_cmpint(ret, !=, -1);
+    ret = socketpair(PF_UNIX, SOCK_STREAM, 0, t->out_sock);
+    g_assert_cmpint(ret, !=, -1);
+    ret = socketpair(PF_UNIX, SOCK_STREAM, 0, t->notify_sock);
+    g_assert_cmpint(ret, !=, -1);
+
+    /* Polling the output must not block forever */
+    ret = setsockopt(t->out_sock[0], SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    g_assert_cmpint(ret, !=, -1);
+
+    /* Only checkpoints release unmatched primary packets */
+    t->qts = qtest_initf(
+        "-nodefaults "
+        "-object iothread,id=iothread0 "
+        "-chardev socket,id=pri0,fd=%d "
+        "-chardev socket,id=sec0,fd=%d "
+        "-chardev socket,id=out0,fd=%d "
+        "-chardev socket,id=notify0,fd=%d "
+        "-object colo-compare,id=comp0,primary_in=pri0,secondary_in=sec0,"
+        "outdev=out0,notify_dev=notify0,iothread=iothread0,"
+        "compare_threads=%d,compare_timeout=3600000",
+        t->pri_sock[1], t->sec_sock[1], t->out_sock[1], t->notify_sock[1],
+        COMPARE_THREADS);
+
+    /* send a qmp command to guarantee that 'connected' is setting to true. */
+    qmp_discard_response(t->qts, "{ 'execute' : 'query-status'}");
+}
+
+static void compare_test_end(CompareTest *t)
+{
+    qtest_quit(t->qts);
+
+    close(t->pri_sock[0]);
+    close(t->pri_sock[1]);
+    close(t->sec_sock[0]);
+    close(t->sec_sock[1]);
+    close(t->out_sock[0]);
+    close(t->out_sock[1]);
+    close(t->notify_sock[0]);
+    close(t->notify_sock[1]);
+}
+
+static void compare_packet_init(ComparePacket *pkt, int conn)
+{
+    memset(pkt, 0, sizeof(*pkt));
+
+    pkt->eth.h_proto = htons(ETH_P_IP);
+    pkt->ip.ip_ver_len = 0x45;
+    pkt->ip.ip_len = htons(sizeof(*pkt) - sizeof(pkt->eth));
+    pkt->ip.ip_ttl = 64;
+    pkt->ip.ip_p = IP_PROTO_UDP;
+    pkt->ip.ip_src = htonl(0x0a000001);
+    pkt->ip.ip_dst = htonl(0x0a000002);
+    /* Each connection hashes to its own shard */
+    pkt->udp.uh_sport = htons(1024 + conn);
+    pkt->udp.uh_dport = htons(7);
+    pkt->udp.uh_ulen = htons(sizeof(pkt->udp) + sizeof(pkt->payload));
+    memset(pkt->payload, conn, sizeof(pkt->payload));
+}
+
+static void compare_send(int sock, const void *buf, uint32_t len)
+{
+    uint32_t size = htonl(len);
+    struct iovec iov[] = {
+        {
+            .iov_base = &size,
+            .iov_len = sizeof(size),
+        }, {
+            .iov_base = (void *)buf,
+            .iov_len = len,
+        },
+    };
+    ssize_t ret;
+
+    ret = iov_send(sock, iov, 2, 0, sizeof(size) + len);
+    g_assert_cmpint(ret, ==, sizeof(size) + len);
+}
+
+/*
+ * Receive one packet from the output and mark its connection as seen.
+ * Returns false if nothing came out in time.
+ */
+static bool compare_recv(CompareTest *t, bool *seen)
+{
+    ComparePacket pkt;
+    uint32_t len;
+    ssize_t ret;
+    int conn;
+
+    ret = recv(t->out_sock[0], &len, sizeof(len), MSG_WAITALL);
+    if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        return false;
+    }
+    g_assert_cmpint(ret, ==, sizeof(len));
+    g_assert_cmpint(ntohl(len), ==, sizeof(pkt));
+
+    ret = recv(t->out_sock[0], &pkt, sizeof(pkt), MSG_WAITALL);
+    g_assert_cmpint(ret, ==, sizeof(pkt));
+
+    conn = ntohs(pkt.udp.uh_sport) - 1024;
+    g_assert_cmpint(conn, >=, 0);
+    g_assert_cmpint(conn, <, COMPARE_CONNECTIONS);
+    g_assert_cmpint(pkt.payload[0], ==, conn);
+    g_assert_false(seen[conn]);
+    seen[conn] = true;
+
+    return true;
+}
+
+static void test_compare_threads_match(void)
+{
+    bool seen[COMPARE_CONNECTIONS] = {};
+    ComparePacket pkt;
+    CompareTest t;
+    int i, received = 0, rounds = 0;
+
+    compare_test_start(&t);
+
+    for (i = 0; i < COMPARE_CONNECTIONS; i++) {
+        compare_packet_init(&pkt, i);
+        compare_send(t.pri_sock[0], &pkt, sizeof(pkt));
+        compare_send(t.sec_sock[0], &pkt, sizeof(pkt));
+    }
+
+    while (received < COMPARE_CONNECTIONS) {
+        if (compare_recv(&t, seen)) {
+            received++;
+        } else {
+            g_assert_cmpint(rounds++, <, 100);
+        }
+    }
+
+    compare_test_end(&t);
+}
+
+static void test_compare_threads_checkpoint(void)
+{
+    const char checkpoint[] = "COLO_CHECKPOINT";
+    bool seen[COMPARE_CONNECTIONS] = {};
+    ComparePacket pkt;
+    CompareTest t;
+    int i, received = 0, rounds = 0;
+
+    compare_test_start(&t);
+
+    for (i = 0; i < COMPARE_CONNECTIONS; i++) {
+        compare_packet_init(&pkt, i);
+        compare_send(t.pri_sock[0], &pkt, sizeof(pkt));
+    }
+
+    /*
+     * The packets can reach the compare object after a checkpoint, so
+     * keep checkpointing until all of them came out.
+     */
+    while (received < COMPARE_CONNECTIONS) {
+        g_assert_cmpint(rounds++, <, 100);
+        compare_send(t.notify_sock[0], checkpoint, strlen(checkpoint));
+        while (compare_recv(&t, seen)) {
+            received++;
+        }
+    }
+
+    compare_test_end(&t);
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+
+    qtest_add_func("/netfilter/colo-compare/threads/match",
+                   test_compare_threads_match);
+    qtest_add_func("/netfilter/colo-compare/threads/checkpoint",
+                   test_compare_threads_checkpoint);
+
+    return g_test_run();
+}
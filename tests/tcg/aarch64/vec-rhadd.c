@@ -0,0 +1,80 @@
+/*
+ * Check SRHADD/URHADD against a scalar reference.
+ *
+ * These are expanded inline as rounding halving add vector ops, so
+ * running with a large iteration count (first argument) also serves
+ * as a microbenchmark of the backend lowering.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include <arm_neon.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+static uint64_t seed = 0x9e3779b97f4a7c15ull;
+
+static uint64_t next(void)
+{
+    seed ^= seed >> 12;
+    seed ^= seed << 25;
+    seed ^= seed >> 27;
+    return seed * 2685821657736338717ull;
+}
+
+static void fill(uint8_t *p, int n)
+{
+    int i;
+
+    for (i = 0; i < n; i++) {
+        p[i] = next();
+    }
+}
+
+#define CHECK(NAME, TYPE, N, LD, OP, ST)                                \
+static int check_##NAME(long iters)                                     \
+{                                                                       \
+    TYPE a[N], b[N], d[N];                                              \
+    long it;                                                            \
+    int i;                                                              \
+                                                                        \
+    for (it = 0; it < iters; it++) {                                    \
+        fill((uint8_t *)a, sizeof(a));                                  \
+        fill((uint8_t *)b, sizeof(b));                                  \
+        ST(d, OP(LD(a), LD(b)));                                        \
+        for (i = 0; i < N; i++) {                                       \
+            TYPE r = ((int64_t)a[i] + b[i] + 1) >> 1;                   \
+            if (d[i] != r) {                                            \
+                printf("%s: element %d: got %lld, expected %lld\n",     \
+                       #NAME, i, (long long)d[i], (long long)r);        \
+                return 1;                                               \
+            }                                                           \
+        }                                                               \
+    }                                                                   \
+    return 0;                                                           \
+}
+
+CHECK(s8, int8_t, 16, vld1q_s8, vrhaddq_s8, vst1q_s8)
+CHECK(u8, uint8_t, 16, vld1q_u8, vrhaddq_u8, vst1q_u8)
+CHECK(s16, int16_t, 8, vld1q_s16, vrhaddq_s16, vst1q_s16)
+CHECK(u16, uint16_t, 8, vld1q_u16, vrhaddq_u16, vst1q_u16)
+CHECK(s32, int32_t, 4, vld1q_s32, vrhaddq_s32, vst1q_s32)
+CHECK(u32, uint32_t, 4, vld1q_u32, vrhaddq_u32, vst1q_u32)
+CHECK(d_u8, uint8_t, 8, vld1_u8, vrhadd_u8, vst1_u8)
+
+int main(int argc, char *argv[])
+{
+    long iters = argc > 1 ? atol(argv[1]) : 1000;
+    int err = 0;
+
+    err |= check_s8(iters);
+    err |= check_u8(iters);
+    err |= check_s16(iters);
+    err |= check_u16(iters);
+    err |= check_s32(iters);
+    err |= check_u32(iters);
+    err |= check_d_u8(iters);
+
+    return err;
+}
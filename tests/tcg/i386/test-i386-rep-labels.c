@@ -0,0 +1,105 @@
+/*
+ * String and loop instructions are translated with branches to labels
+ * inside the translation block.  Check that guest registers live across
+ * those labels keep their values, on the path that takes the branch as
+ * well as on the one that falls through.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+#include <assert.h>
+#include <string.h>
+
+static char src[256], dst[256];
+
+static void test_rep_movsb(unsigned long n)
+{
+    unsigned long a = 0x1234, b = 0x5678, c = n;
+    char *s = src, *d = dst;
+
+    memset(dst, 0, sizeof(dst));
+    asm volatile("add %3, %4\n\t"
+                 "rep movsb\n\t"
+                 "add %4, %3"
+                 : "+S"(s), "+D"(d), "+c"(c), "+r"(a), "+r"(b)
+                 : : "memory", "cc");
+    assert(c == 0);
+    assert(s == src + n && d == dst + n);
+    assert(a == 0x1234 + 0x1234 + 0x5678 && b == 0x1234 + 0x5678);
+    assert(memcmp(src, dst, n) == 0);
+    assert(n == sizeof(dst) || dst[n] == 0);
+}
+
+static void test_repe_cmpsb(unsigned long n, unsigned long diff)
+{
+    unsigned long a = 7, c = n;
+    char *s = src, *d = dst;
+
+    memcpy(dst, src, sizeof(dst));
+    if (diff < n) {
+        dst[diff] ^= 1;
+    }
+    asm volatile("repe cmpsb\n\t"
+                 "lea 1(%3), %3"
+                 : "+S"(s), "+D"(d), "+c"(c), "+r"(a) : : "memory", "cc");
+    assert(a == 8);
+    if (diff < n) {
+        assert(c == n - diff - 1);
+        assert(s == src + diff + 1);
+    } else {
+        assert(c == 0);
+        assert(s == src + n);
+    }
+}
+
+static void test_repne_scasb(unsigned long len)
+{
+    unsigned long a = 0, c = ~0ul, b = 3;
+    char *d = dst;
+
+    memset(dst, 'x', sizeof(dst));
+    dst[len] = 0;
+    asm volatile("repne scasb\n\t"
+                 "lea (%3,%3,2), %3"
+                 : "+D"(d), "+c"(c), "+a"(a), "+r"(b) : : "memory", "cc");
+    assert(d == dst + len + 1);
+    assert(~c - 1 == len);
+    assert(b == 9);
+}
+
+static void test_loop(unsigned long n)
+{
+    unsigned long sum = 0, c = n, other = 42;
+
+    asm volatile("jecxz 2f\n"
+                 "1:\n\t"
+                 "add %1, %0\n\t"
+                 "inc %2\n\t"
+                 "loop 1b\n"
+                 "2:"
+                 : "+r"(sum), "+c"(c), "+r"(other) : : "cc");
+    assert(c == 0);
+    assert(sum == n * (n + 1) / 2);
+    assert(other == 42 + n);
+}
+
+int main(void)
+{
+    unsigned long i;
+
+    for (i = 0; i < sizeof(src); i++) {
+        src[i] = i * 7 + 1;
+    }
+
+    for (i = 0; i <= sizeof(dst); i += 17) {
+        test_rep_movsb(i);
+        test_repe_cmpsb(i, i / 2);
+        test_repe_cmpsb(i, i);
+        test_loop(i);
+    }
+    test_rep_movsb(sizeof(dst));
+    for (i = 0; i < sizeof(dst); i += 13) {
+        test_repne_scasb(i);
+    }
+
+    return 0;
+}
@@ -0,0 +1,77 @@
+/*
+ * Run branchy loops long enough for their TBs to form hot traces and
+ * check the results, so that exits routed inside a trace are exercised
+ * on the paths that stay in the trace as well as on those leaving it.
+ * Meant to be run with a low hot trace threshold.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+#include <stdint.h>
+#include <stdio.h>
+
+static volatile unsigned long limit = 20000;
+static volatile unsigned long rounds = 100000;
+
+/* Steps for @n to reach 1 in the Collatz sequence */
+static unsigned long collatz_steps(unsigned long n)
+{
+    unsigned long steps = 0;
+
+    while (n != 1) {
+        if (n & 1) {
+            n = 3 * n + 1;
+        } else {
+            n >>= 1;
+        }
+        steps++;
+    }
+    return steps;
+}
+
+static uint32_t mix(uint32_t h, unsigned long i)
+{
+    switch (i % 7) {
+    case 0:
+        return h ^ i;
+    case 1:
+    case 2:
+        return h * 16777619;
+    case 5:
+        return h + (h >> 7);
+    default:
+        return h - i;
+    }
+}
+
+int main(void)
+{
+    uint32_t (*volatile fn)(uint32_t, unsigned long) = mix;
+    unsigned long n, total = 0, longest = 0;
+    uint32_t h = 0x811c9dc5;
+    int err = 0;
+
+    for (n = 1; n <= limit; n++) {
+        unsigned long steps = collatz_steps(n);
+
+        total += steps;
+        if (steps > longest) {
+            longest = steps;
+        }
+    }
+    if (total != 1834634 || longest != 278) {
+        printf("collatz: total %lu longest %lu, expected 1834634 278\n",
+               total, longest);
+        err = 1;
+    }
+
+    /* Through a pointer, so that the call leaves the trace */
+    for (n = 0; n < rounds; n++) {
+        h = fn(h, n);
+    }
+    if (h != 0x5de33afc) {
+        printf("mix: %#x, expected 0x5de33afc\n", h);
+        err = 1;
+    }
+
+    return err;
+}
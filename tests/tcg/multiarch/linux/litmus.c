@@ -0,0 +1,104 @@
+/*
+ * Memory ordering litmus tests
+ *
+ * Run the message passing (MP) and load buffering (LB) shapes on two
+ * threads, using acquire loads and release stores, and check that the
+ * outcomes forbidden by those orderings are never observed. On
+ * strongly ordered guests these are plain loads and stores, so this
+ * checks the barriers TCG inserts (and elides) for the guest memory
+ * model. The iteration count (first argument) makes it usable as a
+ * benchmark as well.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+static long iters;
+static pthread_barrier_t start;
+
+static int x, y;
+static int r0, r1;
+static long failures;
+
+#define LOAD(p)      __atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define STORE(p, v)  __atomic_store_n(p, v, __ATOMIC_RELEASE)
+
+/* MP: 0:(x = 1; y = 1) 1:(r0 = y; r1 = x), forbid r0 == 1 && r1 == 0 */
+static void *mp_writer(void *arg)
+{
+    long i;
+
+    for (i = 0; i < iters; i++) {
+        pthread_barrier_wait(&start);
+        STORE(&x, 1);
+        STORE(&y, 1);
+        pthread_barrier_wait(&start);
+    }
+    return NULL;
+}
+
+static void mp_reader(void)
+{
+    r0 = LOAD(&y);
+    r1 = LOAD(&x);
+}
+
+/* LB: 0:(r0 = x; y = 1) 1:(r1 = y; x = 1), forbid r0 == 1 && r1 == 1 */
+static void *lb_thread0(void *arg)
+{
+    long i;
+
+    for (i = 0; i < iters; i++) {
+        pthread_barrier_wait(&start);
+        r0 = LOAD(&x);
+        STORE(&y, 1);
+        pthread_barrier_wait(&start);
+    }
+    return NULL;
+}
+
+static void lb_thread1(void)
+{
+    r1 = LOAD(&y);
+    STORE(&x, 1);
+}
+
+static void run(const char *name, void *(*other)(void *),
+                void (*self)(void), int bad0, int bad1)
+{
+    pthread_t thread;
+    long i, seen = 0;
+
+    if (pthread_create(&thread, NULL, other, NULL)) {
+        perror("pthread_create");
+        exit(EXIT_FAILURE);
+    }
+    for (i = 0; i < iters; i++) {
+        x = y = 0;
+        r0 = r1 = -1;
+        pthread_barrier_wait(&start);
+        self();
+        pthread_barrier_wait(&start);
+        if (r0 == bad0 && r1 == bad1) {
+            seen++;
+        }
+    }
+    pthread_join(thread, NULL);
+
+    printf("%s: %ld forbidden outcomes in %ld runs\n", name, seen, iters);
+    failures += seen;
+}
+
+int main(int argc, char *argv[])
+{
+    iters = argc > 1 ? atol(argv[1]) : 10000;
+    pthread_barrier_init(&start, NULL, 2);
+
+    run("MP", mp_writer, mp_reader, 1, 0);
+    run("LB", lb_thread0, lb_thread1, 1, 1);
+
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,86 @@
+#!/bin/sh
+#
+# Run a system test with a translation block cache (-accel tcg,tb-cache=):
+#
+#   1. with no cache file, which must be written when QEMU exits;
+#   2. with that file, whose TBs must be adopted and still run correctly;
+#   3. with a file whose build id does not match, which must be rejected;
+#   4. with a truncated file, which must be ignored;
+#   5. running another test with the file, whose code differs at the same
+#      guest addresses, which must not break it.
+#
+# The cache is only usable when the code buffer lands at the same host
+# address in every run, so address space randomization is disabled.
+#
+# Usage: tb-cache.sh QEMU TEST OTHER-TEST QEMU-OPTS...
+#
+# SPDX-License-Identifier: GPL-2.0-or-later
+
+qemu=$1
+test=$2
+other=$3
+shift 3
+
+cache=$test.tbc
+log=$test.tbc.log
+rm -f "$cache" "$log"
+
+fail() {
+    echo "tb-cache: $*" >&2
+    exit 1
+}
+
+# run STEP BINARY QEMU-OPTS...: run BINARY with the cache, logging
+# the trace events to $log.STEP
+run() {
+    step=$1
+    bin=$2
+    shift 2
+    rm -f "$log.$step"
+    setarch "$(uname -m)" -R \
+        "$qemu" -monitor none -display none \
+        -chardev file,path="$bin.tbc.$step.out",id=output \
+        -accel tcg,tb-cache="$cache" \
+        -d "trace:tb_cache_*" -D "$log.$step" "$@" "$bin" 2>>"$log" ||
+        fail "step $step: $bin failed, see $log and $log.$step"
+}
+
+if ! setarch "$(uname -m)" -R true 2>/dev/null; then
+    echo "  SKIPPED tb-cache: cannot disable address space randomization"
+    exit 0
+fi
+
+run 1 "$test" "$@"
+if ! grep -q "tb_cache_save" "$log.1"; then
+    if ! grep -q . "$log.1"; then
+        echo "  SKIPPED tb-cache: needs the log trace backend"
+        exit 0
+    fi
+    fail "step 1: no cache written"
+fi
+test -s "$cache" || fail "step 1: $cache is empty"
+
+run 2 "$test" "$@"
+grep -q "tb_cache_load" "$log.2" || fail "step 2: cache not loaded"
+grep -q "tb_cache_adopt" "$log.2" || fail "step 2: no TB adopted"
+cmp -s "$test.tbc.1.out" "$test.tbc.2.out" ||
+    fail "step 2: output differs from the first run"
+
+# The build id follows the 8 byte magic
+cp "$cache" "$cache.good"
+printf '\377' | dd of="$cache" bs=1 seek=8 conv=notrunc 2>/dev/null
+run 3 "$test" "$@"
+grep -q "tb_cache_reject.*build mismatch" "$log.3" ||
+    fail "step 3: mismatched build id accepted"
+grep -q "tb_cache_adopt" "$log.3" && fail "step 3: TB adopted from a bad file"
+
+head -c 100 "$cache.good" > "$cache"
+run 4 "$test" "$@"
+grep -q "truncated or corrupted" "$log" ||
+    fail "step 4: truncated file not reported"
+grep -q "tb_cache_adopt" "$log.4" && fail "step 4: TB adopted from a bad file"
+
+cp "$cache.good" "$cache"
+run 5 "$other" "$@"
+rm -f "$cache" "$cache.good"
+exit 0
@@ -0,0 +1,75 @@
+/*
+ * JIT code patching test, system test version
+ *
+ * Emulates a guest JIT: one page holds a row of small stubs followed
+ * by the data the JIT keeps about them. Every round updates the data
+ * and calls a stub, and every few rounds the stub is re-emitted first.
+ * This exercises both writes that miss the translated code of a page
+ * and writes that invalidate it, and the round count (ROUNDS) makes it
+ * usable as a benchmark of the code-write tracking.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include <stdint.h>
+#include <minilib.h>
+
+#define JIT_PAGE_SIZE 4096
+#define STUB_SIZE     16
+#define NR_STUBS      64
+#define PATCH_EVERY   8
+#define ROUNDS        200000
+
+typedef uint32_t (*stub_fn)(void);
+
+__attribute__((aligned(JIT_PAGE_SIZE)))
+static uint8_t jit_page[JIT_PAGE_SIZE];
+
+static uint32_t expected[NR_STUBS];
+
+/* mov $val, %eax; ret */
+static void emit_stub(int i, uint32_t val)
+{
+    uint8_t *p = &jit_page[i * STUB_SIZE];
+
+    p[0] = 0xb8;
+    p[1] = val;
+    p[2] = val >> 8;
+    p[3] = val >> 16;
+    p[4] = val >> 24;
+    p[5] = 0xc3;
+    expected[i] = val;
+}
+
+int main(void)
+{
+    /* the JIT's per-stub data lives right after the code */
+    uint32_t *calls = (uint32_t *)&jit_page[NR_STUBS * STUB_SIZE];
+    int patches = 0;
+    int r, i;
+
+    for (i = 0; i < NR_STUBS; i++) {
+        emit_stub(i, i);
+    }
+
+    for (r = 0; r < ROUNDS; r++) {
+        stub_fn fn;
+        uint32_t got;
+
+        i = r % NR_STUBS;
+        fn = (stub_fn)&jit_page[i * STUB_SIZE];
+        calls[i]++;
+        if (r % PATCH_EVERY == 0) {
+            emit_stub(i, r);
+            patches++;
+        }
+        got = fn();
+        if (got != expected[i]) {
+            ml_printf("stub %d: got %d, expected %d\n", i, got, expected[i]);
+            return 1;
+        }
+    }
+
+    ml_printf("%d rounds, %d patches\n", ROUNDS, patches);
+    return 0;
+}
@@ -30,6 +30,7 @@
 #include "../migration/qemu-file.h"
 #include "../migration/savevm.h"
 #include "qemu/coroutine.h"
+#include "qapi/qmp/json-writer.h"
 #include "qemu/module.h"
 #include "io/channel-file.h"
 
@@ -1482,6 +1483,160 @@ static void test_tmp_struct(void)
     g_assert_cmpint(obj.f, ==, 8); /* From the child->parent */
 }
 
+static bool test_sub_needed(void *opaque)
+{
+    return true;
+}
+
+static const VMStateDescription vmstate_sub_needed = {
+    .name = "test/sub_needed",
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .needed = test_sub_needed,
+    .fields = (VMStateField[]) {
+        VMSTATE_UINT32(b, TestStruct),
+        VMSTATE_END_OF_LIST()
+    }
+};
+
+static const VMStateDescription vmstate_with_sub_needed = {
+    .name = "test/with_sub_needed",
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .fields = (VMStateField[]) {
+        VMSTATE_UINT32(a, TestStruct),
+        VMSTATE_END_OF_LIST()
+    },
+    .subsections = (const VMStateDescription *[]) {
+        &vmstate_sub_needed,
+        NULL
+    }
+};
+
+static void test_save_read_only(void)
+{
+    g_assert_true(vmstate_save_is_read_only(&vmstate_simple_primitive));
+    g_assert_true(vmstate_save_is_read_only(&vmstate_simple_arr));
+    /* The tmp child has a pre_save hook */
+    g_assert_false(vmstate_save_is_read_only(&vmstate_with_tmp));
+    /* Walking a QTAILQ is not a plain field access */
+    g_assert_false(vmstate_save_is_read_only(&vmstate_q));
+    /* field_exists() callbacks may look at other state */
+    g_assert_false(vmstate_save_is_read_only(&vmstate_skipping));
+    /* So may needed() callbacks */
+    g_assert_false(vmstate_save_is_read_only(&vmstate_with_sub_needed));
+}
+
+typedef struct TestCompiled {
+    uint8_t  a[5];
+    int8_t   b;
+    uint8_t  c;
+    uint8_t  buf[4];
+    uint32_t d;
+    uint8_t  e[3];
+} TestCompiled;
+
+static const VMStateDescription vmstate_compiled = {
+    .name = "test/compiled",
+    .version_id = 2,
+    .minimum_version_id = 1,
+    .fields = (VMStateField[]) {
+        VMSTATE_UINT8_ARRAY(a, TestCompiled, 5),
+        VMSTATE_INT8(b, TestCompiled),
+        VMSTATE_UINT8_V(c, TestCompiled, 2),
+        VMSTATE_BUFFER(buf, TestCompiled),
+        VMSTATE_UINT32(d, TestCompiled),
+        VMSTATE_UINT8_ARRAY(e, TestCompiled, 3),
+        VMSTATE_END_OF_LIST()
+    }
+};
+
+static void obj_compiled_copy(void *target, void *source)
+{
+    memcpy(target, source, sizeof(TestCompiled));
+}
+
+static char *save_vmstate_desc(const VMStateDescription *desc, void *obj)
+{
+    QEMUFile *f = open_test_file(true);
+    JSONWriter *vmdesc = json_writer_new(false);
+    char *json;
+
+    json_writer_start_object(vmdesc, NULL);
+    g_assert(!vmstate_save_state(f, desc, obj, vmdesc));
+    json_writer_end_object(vmdesc);
+    qemu_put_byte(f, QEMU_VM_EOF);
+    g_assert(!qemu_file_get_error(f));
+    qemu_fclose(f);
+
+    json = g_strdup(json_writer_get(vmdesc));
+    json_writer_free(vmdesc);
+    return json;
+}
+
+static void test_compiled(void)
+{
+    TestCompiled obj = {
+        .a = { 1, 2, 3, 4, 5 },
+        .b = -1,
+        .c = 6,
+        .buf = { 7, 8, 9, 10 },
+        .d = 0x0b0c0d0e,
+        .e = { 15, 16, 17 },
+    };
+    TestCompiled obj_clone;
+    uint8_t const wire_compiled[] = {
+        /* a */   0x01, 0x02, 0x03, 0x04, 0x05,
+        /* b */   0xff,
+        /* c */   0x06,
+        /* buf */ 0x07, 0x08, 0x09, 0x0a,
+        /* d */   0x0b, 0x0c, 0x0d, 0x0e,
+        /* e */   0x0f, 0x10, 0x11,
+        QEMU_VM_EOF, /* just to ensure we won't get EOF reported prematurely */
+    };
+    uint8_t const wire_compiled_v1[] = {
+        /* a */   0x01, 0x02, 0x03, 0x04, 0x05,
+        /* b */   0xff,
+        /* buf */ 0x07, 0x08, 0x09, 0x0a,
+        /* d */   0x0b, 0x0c, 0x0d, 0x0e,
+        /* e */   0x0f, 0x10, 0x11,
+        QEMU_VM_EOF, /* just to ensure we won't get EOF reported prematurely */
+    };
+    g_autofree char *desc_interpreted = NULL;
+    g_autofree char *desc_compiled = NULL;
+
+    /* Both paths produce the same stream and the same description */
+    vmstate_set_compile(false);
+    desc_interpreted = save_vmstate_desc(&vmstate_compiled, &obj);
+    compare_vmstate(wire_compiled, sizeof(wire_compiled));
+
+    vmstate_set_compile(true);
+    desc_compiled = save_vmstate_desc(&vmstate_compiled, &obj);
+    compare_vmstate(wire_compiled, sizeof(wire_compiled));
+    g_assert_cmpstr(desc_compiled, ==, desc_interpreted);
+
+    memset(&obj, 0, sizeof(obj));
+    SUCCESS(load_vmstate(&vmstate_compiled, &obj, &obj_clone,
+                         obj_compiled_copy, 2, wire_compiled,
+                         sizeof(wire_compiled)));
+    g_assert_cmpint(obj.a[4], ==, 5);
+    g_assert_cmpint(obj.b, ==, -1);
+    g_assert_cmpint(obj.c, ==, 6);
+    g_assert_cmpint(obj.buf[3], ==, 10);
+    g_assert_cmpint(obj.d, ==, 0x0b0c0d0e);
+    g_assert_cmpint(obj.e[0], ==, 15);
+
+    /* A v1 stream lacks c, the block falls back to the interpreter */
+    memset(&obj, 0, sizeof(obj));
+    SUCCESS(load_vmstate(&vmstate_compiled, &obj, &obj_clone,
+                         obj_compiled_copy, 1, wire_compiled_v1,
+                         sizeof(wire_compiled_v1)));
+    g_assert_cmpint(obj.b, ==, -1);
+    g_assert_cmpint(obj.c, ==, 0);
+    g_assert_cmpint(obj.buf[0], ==, 7);
+    g_assert_cmpint(obj.e[2], ==, 17);
+}
+
 int main(int argc, char **argv)
 {
     g_autofree char *temp_file = g_strdup_printf("%s/vmst.test.XXXXXX",
@@ -1522,6 +1677,8 @@ int main(int argc, char **argv)
     g_test_add_func("/vmstate/qlist/save/saveqlist", test_save_qlist);
     g_test_add_func("/vmstate/qlist/load/loadqlist", test_load_qlist);
     g_test_add_func("/vmstate/tmp_struct", test_tmp_struct);
+    g_test_add_func("/vmstate/save/read_only", test_save_read_only);
+    g_test_add_func("/vmstate/compiled", test_compiled);
     g_test_run();
 
     close(temp_fd);
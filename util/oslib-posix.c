@@ -42,9 +42,11 @@
 #include "qemu/cutils.h"
 #include "qemu/compiler.h"
 #include "qemu/units.h"
+#include "qemu/bitmap.h"
 
 #ifdef CONFIG_LINUX
 #include <sys/syscall.h>
+#include <sched.h>
 #endif
 
 #ifdef __FreeBSD__
@@ -77,18 +79,27 @@ typedef struct MemsetContext {
     bool any_thread_failed;
     struct MemsetThread *threads;
     int num_threads;
+    char *area;
+    size_t size;
+    int64_t start_us;
+    QLIST_ENTRY(MemsetContext) next;
 } MemsetContext;
 
 struct MemsetThread {
     char *addr;
     size_t numpages;
     size_t hpagesize;
+    int node;
     QemuThread pgthread;
     sigjmp_buf env;
     MemsetContext *context;
 };
 typedef struct MemsetThread MemsetThread;
 
+/* preallocations running in the background, see os_mem_prealloc_finish() */
+static QLIST_HEAD(, MemsetContext) memset_contexts =
+    QLIST_HEAD_INITIALIZER(memset_contexts);
+
 /* used by sigbus_handler() */
 static MemsetContext *sigbus_memset_context;
 struct sigaction sigbus_oldact;
@@ -317,6 +328,57 @@ static void sigbus_handler(int signal)
     warn_report("os_mem_prealloc: unrelated SIGBUS detected and ignored");
 }
 
+/*
+ * Run the calling thread on the CPUs of host NUMA node @node, if any.
+ * This is only a hint: the pages are placed according to the memory
+ * policy of the area anyway, this just avoids zeroing them remotely.
+ */
+static void memset_thread_bind_node(int node)
+{
+#ifdef CONFIG_LINUX
+    g_autofree char *path = NULL;
+    g_autofree char *cpulist = NULL;
+    const char *p;
+    cpu_set_t set, allowed;
+
+    if (node < 0) {
+        return;
+    }
+    path = g_strdup_printf("/sys/devices/system/node/node%d/cpulist", node);
+    if (!g_file_get_contents(path, &cpulist, NULL, NULL)) {
+        return;
+    }
+
+    CPU_ZERO(&set);
+    for (p = cpulist; *p && *p != '\n'; ) {
+        unsigned long first, last;
+
+        if (qemu_strtoul(p, &p, 10, &first)) {
+            return;
+        }
+        last = first;
+        if (*p == '-' && qemu_strtoul(p + 1, &p, 10, &last)) {
+            return;
+        }
+        for (; first <= last && first < CPU_SETSIZE; first++) {
+            CPU_SET(first, &set);
+        }
+        if (*p == ',') {
+            p++;
+        }
+    }
+
+    /* Stay within the CPUs QEMU is allowed to run on */
+    if (sched_getaffinity(0, sizeof(allowed), &allowed)) {
+        return;
+    }
+    CPU_AND(&set, &set, &allowed);
+    if (CPU_COUNT(&set)) {
+        sched_setaffinity(0, sizeof(set), &set);
+    }
+#endif
+}
+
 static void *do_touch_pages(void *arg)
 {
     MemsetThread *memset_args = (MemsetThread *)arg;
@@ -334,6 +396,8 @@ static void *do_touch_pages(void *arg)
     }
     qemu_mutex_unlock(&page_mutex);
 
+    memset_thread_bind_node(memset_args->node);
+
     /* unblock SIGBUS */
     sigemptyset(&set);
     sigaddset(&set, SIGBUS);
@@ -377,6 +441,8 @@ static void *do_madv_populate_write_pages(void *arg)
     }
     qemu_mutex_unlock(&page_mutex);
 
+    memset_thread_bind_node(memset_args->node);
+
     if (size && qemu_madvise(addr, size, QEMU_MADV_POPULATE_WRITE)) {
         ret = -errno;
     }
@@ -384,13 +450,13 @@ static void *do_madv_populate_write_pages(void *arg)
 }
 
 static inline int get_memset_num_threads(size_t hpagesize, size_t numpages,
-                                         int smp_cpus)
+                                         int max_threads)
 {
     long host_procs = sysconf(_SC_NPROCESSORS_ONLN);
     int ret = 1;
 
     if (host_procs > 0) {
-        ret = MIN(MIN(host_procs, MAX_MEM_PREALLOC_THREAD_COUNT), smp_cpus);
+        ret = MIN(MIN(host_procs, MAX_MEM_PREALLOC_THREAD_COUNT), max_threads);
     }
 
     /* Especially with gigantic pages, don't create more threads than pages. */
@@ -402,16 +468,41 @@ static inline int get_memset_num_threads(size_t hpagesize, size_t numpages,
     return ret;
 }
 
+static int wait_and_free_mem_prealloc_context(MemsetContext *context)
+{
+    int i, ret = 0;
+
+    for (i = 0; i < context->num_threads; i++) {
+        int tmp = (uintptr_t)qemu_thread_join(&context->threads[i].pgthread);
+
+        if (tmp) {
+            ret = tmp;
+        }
+    }
+    if (sigbus_memset_context == context) {
+        sigbus_memset_context = NULL;
+    }
+    trace_os_mem_prealloc_done(context->area, context->size,
+                               context->num_threads,
+                               (g_get_monotonic_time() - context->start_us)
+                               / 1000);
+    g_free(context->threads);
+    g_free(context);
+    return ret;
+}
+
 static int touch_all_pages(char *area, size_t hpagesize, size_t numpages,
-                           int smp_cpus, bool use_madv_populate_write)
+                           int max_threads, const unsigned long *host_nodes,
+                           int nr_nodes, bool use_madv_populate_write,
+                           bool async)
 {
     static gsize initialized = 0;
-    MemsetContext context = {
-        .num_threads = get_memset_num_threads(hpagesize, numpages, smp_cpus),
-    };
-    size_t numpages_per_thread, leftover;
+    MemsetContext *context;
+    int nodes[MAX_MEM_PREALLOC_THREAD_COUNT];
+    int num_threads, num_nodes = 0, node;
+    size_t unit_pages, numunits, units_per_thread, leftover;
     void *(*touch_fn)(void *);
-    int ret = 0, i = 0;
+    int i;
     char *addr = area;
 
     if (g_once_init_enter(&initialized)) {
@@ -420,9 +511,18 @@ static int touch_all_pages(char *area, size_t hpagesize, size_t numpages,
         g_once_init_leave(&initialized, 1);
     }
 
+    /*
+     * Split the area at huge page boundaries, so that a transparent
+     * huge page is never populated by two threads at once.
+     */
+    unit_pages = MAX(QEMU_VMALLOC_ALIGN / hpagesize, 1);
+    numunits = DIV_ROUND_UP(numpages, unit_pages);
+    num_threads = MIN(get_memset_num_threads(hpagesize, numpages,
+                                             max_threads), numunits);
+
     if (use_madv_populate_write) {
         /* Avoid creating a single thread for MADV_POPULATE_WRITE */
-        if (context.num_threads == 1) {
+        if (num_threads == 1 && !async) {
             if (qemu_madvise(area, hpagesize * numpages,
                              QEMU_MADV_POPULATE_WRITE)) {
                 return -errno;
@@ -434,43 +534,52 @@ static int touch_all_pages(char *area, size_t hpagesize, size_t numpages,
         touch_fn = do_touch_pages;
     }
 
-    context.threads = g_new0(MemsetThread, context.num_threads);
-    numpages_per_thread = numpages / context.num_threads;
-    leftover = numpages % context.num_threads;
-    for (i = 0; i < context.num_threads; i++) {
-        context.threads[i].addr = addr;
-        context.threads[i].numpages = numpages_per_thread + (i < leftover);
-        context.threads[i].hpagesize = hpagesize;
-        context.threads[i].context = &context;
-        qemu_thread_create(&context.threads[i].pgthread, "touch_pages",
-                           touch_fn, &context.threads[i],
-                           QEMU_THREAD_JOINABLE);
-        addr += context.threads[i].numpages * hpagesize;
+    /* Spread the threads over the host nodes the area is bound to. */
+    if (host_nodes) {
+        for (node = find_first_bit(host_nodes, nr_nodes);
+             node < nr_nodes && num_nodes < ARRAY_SIZE(nodes);
+             node = find_next_bit(host_nodes, nr_nodes, node + 1)) {
+            nodes[num_nodes++] = node;
+        }
+    }
+
+    context = g_new0(MemsetContext, 1);
+    context->num_threads = num_threads;
+    context->area = area;
+    context->size = hpagesize * numpages;
+    context->start_us = g_get_monotonic_time();
+    context->threads = g_new0(MemsetThread, num_threads);
+    units_per_thread = numunits / num_threads;
+    leftover = numunits % num_threads;
+    for (i = 0; i < num_threads; i++) {
+        MemsetThread *thread = &context->threads[i];
+        size_t pages = (units_per_thread + (i < leftover)) * unit_pages;
+
+        thread->addr = addr;
+        thread->numpages = MIN(pages, numpages);
+        thread->hpagesize = hpagesize;
+        thread->node = num_nodes ? nodes[i % num_nodes] : -1;
+        thread->context = context;
+        qemu_thread_create(&thread->pgthread, "touch_pages",
+                           touch_fn, thread, QEMU_THREAD_JOINABLE);
+        addr += thread->numpages * hpagesize;
+        numpages -= thread->numpages;
     }
 
     if (!use_madv_populate_write) {
-        sigbus_memset_context = &context;
+        sigbus_memset_context = context;
     }
 
     qemu_mutex_lock(&page_mutex);
-    context.all_threads_created = true;
+    context->all_threads_created = true;
     qemu_cond_broadcast(&page_cond);
     qemu_mutex_unlock(&page_mutex);
 
-    for (i = 0; i < context.num_threads; i++) {
-        int tmp = (uintptr_t)qemu_thread_join(&context.threads[i].pgthread);
-
-        if (tmp) {
-            ret = tmp;
-        }
+    if (async) {
+        QLIST_INSERT_HEAD(&memset_contexts, context, next);
+        return 0;
     }
-
-    if (!use_madv_populate_write) {
-        sigbus_memset_context = NULL;
-    }
-    g_free(context.threads);
-
-    return ret;
+    return wait_and_free_mem_prealloc_context(context);
 }
 
 static bool madv_populate_write_possible(char *area, size_t pagesize)
@@ -479,8 +588,9 @@ static bool madv_populate_write_possible(char *area, size_t pagesize)
            errno != EINVAL;
 }
 
-void os_mem_prealloc(int fd, char *area, size_t memory, int smp_cpus,
-                     Error **errp)
+void os_mem_prealloc(int fd, char *area, size_t memory, int max_threads,
+                     const unsigned long *host_nodes, int nr_nodes,
+                     bool async, Error **errp)
 {
     static gsize initialized;
     int ret;
@@ -495,6 +605,14 @@ void os_mem_prealloc(int fd, char *area, size_t memory, int smp_cpus,
      */
     use_madv_populate_write = madv_populate_write_possible(area, hpagesize);
 
+    /*
+     * Touching pages needs the process-wide SIGBUS handler installed
+     * until it is done, so only MADV_POPULATE_WRITE can run in the
+     * background.
+     */
+    async &= use_madv_populate_write;
+    trace_os_mem_prealloc(area, memory, max_threads, async);
+
     if (!use_madv_populate_write) {
         if (g_once_init_enter(&initialized)) {
             qemu_mutex_init(&sigbus_mutex);
@@ -521,8 +639,9 @@ void os_mem_prealloc(int fd, char *area, size_t memory, int smp_cpus,
     }
 
     /* touch pages simultaneously */
-    ret = touch_all_pages(area, hpagesize, numpages, smp_cpus,
-                          use_madv_populate_write);
+    ret = touch_all_pages(area, hpagesize, numpages, max_threads,
+                          host_nodes, nr_nodes, use_madv_populate_write,
+                          async);
     if (ret) {
         error_setg_errno(errp, -ret,
                          "os_mem_prealloc: preallocating memory failed");
@@ -539,6 +658,29 @@ void os_mem_prealloc(int fd, char *area, size_t memory, int smp_cpus,
     }
 }
 
+bool os_mem_prealloc_finish(Error **errp)
+{
+    MemsetContext *context, *next_context;
+    int ret = 0;
+
+    QLIST_FOREACH_SAFE(context, &memset_contexts, next, next_context) {
+        int tmp;
+
+        QLIST_REMOVE(context, next);
+        tmp = wait_and_free_mem_prealloc_context(context);
+        if (tmp) {
+            ret = tmp;
+        }
+    }
+
+    if (ret) {
+        error_setg_errno(errp, -ret,
+                         "os_mem_prealloc: preallocating memory failed");
+        return false;
+    }
+    return true;
+}
+
 char *qemu_get_pid_name(pid_t pid)
 {
     char *name = NULL;
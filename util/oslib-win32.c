@@ -268,8 +268,9 @@ int getpagesize(void)
     return system_info.dwPageSize;
 }
 
-void os_mem_prealloc(int fd, char *area, size_t memory, int smp_cpus,
-                     Error **errp)
+void os_mem_prealloc(int fd, char *area, size_t memory, int max_threads,
+                     const unsigned long *host_nodes, int nr_nodes,
+                     bool async, Error **errp)
 {
     int i;
     size_t pagesize = qemu_real_host_page_size();
@@ -280,6 +281,11 @@ void os_mem_prealloc(int fd, char *area, size_t memory, int smp_cpus,
     }
 }
 
+bool os_mem_prealloc_finish(Error **errp)
+{
+    return true;
+}
+
 char *qemu_get_pid_name(pid_t pid)
 {
     /* XXX Implement me */